@@ -0,0 +1,23 @@
+#include "async_task.h"
+
+// Executor implementation
+void Executor::post(Job job) {
+    std::lock_guard<std::mutex> lock(mutex);
+    pending.push_back(std::move(job));
+}
+
+void Executor::post(std::coroutine_handle<> handle) {
+    post([handle] { handle.resume(); });
+}
+
+size_t Executor::drain() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (pending.empty()) return 0;
+        running.swap(pending);
+    }
+    for (auto& job : running) job();
+    size_t count = running.size();
+    running.clear();
+    return count;
+}
@@ -0,0 +1,156 @@
+#ifndef ASYNC_TASK_H
+#define ASYNC_TASK_H
+
+#include "worker_pool.h"
+#include <coroutine>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Runs posted work on whichever thread calls drain(). MusicPlayerUI drains
+// it once per frame, so coroutine continuations resume on the UI thread
+// between frames and may touch UI state freely.
+class Executor {
+public:
+    using Job = std::function<void()>;
+
+    // Any thread.
+    void post(Job job);
+    void post(std::coroutine_handle<> handle);
+    // Runs what was posted before the call; work posted meanwhile waits for
+    // the next drain, so a job that re-posts itself polls once per frame.
+    size_t drain();
+
+private:
+    std::mutex mutex;
+    std::vector<Job> pending;
+    std::vector<Job> running;
+};
+
+template <typename T>
+class Task;
+
+struct TaskPromiseBase {
+    struct FinalAwaiter {
+        bool await_ready() const noexcept { return false; }
+        template <typename Promise>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept {
+            TaskPromiseBase& promise = handle.promise();
+            if (promise.continuation) return promise.continuation;
+            if (promise.detached) handle.destroy();
+            return std::noop_coroutine();
+        }
+        void await_resume() const noexcept {}
+    };
+
+    std::suspend_always initial_suspend() const noexcept { return {}; }
+    FinalAwaiter final_suspend() const noexcept { return {}; }
+    void unhandled_exception() const noexcept { std::terminate(); }
+
+    std::coroutine_handle<> continuation;
+    bool detached = false;
+};
+
+template <typename T>
+struct TaskPromise : TaskPromiseBase {
+    Task<T> get_return_object();
+    void return_value(T result) { value.emplace(std::move(result)); }
+    T take() { return std::move(*value); }
+
+    std::optional<T> value;
+};
+
+template <>
+struct TaskPromise<void> : TaskPromiseBase {
+    Task<void> get_return_object();
+    void return_void() const noexcept {}
+    void take() const noexcept {}
+};
+
+// Lazily started coroutine: it runs when awaited, or when detach()ed. The
+// awaiting coroutine resumes directly when it finishes, on the same thread.
+template <typename T = void>
+class Task {
+public:
+    using promise_type = TaskPromise<T>;
+    using Handle = std::coroutine_handle<promise_type>;
+
+    explicit Task(Handle coroutine) : handle(coroutine) {}
+    Task(Task&& other) noexcept : handle(std::exchange(other.handle, {})) {}
+    Task& operator=(Task&& other) noexcept {
+        if (this != &other) {
+            if (handle) handle.destroy();
+            handle = std::exchange(other.handle, {});
+        }
+        return *this;
+    }
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+    ~Task() {
+        if (handle) handle.destroy();
+    }
+
+    bool await_ready() const noexcept { return false; }
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+        handle.promise().continuation = awaiting;
+        return handle;
+    }
+    T await_resume() { return handle.promise().take(); }
+
+    // Starts a task nobody will await; its frame frees itself when done.
+    void detach() {
+        Handle started = std::exchange(handle, {});
+        started.promise().detached = true;
+        started.resume();
+    }
+
+private:
+    Handle handle;
+};
+
+template <typename T>
+Task<T> TaskPromise<T>::get_return_object() {
+    return Task<T>(Task<T>::Handle::from_promise(*this));
+}
+
+inline Task<void> TaskPromise<void>::get_return_object() {
+    return Task<void>(Task<void>::Handle::from_promise(*this));
+}
+
+// co_await runOnPool(pool, executor, fn): runs fn on the pool, then resumes
+// the coroutine on the executor with fn's result. A job still queued when
+// the pool is destroyed is dropped, and its coroutine never resumes.
+template <typename F>
+class PoolAwaitable {
+public:
+    using Result = std::invoke_result_t<F&>;
+
+    PoolAwaitable(WorkerPool& workerPool, Executor& resumeOn, F function)
+        : pool(workerPool), executor(resumeOn), fn(std::move(function)) {}
+
+    bool await_ready() const noexcept { return false; }
+    void await_suspend(std::coroutine_handle<> handle) {
+        pool.submit([this, handle] {
+            result.emplace(fn());
+            executor.post(handle);
+        });
+    }
+    Result await_resume() { return std::move(*result); }
+
+private:
+    WorkerPool& pool;
+    Executor& executor;
+    F fn;
+    std::optional<Result> result;
+};
+
+template <typename F>
+PoolAwaitable<F> runOnPool(WorkerPool& pool, Executor& executor, F fn) {
+    return PoolAwaitable<F>(pool, executor, std::move(fn));
+}
+
+#endif // ASYNC_TASK_H
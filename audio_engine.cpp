@@ -0,0 +1,542 @@
+#include "audio_engine.h"
+#include "logger.h"
+#include "trace.h"
+#include <algorithm>
+#include <cmath>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+constexpr double PI = 3.14159265358979323846;
+
+} // namespace
+
+// TrackDecoder implementation
+bool TrackDecoder::open(const std::string& filepath, unsigned rate, ResamplerQuality quality) {
+    TraceScope scope("openFromFile");
+    if (!file.openFromFile(filepath) || file.getChannelCount() == 0 || file.getSampleRate() == 0) return false;
+    channels = file.getChannelCount();
+    scratch.resize(MAX_BLOCK * channels);
+    outputRate = rate ? rate : file.getSampleRate();
+    position = 0;
+    if (file.getSampleRate() != outputRate) {
+        resampler = std::make_unique<Resampler>(file.getSampleRate(), outputRate, quality);
+        staged.resize(MAX_BLOCK * 2);
+    }
+    unstretched.resize(MAX_BLOCK * 2);
+    return true;
+}
+
+size_t TrackDecoder::decode(float* output, size_t frames) {
+    const float scale = 1.0f / 32768.0f;
+    size_t done = 0;
+    while (done < frames) {
+        size_t want = std::min(frames - done, MAX_BLOCK);
+        size_t got = static_cast<size_t>(file.read(scratch.data(), want * channels)) / channels;
+        if (got == 0) break;
+        float* out = output + done * 2;
+        const sf::Int16* in = scratch.data();
+        if (channels == 1) {
+            for (size_t i = 0; i < got; ++i) out[2 * i] = out[2 * i + 1] = in[i] * scale;
+        } else if (channels == 2) {
+            for (size_t i = 0; i < got * 2; ++i) out[i] = in[i] * scale;
+        } else {
+            for (size_t i = 0; i < got; ++i) {
+                out[2 * i] = in[i * channels] * scale;
+                out[2 * i + 1] = in[i * channels + 1] * scale;
+            }
+        }
+        done += got;
+    }
+    return done;
+}
+
+size_t TrackDecoder::readSource(float* output, size_t frames) {
+    if (!resampler) return decode(output, frames);
+    size_t done = 0;
+    while (done < frames) {
+        if (stagedStart == stagedEnd && !endOfFile) {
+            stagedStart = 0;
+            stagedEnd = decode(staged.data(), MAX_BLOCK);
+            endOfFile = stagedEnd == 0;
+        }
+        size_t made;
+        if (stagedStart < stagedEnd) {
+            size_t consumed = 0;
+            made = resampler->process(staged.data() + 2 * stagedStart, stagedEnd - stagedStart, consumed,
+                                      output + 2 * done, frames - done);
+            stagedStart += consumed;
+        } else {
+            made = resampler->drain(output + 2 * done, frames - done);
+            if (made == 0) break;
+        }
+        done += made;
+    }
+    return done;
+}
+
+size_t TrackDecoder::read(float* output, size_t frames) {
+    if (!stretching) {
+        size_t done = readSource(output, frames);
+        position += done;
+        return done;
+    }
+    size_t done = 0;
+    while (done < frames) {
+        if (unstretchedStart == unstretchedEnd && !sourceEnded) {
+            unstretchedStart = 0;
+            unstretchedEnd = readSource(unstretched.data(), MAX_BLOCK);
+            sourceEnded = unstretchedEnd == 0;
+        }
+        size_t made;
+        if (unstretchedStart < unstretchedEnd) {
+            size_t consumed = 0;
+            made = stretcher.process(unstretched.data() + 2 * unstretchedStart, unstretchedEnd - unstretchedStart, consumed,
+                                     output + 2 * done, frames - done);
+            unstretchedStart += consumed;
+        } else {
+            made = stretcher.drain(output + 2 * done, frames - done);
+            if (made == 0) break;
+        }
+        done += made;
+    }
+    position = std::min(getFrameCount(), stretchBase + static_cast<uint64_t>(stretcher.getSourcePosition()));
+    return done;
+}
+
+void TrackDecoder::restartStretch() {
+    stretcher.reset();
+    stretchBase = position;
+    unstretchedStart = unstretchedEnd = 0;
+    sourceEnded = false;
+}
+
+void TrackDecoder::setPlayback(float newSpeed, float newPitch) {
+    speed = newSpeed;
+    pitch = newPitch;
+    stretcher.setRatios(newSpeed, newPitch);
+    if (!stretching && (newSpeed != 1.0f || newPitch != 1.0f)) {
+        stretching = true;
+        restartStretch();
+    }
+}
+
+void TrackDecoder::seek(uint64_t frame) {
+    frame = std::min(frame, getFrameCount());
+    uint64_t sourceFrame = frame * file.getSampleRate() / outputRate;
+    file.seek(sourceFrame * channels);
+    position = frame;
+    if (resampler) {
+        resampler->reset();
+        stagedStart = stagedEnd = 0;
+        endOfFile = false;
+    }
+    stretching = speed != 1.0f || pitch != 1.0f;
+    if (stretching) restartStretch();
+}
+
+unsigned TrackDecoder::getSampleRate() const { return outputRate; }
+unsigned TrackDecoder::getSourceRate() const { return file.getSampleRate(); }
+
+uint64_t TrackDecoder::getFrameCount() const {
+    if (channels == 0) return 0;
+    return file.getSampleCount() / channels * outputRate / file.getSampleRate();
+}
+
+uint64_t TrackDecoder::getPosition() const { return position; }
+
+uint64_t TrackDecoder::getRemainingFrames() const {
+    uint64_t total = getFrameCount();
+    return total > position ? static_cast<uint64_t>((total - position) / speed) : 0;
+}
+
+sf::Time TrackDecoder::getDuration() const { return file.getDuration(); }
+
+void mixCrossfade(const float* a, const float* b, const float* gainA, const float* gainB, float* output, size_t frames) {
+    size_t f = 0;
+#if defined(__AVX2__)
+    for (; f + 4 <= frames; f += 4) {
+        __m128 ga = _mm_loadu_ps(gainA + f);
+        __m128 gb = _mm_loadu_ps(gainB + f);
+        // Each gain covers both channels of its frame: g0 g0 g1 g1 | g2 g2 g3 g3.
+        __m256 va = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_unpacklo_ps(ga, ga)), _mm_unpackhi_ps(ga, ga), 1);
+        __m256 vb = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_unpacklo_ps(gb, gb)), _mm_unpackhi_ps(gb, gb), 1);
+        __m256 mixed = _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(a + 2 * f), va),
+                                     _mm256_mul_ps(_mm256_loadu_ps(b + 2 * f), vb));
+        _mm256_storeu_ps(output + 2 * f, mixed);
+    }
+#elif defined(__SSE2__)
+    for (; f + 2 <= frames; f += 2) {
+        __m128 ga = _mm_castpd_ps(_mm_load_sd(reinterpret_cast<const double*>(gainA + f)));
+        __m128 gb = _mm_castpd_ps(_mm_load_sd(reinterpret_cast<const double*>(gainB + f)));
+        __m128 mixed = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(a + 2 * f), _mm_unpacklo_ps(ga, ga)),
+                                  _mm_mul_ps(_mm_loadu_ps(b + 2 * f), _mm_unpacklo_ps(gb, gb)));
+        _mm_storeu_ps(output + 2 * f, mixed);
+    }
+#endif
+    for (; f < frames; ++f) {
+        output[2 * f] = a[2 * f] * gainA[f] + b[2 * f] * gainB[f];
+        output[2 * f + 1] = a[2 * f + 1] * gainA[f] + b[2 * f + 1] * gainB[f];
+    }
+}
+
+void floatToInt16(const float* input, sf::Int16* output, size_t count) {
+    size_t i = 0;
+#if defined(__SSE2__)
+    const __m128 scale = _mm_set1_ps(32768.0f);
+    const __m128 lo = _mm_set1_ps(-1.0f), hi = _mm_set1_ps(1.0f);
+    for (; i + 8 <= count; i += 8) {
+        __m128 x0 = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(input + i), lo), hi);
+        __m128 x1 = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(input + i + 4), lo), hi);
+        // packs saturates +1.0 (32768) to 32767.
+        __m128i packed = _mm_packs_epi32(_mm_cvtps_epi32(_mm_mul_ps(x0, scale)), _mm_cvtps_epi32(_mm_mul_ps(x1, scale)));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(output + i), packed);
+    }
+#endif
+    for (; i < count; ++i) {
+        float v = std::nearbyint(input[i] * 32768.0f);
+        output[i] = static_cast<sf::Int16>(std::max(-32768.0f, std::min(32767.0f, v)));
+    }
+}
+
+// PlaybackEngine implementation
+template <typename T>
+bool PlaybackEngine::SpscQueue<T>::push(const T& item) {
+    size_t t = tail.load(std::memory_order_relaxed);
+    size_t following = (t + 1) % QUEUE_SIZE;
+    if (following == head.load(std::memory_order_acquire)) return false;
+    items[t] = item;
+    tail.store(following, std::memory_order_release);
+    return true;
+}
+
+template <typename T>
+bool PlaybackEngine::SpscQueue<T>::pop(T& item) {
+    size_t h = head.load(std::memory_order_relaxed);
+    if (h == tail.load(std::memory_order_acquire)) return false;
+    item = items[h];
+    head.store((h + 1) % QUEUE_SIZE, std::memory_order_release);
+    return true;
+}
+
+PlaybackEngine::PlaybackEngine()
+    : bufferA(BLOCK * CHANNELS), bufferB(BLOCK * CHANNELS), gainsA(BLOCK), gainsB(BLOCK) {}
+
+PlaybackEngine::~PlaybackEngine() {
+    // The stream is stopped by now, so nothing else touches the decks.
+    delete current.decoder;
+    delete incoming.decoder;
+    delete next.decoder;
+    Command command;
+    while (commands.pop(command)) delete command.decoder;
+    collectGarbage();
+}
+
+bool PlaybackEngine::post(const Command& command) {
+    if (commands.push(command)) return true;
+    logWarn("Playback command queue full, dropping command");
+    delete command.decoder;
+    return false;
+}
+
+bool PlaybackEngine::play(std::unique_ptr<TrackDecoder> decoder, uint64_t trackId, float gain, bool crossfade) {
+    setTrackGain(trackId, gain);
+    return post({crossfade ? Command::PlayCrossfade : Command::Play, decoder.release(), trackId, 0, gain});
+}
+
+bool PlaybackEngine::setNext(std::unique_ptr<TrackDecoder> decoder, uint64_t trackId, float gain) {
+    setTrackGain(trackId, gain);
+    return post({Command::SetNext, decoder.release(), trackId, 0, gain});
+}
+
+bool PlaybackEngine::clearNext() { return post({Command::ClearNext, nullptr, 0, 0, 0.0f}); }
+
+bool PlaybackEngine::seek(uint64_t frame) { return post({Command::Seek, nullptr, 0, frame, 0.0f}); }
+
+void PlaybackEngine::setTrackGain(uint64_t trackId, float gain) {
+    if (trackId == 0) return;
+    // Reuse the track's slot; otherwise replace the oldest, which at most
+    // three live decks never need.
+    size_t index = GAIN_SLOTS;
+    for (size_t i = 0; i < GAIN_SLOTS && index == GAIN_SLOTS; ++i) {
+        if (trackGains[i].trackId.load(std::memory_order_relaxed) == trackId) index = i;
+    }
+    if (index == GAIN_SLOTS) {
+        index = nextGainSlot;
+        nextGainSlot = (nextGainSlot + 1) % GAIN_SLOTS;
+    }
+    GainSlot& slot = trackGains[index];
+    slot.sequence.fetch_add(1, std::memory_order_acq_rel);
+    slot.trackId.store(trackId, std::memory_order_relaxed);
+    slot.gain.store(gain, std::memory_order_relaxed);
+    slot.sequence.fetch_add(1, std::memory_order_release);
+}
+
+void PlaybackEngine::setMasterGain(float gain) { masterGain.store(gain, std::memory_order_relaxed); }
+
+void PlaybackEngine::setCrossfade(float seconds, CrossfadeCurve curve) {
+    crossfadeSeconds.store(std::max(0.0f, seconds), std::memory_order_relaxed);
+    crossfadeCurve.store(curve, std::memory_order_relaxed);
+}
+
+void PlaybackEngine::setSpeed(float value) {
+    speed.store(std::clamp(value, static_cast<float>(TimeStretcher::MIN_SPEED), static_cast<float>(TimeStretcher::MAX_SPEED)),
+                std::memory_order_relaxed);
+}
+
+void PlaybackEngine::setPitch(float ratio) {
+    pitch.store(std::clamp(ratio, static_cast<float>(TimeStretcher::MIN_PITCH), static_cast<float>(TimeStretcher::MAX_PITCH)),
+                std::memory_order_relaxed);
+}
+
+void PlaybackEngine::setOutputRate(unsigned sampleRate) {
+    outputRate.store(sampleRate, std::memory_order_relaxed);
+    dsp.prepare(sampleRate);
+}
+
+DspChain& PlaybackEngine::getDsp() { return dsp; }
+const DspChain& PlaybackEngine::getDsp() const { return dsp; }
+
+void PlaybackEngine::collectGarbage() {
+    TrackDecoder* decoder;
+    while (retired.pop(decoder)) delete decoder;
+}
+
+void PlaybackEngine::rewind(uint64_t frame) {
+    streamFrame = frame;
+    // Segments from the new cursor on described audio that was never heard;
+    // the command behind the rewind publishes its own.
+    size_t count = segmentCount.load(std::memory_order_relaxed);
+    while (count > 0 && segments[(count - 1) % SEGMENT_COUNT].streamFrame.load(std::memory_order_relaxed) >= frame) --count;
+    segmentSequence.fetch_add(1, std::memory_order_acq_rel);
+    segmentCount.store(count, std::memory_order_relaxed);
+    segmentSequence.fetch_add(1, std::memory_order_release);
+}
+
+void PlaybackEngine::retire(Deck& deck) {
+    // Freeing a decoder closes a file; leave that to the control thread.
+    if (deck.decoder && !retired.push(deck.decoder)) delete deck.decoder;
+    deck = Deck{};
+}
+
+void PlaybackEngine::applyCommands() {
+    Command command;
+    while (commands.pop(command)) {
+        switch (command.type) {
+        case Command::PlayCrossfade:
+            if (current.decoder && crossfadeSeconds.load(std::memory_order_relaxed) > 0.0f) {
+                Deck deck{command.decoder, command.trackId, command.gain};
+                startFade(deck, 0);
+                break;
+            }
+            [[fallthrough]]; // nothing to fade from
+        case Command::Play:
+            retire(incoming);
+            retire(current);
+            fading = false;
+            current = Deck{command.decoder, command.trackId, command.gain};
+            publishSegment(current.trackId, 0);
+            break;
+        case Command::SetNext:
+            retire(next);
+            next = Deck{command.decoder, command.trackId, command.gain};
+            break;
+        case Command::ClearNext:
+            retire(next);
+            break;
+        case Command::Seek:
+            if (fading) finishFade();
+            if (current.decoder) {
+                current.decoder->seek(command.frame);
+                publishSegment(current.trackId, framesToUs(current.decoder->getPosition(), current.decoder->getSampleRate()));
+            }
+            break;
+        }
+    }
+}
+
+void PlaybackEngine::startFade(Deck& deck, uint64_t length) {
+    // A new fade during a fade drops the track that was already fading out.
+    if (fading) finishFade();
+    uint64_t configured = static_cast<uint64_t>(crossfadeSeconds.load(std::memory_order_relaxed) * outputRate.load(std::memory_order_relaxed));
+    incoming = deck;
+    fading = true;
+    fadePosition = 0;
+    fadeLength = std::max<uint64_t>(1, length ? std::min(length, configured) : configured);
+    publishSegment(incoming.trackId, framesToUs(incoming.decoder->getPosition(), incoming.decoder->getSampleRate()));
+}
+
+void PlaybackEngine::finishFade() {
+    retire(current);
+    current = incoming;
+    incoming = Deck{};
+    fading = false;
+}
+
+void PlaybackEngine::refreshGains() {
+    for (Deck* deck : {&current, &incoming, &next}) {
+        if (!deck->decoder) continue;
+        for (const GainSlot& slot : trackGains) {
+            // Mid-write slots are skipped rather than waited for; the deck
+            // keeps its gain until the next block.
+            uint32_t sequence = slot.sequence.load(std::memory_order_acquire);
+            if ((sequence & 1) || slot.trackId.load(std::memory_order_relaxed) != deck->trackId) continue;
+            float gain = slot.gain.load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (slot.sequence.load(std::memory_order_relaxed) == sequence) deck->gain = gain;
+            break;
+        }
+    }
+}
+
+void PlaybackEngine::updatePlayback() {
+    float newSpeed = speed.load(std::memory_order_relaxed), newPitch = pitch.load(std::memory_order_relaxed);
+    for (Deck* deck : {&current, &incoming, &next}) {
+        if (deck->decoder) deck->decoder->setPlayback(newSpeed, newPitch);
+    }
+    if (newSpeed == renderSpeed) return;
+    renderSpeed = newSpeed;
+    // Positions from here on advance at the new rate.
+    Deck& audible = fading ? incoming : current;
+    if (audible.decoder) publishSegment(audible.trackId, framesToUs(audible.decoder->getPosition(), audible.decoder->getSampleRate()));
+}
+
+void PlaybackEngine::fadeGains(size_t frames) {
+    CrossfadeCurve curve = crossfadeCurve.load(std::memory_order_relaxed);
+    float master = masterGain.load(std::memory_order_relaxed);
+    float outGain = current.gain * master, inGain = incoming.gain * master;
+    double length = static_cast<double>(fadeLength);
+    // sin/cos advance by a fixed angle per frame; re-seeding every block keeps
+    // the rotation from drifting over long fades.
+    double step = (curve == CrossfadeCurve::SCurve ? PI : PI / 2) / length;
+    double theta = step * (fadePosition + 0.5);
+    double c = std::cos(theta), s = std::sin(theta);
+    double dc = std::cos(step), ds = std::sin(step);
+    for (size_t i = 0; i < frames; ++i) {
+        float fadeIn, fadeOut;
+        switch (curve) {
+        case CrossfadeCurve::EqualPower:
+            fadeIn = static_cast<float>(s);
+            fadeOut = static_cast<float>(c);
+            break;
+        case CrossfadeCurve::SCurve:
+            fadeIn = static_cast<float>(0.5 - 0.5 * c);
+            fadeOut = 1.0f - fadeIn;
+            break;
+        default:
+            fadeIn = static_cast<float>((fadePosition + i + 0.5) / length);
+            fadeOut = 1.0f - fadeIn;
+            break;
+        }
+        gainsA[i] = fadeOut * outGain;
+        gainsB[i] = fadeIn * inGain;
+        double rotated = c * dc - s * ds;
+        s = s * dc + c * ds;
+        c = rotated;
+    }
+}
+
+size_t PlaybackEngine::render(float* output, size_t frames) {
+    applyCommands();
+    updatePlayback();
+    refreshGains();
+    uint64_t fadeFrames = static_cast<uint64_t>(crossfadeSeconds.load(std::memory_order_relaxed) * outputRate.load(std::memory_order_relaxed));
+    size_t produced = 0;
+    while (produced < frames && current.decoder) {
+        size_t n = std::min(BLOCK, frames - produced);
+        float* out = output + produced * CHANNELS;
+
+        if (!fading && next.decoder && fadeFrames > 0 && current.decoder->getFrameCount() > 0) {
+            // Start the fade on the exact frame that lets it end with the track.
+            uint64_t remaining = current.decoder->getRemainingFrames();
+            if (remaining <= fadeFrames) {
+                Deck deck = next;
+                next = Deck{};
+                startFade(deck, std::max<uint64_t>(remaining, 1));
+            } else {
+                n = static_cast<size_t>(std::min<uint64_t>(n, remaining - fadeFrames));
+            }
+        }
+
+        if (fading) {
+            n = static_cast<size_t>(std::min<uint64_t>(n, fadeLength - fadePosition));
+            size_t a = current.decoder->read(bufferA.data(), n);
+            size_t b = incoming.decoder->read(bufferB.data(), n);
+            std::fill(bufferA.begin() + a * CHANNELS, bufferA.begin() + n * CHANNELS, 0.0f);
+            std::fill(bufferB.begin() + b * CHANNELS, bufferB.begin() + n * CHANNELS, 0.0f);
+            fadeGains(n);
+            mixCrossfade(bufferA.data(), bufferB.data(), gainsA.data(), gainsB.data(), out, n);
+            fadePosition += n;
+            produced += n;
+            streamFrame += n;
+            if (fadePosition >= fadeLength) finishFade();
+            continue;
+        }
+
+        size_t got = current.decoder->read(bufferA.data(), n);
+        scaleSamples(bufferA.data(), current.gain * masterGain.load(std::memory_order_relaxed), out, got * CHANNELS);
+        produced += got;
+        streamFrame += got;
+        if (got < n) {
+            // End of track: continue gaplessly with the queued one, if any.
+            retire(current);
+            if (next.decoder) {
+                current = next;
+                next = Deck{};
+                publishSegment(current.trackId, framesToUs(current.decoder->getPosition(), current.decoder->getSampleRate()));
+            }
+        }
+    }
+    dsp.process(output, produced);
+    return produced;
+}
+
+void PlaybackEngine::publishSegment(uint64_t trackId, int64_t trackStartUs) {
+    size_t count = segmentCount.load(std::memory_order_relaxed);
+    SegmentSlot& slot = segments[count % SEGMENT_COUNT];
+    segmentSequence.fetch_add(1, std::memory_order_acq_rel);
+    slot.streamFrame.store(streamFrame, std::memory_order_relaxed);
+    slot.trackId.store(trackId, std::memory_order_relaxed);
+    slot.trackStartUs.store(trackStartUs, std::memory_order_relaxed);
+    slot.speed.store(renderSpeed, std::memory_order_relaxed);
+    segmentCount.store(count + 1, std::memory_order_relaxed);
+    segmentSequence.fetch_add(1, std::memory_order_release);
+}
+
+bool PlaybackEngine::findSegment(uint64_t frame, PlaybackSegment& segment) const {
+    for (;;) {
+        uint32_t sequence = segmentSequence.load(std::memory_order_acquire);
+        if (sequence & 1) continue;
+        size_t count = segmentCount.load(std::memory_order_relaxed);
+        size_t oldest = count > SEGMENT_COUNT ? count - SEGMENT_COUNT : 0;
+        bool found = false;
+        for (size_t i = count; i > oldest; --i) {
+            const SegmentSlot& slot = segments[(i - 1) % SEGMENT_COUNT];
+            if (slot.streamFrame.load(std::memory_order_relaxed) <= frame) {
+                segment.streamFrame = slot.streamFrame.load(std::memory_order_relaxed);
+                segment.trackId = slot.trackId.load(std::memory_order_relaxed);
+                segment.trackStartUs = slot.trackStartUs.load(std::memory_order_relaxed);
+                segment.speed = slot.speed.load(std::memory_order_relaxed);
+                found = true;
+                break;
+            }
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (segmentSequence.load(std::memory_order_relaxed) == sequence) return found;
+    }
+}
+
+int64_t PlaybackEngine::framesToUs(uint64_t frames, unsigned sampleRate) {
+    return sampleRate ? static_cast<int64_t>(frames * 1000000 / sampleRate) : 0;
+}
+
+unsigned PlaybackEngine::getOutputRate() const { return outputRate.load(std::memory_order_relaxed); }
+float PlaybackEngine::getCrossfadeSeconds() const { return crossfadeSeconds.load(std::memory_order_relaxed); }
+CrossfadeCurve PlaybackEngine::getCrossfadeCurve() const { return crossfadeCurve.load(std::memory_order_relaxed); }
+float PlaybackEngine::getSpeed() const { return speed.load(std::memory_order_relaxed); }
+float PlaybackEngine::getPitch() const { return pitch.load(std::memory_order_relaxed); }
@@ -0,0 +1,206 @@
+#ifndef AUDIO_ENGINE_H
+#define AUDIO_ENGINE_H
+
+#include "dsp_chain.h"
+#include "resampler.h"
+#include "time_stretch.h"
+#include <SFML/Audio.hpp>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Decodes one file to interleaved stereo float at a fixed output rate (mono
+// is duplicated, extra channels dropped). Frame counts and positions are in
+// output-rate frames of the track itself, whatever the playback speed.
+class TrackDecoder {
+public:
+    static constexpr size_t MAX_BLOCK = 4096; // frames decoded per file read
+
+    bool open(const std::string& filepath, unsigned outputRate, ResamplerQuality quality);
+    size_t read(float* output, size_t frames);
+    void seek(uint64_t frame);
+    // Audio thread, between reads. The stretcher stays engaged once used
+    // until the next seek; at 1x it passes audio through unchanged.
+    void setPlayback(float speed, float pitch);
+
+    unsigned getSampleRate() const; // output rate
+    unsigned getSourceRate() const;
+    uint64_t getFrameCount() const;
+    uint64_t getPosition() const;
+    // Output frames left at the current speed.
+    uint64_t getRemainingFrames() const;
+    sf::Time getDuration() const;
+
+private:
+    size_t decode(float* output, size_t frames);
+    size_t readSource(float* output, size_t frames);
+    void restartStretch();
+
+    sf::InputSoundFile file;
+    std::vector<sf::Int16> scratch;
+    unsigned channels = 0;
+    unsigned outputRate = 0;
+    uint64_t position = 0;
+    std::unique_ptr<Resampler> resampler; // null when the file is already at the output rate
+    std::vector<float> staged;            // decoded, not yet resampled
+    size_t stagedStart = 0, stagedEnd = 0;
+    bool endOfFile = false;
+    TimeStretcher stretcher;
+    bool stretching = false;
+    float speed = 1.0f, pitch = 1.0f;
+    uint64_t stretchBase = 0;       // position the stretcher was reset at
+    std::vector<float> unstretched; // resampled, not yet stretched
+    size_t unstretchedStart = 0, unstretchedEnd = 0;
+    bool sourceEnded = false;
+};
+
+enum class CrossfadeCurve : uint8_t {
+    EqualPower, // sin/cos, constant power for uncorrelated material
+    Linear,
+    SCurve      // raised cosine, constant amplitude
+};
+
+// out[i] = a[i] * gainA[frame] + b[i] * gainB[frame] over interleaved stereo frames.
+void mixCrossfade(const float* a, const float* b, const float* gainA, const float* gainB, float* output, size_t frames);
+void floatToInt16(const float* input, sf::Int16* output, size_t count);
+
+// Marks where in the output stream a track (or a seek inside it) begins.
+struct PlaybackSegment {
+    uint64_t streamFrame = 0;
+    float renderSpeed = 1.0f;
+    uint64_t trackId = 0;
+    int64_t trackStartUs = 0;
+    float speed = 1.0f; // track time per stream time from streamFrame on
+};
+
+// Two-deck stereo renderer. The control thread opens decoders and posts
+// commands; the audio thread applies them between blocks, so it never waits
+// on file I/O and never frees a decoder (retired decks are handed back).
+class PlaybackEngine {
+public:
+    static constexpr unsigned CHANNELS = 2;
+    static constexpr size_t BLOCK = 1024; // frames mixed per inner iteration
+
+    PlaybackEngine();
+    ~PlaybackEngine();
+
+    // Control thread ----------------------------------------------------------
+    // Makes `decoder` the playing track, either cutting or crossfading to it.
+    bool play(std::unique_ptr<TrackDecoder> decoder, uint64_t trackId, float gain, bool crossfade);
+    // Track to continue with when the current one ends (gapless or crossfaded).
+    bool setNext(std::unique_ptr<TrackDecoder> decoder, uint64_t trackId, float gain);
+    bool clearNext();
+    bool seek(uint64_t frame);
+    // Takes effect on whichever deck holds `trackId`, without going through the
+    // queue. Track id 0 is never played, so it's ignored here.
+    void setTrackGain(uint64_t trackId, float gain);
+    void setMasterGain(float gain);
+    void setCrossfade(float seconds, CrossfadeCurve curve);
+    // Tempo (0.5-2) and pitch (frequency ratio, 0.5-2) apply to every deck
+    // from the next rendered block.
+    void setSpeed(float speed);
+    void setPitch(float ratio);
+    // Stream stopped: also prepares the DSP chain for the new rate.
+    void setOutputRate(unsigned sampleRate);
+    void collectGarbage();
+    // Post-mix processing. Insert stages while the stream is stopped.
+    DspChain& getDsp();
+    const DspChain& getDsp() const;
+
+    // Audio thread ------------------------------------------------------------
+    size_t render(float* output, size_t frames);
+
+    // Only while the audio thread is stopped: restarts the stream cursor at
+    // `streamFrame` after queued audio was discarded.
+    void rewind(uint64_t streamFrame);
+
+    // Any thread --------------------------------------------------------------
+    bool findSegment(uint64_t streamFrame, PlaybackSegment& segment) const;
+    unsigned getOutputRate() const;
+    float getCrossfadeSeconds() const;
+    CrossfadeCurve getCrossfadeCurve() const;
+    float getSpeed() const;
+    float getPitch() const;
+
+private:
+    struct Deck {
+        TrackDecoder* decoder = nullptr;
+        uint64_t trackId = 0;
+        float gain = 1.0f;
+    };
+    struct Command {
+        enum Type : uint8_t { Play, PlayCrossfade, SetNext, ClearNext, Seek } type;
+        TrackDecoder* decoder;
+        uint64_t trackId;
+        uint64_t frame;
+        float gain;
+    };
+    static constexpr size_t QUEUE_SIZE = 64;
+    static constexpr size_t SEGMENT_COUNT = 16;
+    static constexpr size_t GAIN_SLOTS = 4;
+
+    struct SegmentSlot {
+        std::atomic<uint64_t> streamFrame{0}, trackId{0};
+        std::atomic<int64_t> trackStartUs{0};
+        std::atomic<float> speed{1.0f};
+    };
+    // Written by the control thread only; the full id is compared, so a gain
+    // never pairs with the wrong track.
+    struct GainSlot {
+        std::atomic<uint32_t> sequence{0};
+        std::atomic<uint64_t> trackId{0};
+        std::atomic<float> gain{1.0f};
+    };
+
+    template <typename T>
+    struct SpscQueue {
+        std::array<T, QUEUE_SIZE> items;
+        std::atomic<size_t> head{0}, tail{0};
+        bool push(const T& item);
+        bool pop(T& item);
+    };
+
+    bool post(const Command& command);
+    void applyCommands();
+    void retire(Deck& deck);
+    // length 0 means the configured crossfade length.
+    void startFade(Deck& deck, uint64_t length);
+    void finishFade();
+    void refreshGains();
+    void updatePlayback();
+    void fadeGains(size_t frames);
+    void publishSegment(uint64_t trackId, int64_t trackStartUs);
+    static int64_t framesToUs(uint64_t frames, unsigned sampleRate);
+
+    Deck current, incoming, next;
+    bool fading = false;
+    uint64_t fadePosition = 0;
+    uint64_t fadeLength = 0;
+    uint64_t streamFrame = 0;
+    float renderSpeed = 1.0f;
+
+    std::atomic<float> masterGain{1.0f};
+    std::atomic<float> crossfadeSeconds{0.0f};
+    std::atomic<CrossfadeCurve> crossfadeCurve{CrossfadeCurve::EqualPower};
+    std::atomic<float> speed{1.0f};
+    std::atomic<float> pitch{1.0f};
+    std::atomic<unsigned> outputRate{0};
+    std::array<GainSlot, GAIN_SLOTS> trackGains;
+    size_t nextGainSlot = 0; // control thread
+
+    SpscQueue<Command> commands;
+    SpscQueue<TrackDecoder*> retired;
+
+    // Written by the audio thread only; readers retry on a sequence change.
+    std::array<SegmentSlot, SEGMENT_COUNT> segments;
+    std::atomic<uint32_t> segmentSequence{0};
+    std::atomic<size_t> segmentCount{0};
+
+    std::vector<float> bufferA, bufferB, gainsA, gainsB;
+    DspChain dsp;
+};
+
+#endif // AUDIO_ENGINE_H
@@ -0,0 +1,230 @@
+#include "audio_sink.h"
+#include "logger.h"
+#include "metrics.h"
+#include "trace.h"
+#include <algorithm>
+#include <chrono>
+
+namespace {
+
+MetricCounter underrunsMetric("msx_audio_underruns_total", "Device callbacks that found the queue (nearly) empty");
+
+} // namespace
+
+// AudioSink implementation
+void AudioSink::open(PlaybackEngine& playbackEngine, unsigned rate) {
+    engine = &playbackEngine;
+    sampleRate = rate;
+    engine->setOutputRate(rate);
+    // 50 ms blocks: short enough that a flush is barely audible, sized up
+    // front so the sink thread never allocates.
+    size_t frames = std::max<size_t>(rate / 20, PlaybackEngine::BLOCK);
+    mixBuffer.assign(frames * PlaybackEngine::CHANNELS, 0.0f);
+    outputBuffer.assign(frames * PlaybackEngine::CHANNELS, 0);
+    tap.reset(rate, PlaybackEngine::CHANNELS, 0);
+}
+
+unsigned AudioSink::getSampleRate() const { return sampleRate; }
+const SampleTap& AudioSink::getTap() const { return tap; }
+
+AudioSink::Stats AudioSink::getStats() const {
+    Stats stats;
+    stats.renderedFrame = renderedFrame.load(std::memory_order_relaxed);
+    stats.underruns = underruns.load(std::memory_order_relaxed);
+    stats.renderNanoseconds = renderNanoseconds.load(std::memory_order_relaxed);
+    return stats;
+}
+
+size_t AudioSink::renderBlock() {
+    TraceScope scope("renderBlock");
+    auto start = std::chrono::steady_clock::now();
+    size_t frames = mixBuffer.size() / PlaybackEngine::CHANNELS;
+    size_t rendered = engine ? engine->render(mixBuffer.data(), frames) : 0;
+    floatToInt16(mixBuffer.data(), outputBuffer.data(), rendered * PlaybackEngine::CHANNELS);
+    tap.push(outputBuffer.data(), rendered * PlaybackEngine::CHANNELS);
+    renderedFrame.fetch_add(rendered, std::memory_order_relaxed);
+    renderNanoseconds.fetch_add(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count(),
+        std::memory_order_relaxed);
+    return rendered;
+}
+
+void AudioSink::rewind(uint64_t frame) {
+    if (engine) engine->rewind(frame);
+    tap.reset(sampleRate, PlaybackEngine::CHANNELS, frame);
+    renderedFrame.store(frame, std::memory_order_relaxed);
+}
+
+// DeviceSink implementation
+DeviceSink::DeviceSink() : stream(*this) {}
+
+DeviceSink::~DeviceSink() {
+    stream.stop();
+}
+
+const char* DeviceSink::getName() const { return "device"; }
+
+void DeviceSink::open(PlaybackEngine& playbackEngine, unsigned rate) {
+    AudioSink::open(playbackEngine, rate);
+    stream.setup(rate);
+}
+
+void DeviceSink::play() { stream.play(); }
+void DeviceSink::pause() { stream.pause(); }
+void DeviceSink::stop() { stream.stop(); }
+
+void DeviceSink::flush() {
+    // setPlayingOffset() stops the thread, discards queued buffers and
+    // restarts at the same stream time; onSeek() tells the engine.
+    if (stream.getStatus() != Status::Stopped) stream.setPlayingOffset(stream.getPlayingOffset());
+}
+
+AudioSink::Status DeviceSink::getStatus() const { return stream.getStatus(); }
+
+uint64_t DeviceSink::getAudibleFrame() const {
+    if (stream.getStatus() == Status::Stopped) return 0;
+    return static_cast<uint64_t>(stream.getPlayingOffset().asMicroseconds()) * sampleRate / 1000000;
+}
+
+DeviceSink::Stream::Stream(DeviceSink& owner) : sink(owner) {}
+
+void DeviceSink::Stream::setup(unsigned rate) { initialize(PlaybackEngine::CHANNELS, rate); }
+
+bool DeviceSink::Stream::onGetData(Chunk& data) {
+    // getPlayingOffset() only reads state this thread writes, so it's safe here.
+    if (primedBuffers < QUEUED_BUFFERS) {
+        ++primedBuffers;
+    } else {
+        uint64_t queuedUpTo = sink.getAudibleFrame() + sink.sampleRate * UNDERRUN_MS / 1000;
+        if (queuedUpTo >= sink.renderedFrame.load(std::memory_order_relaxed)) {
+            sink.underruns.fetch_add(1, std::memory_order_relaxed);
+            underrunsMetric.add();
+        }
+    }
+    size_t rendered = sink.renderBlock();
+    data.samples = sink.outputBuffer.data();
+    data.sampleCount = rendered * PlaybackEngine::CHANNELS;
+    return rendered * PlaybackEngine::CHANNELS == sink.mixBuffer.size();
+}
+
+void DeviceSink::Stream::onSeek(sf::Time timeOffset) {
+    primedBuffers = 0;
+    sink.rewind(static_cast<uint64_t>(timeOffset.asMicroseconds()) * sink.sampleRate / 1000000);
+}
+
+// OfflineSink implementation
+OfflineSink::~OfflineSink() {
+    shutdown();
+}
+
+void OfflineSink::shutdown() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        status.store(Status::Stopped);
+    }
+    resumed.notify_all();
+    if (thread.joinable()) thread.join();
+}
+
+void OfflineSink::play() {
+    Status current = status.load();
+    if (current == Status::Playing) return;
+    if (current == Status::Paused) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            status.store(Status::Playing);
+        }
+        resumed.notify_all();
+        return;
+    }
+    // A run that ended by itself still has to be joined.
+    if (thread.joinable()) thread.join();
+    if (!engine) {
+        logWarn("Sink played before open", {{"sink", getName()}});
+        return;
+    }
+    rewind(0);
+    framesWritten.store(0);
+    if (!begin()) return;
+    status.store(Status::Playing);
+    thread = std::thread(&OfflineSink::run, this);
+}
+
+void OfflineSink::pause() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (status.load() == Status::Playing) status.store(Status::Paused);
+}
+
+void OfflineSink::stop() {
+    shutdown();
+    rewind(0);
+}
+
+void OfflineSink::flush() {
+    // Nothing is queued past the engine; the next block already follows
+    // whatever was posted.
+}
+
+AudioSink::Status OfflineSink::getStatus() const { return status.load(); }
+
+uint64_t OfflineSink::getAudibleFrame() const {
+    return status.load() == Status::Stopped ? 0 : framesWritten.load();
+}
+
+uint64_t OfflineSink::getFramesWritten() const { return framesWritten.load(); }
+
+bool OfflineSink::begin() { return true; }
+void OfflineSink::end() {}
+
+void OfflineSink::run() {
+    size_t blockFrames = mixBuffer.size() / PlaybackEngine::CHANNELS;
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            resumed.wait(lock, [this] { return status.load() != Status::Paused; });
+            if (status.load() == Status::Stopped) break;
+        }
+        size_t rendered = renderBlock();
+        write(outputBuffer.data(), rendered * PlaybackEngine::CHANNELS);
+        framesWritten.fetch_add(rendered);
+        if (rendered < blockFrames) {
+            status.store(Status::Stopped);
+            break;
+        }
+    }
+    end();
+}
+
+// NullSink implementation
+NullSink::~NullSink() {
+    shutdown();
+}
+
+const char* NullSink::getName() const { return "null"; }
+
+void NullSink::write(const sf::Int16*, size_t) {}
+
+// WavFileSink implementation
+WavFileSink::WavFileSink(const std::string& path) : filepath(path) {}
+
+WavFileSink::~WavFileSink() {
+    shutdown();
+}
+
+const char* WavFileSink::getName() const { return "wav"; }
+
+bool WavFileSink::begin() {
+    if (!file.openFromFile(filepath, sampleRate, PlaybackEngine::CHANNELS)) {
+        logError("Failed to open for writing", {{"path", filepath}});
+        return false;
+    }
+    return true;
+}
+
+void WavFileSink::write(const sf::Int16* samples, size_t sampleCount) {
+    if (sampleCount > 0) file.write(samples, sampleCount);
+}
+
+void WavFileSink::end() {
+    file.close();
+}
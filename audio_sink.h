@@ -0,0 +1,167 @@
+#ifndef AUDIO_SINK_H
+#define AUDIO_SINK_H
+
+#include "audio_engine.h"
+#include "sample_tap.h"
+#include <SFML/Audio.hpp>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Where rendered audio goes. A sink pulls blocks from a PlaybackEngine on its
+// own thread, converts them to 16-bit and feeds the sample tap; stream
+// frames count from 0 at each start. Control methods are for one thread.
+class AudioSink {
+public:
+    using Status = sf::SoundSource::Status;
+
+    // Buffer health counters, for the perf HUD. Any thread.
+    struct Stats {
+        uint64_t renderedFrame = 0;     // stream frame after the last rendered block
+        uint64_t underruns = 0;         // device ran dry before the next block was ready
+        uint64_t renderNanoseconds = 0; // time spent decoding and mixing, since creation
+    };
+
+    virtual ~AudioSink() = default;
+    virtual const char* getName() const = 0;
+
+    // Sink stopped. Also sets the engine's output rate.
+    virtual void open(PlaybackEngine& engine, unsigned sampleRate);
+    virtual void play() = 0;
+    virtual void pause() = 0;
+    virtual void stop() = 0;
+    // Drops queued audio so posted commands are heard immediately.
+    virtual void flush() = 0;
+    virtual Status getStatus() const = 0;
+    // Stream frame being heard (or consumed) now; 0 when stopped.
+    virtual uint64_t getAudibleFrame() const = 0;
+
+    unsigned getSampleRate() const;
+    const SampleTap& getTap() const;
+    Stats getStats() const;
+
+protected:
+    // Sink thread: renders one block into the 16-bit buffer; returns frames.
+    size_t renderBlock();
+    // Sink thread stopped: the next block starts at `frame`.
+    void rewind(uint64_t frame);
+
+    PlaybackEngine* engine = nullptr;
+    unsigned sampleRate = 0;
+    SampleTap tap;
+    std::vector<float> mixBuffer;
+    std::vector<sf::Int16> outputBuffer;
+    std::atomic<uint64_t> renderedFrame{0};
+    std::atomic<uint64_t> underruns{0};
+    std::atomic<uint64_t> renderNanoseconds{0};
+};
+
+// The system audio device, through an sf::SoundStream.
+class DeviceSink : public AudioSink {
+public:
+    DeviceSink();
+    ~DeviceSink();
+
+    const char* getName() const override;
+    void open(PlaybackEngine& engine, unsigned sampleRate) override;
+    void play() override;
+    void pause() override;
+    void stop() override;
+    void flush() override;
+    Status getStatus() const override;
+    uint64_t getAudibleFrame() const override;
+
+private:
+    class Stream : public sf::SoundStream {
+    public:
+        // SFML keeps this many buffers queued; the first ones after a start
+        // only fill the queue, so they can't be late.
+        static constexpr unsigned QUEUED_BUFFERS = 3;
+        // Less than this left queued when asked for more counts as an underrun.
+        static constexpr unsigned UNDERRUN_MS = 5;
+
+        explicit Stream(DeviceSink& sink);
+        void setup(unsigned sampleRate);
+
+    protected:
+        bool onGetData(Chunk& data) override;
+        void onSeek(sf::Time timeOffset) override;
+
+    private:
+        DeviceSink& sink;
+        unsigned primedBuffers = 0; // stream thread only
+    };
+
+    Stream stream;
+};
+
+// Renders as fast as the pipeline allows on its own thread, with no device
+// clock, and hands each block to write(). Stops by itself when the engine
+// runs dry, like the device stream does.
+class OfflineSink : public AudioSink {
+public:
+    ~OfflineSink();
+
+    void play() override;
+    void pause() override;
+    void stop() override;
+    void flush() override;
+    Status getStatus() const override;
+    uint64_t getAudibleFrame() const override;
+
+    // Frames consumed since the last start, also after a natural stop.
+    uint64_t getFramesWritten() const;
+
+protected:
+    // begin() runs just before the sink thread starts and can refuse the
+    // start; write() and end() run on the sink thread.
+    virtual bool begin();
+    virtual void write(const sf::Int16* samples, size_t sampleCount) = 0;
+    virtual void end();
+
+    // Derived destructors call this so write() never runs on a half-destroyed sink.
+    void shutdown();
+
+private:
+    void run();
+
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable resumed;
+    std::atomic<Status> status{Status::Stopped};
+    std::atomic<uint64_t> framesWritten{0};
+};
+
+// Discards everything; measures decode -> DSP throughput.
+class NullSink : public OfflineSink {
+public:
+    ~NullSink();
+    const char* getName() const override;
+
+protected:
+    void write(const sf::Int16* samples, size_t sampleCount) override;
+};
+
+// Writes 16-bit PCM, so runs with the same input and settings can be
+// compared byte for byte. Each start truncates the file.
+class WavFileSink : public OfflineSink {
+public:
+    explicit WavFileSink(const std::string& filepath);
+    ~WavFileSink();
+    const char* getName() const override;
+
+protected:
+    bool begin() override;
+    void write(const sf::Int16* samples, size_t sampleCount) override;
+    void end() override;
+
+private:
+    std::string filepath;
+    sf::OutputSoundFile file;
+};
+
+#endif // AUDIO_SINK_H
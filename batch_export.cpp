@@ -0,0 +1,160 @@
+#include "batch_export.h"
+#include "audio_engine.h"
+#include "logger.h"
+#include "loudness.h"
+#include <SFML/Audio.hpp>
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+#include <numeric>
+#include <thread>
+
+namespace fs = std::filesystem;
+
+BatchExporter::BatchExporter(ExportSettings exportSettings) : settings(std::move(exportSettings)) {}
+
+void BatchExporter::cancel() { cancelled.store(true); }
+size_t BatchExporter::getCompletedCount() const { return completed.load(); }
+
+std::string BatchExporter::destinationFor(size_t index, size_t count, const std::string& source) const {
+    // "07 - Title.flac": the number keeps the set order in any file browser.
+    size_t width = std::to_string(count).size();
+    std::string number = std::to_string(index + 1);
+    number.insert(0, width - number.size(), '0');
+    std::string name = number + " - " + fs::path(source).stem().string();
+    name += settings.format == ExportFormat::Flac ? ".flac" : ".wav";
+    return (fs::path(settings.outputDirectory) / name).string();
+}
+
+size_t BatchExporter::run(const std::vector<std::string>& tracks, std::vector<ExportResult>& results) {
+    results.assign(tracks.size(), ExportResult{});
+    completed.store(0);
+    cancelled.store(false);
+    if (tracks.empty()) return 0;
+
+    std::error_code error;
+    fs::create_directories(settings.outputDirectory, error);
+    if (error) {
+        logError("Cannot create export directory", {{"path", settings.outputDirectory}, {"error", error.message()}});
+        return 0;
+    }
+    for (size_t i = 0; i < tracks.size(); ++i) {
+        results[i].source = tracks[i];
+        results[i].destination = destinationFor(i, tracks.size(), tracks[i]);
+    }
+
+    // Largest first, dealt round-robin, so the long tracks start early and
+    // stealing only has short ones left to balance at the end.
+    std::vector<uintmax_t> sizes(tracks.size(), 0);
+    for (size_t i = 0; i < tracks.size(); ++i) {
+        sizes[i] = fs::file_size(tracks[i], error);
+        if (error) sizes[i] = 0;
+    }
+    std::vector<size_t> order(tracks.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return sizes[a] > sizes[b]; });
+
+    size_t threadCount = settings.threadCount;
+    if (threadCount == 0) threadCount = std::max(1u, std::thread::hardware_concurrency());
+    threadCount = std::min(threadCount, tracks.size());
+    queues = std::vector<WorkQueue>(threadCount);
+    for (size_t i = 0; i < order.size(); ++i) queues[i % threadCount].jobs.push_back(order[i]);
+
+    std::vector<std::thread> workers;
+    workers.reserve(threadCount);
+    for (size_t w = 0; w < threadCount; ++w) {
+        workers.emplace_back([this, w, &tracks, &results] {
+            Buffers buffers;
+            buffers.samples.resize(BLOCK * PlaybackEngine::CHANNELS);
+            buffers.pcm.resize(BLOCK * PlaybackEngine::CHANNELS);
+            size_t job;
+            while (!cancelled.load() && takeJob(w, job)) {
+                results[job].ok = exportTrack(tracks[job], results[job], buffers);
+                completed.fetch_add(1);
+            }
+        });
+    }
+    for (auto& worker : workers) worker.join();
+    queues.clear();
+
+    size_t written = 0;
+    for (const auto& result : results) written += result.ok ? 1 : 0;
+    return written;
+}
+
+bool BatchExporter::takeJob(size_t worker, size_t& job) {
+    {
+        WorkQueue& own = queues[worker];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.jobs.empty()) {
+            job = own.jobs.front();
+            own.jobs.pop_front();
+            return true;
+        }
+    }
+    // Jobs are only ever removed, so one empty pass means we're done.
+    for (size_t k = 1; k < queues.size(); ++k) {
+        WorkQueue& victim = queues[(worker + k) % queues.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.jobs.empty()) {
+            job = victim.jobs.back();
+            victim.jobs.pop_back();
+            return true;
+        }
+    }
+    return false;
+}
+
+bool BatchExporter::exportTrack(const std::string& source, ExportResult& result, Buffers& buffers) {
+    if (settings.normalize) {
+        LoudnessInfo info;
+        bool known = loadLoudness(source, info);
+        if (!known && analyzeLoudness(source, info)) {
+            saveLoudness(source, info);
+            known = true;
+        }
+        if (known) result.gainDb = std::min(settings.targetLufs - info.integratedLufs, settings.ceilingDbtp - info.truePeakDb);
+    }
+
+    TrackDecoder decoder;
+    if (!decoder.open(source, settings.sampleRate, settings.quality)) {
+        logError("Export: failed to open", {{"path", source}});
+        return false;
+    }
+    decoder.setPlayback(settings.speed, settings.pitch);
+
+    DspChain dsp;
+    PreampStage* preamp = dsp.insert(0, std::make_unique<PreampStage>());
+    preamp->setGainDb(settings.preampDb + result.gainDb);
+    if (!settings.eqBands.empty()) dsp.insert(dsp.getStageCount(), std::make_unique<EqualizerStage>(settings.eqBands));
+    if (settings.limiter) {
+        // Normalization already keeps true peaks at the ceiling; limit only
+        // what preamp and EQ push past it, so normalized peaks pass untouched.
+        LimiterStage* limiter = dsp.insert(dsp.getStageCount(), std::make_unique<LimiterStage>());
+        limiter->setThresholdDb(settings.ceilingDbtp);
+        limiter->setCeilingDb(settings.ceilingDbtp);
+    }
+    dsp.prepare(settings.sampleRate);
+
+    sf::OutputSoundFile file;
+    if (!file.openFromFile(result.destination, settings.sampleRate, PlaybackEngine::CHANNELS)) {
+        logError("Export: failed to create", {{"path", result.destination}});
+        return false;
+    }
+    size_t got;
+    while (!cancelled.load() && (got = decoder.read(buffers.samples.data(), BLOCK)) > 0) {
+        dsp.process(buffers.samples.data(), got);
+        floatToInt16(buffers.samples.data(), buffers.pcm.data(), got * PlaybackEngine::CHANNELS);
+        file.write(buffers.pcm.data(), got * PlaybackEngine::CHANNELS);
+        result.frames += got;
+    }
+    file.close();
+
+    if (cancelled.load()) {
+        std::error_code error;
+        fs::remove(result.destination, error);
+        return false;
+    }
+    logInfo("Exported", {{"path", result.destination}, {"gainDb", result.gainDb}, {"frames", result.frames}});
+    return true;
+}
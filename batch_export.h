@@ -0,0 +1,81 @@
+#ifndef BATCH_EXPORT_H
+#define BATCH_EXPORT_H
+
+#include "dsp_chain.h"
+#include "resampler.h"
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+
+enum class ExportFormat : uint8_t { Wav, Flac };
+
+// What each track goes through: the same decode -> resample -> stretch ->
+// preamp/EQ/limiter path as playback, with loudness normalization applied
+// as preamp gain.
+struct ExportSettings {
+    std::string outputDirectory;
+    ExportFormat format = ExportFormat::Wav;
+    unsigned sampleRate = 48000;
+    ResamplerQuality quality = ResamplerQuality::Best;
+    bool normalize = true;
+    float targetLufs = -18.0f;
+    float ceilingDbtp = -1.0f;
+    float preampDb = 0.0f;
+    std::vector<EqBand> eqBands; // empty: no EQ stage
+    bool limiter = true;
+    float speed = 1.0f;
+    float pitch = 1.0f;          // frequency ratio
+    size_t threadCount = 0;      // 0: one per core
+};
+
+struct ExportResult {
+    std::string source;
+    std::string destination;
+    bool ok = false;
+    float gainDb = 0.0f;         // normalization gain that was applied
+    uint64_t frames = 0;
+};
+
+// Renders a list of tracks to numbered files in parallel. Tracks are dealt
+// largest first across per-thread deques; a thread that runs dry steals
+// from the back of the others, so one long track doesn't leave the rest of
+// the machine idle at the end. Every track is streamed in fixed blocks, so
+// peak memory is a few buffers per thread whatever the track lengths.
+class BatchExporter {
+public:
+    static constexpr size_t BLOCK = 4096; // frames per read/process/write
+
+    explicit BatchExporter(ExportSettings settings);
+
+    // Blocks until every track is written or cancel() is called; returns the
+    // number written. results[i] describes tracks[i].
+    size_t run(const std::vector<std::string>& tracks, std::vector<ExportResult>& results);
+
+    // Any thread.
+    void cancel();
+    size_t getCompletedCount() const;
+
+private:
+    struct WorkQueue {
+        std::mutex mutex;
+        std::deque<size_t> jobs;
+    };
+    struct Buffers {
+        std::vector<float> samples;
+        std::vector<int16_t> pcm;
+    };
+
+    bool takeJob(size_t worker, size_t& job);
+    bool exportTrack(const std::string& source, ExportResult& result, Buffers& buffers);
+    std::string destinationFor(size_t index, size_t count, const std::string& source) const;
+
+    ExportSettings settings;
+    std::vector<WorkQueue> queues;
+    std::atomic<bool> cancelled{false};
+    std::atomic<size_t> completed{0};
+};
+
+#endif // BATCH_EXPORT_H
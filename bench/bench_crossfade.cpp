@@ -0,0 +1,59 @@
+// Cost of mixing one second of 48 kHz stereo audio through the crossfade
+// path (mix kernel + float to 16-bit conversion), against a plain scalar loop.
+// g++ -std=c++17 -O2 -march=native -I. bench/bench_crossfade.cpp audio_engine.cpp dsp_chain.cpp logger.cpp resampler.cpp time_stretch.cpp trace.cpp -o bench_crossfade -lsfml-audio -lsfml-system -pthread
+#include "audio_engine.h"
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+namespace {
+
+constexpr size_t RATE = 48000;
+constexpr size_t BLOCK = PlaybackEngine::BLOCK;
+constexpr int SECONDS = 600;
+
+void mixScalar(const float* a, const float* b, const float* gainA, const float* gainB, float* output, size_t frames) {
+    for (size_t f = 0; f < frames; ++f) {
+        output[2 * f] = a[2 * f] * gainA[f] + b[2 * f] * gainB[f];
+        output[2 * f + 1] = a[2 * f + 1] * gainA[f] + b[2 * f + 1] * gainB[f];
+    }
+}
+
+template <typename Mix>
+double nsPerSecond(Mix mix, const std::vector<float>& a, const std::vector<float>& b, const std::vector<float>& gainA,
+                   const std::vector<float>& gainB, std::vector<float>& mixed, std::vector<sf::Int16>& out) {
+    auto start = std::chrono::steady_clock::now();
+    for (int s = 0; s < SECONDS; ++s) {
+        for (size_t f = 0; f < RATE; f += BLOCK) {
+            size_t n = std::min(BLOCK, RATE - f);
+            mix(a.data(), b.data(), gainA.data(), gainB.data(), mixed.data(), n);
+            floatToInt16(mixed.data(), out.data(), n * 2);
+        }
+    }
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / SECONDS;
+}
+
+} // namespace
+
+int main() {
+    std::vector<float> a(BLOCK * 2), b(BLOCK * 2), gainA(BLOCK), gainB(BLOCK), mixed(BLOCK * 2);
+    std::vector<sf::Int16> out(BLOCK * 2);
+    for (size_t i = 0; i < BLOCK * 2; ++i) {
+        a[i] = 0.5f * std::sin(i * 0.01f);
+        b[i] = 0.5f * std::sin(i * 0.017f);
+    }
+    for (size_t f = 0; f < BLOCK; ++f) {
+        float x = (f + 0.5f) / BLOCK;
+        gainA[f] = std::cos(x * 1.5707963f);
+        gainB[f] = std::sin(x * 1.5707963f);
+    }
+
+    double scalar = nsPerSecond(mixScalar, a, b, gainA, gainB, mixed, out);
+    double simd = nsPerSecond(mixCrossfade, a, b, gainA, gainB, mixed, out);
+    std::cout << "Crossfade mix, scalar: " << scalar / 1000.0 << " us per second of audio\n";
+    std::cout << "Crossfade mix, SIMD:   " << simd / 1000.0 << " us per second of audio ("
+              << 1e9 / simd << "x real time)\n";
+    return 0;
+}
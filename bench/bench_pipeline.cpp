@@ -0,0 +1,62 @@
+// Decode -> resample -> DSP -> sink throughput for a playlist, with no audio
+// device. With --wav the output is written instead of discarded; two runs
+// over the same files and settings produce byte-identical files.
+// Loudness normalization is off because its gains arrive asynchronously.
+// g++ -std=c++17 -O2 -march=native -I. bench/bench_pipeline.cpp msx_player_gui.cpp audio_engine.cpp audio_sink.cpp batch_export.cpp binary_playlist.cpp dsp_chain.cpp file_cache.cpp logger.cpp loudness.cpp mapped_file.cpp metrics.cpp playlist_file.cpp resampler.cpp sample_tap.cpp seek_index.cpp time_stretch.cpp trace.cpp track_metadata.cpp track_table.cpp worker_pool.cpp -o bench_pipeline -lsfml-graphics -lsfml-window -lsfml-audio -lsfml-system -pthread
+// ./bench_pipeline [--wav out.wav] [--speed 1.5] file...
+#include "msx_player.h"
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <thread>
+
+int main(int argc, char** argv) {
+    std::string wavPath;
+    float speed = 1.0f;
+    std::vector<std::string> files;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--wav") == 0 && i + 1 < argc) {
+            wavPath = argv[++i];
+        } else if (std::strcmp(argv[i], "--speed") == 0 && i + 1 < argc) {
+            speed = std::stof(argv[++i]);
+        } else {
+            files.push_back(argv[i]);
+        }
+    }
+    if (files.empty()) {
+        std::cout << "usage: bench_pipeline [--wav out.wav] [--speed x] file...\n";
+        return 1;
+    }
+
+    std::unique_ptr<OfflineSink> sink;
+    if (wavPath.empty()) {
+        sink = std::make_unique<NullSink>();
+    } else {
+        sink = std::make_unique<WavFileSink>(wavPath);
+    }
+    OfflineSink* output = sink.get();
+    MusicPlayer player(std::move(sink));
+    player.setNormalization(false);
+    player.setSpeed(speed);
+    for (const auto& file : files) player.addToPlaylist(file);
+
+    auto start = std::chrono::steady_clock::now();
+    if (!player.play()) return 1;
+    // Poll like the UI does so gapless transitions are queued in time.
+    while (player.getIsPlaying()) {
+        player.update();
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    double seconds = static_cast<double>(output->getFramesWritten()) / MusicPlayer::OUTPUT_RATE;
+    std::cout << output->getName() << " sink: " << seconds << " s of audio in " << elapsed.count() << " s, "
+              << seconds / elapsed.count() << "x real time\n";
+    std::vector<DspStageCost> costs;
+    player.getDspCosts(costs);
+    for (const auto& cost : costs) {
+        if (cost.frames == 0) continue;
+        std::cout << "  " << cost.name << ": " << 1e3 * cost.nanoseconds / cost.frames << " ns/kframe\n";
+    }
+    return 0;
+}
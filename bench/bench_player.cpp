@@ -0,0 +1,392 @@
+// MusicPlayer and MusicPlayerUI hot paths, written as JSON so runs from two
+// commits can be compared (--baseline prints the change per benchmark).
+// Inputs are generated in a temporary directory: empty .mp3 files for folder
+// scans, and test tones in each format SFML can write (wav, flac, ogg) for
+// decoding and track switching. SFML can't encode mp3; pass mp3 files with
+// --decode to include them. The UI draws into an offscreen texture, with
+// synthetic playlists of up to 1M tracks.
+// g++ -std=c++20 -O2 -march=native -I. bench/bench_player.cpp msx_player_gui.cpp async_task.cpp audio_engine.cpp audio_sink.cpp batch_export.cpp binary_playlist.cpp dsp_chain.cpp file_cache.cpp histogram.cpp input_recording.cpp logger.cpp loudness.cpp mapped_file.cpp metrics.cpp perf_hud.cpp player_controller.cpp playlist_file.cpp resampler.cpp sample_tap.cpp seek_index.cpp session_store.cpp spectrum.cpp time_stretch.cpp trace.cpp track_metadata.cpp track_table.cpp waveform.cpp worker_pool.cpp tinyfiledialogs.c -o bench_player -lsfml-graphics -lsfml-window -lsfml-audio -lsfml-system -pthread
+// ./bench_player [--json out.json] [--baseline old.json] [--filter name] [--decode file]...
+#include "front_end.cpp"
+#include "playlist_file.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <unistd.h>
+
+// Friend of MusicPlayerUI (see front_end.cpp).
+struct UiBench {
+    static void setPlaylist(MusicPlayerUI& ui, std::shared_ptr<const PlaylistSnapshot> playlist) {
+        ui.state.trackCount = playlist->paths.size();
+        ui.state.currentTrack = 0;
+        // Halfway down, like a user scrolled into a long list.
+        ui.scrollOffset = playlist->paths.size() / 2 * MusicPlayerUI::TRACK_HEIGHT;
+        ui.playlist = std::move(playlist);
+    }
+    static size_t renderPlaylist(MusicPlayerUI& ui) {
+        ui.rowsRendered = 0;
+        ui.renderPlaylist();
+        return ui.rowsRendered;
+    }
+    static void hover(MusicPlayerUI& ui, sf::Vector2f position) { ui.handleMouseHover(position); }
+    // A row in the middle of the visible area.
+    static sf::Vector2f visibleRow() {
+        return sf::Vector2f(400.0f, MusicPlayerUI::PLAYLIST_TOP + 5 * MusicPlayerUI::TRACK_HEIGHT + 1.0f);
+    }
+};
+
+namespace {
+
+namespace fs = std::filesystem;
+using Clock = std::chrono::steady_clock;
+
+constexpr auto TIME_BUDGET = std::chrono::milliseconds(300); // per benchmark, after the minimum runs
+constexpr size_t MIN_RUNS = 3;
+constexpr unsigned TONE_RATE = 44100; // not the output rate, so the resampler is exercised
+constexpr unsigned TONE_SECONDS = 10;
+
+struct Result {
+    std::string name;
+    size_t size = 0;          // tracks, files or frames per run
+    std::vector<double> runs; // nanoseconds, sorted
+    double extra = 0.0;       // benchmark-specific, named by extraName
+    const char* extraName = nullptr;
+
+    double median() const { return runs[runs.size() / 2]; }
+    double percentile(double fraction) const {
+        return runs[std::min(runs.size() - 1, static_cast<size_t>(fraction * runs.size()))];
+    }
+};
+
+std::vector<Result> results;
+std::string filter;
+
+bool selected(const std::string& name) { return filter.empty() || name.find(filter) != std::string::npos; }
+
+// Runs setup (untimed) and body until MIN_RUNS are done and TIME_BUDGET has
+// passed, so the million-track cases still finish in a few seconds.
+Result& measure(const std::string& name, size_t size, const std::function<void()>& setup,
+                const std::function<void()>& body) {
+    Result result;
+    result.name = name;
+    result.size = size;
+    Clock::time_point deadline = Clock::now() + TIME_BUDGET;
+    while (result.runs.size() < MIN_RUNS || Clock::now() < deadline) {
+        if (setup) setup();
+        Clock::time_point start = Clock::now();
+        body();
+        result.runs.push_back(std::chrono::duration<double, std::nano>(Clock::now() - start).count());
+    }
+    std::sort(result.runs.begin(), result.runs.end());
+    std::printf("%-28s %8zu  median %12.0f ns  p90 %12.0f ns  (%zu runs)\n", name.c_str(), size, result.median(),
+                result.percentile(0.9), result.runs.size());
+    std::fflush(stdout);
+    results.push_back(std::move(result));
+    return results.back();
+}
+
+std::string trackPath(const fs::path& directory, size_t index) {
+    char name[32];
+    std::snprintf(name, sizeof(name), "track_%07zu.mp3", index);
+    return (directory / name).string();
+}
+
+// A few partials plus a little noise, so flac and ogg have something to encode.
+bool writeTone(const std::string& path, unsigned seconds) {
+    sf::OutputSoundFile file;
+    if (!file.openFromFile(path, TONE_RATE, 2)) return false;
+    std::vector<sf::Int16> block(TONE_RATE * 2);
+    uint32_t noise = 12345;
+    for (unsigned second = 0; second < seconds; ++second) {
+        for (unsigned i = 0; i < TONE_RATE; ++i) {
+            double t = static_cast<double>(second * TONE_RATE + i) / TONE_RATE;
+            noise = noise * 1664525u + 1013904223u;
+            double value = 0.4 * std::sin(2 * M_PI * 440 * t) + 0.2 * std::sin(2 * M_PI * 660 * t) +
+                           0.1 * std::sin(2 * M_PI * 1320 * t) + 0.02 * (static_cast<int32_t>(noise) / 2147483648.0);
+            block[2 * i] = static_cast<sf::Int16>(value * 32767);
+            block[2 * i + 1] = static_cast<sf::Int16>(value * 0.8 * 32767);
+        }
+        file.write(block.data(), block.size());
+    }
+    file.close();
+    return true;
+}
+
+std::shared_ptr<const PlaylistSnapshot> syntheticPlaylist(size_t tracks) {
+    auto playlist = std::make_shared<PlaylistSnapshot>();
+    playlist->version = 1;
+    std::vector<std::string> paths;
+    paths.reserve(tracks);
+    for (size_t i = 0; i < tracks; ++i) paths.push_back(trackPath("/music/synthetic", i));
+    // Every tenth track has tags, the rest fall back to the file name.
+    std::vector<TrackInfo> info(tracks);
+    for (size_t i = 0; i < tracks; i += 10) {
+        info[i].setText("Synthetic Title " + std::to_string(i), "Bench Artist", "Bench Album");
+        info[i].loaded = true;
+        info[i].durationMs = 180000 + i % 60000;
+    }
+    playlist->paths = SharedRows<std::string>(std::move(paths));
+    playlist->info = SharedRows<TrackInfo>(std::move(info));
+    return playlist;
+}
+
+void benchPlaylist() {
+    for (size_t tracks : {1000, 4000, 16000}) {
+        if (!selected("addToPlaylist")) break;
+        std::unique_ptr<MusicPlayer> player;
+        measure("addToPlaylist", tracks,
+                [&] {
+                    player.reset();
+                    player = std::make_unique<MusicPlayer>(std::make_unique<NullSink>());
+                },
+                [&] {
+                    for (size_t i = 0; i < tracks; ++i) player->addToPlaylist(trackPath("/music/missing", i));
+                });
+        player.reset();
+    }
+}
+
+void benchFolders(const fs::path& root) {
+    for (size_t files : {100, 1000, 10000}) {
+        if (!selected("loadFromFolder") && !selected("scanFolder")) break;
+        fs::path folder = root / ("folder_" + std::to_string(files));
+        fs::create_directories(folder);
+        for (size_t i = 0; i < files; ++i) std::ofstream(trackPath(folder, i));
+        // Non-audio neighbours the scan has to skip.
+        for (size_t i = 0; i < files / 10; ++i) std::ofstream(folder / ("cover_" + std::to_string(i) + ".jpg"));
+        fs::create_directories(folder / "subfolder");
+
+        if (selected("scanFolder")) {
+            std::vector<std::string> tracks;
+            measure("scanFolder", files, [&] { tracks.clear(); }, [&] { scanFolder(folder.string(), tracks); });
+        }
+        if (selected("loadFromFolder")) {
+            std::unique_ptr<MusicPlayer> player;
+            measure("loadFromFolder", files,
+                    [&] {
+                        player.reset();
+                        player = std::make_unique<MusicPlayer>(std::make_unique<NullSink>());
+                    },
+                    [&] { player->loadFromFolder(folder.string()); });
+        }
+    }
+}
+
+void benchUi() {
+    if (!selected("renderPlaylist") && !selected("handleMouseHover")) return;
+    sf::RenderTexture texture;
+    if (!texture.create(800, 600)) {
+        std::printf("skipping UI benchmarks: no offscreen render target\n");
+        return;
+    }
+    MusicPlayerUI ui(texture, std::make_unique<NullSink>());
+    for (size_t tracks : {1000, 10000, 100000, 1000000}) {
+        UiBench::setPlaylist(ui, syntheticPlaylist(tracks));
+        if (selected("renderPlaylist")) {
+            size_t rows = 0;
+            Result& result = measure("renderPlaylist", tracks, nullptr, [&] { rows = UiBench::renderPlaylist(ui); });
+            result.extra = static_cast<double>(rows);
+            result.extraName = "rows_drawn";
+        }
+        if (selected("handleMouseHover")) {
+            sf::Vector2f position = UiBench::visibleRow();
+            measure("handleMouseHover", tracks, nullptr, [&] { UiBench::hover(ui, position); });
+        }
+    }
+}
+
+void benchDecode(const std::vector<std::string>& files) {
+    for (const std::string& file : files) {
+        std::string format = fs::path(file).extension().string().substr(1);
+        for (unsigned rate : {0u, MusicPlayer::OUTPUT_RATE}) {
+            std::string name = std::string(rate ? "decodeResampled_" : "decode_") + format;
+            if (!selected(name)) continue;
+            auto decoder = std::make_unique<TrackDecoder>();
+            if (!decoder->open(file, rate, ResamplerQuality::Best)) {
+                std::printf("skipping %s: can't open %s\n", name.c_str(), file.c_str());
+                continue;
+            }
+            std::vector<float> block(TrackDecoder::MAX_BLOCK * 2);
+            uint64_t frames = 0;
+            Result& result = measure(name, static_cast<size_t>(decoder->getFrameCount()),
+                                     [&] {
+                                         decoder = std::make_unique<TrackDecoder>();
+                                         decoder->open(file, rate, ResamplerQuality::Best);
+                                     },
+                                     [&] {
+                                         frames = 0;
+                                         while (size_t got = decoder->read(block.data(), TrackDecoder::MAX_BLOCK)) {
+                                             frames += got;
+                                         }
+                                     });
+            double seconds = static_cast<double>(frames) / decoder->getSampleRate();
+            result.extra = seconds / (result.median() * 1e-9);
+            result.extraName = "realtime_factor";
+        }
+    }
+}
+
+// Time from a track change to the new track being the one that renders:
+// until the segment at the sink's audible frame belongs to it.
+void benchSwitching(const std::vector<std::string>& tones) {
+    if (tones.empty()) return;
+    const auto timeout = std::chrono::seconds(5);
+    if (selected("setTrack")) {
+        MusicPlayer player(std::make_unique<NullSink>());
+        for (const std::string& tone : tones) player.addToPlaylist(tone);
+        player.play();
+        size_t track = 0;
+        measure("setTrack", tones.size(), nullptr, [&] {
+            player.setTrack(++track % tones.size());
+            TrackHandle target = player.getCurrentHandle();
+            auto deadline = std::chrono::steady_clock::now() + timeout;
+            while (player.getAudibleHandle() != target && std::chrono::steady_clock::now() < deadline) {
+                player.update();
+                std::this_thread::yield();
+            }
+        });
+    }
+    if (selected("controllerSetTrack")) {
+        // Also includes the wait for the control thread to publish state,
+        // up to PlayerController::UPDATE_INTERVAL after the change is heard.
+        PlayerController controller(std::make_unique<NullSink>());
+        for (const std::string& tone : tones) controller.addToPlaylist(tone);
+        controller.wait(controller.play(), timeout);
+        size_t track = 0;
+        measure("controllerSetTrack", tones.size(), nullptr, [&] {
+            controller.wait(controller.setTrack(++track % tones.size()), timeout);
+            auto deadline = std::chrono::steady_clock::now() + timeout;
+            for (;;) {
+                PlayerState state = controller.getState();
+                if (state.audibleHandle == state.currentHandle || std::chrono::steady_clock::now() >= deadline) break;
+                std::this_thread::yield();
+            }
+        });
+    }
+}
+
+void appendJsonString(std::string& out, const std::string& text) {
+    out += '"';
+    for (char c : text) {
+        if (c == '"' || c == '\\') out += '\\';
+        out += c;
+    }
+    out += '"';
+}
+
+// One benchmark per line, so a baseline can be read back without a JSON parser.
+bool writeJson(const std::string& path) {
+    std::string out = "{\"benchmarks\":[\n";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const Result& result = results[i];
+        char numbers[256];
+        std::snprintf(numbers, sizeof(numbers),
+                      ",\"size\":%zu,\"runs\":%zu,\"median_ns\":%.0f,\"p90_ns\":%.0f,\"min_ns\":%.0f,\"max_ns\":%.0f",
+                      result.size, result.runs.size(), result.median(), result.percentile(0.9), result.runs.front(),
+                      result.runs.back());
+        out += "{\"name\":";
+        appendJsonString(out, result.name);
+        out += numbers;
+        if (result.extraName) {
+            std::snprintf(numbers, sizeof(numbers), ",\"%s\":%.6g", result.extraName, result.extra);
+            out += numbers;
+        }
+        out += i + 1 < results.size() ? "},\n" : "}\n";
+    }
+    out += "]}\n";
+    std::ofstream file(path);
+    file << out;
+    return static_cast<bool>(file);
+}
+
+// name@size -> median_ns, from a file written by writeJson().
+std::map<std::string, double> readBaseline(const std::string& path) {
+    std::map<std::string, double> medians;
+    std::ifstream file(path);
+    std::string line;
+    while (std::getline(file, line)) {
+        size_t name = line.find("{\"name\":\"");
+        size_t size = line.find("\"size\":");
+        size_t median = line.find("\"median_ns\":");
+        if (name == std::string::npos || size == std::string::npos || median == std::string::npos) continue;
+        name += 9;
+        std::string key = line.substr(name, line.find('"', name) - name) + "@" +
+                          std::to_string(std::strtoull(line.c_str() + size + 7, nullptr, 10));
+        medians[key] = std::strtod(line.c_str() + median + 12, nullptr);
+    }
+    return medians;
+}
+
+void compareWithBaseline(const std::string& path) {
+    std::map<std::string, double> baseline = readBaseline(path);
+    if (baseline.empty()) {
+        std::printf("no benchmarks in %s\n", path.c_str());
+        return;
+    }
+    std::printf("\nchange in median against %s:\n", path.c_str());
+    for (const Result& result : results) {
+        auto it = baseline.find(result.name + "@" + std::to_string(result.size));
+        if (it == baseline.end() || it->second <= 0) continue;
+        double change = (result.median() / it->second - 1.0) * 100.0;
+        std::printf("%-28s %8zu  %+7.1f%%%s\n", result.name.c_str(), result.size, change,
+                    change > 10.0 ? "  slower" : "");
+    }
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    std::string jsonPath = "bench_player.json";
+    std::string baselinePath;
+    std::vector<std::string> decodeFiles;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+            jsonPath = argv[++i];
+        } else if (std::strcmp(argv[i], "--baseline") == 0 && i + 1 < argc) {
+            baselinePath = argv[++i];
+        } else if (std::strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+            filter = argv[++i];
+        } else if (std::strcmp(argv[i], "--decode") == 0 && i + 1 < argc) {
+            decodeFiles.push_back(argv[++i]);
+        } else {
+            std::printf("usage: bench_player [--json out.json] [--baseline old.json] [--filter name] [--decode file]...\n");
+            return 1;
+        }
+    }
+
+    fs::path root = fs::temp_directory_path() / ("msx_bench_" + std::to_string(::getpid()));
+    fs::create_directories(root);
+    std::vector<std::string> tones;
+    for (const char* format : {"wav", "flac", "ogg"}) {
+        std::string path = (root / (std::string("tone.") + format)).string();
+        if (writeTone(path, TONE_SECONDS)) {
+            tones.push_back(path);
+        } else {
+            std::printf("can't write %s test tones; skipping them\n", format);
+        }
+    }
+    decodeFiles.insert(decodeFiles.begin(), tones.begin(), tones.end());
+
+    benchPlaylist();
+    benchFolders(root);
+    benchUi();
+    benchDecode(decodeFiles);
+    benchSwitching(tones);
+
+    Logger::flush();
+    std::error_code error;
+    fs::remove_all(root, error);
+
+    if (!writeJson(jsonPath)) {
+        std::printf("failed to write %s\n", jsonPath.c_str());
+        return 1;
+    }
+    std::printf("wrote %s\n", jsonPath.c_str());
+    if (!baselinePath.empty()) compareWithBaseline(baselinePath);
+    return 0;
+}
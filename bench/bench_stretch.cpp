@@ -0,0 +1,83 @@
+// Time-stretch / pitch-shift cost and accuracy over the speed and pitch range.
+// Output is pulled in 1024-frame blocks like the engine does; "worst block"
+// is the slowest one as a share of its real-time budget. The tone column is
+// the measured frequency of a 440 Hz input, which should follow pitch only.
+// g++ -std=c++17 -O2 -march=native -I. bench/bench_stretch.cpp time_stretch.cpp -o bench_stretch
+#include "time_stretch.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+namespace {
+
+constexpr double PI = 3.14159265358979323846;
+constexpr unsigned RATE = 48000;
+constexpr size_t BLOCK = 1024;
+
+// Average period from interpolated rising zero crossings.
+double measureFrequency(const std::vector<float>& signal) {
+    double first = -1.0, last = -1.0;
+    int crossings = 0;
+    for (size_t i = signal.size() / 8; i < signal.size() / 2; ++i) {
+        float a = signal[2 * (i - 1)], b = signal[2 * i];
+        if (a < 0.0f && b >= 0.0f) {
+            double at = (i - 1) + a / (a - b);
+            if (first < 0.0) first = at;
+            last = at;
+            crossings++;
+        }
+    }
+    return crossings > 1 ? (crossings - 1) * RATE / (last - first) : 0.0;
+}
+
+} // namespace
+
+int main() {
+    const double seconds = 10.0;
+    std::vector<float> input(2 * static_cast<size_t>(RATE * seconds));
+    for (size_t i = 0; i < input.size() / 2; ++i) {
+        // A tone in one channel, a chord with some noise in the other.
+        input[2 * i] = static_cast<float>(0.5 * std::sin(2.0 * PI * 440.0 * i / RATE));
+        input[2 * i + 1] = static_cast<float>(0.2 * std::sin(2.0 * PI * 261.6 * i / RATE) + 0.2 * std::sin(2.0 * PI * 392.0 * i / RATE) +
+                                              0.05 * ((i * 2654435761u % 1000) / 500.0 - 1.0));
+    }
+
+    const double settings[][2] = {{1.0, 0.0}, {0.5, 0.0}, {0.75, 0.0}, {1.25, 0.0}, {1.5, 0.0}, {2.0, 0.0},
+                                  {1.0, -12.0}, {1.0, -3.0}, {1.0, 3.0}, {1.0, 12.0}, {0.5, 12.0}, {2.0, -12.0}};
+    const double budget = static_cast<double>(BLOCK) / RATE;
+    for (const auto& setting : settings) {
+        TimeStretcher stretcher;
+        double pitch = std::pow(2.0, setting[1] / 12.0);
+        stretcher.setRatios(setting[0], pitch);
+        std::vector<float> output(2 * static_cast<size_t>(input.size() / 2 / setting[0] + 4 * BLOCK));
+        size_t offset = 0, produced = 0;
+        double worst = 0.0;
+        auto start = std::chrono::steady_clock::now();
+        while (produced + BLOCK <= output.size() / 2) {
+            auto blockStart = std::chrono::steady_clock::now();
+            size_t made = 0;
+            while (made < BLOCK) {
+                size_t consumed = 0;
+                size_t got = stretcher.process(input.data() + 2 * offset, std::min<size_t>(4096, input.size() / 2 - offset), consumed,
+                                               output.data() + 2 * (produced + made), BLOCK - made);
+                offset += consumed;
+                if (got == 0 && consumed == 0) got = stretcher.drain(output.data() + 2 * (produced + made), BLOCK - made);
+                if (got == 0 && consumed == 0) break;
+                made += got;
+            }
+            std::chrono::duration<double> blockTime = std::chrono::steady_clock::now() - blockStart;
+            worst = std::max(worst, blockTime.count());
+            produced += made;
+            if (made < BLOCK) break;
+        }
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        output.resize(2 * produced);
+        std::cout << "speed " << setting[0] << "x, pitch " << setting[1] << " st: " << (produced / double(RATE)) / elapsed.count()
+                  << "x real time, worst block " << 100.0 * worst / budget << "% of budget, length " << produced / double(RATE)
+                  << "s (expected " << seconds / setting[0] << "s), tone " << measureFrequency(output) << " Hz (expected "
+                  << 440.0 * pitch << " Hz)\n";
+    }
+    return 0;
+}
@@ -0,0 +1,53 @@
+// Cost of one TraceScope, on one thread and with several threads recording
+// at once, plus the time to dump the full buffers as Chrome trace JSON.
+// Build without -DENABLE_TRACING to check that scopes compile away.
+// g++ -std=c++17 -O2 -march=native -DENABLE_TRACING -I. bench/bench_trace.cpp logger.cpp trace.cpp -o bench_trace -pthread
+#include "trace.h"
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+namespace {
+
+constexpr size_t SCOPES = 4000000;
+
+// Keeps the loop from being folded away when scopes compile to nothing.
+volatile unsigned sink = 0;
+
+double nsPerScope() {
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < SCOPES; ++i) {
+        TraceScope scope("bench");
+        sink = sink + 1;
+    }
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / SCOPES;
+}
+
+} // namespace
+
+int main() {
+    nsPerScope(); // first event allocates the thread's buffer
+    std::cout << "1 thread: " << nsPerScope() << " ns/scope\n";
+
+    unsigned threadCount = std::max(2u, std::thread::hardware_concurrency());
+    std::vector<double> results(threadCount);
+    std::vector<std::thread> threads;
+    for (unsigned t = 0; t < threadCount; ++t) {
+        threads.emplace_back([t, &results] { results[t] = nsPerScope(); });
+    }
+    for (auto& thread : threads) thread.join();
+    double worst = 0.0;
+    for (double result : results) worst = std::max(worst, result);
+    std::cout << threadCount << " threads: " << worst << " ns/scope (slowest thread)\n";
+
+    auto start = std::chrono::steady_clock::now();
+    bool written = Tracer::writeChromeTrace("bench_trace.json");
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    if (written) {
+        std::cout << "dump: " << elapsed.count() << " ms\n";
+        std::remove("bench_trace.json");
+    }
+    return 0;
+}
@@ -0,0 +1,205 @@
+#include "binary_playlist.h"
+#include "logger.h"
+#include "trace.h"
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <string_view>
+#include <unordered_map>
+
+namespace {
+
+constexpr char PLAYLIST_MAGIC[4] = {'M', 'S', 'X', 'P'};
+constexpr uint32_t HAS_METADATA = 1;
+// Record flags.
+constexpr uint8_t INFO_LOADED = 1;
+constexpr uint8_t INFO_LOUDNESS = 2;
+
+struct DirectoryEntry {
+    uint32_t offset;
+    uint32_t length;
+};
+
+// Whether `count` items of `unit` bytes starting at `offset` lie inside `size`.
+bool fits(uint64_t offset, uint64_t count, uint64_t unit, uint64_t size) {
+    return offset <= size && count <= (size - offset) / unit;
+}
+
+} // namespace
+
+// BinaryPlaylist implementation
+bool BinaryPlaylist::open(const std::string& path) {
+    close();
+    if (!file.open(path, MappedFile::Access::Random)) return false;
+    uint64_t size = file.size();
+    if (size >= sizeof(Header)) std::memcpy(&header, file.data(), sizeof(Header));
+    if (size < sizeof(Header) || std::memcmp(header.magic, PLAYLIST_MAGIC, 4) != 0 || header.version != VERSION) {
+        logError("Not a playlist file", {{"path", path}});
+        close();
+        return false;
+    }
+    // Records are checked as they're read, so the cost of opening doesn't grow with the playlist.
+    if (!fits(header.directoriesOffset, header.directoryCount, sizeof(DirectoryEntry), size) ||
+        !fits(header.recordsOffset, header.trackCount, sizeof(Record), size) ||
+        !fits(header.arenaOffset, header.arenaSize, 1, size)) {
+        logError("Playlist file is damaged", {{"path", path}});
+        close();
+        return false;
+    }
+    logInfo("Opened playlist", {{"path", path}, {"tracks", header.trackCount}});
+    return true;
+}
+
+void BinaryPlaylist::close() {
+    file.close();
+    header = Header{};
+}
+
+size_t BinaryPlaylist::size() const { return static_cast<size_t>(header.trackCount); }
+bool BinaryPlaylist::hasMetadata() const { return (header.flags & HAS_METADATA) != 0; }
+
+BinaryPlaylist::Record BinaryPlaylist::getRecord(size_t trackIndex) const {
+    Record record{};
+    if (trackIndex < header.trackCount) {
+        std::memcpy(&record, file.data() + header.recordsOffset + trackIndex * sizeof(Record), sizeof(Record));
+    }
+    return record;
+}
+
+bool BinaryPlaylist::getArena(uint32_t offset, uint32_t length, std::string_view& text) const {
+    if (!fits(offset, length, 1, header.arenaSize)) return false;
+    text = std::string_view(file.data() + header.arenaOffset + offset, length);
+    return true;
+}
+
+std::string BinaryPlaylist::getPath(size_t trackIndex) const {
+    if (trackIndex >= header.trackCount) return {};
+    Record record = getRecord(trackIndex);
+    if (record.directory >= header.directoryCount) return {};
+    DirectoryEntry directory;
+    std::memcpy(&directory, file.data() + header.directoriesOffset + record.directory * sizeof(DirectoryEntry),
+                sizeof(DirectoryEntry));
+    std::string_view folder, name;
+    if (!getArena(directory.offset, directory.length, folder) || !getArena(record.name, record.nameLength, name)) return {};
+    std::string path;
+    path.reserve(folder.size() + name.size());
+    path.append(folder).append(name);
+    return path;
+}
+
+bool BinaryPlaylist::getInfo(size_t trackIndex, TrackInfo& info) const {
+    if (!hasMetadata() || trackIndex >= header.trackCount) return false;
+    Record record = getRecord(trackIndex);
+    if (!(record.flags & (INFO_LOADED | INFO_LOUDNESS))) return false;
+    info = TrackInfo{};
+    std::string_view text;
+    if ((record.flags & INFO_LOADED) && getArena(record.text, record.textLength, text) &&
+        record.artistPos <= text.size() && record.albumPos <= text.size()) {
+        info.text.assign(text);
+        info.artistPos = record.artistPos;
+        info.albumPos = record.albumPos;
+        info.trackNumber = record.trackNumber;
+        info.channels = record.channels;
+        info.durationMs = record.durationMs;
+        info.sampleRate = record.sampleRate;
+        info.loaded = true;
+    }
+    if (record.flags & INFO_LOUDNESS) {
+        info.hasLoudness = true;
+        info.loudnessLufs = record.loudnessLufs;
+        info.truePeakDb = record.truePeakDb;
+    }
+    return true;
+}
+
+bool writeBinaryPlaylist(const std::string& path, const std::vector<std::string>& tracks, const std::vector<TrackInfo>& info) {
+    TraceScope scope("writeBinaryPlaylist");
+    constexpr size_t ARENA_LIMIT = std::numeric_limits<uint32_t>::max();
+    constexpr size_t FIELD_LIMIT = std::numeric_limits<uint16_t>::max();
+    std::string arena;
+    auto addString = [&](std::string_view text, uint32_t& offset) {
+        if (arena.size() + text.size() > ARENA_LIMIT) return false;
+        offset = static_cast<uint32_t>(arena.size());
+        arena.append(text);
+        return true;
+    };
+
+    std::vector<DirectoryEntry> directories;
+    std::unordered_map<std::string_view, uint32_t> directoryIndex;
+    std::vector<BinaryPlaylist::Record> records(tracks.size());
+    bool anyMetadata = false;
+    bool ok = true;
+    for (size_t i = 0; i < tracks.size() && ok; ++i) {
+        std::string_view track = tracks[i];
+        size_t slash = track.rfind('/');
+        std::string_view folder = slash == std::string_view::npos ? std::string_view() : track.substr(0, slash + 1);
+        std::string_view name = track.substr(folder.size());
+        BinaryPlaylist::Record& record = records[i];
+
+        auto found = directoryIndex.find(folder);
+        if (found == directoryIndex.end()) {
+            DirectoryEntry entry{0, static_cast<uint32_t>(folder.size())};
+            ok = folder.size() <= ARENA_LIMIT && addString(folder, entry.offset);
+            found = directoryIndex.emplace(folder, static_cast<uint32_t>(directories.size())).first;
+            directories.push_back(entry);
+        }
+        record.directory = found->second;
+        ok = ok && name.size() <= FIELD_LIMIT && addString(name, record.name);
+        record.nameLength = static_cast<uint16_t>(name.size());
+
+        if (i >= info.size()) continue;
+        const TrackInfo& known = info[i];
+        if (known.loaded && known.text.size() <= FIELD_LIMIT) {
+            ok = ok && addString(known.text, record.text);
+            record.textLength = static_cast<uint16_t>(known.text.size());
+            record.artistPos = known.artistPos;
+            record.albumPos = known.albumPos;
+            record.trackNumber = known.trackNumber;
+            record.channels = known.channels;
+            record.durationMs = known.durationMs;
+            record.sampleRate = known.sampleRate;
+            record.flags |= INFO_LOADED;
+        }
+        if (known.hasLoudness) {
+            record.loudnessLufs = known.loudnessLufs;
+            record.truePeakDb = known.truePeakDb;
+            record.flags |= INFO_LOUDNESS;
+        }
+        anyMetadata = anyMetadata || record.flags != 0;
+    }
+    if (!ok) {
+        logError("Playlist too large for the binary format", {{"path", path}, {"tracks", tracks.size()}});
+        return false;
+    }
+
+    BinaryPlaylist::Header header{};
+    std::memcpy(header.magic, PLAYLIST_MAGIC, 4);
+    header.version = BinaryPlaylist::VERSION;
+    header.trackCount = records.size();
+    header.directoryCount = directories.size();
+    header.directoriesOffset = sizeof(header);
+    header.recordsOffset = header.directoriesOffset + directories.size() * sizeof(DirectoryEntry);
+    header.arenaOffset = header.recordsOffset + records.size() * sizeof(BinaryPlaylist::Record);
+    header.arenaSize = arena.size();
+    header.flags = anyMetadata ? HAS_METADATA : 0;
+
+    std::string temporary = path + ".tmp";
+    FILE* out = std::fopen(temporary.c_str(), "wb");
+    if (!out) {
+        logError("Failed to write playlist", {{"path", temporary}});
+        return false;
+    }
+    ok = std::fwrite(&header, sizeof(header), 1, out) == 1 &&
+         std::fwrite(directories.data(), sizeof(DirectoryEntry), directories.size(), out) == directories.size() &&
+         std::fwrite(records.data(), sizeof(BinaryPlaylist::Record), records.size(), out) == records.size() &&
+         std::fwrite(arena.data(), 1, arena.size(), out) == arena.size();
+    ok = std::fclose(out) == 0 && ok;
+    if (ok && std::rename(temporary.c_str(), path.c_str()) != 0) ok = false;
+    if (!ok) {
+        std::remove(temporary.c_str());
+        logError("Failed to write playlist", {{"path", path}});
+        return false;
+    }
+    logInfo("Wrote playlist", {{"path", path}, {"tracks", tracks.size()}, {"directories", directories.size()}});
+    return true;
+}
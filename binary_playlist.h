@@ -0,0 +1,78 @@
+#ifndef BINARY_PLAYLIST_H
+#define BINARY_PLAYLIST_H
+
+#include "mapped_file.h"
+#include "track_metadata.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// The player's own playlist format (.msxpl), for playlists of hundreds of
+// thousands of tracks. Opening one maps the file and checks the header, so it
+// takes the same time at any size; tracks are read straight from the mapping.
+//
+// File (native byte order, like the other caches): a 64-byte header, a table
+// of directories, one fixed-size record per track, then a string arena.
+// Directories are stored once and shared by every track inside them; a record
+// holds its directory's index, its file name and, when the playlist was saved
+// with metadata, the track's TrackInfo including loudness.
+class BinaryPlaylist {
+public:
+    static constexpr uint32_t VERSION = 1;
+
+    bool open(const std::string& path);
+    void close();
+
+    size_t size() const;
+    bool hasMetadata() const;
+    // Empty if the record points outside the file.
+    std::string getPath(size_t trackIndex) const;
+    // False if the playlist has no metadata for the track.
+    bool getInfo(size_t trackIndex, TrackInfo& info) const;
+
+private:
+    struct Header {
+        char magic[4];
+        uint32_t version;
+        uint64_t trackCount;
+        uint64_t directoryCount;
+        uint64_t directoriesOffset;
+        uint64_t recordsOffset;
+        uint64_t arenaOffset;
+        uint64_t arenaSize;
+        uint32_t flags;
+        uint32_t reserved;
+    };
+    struct Record {
+        uint32_t directory;
+        uint32_t name;      // arena offsets
+        uint32_t text;      // TrackInfo::text
+        uint32_t durationMs;
+        uint32_t sampleRate;
+        float loudnessLufs;
+        float truePeakDb;
+        uint16_t nameLength;
+        uint16_t textLength;
+        uint16_t artistPos;
+        uint16_t albumPos;
+        uint16_t trackNumber;
+        uint8_t channels;
+        uint8_t flags;
+    };
+    static_assert(sizeof(Header) == 64 && sizeof(Record) == 40, "on-disk layout");
+
+    Record getRecord(size_t trackIndex) const;
+    bool getArena(uint32_t offset, uint32_t length, std::string_view& text) const;
+
+    friend bool writeBinaryPlaylist(const std::string& path, const std::vector<std::string>& tracks,
+                                    const std::vector<TrackInfo>& info);
+
+    MappedFile file;
+    Header header{};
+};
+
+// Writes `tracks` with absolute paths and, where known, their metadata; the
+// file is replaced atomically. Fails if the strings exceed the 4 GiB arena.
+bool writeBinaryPlaylist(const std::string& path, const std::vector<std::string>& tracks, const std::vector<TrackInfo>& info);
+
+#endif // BINARY_PLAYLIST_H
@@ -0,0 +1,106 @@
+#ifndef CONTROL_PROTOCOL_H
+#define CONTROL_PROTOCOL_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Wire format of the daemon's Unix socket, shared with clients. Every message
+// is a 16-byte little-endian header, followed by `length` payload bytes:
+//
+//   u8 opcode | u8 status | u16 length | u32 sequence | i64 argument
+//
+// A reply echoes the request's opcode and sequence, so clients may pipeline.
+// Requests are answered in order.
+
+enum class ControlOp : uint8_t {
+    Ping,
+    Play,
+    Pause,     // toggles, like the UI button
+    Stop,
+    Next,
+    Previous,
+    Seek,      // argument: milliseconds
+    SetTrack,  // argument: playlist index
+    SetVolume, // argument: percent
+    Enqueue,   // payload: file path
+    Query,     // reply payload: ControlState
+    Count
+};
+
+enum class ControlStatus : uint8_t { Ok, Failed, BadRequest };
+
+struct ControlHeader {
+    ControlOp opcode = ControlOp::Ping;
+    ControlStatus status = ControlStatus::Ok;
+    uint16_t length = 0;
+    uint32_t sequence = 0;
+    int64_t argument = 0;
+};
+
+enum class ControlPlayback : uint8_t { Stopped, Playing, Paused };
+
+struct ControlState {
+    ControlPlayback playback = ControlPlayback::Stopped;
+    bool normalize = false;
+    uint16_t volume = 0;    // percent
+    uint32_t track = 0;
+    uint32_t trackCount = 0;
+    int64_t positionMs = 0;
+    int64_t durationMs = 0;
+};
+
+constexpr size_t CONTROL_HEADER_SIZE = 16;
+constexpr size_t CONTROL_STATE_SIZE = 28;
+constexpr size_t CONTROL_MAX_PAYLOAD = 4096;
+
+inline void putLe(uint8_t* out, uint64_t value, size_t bytes) {
+    for (size_t i = 0; i < bytes; ++i) out[i] = static_cast<uint8_t>(value >> (8 * i));
+}
+
+inline uint64_t getLe(const uint8_t* in, size_t bytes) {
+    uint64_t value = 0;
+    for (size_t i = 0; i < bytes; ++i) value |= static_cast<uint64_t>(in[i]) << (8 * i);
+    return value;
+}
+
+inline void encodeHeader(const ControlHeader& header, uint8_t* out) {
+    out[0] = static_cast<uint8_t>(header.opcode);
+    out[1] = static_cast<uint8_t>(header.status);
+    putLe(out + 2, header.length, 2);
+    putLe(out + 4, header.sequence, 4);
+    putLe(out + 8, static_cast<uint64_t>(header.argument), 8);
+}
+
+// False for an unknown opcode or an oversized payload; the stream can't be
+// resynchronized after either, so the connection should be dropped.
+inline bool decodeHeader(const uint8_t* in, ControlHeader& header) {
+    if (in[0] >= static_cast<uint8_t>(ControlOp::Count)) return false;
+    header.opcode = static_cast<ControlOp>(in[0]);
+    header.status = static_cast<ControlStatus>(in[1]);
+    header.length = static_cast<uint16_t>(getLe(in + 2, 2));
+    header.sequence = static_cast<uint32_t>(getLe(in + 4, 4));
+    header.argument = static_cast<int64_t>(getLe(in + 8, 8));
+    return header.length <= CONTROL_MAX_PAYLOAD;
+}
+
+inline void encodeState(const ControlState& state, uint8_t* out) {
+    out[0] = static_cast<uint8_t>(state.playback);
+    out[1] = state.normalize ? 1 : 0;
+    putLe(out + 2, state.volume, 2);
+    putLe(out + 4, state.track, 4);
+    putLe(out + 8, state.trackCount, 4);
+    putLe(out + 12, static_cast<uint64_t>(state.positionMs), 8);
+    putLe(out + 20, static_cast<uint64_t>(state.durationMs), 8);
+}
+
+inline void decodeState(const uint8_t* in, ControlState& state) {
+    state.playback = static_cast<ControlPlayback>(in[0]);
+    state.normalize = in[1] != 0;
+    state.volume = static_cast<uint16_t>(getLe(in + 2, 2));
+    state.track = static_cast<uint32_t>(getLe(in + 4, 4));
+    state.trackCount = static_cast<uint32_t>(getLe(in + 8, 4));
+    state.positionMs = static_cast<int64_t>(getLe(in + 12, 8));
+    state.durationMs = static_cast<int64_t>(getLe(in + 20, 8));
+}
+
+#endif // CONTROL_PROTOCOL_H
@@ -0,0 +1,287 @@
+#include "control_server.h"
+#include "logger.h"
+#include "player_controller.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <limits>
+#include <thread>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+
+bool setNonBlocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+} // namespace
+
+ControlServer::ControlServer(PlayerController& musicPlayer, std::string path)
+    : player(musicPlayer), socketPath(std::move(path)) {}
+
+ControlServer::~ControlServer() {
+    for (auto& client : clients) ::close(client.fd);
+    if (listener >= 0) {
+        ::close(listener);
+        ::unlink(socketPath.c_str());
+    }
+}
+
+bool ControlServer::open() {
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (socketPath.empty() || socketPath.size() >= sizeof(address.sun_path)) {
+        logError("Invalid control socket path", {{"path", socketPath}});
+        return false;
+    }
+    std::memcpy(address.sun_path, socketPath.c_str(), socketPath.size() + 1);
+    // A socket file left behind by a daemon that didn't exit cleanly is
+    // replaced; anything else at the path is left alone.
+    struct stat existing;
+    if (::lstat(socketPath.c_str(), &existing) == 0) {
+        if (!S_ISSOCK(existing.st_mode)) {
+            logError("Control socket path exists and is not a socket", {{"path", socketPath}});
+            return false;
+        }
+        ::unlink(socketPath.c_str());
+    }
+
+    listener = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0) {
+        logError("Failed to create control socket", {{"error", std::strerror(errno)}});
+        return false;
+    }
+    if (::bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ||
+        ::listen(listener, 16) != 0 || !setNonBlocking(listener)) {
+        logError("Failed to listen", {{"path", socketPath}, {"error", std::strerror(errno)}});
+        ::close(listener);
+        listener = -1;
+        return false;
+    }
+    logInfo("Listening", {{"path", socketPath}});
+    return true;
+}
+
+void ControlServer::stop() { stopping.store(true); }
+
+void ControlServer::run() {
+    std::vector<pollfd> fds;
+    int idlePolls = 0;
+    while (!stopping.load()) {
+        fds.clear();
+        fds.push_back({listener, POLLIN, 0});
+        bool waiting = false;
+        for (const auto& client : clients) {
+            fds.push_back({client.fd, static_cast<short>(POLLIN | (client.output.empty() ? 0 : POLLOUT)), 0});
+            waiting = waiting || !client.pending.empty();
+        }
+        // With replies waiting, check on the player between non-blocking polls.
+        int ready = ::poll(fds.data(), fds.size(), waiting ? 0 : STOP_CHECK_MS);
+        if (ready < 0 && errno != EINTR) {
+            logError("Control socket poll failed", {{"error", std::strerror(errno)}});
+            break;
+        }
+        if (ready > 0 || waiting) {
+            // Walk backwards so dropping a client doesn't shift the ones not yet visited.
+            for (size_t i = clients.size(); i-- > 0;) {
+                short events = ready > 0 ? fds[i + 1].revents : 0;
+                bool alive = true;
+                if (events & (POLLIN | POLLHUP | POLLERR)) alive = receive(clients[i]);
+                if (alive) flushReplies(clients[i]);
+                if (alive && !clients[i].output.empty()) alive = send(clients[i]);
+                if (!alive) {
+                    ::close(clients[i].fd);
+                    clients.erase(clients.begin() + static_cast<std::ptrdiff_t>(i));
+                }
+            }
+            if (ready > 0 && (fds[0].revents & POLLIN)) acceptClients();
+        }
+        // Same back-off as PlayerController::wait(): most commands apply within microseconds.
+        if (waiting && ready == 0) {
+            if (++idlePolls < 64) {
+                std::this_thread::yield();
+            } else {
+                std::this_thread::sleep_for(PENDING_POLL);
+            }
+        } else {
+            idlePolls = 0;
+        }
+    }
+}
+
+void ControlServer::acceptClients() {
+    for (;;) {
+        int fd = ::accept(listener, nullptr, nullptr);
+        if (fd < 0) return;
+        if (clients.size() >= MAX_CLIENTS || !setNonBlocking(fd)) {
+            ::close(fd);
+            continue;
+        }
+        Client client;
+        client.fd = fd;
+        clients.push_back(std::move(client));
+    }
+}
+
+bool ControlServer::receive(Client& client) {
+    uint8_t buffer[16384];
+    for (;;) {
+        ssize_t got = ::recv(client.fd, buffer, sizeof(buffer), 0);
+        if (got > 0) {
+            client.input.insert(client.input.end(), buffer, buffer + got);
+            if (static_cast<size_t>(got) < sizeof(buffer)) break;
+            continue;
+        }
+        if (got == 0) return false;
+        if (errno == EINTR) continue;
+        if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+        return false;
+    }
+
+    // Answer every complete request; a partial one waits for the rest.
+    size_t offset = 0;
+    while (client.input.size() - offset >= CONTROL_HEADER_SIZE) {
+        ControlHeader request;
+        if (!decodeHeader(client.input.data() + offset, request)) return false;
+        if (client.input.size() - offset < CONTROL_HEADER_SIZE + request.length) break;
+        handle(request, client.input.data() + offset + CONTROL_HEADER_SIZE, client);
+        offset += CONTROL_HEADER_SIZE + request.length;
+    }
+    client.input.erase(client.input.begin(), client.input.begin() + static_cast<std::ptrdiff_t>(offset));
+    return true;
+}
+
+bool ControlServer::send(Client& client) {
+    size_t sent = 0;
+    while (sent < client.output.size()) {
+        ssize_t n = ::send(client.fd, client.output.data() + sent, client.output.size() - sent, MSG_NOSIGNAL);
+        if (n > 0) {
+            sent += static_cast<size_t>(n);
+        } else if (n < 0 && errno == EINTR) {
+            continue;
+        } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break; // the rest goes out on POLLOUT
+        } else {
+            return false;
+        }
+    }
+    client.output.erase(client.output.begin(), client.output.begin() + static_cast<std::ptrdiff_t>(sent));
+    return true;
+}
+
+void ControlServer::handle(const ControlHeader& request, const uint8_t* payload, Client& client) {
+    PendingReply pending;
+    ControlHeader& reply = pending.reply;
+    reply.opcode = request.opcode;
+    reply.sequence = request.sequence;
+    PlayerState current = player.getState();
+    uint64_t ticket = 0;
+
+    switch (request.opcode) {
+    case ControlOp::Ping:
+        break;
+    case ControlOp::Play:
+        ticket = player.play();
+        break;
+    case ControlOp::Pause:
+        ticket = player.pause();
+        break;
+    case ControlOp::Stop:
+        ticket = player.stop();
+        break;
+    case ControlOp::Next:
+        ticket = player.next();
+        break;
+    case ControlOp::Previous:
+        ticket = player.previous();
+        break;
+    case ControlOp::Seek:
+        if (request.argument < 0 || current.status == AudioSink::Status::Stopped) {
+            reply.status = ControlStatus::Failed;
+        } else {
+            // Past the end clamps to the end anyway; just keep the cast in range.
+            int64_t ms = std::min<int64_t>(request.argument, std::numeric_limits<sf::Int32>::max());
+            ticket = player.seek(sf::milliseconds(static_cast<sf::Int32>(ms)));
+        }
+        break;
+    case ControlOp::SetTrack:
+        if (request.argument < 0 || static_cast<uint64_t>(request.argument) >= current.trackCount) {
+            reply.status = ControlStatus::BadRequest;
+        } else {
+            ticket = player.setTrack(static_cast<size_t>(request.argument));
+        }
+        break;
+    case ControlOp::SetVolume:
+        if (request.argument < 0 || request.argument > 100) {
+            reply.status = ControlStatus::BadRequest;
+        } else {
+            ticket = player.setVolume(static_cast<float>(request.argument));
+        }
+        break;
+    case ControlOp::Enqueue:
+        if (request.length == 0) {
+            reply.status = ControlStatus::BadRequest;
+        } else {
+            ticket = player.addToPlaylist(std::string(reinterpret_cast<const char*>(payload), request.length));
+        }
+        break;
+    case ControlOp::Query:
+        // Answered once the client's earlier commands are in.
+        ticket = client.lastTicket;
+        break;
+    case ControlOp::Count:
+        reply.status = ControlStatus::BadRequest;
+        break;
+    }
+
+    if (reply.status == ControlStatus::Ok && request.opcode != ControlOp::Ping && request.opcode != ControlOp::Query) {
+        // A full command queue hands out ticket 0.
+        if (ticket == 0) reply.status = ControlStatus::Failed;
+        client.lastTicket = std::max(client.lastTicket, ticket);
+    }
+    pending.ticket = reply.status == ControlStatus::Ok ? ticket : 0;
+    pending.deadline = std::chrono::steady_clock::now() + APPLY_TIMEOUT;
+    client.pending.push_back(pending);
+}
+
+void ControlServer::flushReplies(Client& client) {
+    if (client.pending.empty()) return;
+    PlayerState current = player.getState();
+    auto now = std::chrono::steady_clock::now();
+    while (!client.pending.empty()) {
+        PendingReply& pending = client.pending.front();
+        ControlHeader& reply = pending.reply;
+        if (pending.ticket > current.commandsApplied) {
+            if (now < pending.deadline) break;
+            reply.status = ControlStatus::Failed;
+        }
+        uint8_t state[CONTROL_STATE_SIZE];
+        if (reply.opcode == ControlOp::Enqueue) reply.argument = static_cast<int64_t>(current.trackCount);
+        if (reply.opcode == ControlOp::Query) {
+            ControlState snapshot;
+            snapshot.playback = current.status == AudioSink::Status::Playing  ? ControlPlayback::Playing
+                              : current.status == AudioSink::Status::Paused   ? ControlPlayback::Paused
+                                                                              : ControlPlayback::Stopped;
+            snapshot.normalize = current.normalize;
+            snapshot.volume = static_cast<uint16_t>(current.volume + 0.5f);
+            snapshot.track = static_cast<uint32_t>(current.currentTrack);
+            snapshot.trackCount = static_cast<uint32_t>(current.trackCount);
+            snapshot.positionMs = current.positionUs / 1000;
+            snapshot.durationMs = current.durationUs / 1000;
+            encodeState(snapshot, state);
+            reply.length = CONTROL_STATE_SIZE;
+        }
+
+        size_t at = client.output.size();
+        client.output.resize(at + CONTROL_HEADER_SIZE + reply.length);
+        encodeHeader(reply, client.output.data() + at);
+        if (reply.length > 0) std::memcpy(client.output.data() + at + CONTROL_HEADER_SIZE, state, reply.length);
+        client.pending.pop_front();
+    }
+}
@@ -0,0 +1,69 @@
+#ifndef CONTROL_SERVER_H
+#define CONTROL_SERVER_H
+
+#include "control_protocol.h"
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <string>
+#include <vector>
+
+class PlayerController;
+
+// Serves the control protocol on a Unix domain socket. run() polls the
+// listener and every client and handles each complete request as soon as it
+// arrives. Commands are posted to the player's control thread and answered
+// once applied; until then the reply waits in its client's queue, so a slow
+// command never holds up other clients. Replies go out in request order, so
+// a Query always sees the effect of the client's earlier requests.
+class ControlServer {
+public:
+    static constexpr int STOP_CHECK_MS = 100;
+    // Longest a reply waits for the player, e.g. while play() opens a file.
+    static constexpr auto APPLY_TIMEOUT = std::chrono::milliseconds(2000);
+    // Poll interval while replies wait, once a few yields didn't do.
+    static constexpr auto PENDING_POLL = std::chrono::microseconds(50);
+    static constexpr size_t MAX_CLIENTS = 64;
+
+    ControlServer(PlayerController& player, std::string socketPath);
+    ~ControlServer();
+
+    ControlServer(const ControlServer&) = delete;
+    ControlServer& operator=(const ControlServer&) = delete;
+
+    bool open();
+    // Returns after stop().
+    void run();
+    // Async-signal-safe.
+    void stop();
+
+private:
+    struct PendingReply {
+        ControlHeader reply;
+        uint64_t ticket = 0; // ready once applied; 0 is ready now
+        std::chrono::steady_clock::time_point deadline;
+    };
+
+    struct Client {
+        int fd = -1;
+        std::vector<uint8_t> input;
+        std::vector<uint8_t> output;
+        std::deque<PendingReply> pending;
+        uint64_t lastTicket = 0; // of the client's latest command
+    };
+
+    void acceptClients();
+    bool receive(Client& client);
+    bool send(Client& client);
+    void handle(const ControlHeader& request, const uint8_t* payload, Client& client);
+    // Moves the replies whose commands have been applied (or timed out) to the output, in order.
+    void flushReplies(Client& client);
+
+    PlayerController& player;
+    std::string socketPath;
+    int listener = -1;
+    std::vector<Client> clients;
+    std::atomic<bool> stopping{false};
+};
+
+#endif // CONTROL_SERVER_H
@@ -0,0 +1,282 @@
+#include "dsp_chain.h"
+#include "logger.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+constexpr double PI = 3.14159265358979323846;
+
+float dbToLinear(float db) { return std::pow(10.0f, db / 20.0f); }
+
+// Multiplies each stereo frame by its own gain.
+void applyFrameGains(float* samples, const float* gains, size_t frames) {
+    size_t f = 0;
+#if defined(__AVX__)
+    for (; f + 4 <= frames; f += 4) {
+        __m128 g = _mm_loadu_ps(gains + f);
+        __m256 g2 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_unpacklo_ps(g, g)), _mm_unpackhi_ps(g, g), 1);
+        _mm256_storeu_ps(samples + 2 * f, _mm256_mul_ps(_mm256_loadu_ps(samples + 2 * f), g2));
+    }
+#elif defined(__SSE2__)
+    for (; f + 2 <= frames; f += 2) {
+        __m128 g = _mm_castpd_ps(_mm_load_sd(reinterpret_cast<const double*>(gains + f)));
+        _mm_storeu_ps(samples + 2 * f, _mm_mul_ps(_mm_loadu_ps(samples + 2 * f), _mm_unpacklo_ps(g, g)));
+    }
+#endif
+    for (; f < frames; ++f) {
+        samples[2 * f] *= gains[f];
+        samples[2 * f + 1] *= gains[f];
+    }
+}
+
+} // namespace
+
+void scaleSamples(const float* input, float gain, float* output, size_t count) {
+    size_t i = 0;
+#if defined(__AVX__)
+    __m256 vgain = _mm256_set1_ps(gain);
+    for (; i + 8 <= count; i += 8) _mm256_storeu_ps(output + i, _mm256_mul_ps(_mm256_loadu_ps(input + i), vgain));
+#elif defined(__SSE2__)
+    __m128 vgain = _mm_set1_ps(gain);
+    for (; i + 4 <= count; i += 4) _mm_storeu_ps(output + i, _mm_mul_ps(_mm_loadu_ps(input + i), vgain));
+#endif
+    for (; i < count; ++i) output[i] = input[i] * gain;
+}
+
+// DspStage implementation
+void DspStage::setEnabled(bool value) { enabled.store(value, std::memory_order_relaxed); }
+bool DspStage::isEnabled() const { return enabled.load(std::memory_order_relaxed); }
+
+// PreampStage implementation
+const char* PreampStage::getName() const { return "preamp"; }
+
+void PreampStage::prepare(unsigned) { gain = targetGain.load(std::memory_order_relaxed); }
+
+void PreampStage::process(float* samples, size_t frames) {
+    float target = targetGain.load(std::memory_order_relaxed);
+    if (target == gain) {
+        if (gain != 1.0f) scaleSamples(samples, gain, samples, frames * 2);
+        return;
+    }
+    // Ramp over the block so a slider drag does not click.
+    float step = (target - gain) / frames;
+    for (size_t f = 0; f < frames; ++f) {
+        float g = gain + step * (f + 1);
+        samples[2 * f] *= g;
+        samples[2 * f + 1] *= g;
+    }
+    gain = target;
+}
+
+void PreampStage::setGainDb(float gainDb) { targetGain.store(dbToLinear(gainDb), std::memory_order_relaxed); }
+float PreampStage::getGainDb() const { return 20.0f * std::log10(targetGain.load(std::memory_order_relaxed)); }
+
+// EqualizerStage implementation
+EqualizerStage::EqualizerStage(std::vector<EqBand> initialBands) : bands(std::move(initialBands)) {
+    if (bands.size() > MAX_BANDS) bands.resize(MAX_BANDS);
+}
+
+const char* EqualizerStage::getName() const { return "equalizer"; }
+
+void EqualizerStage::prepare(unsigned rate) {
+    sampleRate = rate;
+    std::fill(&state[0][0], &state[0][0] + MAX_BANDS * 4, 0.0);
+    publishCoefficients();
+    coefficients.update();
+}
+
+void EqualizerStage::setBand(size_t index, const EqBand& band) {
+    if (index >= bands.size()) return;
+    bands[index] = band;
+    publishCoefficients();
+}
+
+const EqBand& EqualizerStage::getBand(size_t index) const { return bands[index]; }
+size_t EqualizerStage::getBandCount() const { return bands.size(); }
+
+void EqualizerStage::publishCoefficients() {
+    if (sampleRate == 0) return;
+    Coefficients& next = coefficients.back();
+    next.count = 0;
+    for (size_t i = 0; i < bands.size(); ++i) {
+        const EqBand& band = bands[i];
+        if (std::abs(band.gainDb) < 0.01f) continue;
+        double fs = sampleRate;
+        double f0 = std::min<double>(std::max(band.frequency, 10.0f), 0.49 * fs);
+        double a = std::pow(10.0, band.gainDb / 40.0);
+        double w0 = 2.0 * PI * f0 / fs;
+        double cosw = std::cos(w0);
+        double alpha = std::sin(w0) / (2.0 * std::max(band.q, 0.05f));
+        double b0, b1, b2, a0, a1, a2;
+        switch (band.type) {
+        case EqBand::Type::LowShelf: {
+            double s = 2.0 * std::sqrt(a) * alpha;
+            b0 = a * ((a + 1) - (a - 1) * cosw + s);
+            b1 = 2 * a * ((a - 1) - (a + 1) * cosw);
+            b2 = a * ((a + 1) - (a - 1) * cosw - s);
+            a0 = (a + 1) + (a - 1) * cosw + s;
+            a1 = -2 * ((a - 1) + (a + 1) * cosw);
+            a2 = (a + 1) + (a - 1) * cosw - s;
+            break;
+        }
+        case EqBand::Type::HighShelf: {
+            double s = 2.0 * std::sqrt(a) * alpha;
+            b0 = a * ((a + 1) + (a - 1) * cosw + s);
+            b1 = -2 * a * ((a - 1) + (a + 1) * cosw);
+            b2 = a * ((a + 1) + (a - 1) * cosw - s);
+            a0 = (a + 1) - (a - 1) * cosw + s;
+            a1 = 2 * ((a - 1) - (a + 1) * cosw);
+            a2 = (a + 1) - (a - 1) * cosw - s;
+            break;
+        }
+        default:
+            b0 = 1 + alpha * a;
+            b1 = -2 * cosw;
+            b2 = 1 - alpha * a;
+            a0 = 1 + alpha / a;
+            a1 = -2 * cosw;
+            a2 = 1 - alpha / a;
+            break;
+        }
+        next.biquads[next.count] = {b0 / a0, b1 / a0, b2 / a0, a1 / a0, a2 / a0};
+        next.bandOf[next.count] = static_cast<uint8_t>(i);
+        next.count++;
+    }
+    coefficients.publish();
+}
+
+void EqualizerStage::process(float* samples, size_t frames) {
+    if (coefficients.update()) {
+        // A band switched off keeps no history, so switching it back on starts clean.
+        bool active[MAX_BANDS] = {};
+        const Coefficients& current = coefficients.front();
+        for (size_t i = 0; i < current.count; ++i) active[current.bandOf[i]] = true;
+        for (size_t b = 0; b < MAX_BANDS; ++b) {
+            if (!active[b]) std::fill(state[b], state[b] + 4, 0.0);
+        }
+    }
+    const Coefficients& current = coefficients.front();
+    // One band at a time over the whole block keeps its coefficients in registers.
+    for (size_t i = 0; i < current.count; ++i) {
+        const Biquad& q = current.biquads[i];
+        double* z = state[current.bandOf[i]];
+#if defined(__SSE2__)
+        const __m128d b0 = _mm_set1_pd(q.b0), b1 = _mm_set1_pd(q.b1), b2 = _mm_set1_pd(q.b2);
+        const __m128d a1 = _mm_set1_pd(q.a1), a2 = _mm_set1_pd(q.a2);
+        __m128d z1 = _mm_loadu_pd(z), z2 = _mm_loadu_pd(z + 2);
+        for (size_t f = 0; f < frames; ++f) {
+            __m128d x = _mm_cvtps_pd(_mm_castpd_ps(_mm_load_sd(reinterpret_cast<const double*>(samples + 2 * f))));
+            __m128d y = _mm_add_pd(_mm_mul_pd(b0, x), z1);
+            z1 = _mm_add_pd(_mm_sub_pd(_mm_mul_pd(b1, x), _mm_mul_pd(a1, y)), z2);
+            z2 = _mm_sub_pd(_mm_mul_pd(b2, x), _mm_mul_pd(a2, y));
+            _mm_store_sd(reinterpret_cast<double*>(samples + 2 * f), _mm_castps_pd(_mm_cvtpd_ps(y)));
+        }
+        _mm_storeu_pd(z, z1);
+        _mm_storeu_pd(z + 2, z2);
+#else
+        for (size_t f = 0; f < frames; ++f) {
+            for (size_t c = 0; c < 2; ++c) {
+                double x = samples[2 * f + c];
+                double y = q.b0 * x + z[c];
+                z[c] = q.b1 * x - q.a1 * y + z[2 + c];
+                z[2 + c] = q.b2 * x - q.a2 * y;
+                samples[2 * f + c] = static_cast<float>(y);
+            }
+        }
+#endif
+    }
+}
+
+// LimiterStage implementation
+LimiterStage::LimiterStage() : threshold(dbToLinear(-3.0f)), ceiling(dbToLinear(-0.3f)), gains(MAX_FRAMES) {}
+
+const char* LimiterStage::getName() const { return "limiter"; }
+
+void LimiterStage::prepare(unsigned sampleRate) {
+    // 150 ms release
+    releaseCoefficient = std::exp(-1.0f / (0.15f * std::max(1u, sampleRate)));
+    envelope = 0.0f;
+}
+
+void LimiterStage::process(float* samples, size_t frames) {
+    frames = std::min(frames, MAX_FRAMES);
+    float t = threshold.load(std::memory_order_relaxed);
+    float c = std::max(ceiling.load(std::memory_order_relaxed), t + 1e-4f);
+    float knee = c - t;
+    float minGain = 1.0f;
+    for (size_t f = 0; f < frames; ++f) {
+        float peak = std::max(std::abs(samples[2 * f]), std::abs(samples[2 * f + 1]));
+        envelope = std::max(peak, envelope * releaseCoefficient);
+        float g = 1.0f;
+        if (envelope > t) g = (t + knee * std::tanh((envelope - t) / knee)) / envelope;
+        gains[f] = g;
+        minGain = std::min(minGain, g);
+    }
+    reductionDb.store(-20.0f * std::log10(minGain), std::memory_order_relaxed);
+    if (minGain < 1.0f) applyFrameGains(samples, gains.data(), frames);
+}
+
+void LimiterStage::setThresholdDb(float thresholdDb) { threshold.store(dbToLinear(thresholdDb), std::memory_order_relaxed); }
+void LimiterStage::setCeilingDb(float ceilingDb) { ceiling.store(dbToLinear(ceilingDb), std::memory_order_relaxed); }
+float LimiterStage::getGainReductionDb() const { return reductionDb.load(std::memory_order_relaxed); }
+
+// DspChain implementation
+bool DspChain::insertStage(size_t position, std::unique_ptr<DspStage> stage) {
+    if (stages.size() == MAX_STAGES) {
+        logWarn("DSP chain full, stage not added", {{"stage", stage->getName()}});
+        return false;
+    }
+    position = std::min(position, stages.size());
+    stages.insert(stages.begin() + position, std::move(stage));
+    for (size_t i = stages.size() - 1; i > position; --i) {
+        nanoseconds[i].store(nanoseconds[i - 1].load(std::memory_order_relaxed), std::memory_order_relaxed);
+        frameCounts[i].store(frameCounts[i - 1].load(std::memory_order_relaxed), std::memory_order_relaxed);
+    }
+    nanoseconds[position].store(0, std::memory_order_relaxed);
+    frameCounts[position].store(0, std::memory_order_relaxed);
+    return true;
+}
+
+void DspChain::prepare(unsigned sampleRate) {
+    for (auto& stage : stages) stage->prepare(sampleRate);
+}
+
+void DspChain::process(float* samples, size_t frames) {
+#if defined(__SSE2__)
+    // Decaying filter tails would otherwise turn denormal and stall the FPU.
+    unsigned csr = _mm_getcsr();
+    _mm_setcsr(csr | 0x8040); // flush-to-zero | denormals-are-zero
+#endif
+    for (size_t done = 0; done < frames; done += BLOCK) {
+        size_t n = std::min(BLOCK, frames - done);
+        for (size_t i = 0; i < stages.size(); ++i) {
+            if (!stages[i]->isEnabled()) continue;
+            auto start = std::chrono::steady_clock::now();
+            stages[i]->process(samples + done * 2, n);
+            auto elapsed = std::chrono::steady_clock::now() - start;
+            nanoseconds[i].fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count(), std::memory_order_relaxed);
+            frameCounts[i].fetch_add(n, std::memory_order_relaxed);
+        }
+    }
+#if defined(__SSE2__)
+    _mm_setcsr(csr);
+#endif
+}
+
+size_t DspChain::getStageCount() const { return stages.size(); }
+
+void DspChain::getCosts(std::vector<DspStageCost>& costs) const {
+    costs.clear();
+    for (size_t i = 0; i < stages.size(); ++i) {
+        costs.push_back({stages[i]->getName(), stages[i]->isEnabled(), nanoseconds[i].load(std::memory_order_relaxed),
+                         frameCounts[i].load(std::memory_order_relaxed)});
+    }
+}
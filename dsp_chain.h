@@ -0,0 +1,174 @@
+#ifndef DSP_CHAIN_H
+#define DSP_CHAIN_H
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Multiplies `count` floats by `gain` (AVX/SSE when available).
+void scaleSamples(const float* input, float gain, float* output, size_t count);
+
+// Lock-free handoff of a whole value from one writer to one reader. The
+// writer fills the back slot and publishes it; the reader picks up the most
+// recently published slot and never sees a half-written one.
+template <typename T>
+class TripleBuffer {
+public:
+    T& back() { return slots[backIndex]; }
+    void publish() { backIndex = shared.exchange(backIndex | DIRTY, std::memory_order_acq_rel) & INDEX; }
+    // Returns true if a newer value was published since the last call.
+    bool update() {
+        if (!(shared.load(std::memory_order_relaxed) & DIRTY)) return false;
+        frontIndex = shared.exchange(frontIndex, std::memory_order_acq_rel) & INDEX;
+        return true;
+    }
+    const T& front() const { return slots[frontIndex]; }
+
+private:
+    static constexpr uint8_t INDEX = 3, DIRTY = 4;
+    std::array<T, 3> slots{};
+    std::atomic<uint8_t> shared{1};
+    uint8_t backIndex = 2;
+    uint8_t frontIndex = 0;
+};
+
+// One processing step on interleaved stereo float. prepare() runs on the
+// control thread while the stream is stopped; process() runs on the audio
+// thread and must not allocate or lock. Setters are safe from the UI thread.
+class DspStage {
+public:
+    virtual ~DspStage() = default;
+    virtual const char* getName() const = 0;
+    virtual void prepare(unsigned sampleRate) = 0;
+    virtual void process(float* samples, size_t frames) = 0;
+
+    void setEnabled(bool enabled);
+    bool isEnabled() const;
+
+private:
+    std::atomic<bool> enabled{true};
+};
+
+class PreampStage : public DspStage {
+public:
+    const char* getName() const override;
+    void prepare(unsigned sampleRate) override;
+    void process(float* samples, size_t frames) override;
+
+    void setGainDb(float gainDb);
+    float getGainDb() const;
+
+private:
+    std::atomic<float> targetGain{1.0f};
+    float gain = 1.0f; // audio thread; ramps to targetGain over one block
+};
+
+struct EqBand {
+    enum class Type : uint8_t { Peak, LowShelf, HighShelf };
+    Type type = Type::Peak;
+    float frequency = 1000.0f;
+    float gainDb = 0.0f;
+    float q = 1.0f;
+};
+
+// Parametric EQ as a cascade of RBJ biquads in transposed direct form II.
+// Left and right run together in one SSE2 register of doubles.
+class EqualizerStage : public DspStage {
+public:
+    static constexpr size_t MAX_BANDS = 16;
+
+    explicit EqualizerStage(std::vector<EqBand> bands);
+
+    const char* getName() const override;
+    void prepare(unsigned sampleRate) override;
+    void process(float* samples, size_t frames) override;
+
+    // UI thread.
+    void setBand(size_t index, const EqBand& band);
+    const EqBand& getBand(size_t index) const;
+    size_t getBandCount() const;
+
+private:
+    struct Biquad {
+        double b0, b1, b2, a1, a2;
+    };
+    struct Coefficients {
+        std::array<Biquad, MAX_BANDS> biquads;
+        std::array<uint8_t, MAX_BANDS> bandOf; // which band each active biquad belongs to
+        size_t count = 0;                       // 0 dB bands are left out
+    };
+
+    void publishCoefficients();
+
+    std::vector<EqBand> bands;
+    unsigned sampleRate = 0;
+    TripleBuffer<Coefficients> coefficients;
+    double state[MAX_BANDS][4] = {}; // z1 L/R, z2 L/R per band
+};
+
+// Peak limiter with instant attack, exponential release and a tanh soft knee
+// between the threshold and the ceiling, so output never exceeds the ceiling.
+class LimiterStage : public DspStage {
+public:
+    static constexpr size_t MAX_FRAMES = 1024;
+
+    LimiterStage();
+
+    const char* getName() const override;
+    void prepare(unsigned sampleRate) override;
+    void process(float* samples, size_t frames) override;
+
+    void setThresholdDb(float thresholdDb);
+    void setCeilingDb(float ceilingDb);
+    float getGainReductionDb() const;
+
+private:
+    std::atomic<float> threshold;
+    std::atomic<float> ceiling;
+    std::atomic<float> reductionDb{0.0f};
+    float releaseCoefficient = 0.0f;
+    float envelope = 0.0f;
+    std::vector<float> gains;
+};
+
+struct DspStageCost {
+    const char* name;
+    bool enabled;
+    uint64_t nanoseconds; // total time spent in process()
+    uint64_t frames;      // total frames processed
+};
+
+// Ordered list of stages run on each rendered block. Stages are inserted and
+// prepared while the stream is stopped; their parameters change at any time.
+class DspChain {
+public:
+    static constexpr size_t MAX_STAGES = 8;
+    static constexpr size_t BLOCK = LimiterStage::MAX_FRAMES;
+
+    // Control thread, stream stopped. Returns the inserted stage, or null if
+    // the chain is full.
+    template <typename T>
+    T* insert(size_t position, std::unique_ptr<T> stage) {
+        T* inserted = stage.get();
+        return insertStage(position, std::move(stage)) ? inserted : nullptr;
+    }
+    void prepare(unsigned sampleRate);
+
+    // Audio thread.
+    void process(float* samples, size_t frames);
+
+    // Any thread.
+    size_t getStageCount() const;
+    void getCosts(std::vector<DspStageCost>& costs) const;
+
+private:
+    bool insertStage(size_t position, std::unique_ptr<DspStage> stage);
+
+    std::vector<std::unique_ptr<DspStage>> stages;
+    std::array<std::atomic<uint64_t>, MAX_STAGES> nanoseconds{};
+    std::array<std::atomic<uint64_t>, MAX_STAGES> frameCounts{};
+};
+
+#endif // DSP_CHAIN_H
@@ -0,0 +1,59 @@
+#include "file_cache.h"
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <system_error>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+std::string getTemporaryPath(const std::string& path) {
+    static std::atomic<uint64_t> counter{0};
+    char suffix[48];
+    std::snprintf(suffix, sizeof(suffix), ".%ld.%llu.tmp", static_cast<long>(::getpid()),
+                  static_cast<unsigned long long>(counter.fetch_add(1)));
+    return path + suffix;
+}
+
+uint64_t hashBytes(const void* data, size_t size, uint64_t seed) {
+    // 64-bit FNV-1a
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    uint64_t hash = seed;
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= p[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+bool getFileIdentity(const std::string& filepath, FileIdentity& identity) {
+    std::error_code ec;
+    uintmax_t size = fs::file_size(filepath, ec);
+    if (ec) return false;
+    auto modified = fs::last_write_time(filepath, ec);
+    if (ec) return false;
+    identity.pathHash = hashBytes(filepath.data(), filepath.size());
+    identity.size = size;
+    identity.modified = static_cast<int64_t>(modified.time_since_epoch().count());
+    return true;
+}
+
+std::string getCachePath(const FileIdentity& identity, const std::string& kind, const std::string& extension) {
+    fs::path root;
+    if (const char* xdg = std::getenv("XDG_CACHE_HOME"); xdg && *xdg) {
+        root = xdg;
+    } else if (const char* home = std::getenv("HOME"); home && *home) {
+        root = fs::path(home) / ".cache";
+    } else {
+        return {};
+    }
+    fs::path dir = root / "msx_player" / kind;
+    std::error_code ec;
+    fs::create_directories(dir, ec);
+    if (ec) return {};
+
+    char name[64];
+    std::snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(hashBytes(&identity, sizeof(identity))));
+    return (dir / (name + extension)).string();
+}
@@ -0,0 +1,33 @@
+#ifndef FILE_CACHE_H
+#define FILE_CACHE_H
+
+#include <cstdint>
+#include <string>
+
+// Identifies a file by path, size and modification time, so cached analysis
+// results are invalidated when the file is replaced or edited.
+struct FileIdentity {
+    uint64_t pathHash = 0;
+    uint64_t size = 0;
+    int64_t modified = 0;
+
+    bool operator==(const FileIdentity& other) const {
+        return pathHash == other.pathHash && size == other.size && modified == other.modified;
+    }
+    bool operator!=(const FileIdentity& other) const { return !(*this == other); }
+};
+
+bool getFileIdentity(const std::string& filepath, FileIdentity& identity);
+
+// Path of the cache entry for `identity` under $XDG_CACHE_HOME/msx_player/<kind>/,
+// creating the directory on first use. Returns an empty string if there is no cache dir.
+std::string getCachePath(const FileIdentity& identity, const std::string& kind, const std::string& extension);
+
+// `path` with a suffix no other writer in any process uses, for writing a
+// cache entry before renaming it into place. Two threads saving the same
+// entry then each publish a whole file.
+std::string getTemporaryPath(const std::string& path);
+
+uint64_t hashBytes(const void* data, size_t size, uint64_t seed = 14695981039346656037ull);
+
+#endif // FILE_CACHE_H
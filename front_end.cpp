@@ -1,30 +1,94 @@
-#include "msx_player.h"
+#include "input_recording.h"
+#include "logger.h"
+#include "metrics.h"
+#include "perf_hud.h"
+#include "playlist_file.h"
+#include "player_controller.h"
+#include "session_store.h"
+#include "spectrum.h"
 #include "tinyfiledialogs.h"
-#include <iostream>
+#include "trace.h"
+#include "waveform.h"
+#include <chrono>
+#include <cmath>
+#include <cstdio>
 #include <SFML/Graphics.hpp>
 #include <filesystem>
+#include <thread>
 
 class MusicPlayerUI {
 private:
+    // bench/bench_player.cpp drives renderPlaylist() and handleMouseHover() offscreen.
+    friend struct UiBench;
+
     sf::RenderWindow window;
+    sf::RenderTarget* target; // the window, or an offscreen texture
     sf::View view;
     sf::Font font;
-    MusicPlayer player;
+    PlayerController player;
+    // Read once per frame; the render loop never touches the player itself.
+    PlayerState state;
+    std::shared_ptr<const PlaylistSnapshot> playlist;
+    uint64_t scrollTicket = 0; // scroll to the current track once this command has run
     std::vector<std::string> folderPaths;
     
     Button selectFolderButton, playButton, pauseButton, stopButton, nextButton, prevButton, exitButton;
     float scrollOffset = 0.0f;
     int hoveredTrack = -1;
     bool clickProcessed = false;
+    size_t visibleFirst = 0;
+    size_t visibleLast = 0;
+    bool draggingTimeline = false;
+    float dragFraction = 0.0f;
+    WaveformGenerator waveforms{static_cast<size_t>(TIMELINE_WIDTH)};
+    std::shared_ptr<const Waveform> shownWaveform;
+    sf::VertexArray waveformVertices{sf::Lines};
+    SpectrumAnalyzer spectrum;
+    sf::VertexArray spectrumVertices{sf::Quads};
+    sf::Clock frameClock;
+    PerfHud hud{font};
+    std::chrono::steady_clock::time_point frameStart = std::chrono::steady_clock::now();
+    size_t drawCalls = 0;    // this frame, for the HUD
+    size_t rowsRendered = 0;
+    size_t eventsHandled = 0;
+    FrameSample lastFrame;
+    bool closed = false;
+    InputRecorder* recorder = nullptr;
+    InputReplay* replay = nullptr; // events come from here instead of the window
+    SessionStore* session = nullptr;
+    uint64_t sessionTicket = 0; // changes are journaled once the restore has been applied
 
     static constexpr float PLAYLIST_TOP = 60.0f;
     static constexpr float PLAYLIST_BOTTOM = 500.0f;
     static constexpr float TRACK_HEIGHT = 40.0f;
+    static constexpr float TIMELINE_LEFT = 50.0f;
+    static constexpr float TIMELINE_TOP = 506.0f;
+    static constexpr float TIMELINE_WIDTH = 590.0f;
+    static constexpr float TIMELINE_HEIGHT = 32.0f;
+    static constexpr float VOLUME_LEFT = 560.0f;
+    static constexpr float VOLUME_TOP = 556.0f;
+    static constexpr float VOLUME_WIDTH = 80.0f;
+    static constexpr float VOLUME_HEIGHT = 10.0f;
+    static constexpr float SPECTRUM_LEFT = 300.0f;
+    static constexpr float SPECTRUM_TOP = 10.0f;
+    static constexpr float SPECTRUM_WIDTH = 400.0f;
+    static constexpr float SPECTRUM_HEIGHT = 40.0f;
+    static constexpr float CROSSFADE_LEFT = 712.0f;
+    static constexpr float CROSSFADE_TOP = 20.0f;
+    static constexpr float SPEED_TOP = 2.0f;
+    static constexpr float PITCH_TOP = 38.0f;
 
 public:
-    MusicPlayerUI() 
-        : window(sf::VideoMode(800, 600), "Cyberpunk Music Player", sf::Style::Resize),
+    MusicPlayerUI() : MusicPlayerUI(nullptr, nullptr) {}
+    // No window; frames are drawn into `offscreen` and never shown.
+    MusicPlayerUI(sf::RenderTarget& offscreen, std::unique_ptr<AudioSink> output)
+        : MusicPlayerUI(&offscreen, std::move(output)) {}
+
+private:
+    MusicPlayerUI(sf::RenderTarget* offscreen, std::unique_ptr<AudioSink> output)
+        : target(offscreen ? offscreen : &window),
           view(sf::FloatRect(0, 0, 800.0f, 600.0f)),
+          player(std::move(output)),
           selectFolderButton("+ Add Folder", 50, 10, 200, 40, sf::Color(0, 255, 255, 200), font, 20, 60.0f, 15.0f),  // Centered
           playButton("Play", 200, 550, 80, 50, sf::Color(0, 255, 0, 200), font, 20, 20.0f, 10.0f),              // Your offset
           pauseButton("Pause", 290, 550, 80, 50, sf::Color(255, 255, 0, 200), font, 20, 20.0f, 10.0f),         // Your offset
@@ -33,25 +97,205 @@ public:
           prevButton("Prev", 110, 550, 80, 50, sf::Color(100, 255, 255, 200), font, 20, 20.0f, 10.0f),        // Your offset
           exitButton("Exit", 650, 550, 100, 50, sf::Color(255, 50, 50, 200), font, 20, 20.0f, 10.0f)          // Your offset
     {
-        window.setFramerateLimit(60);
-        window.setView(view);
+        if (!offscreen) {
+            window.create(sf::VideoMode(800, 600), "Cyberpunk Music Player", sf::Style::Resize);
+            window.setFramerateLimit(60);
+        }
+        target->setView(view);
         if (!font.loadFromFile("/usr/share/fonts/truetype/dejavu/DejaVuSans.ttf")) {
-            std::cout << "Warning: Font Load Failed!\n";
+            logWarn("Font load failed");
         }
+        playlist = player.getPlaylist();
+        state = player.getState();
     }
 
+public:
     void run() {
-        while (window.isOpen()) {
-            handleEvents();
-            render();
+        Tracer::setThreadName("UI");
+        while (!closed) runFrame();
+    }
+
+    // Restores the playlist, track, position, settings and scroll offset the
+    // last run ended with, without rescanning anything, and journals changes
+    // to `store` from then on.
+    void resumeSession(SessionStore& store) {
+        SessionState saved;
+        std::vector<std::string> paths;
+        std::vector<TrackInfo> info;
+        if (store.open(saved, paths, info)) {
+            player.addTracks(std::move(paths), std::move(info));
+            player.setVolume(saved.volume);
+            player.setNormalization(saved.normalize);
+            player.setCrossfade(saved.crossfade);
+            player.setSpeed(saved.speed);
+            player.setPitch(saved.pitch);
+            sessionTicket = player.resumeAt(saved.currentTrack, sf::microseconds(saved.positionUs), saved.playing);
+            scrollOffset = saved.scrollOffset;
+        }
+        session = &store;
+    }
+
+    // Every event handled from now on is written to `inputRecorder`.
+    void setInputRecorder(InputRecorder* inputRecorder) { recorder = inputRecorder; }
+
+    // Offscreen: plays `input` back frame by frame until it runs out or
+    // closes the player. Paced replays start each frame when it started in
+    // the recording, so background work lands between the same events;
+    // unpaced ones run flat out.
+    std::vector<ReplayFrame> replayInput(InputReplay& input, bool paced) {
+        Tracer::setThreadName("UI");
+        replay = &input;
+        std::vector<ReplayFrame> frames;
+        frames.reserve(input.getFrameCount());
+        auto replayStart = std::chrono::steady_clock::now();
+        std::chrono::microseconds recordedStart;
+        while (!closed && input.nextFrame(recordedStart)) {
+            if (paced) std::this_thread::sleep_until(replayStart + recordedStart);
+            auto start = std::chrono::steady_clock::now();
+            runFrame();
+            auto end = std::chrono::steady_clock::now();
+            ReplayFrame frame;
+            frame.startMicroseconds = std::chrono::duration_cast<std::chrono::microseconds>(start - replayStart).count();
+            frame.workMicroseconds = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+            frame.events = lastFrame.events;
+            frame.drawCalls = lastFrame.drawCalls;
+            frame.rowsRendered = lastFrame.rowsRendered;
+            frames.push_back(frame);
         }
+        replay = nullptr;
+        return frames;
     }
 
 private:
+    void runFrame() {
+        TraceScope scope("frame");
+        if (recorder) recorder->beginFrame();
+        refreshState();
+        player.getExecutor().drain();
+        handleEvents();
+        updateVisibleRange();
+        followCurrentTrack();
+        updateSpectrum();
+        render();
+        recordFrame();
+        saveSession();
+    }
+
+    void saveSession() {
+        if (!session || state.commandsApplied < sessionTicket) return;
+        SessionState current;
+        current.currentTrack = state.currentTrack;
+        current.positionUs = state.positionUs;
+        current.playing = state.isPlaying;
+        current.normalize = state.normalize;
+        current.volume = state.volume;
+        current.crossfade = state.crossfade;
+        current.speed = state.speed;
+        current.pitch = state.pitch;
+        current.scrollOffset = scrollOffset;
+        session->observe(current, playlist);
+    }
+
+    void close() {
+        closed = true;
+        if (target == &window) window.close();
+    }
+
+    void refreshState() {
+        state = player.getState();
+        if (playlist->version >= state.playlistVersion) return;
+        size_t known = playlist->paths.size();
+        playlist = player.getPlaylist();
+        // Tracks added since the last frame get their waveforms in the background.
+        if (playlist->paths.size() > known) {
+            std::vector<std::string> added;
+            added.reserve(playlist->paths.size() - known);
+            for (size_t i = known; i < playlist->paths.size(); ++i) added.push_back(playlist->paths[i]);
+            waveforms.precompute(added);
+        }
+        clampScrollOffset();
+    }
+
+    // Scans on the I/O pool and, if nothing is playing, starts the first new
+    // track once it's open; the frame loop keeps running throughout.
+    Task<> importFolder(std::string folderPath) {
+        size_t first = state.trackCount;
+        size_t added = co_await player.importAsync(folderPath);
+        if (added == 0 || state.isPlaying) co_return;
+        if (co_await player.openAsync(first)) {
+            refreshState();
+            adjustScrollToTrack(first);
+        }
+    }
+
+    Task<> importPlaylist(std::string path) {
+        size_t first = state.trackCount;
+        size_t added = co_await player.importPlaylistAsync(path);
+        if (added == 0 || state.isPlaying) co_return;
+        if (co_await player.openAsync(first)) {
+            refreshState();
+            adjustScrollToTrack(first);
+        }
+    }
+
+    Task<> exportPlaylist(std::string path) {
+        if (!co_await player.exportPlaylistAsync(path)) logWarn("Playlist not saved", {{"path", path}});
+    }
+
+    Task<> exportTracks(std::string directory, ExportFormat format) {
+        size_t count = playlist->paths.size();
+        size_t written = co_await player.exportTracksAsync(directory, format);
+        if (written < count) logWarn("Not every track was exported", {{"written", written}, {"tracks", count}});
+    }
+
+    Task<> playTrack(size_t trackIndex) {
+        if (co_await player.openAsync(trackIndex)) {
+            refreshState();
+            adjustScrollToTrack(trackIndex);
+        }
+    }
+
+    void recordFrame() {
+        // Function-local: main.cpp includes this file, so a namespace-scope
+        // metric would be registered twice.
+        static MetricHistogram frameTimeMetric("msx_frame_seconds", "Time between UI frame starts",
+                                               {0.008, 0.017, 0.025, 0.034, 0.05, 0.1, 0.25, 1});
+        auto now = std::chrono::steady_clock::now();
+        FrameSample sample;
+        sample.frameMicroseconds = std::chrono::duration_cast<std::chrono::microseconds>(now - frameStart).count();
+        sample.drawCalls = drawCalls;
+        sample.rowsRendered = rowsRendered;
+        sample.events = eventsHandled;
+        sample.audio = player.getSinkStats();
+        sample.audibleFrame = state.audibleFrame;
+        sample.sampleRate = player.getSampleTap().getSampleRate();
+        sample.playing = state.status == AudioSink::Status::Playing;
+        hud.addFrame(sample);
+        lastFrame = sample;
+        frameTimeMetric.observe(now - frameStart);
+        frameStart = now;
+        drawCalls = 0;
+        rowsRendered = 0;
+        eventsHandled = 0;
+    }
+
+    void draw(const sf::Drawable& drawable) {
+        target->draw(drawable);
+        ++drawCalls;
+    }
+
+    void followCurrentTrack() {
+        if (scrollTicket != 0 && state.commandsApplied >= scrollTicket) {
+            scrollTicket = 0;
+            adjustScrollToCurrent();
+        }
+    }
+
     void handleEvents() {
+        TraceScope scope("handleEvents");
         sf::Event event;
-        while (window.pollEvent(event)) {
-            if (event.type == sf::Event::Closed) window.close();
+        while (pollEvent(event)) {
+            if (event.type == sf::Event::Closed) close();
             if (event.type == sf::Event::Resized) {
                 view.setSize(800.0f, 600.0f);
                 float aspectRatio = 800.0f / 600.0f;
@@ -65,152 +309,494 @@ private:
                     viewport.top = (1.0f - viewport.height) / 2.0f;
                 }
                 view.setViewport(viewport);
-                window.setView(view);
+                target->setView(view);
             }
             if (event.type == sf::Event::MouseWheelScrolled) {
-                scrollOffset -= event.mouseWheelScroll.delta * 30;
-                clampScrollOffset();
+                sf::Vector2f mousePos = toView(event.mouseWheelScroll.x, event.mouseWheelScroll.y);
+                if (volumeBounds().contains(mousePos)) {
+                    // Update the local copy too, so several wheel steps in one frame add up.
+                    state.volume = std::max(0.0f, std::min(state.volume + event.mouseWheelScroll.delta * 5.0f, 100.0f));
+                    player.setVolume(state.volume);
+                } else {
+                    scrollOffset -= event.mouseWheelScroll.delta * 30;
+                    clampScrollOffset();
+                }
+            }
+            if (event.type == sf::Event::KeyPressed && event.key.code == sf::Keyboard::F3) hud.toggle();
+            if (event.type == sf::Event::KeyPressed && event.key.control && event.key.code == sf::Keyboard::O) openPlaylist();
+            if (event.type == sf::Event::KeyPressed && event.key.control && event.key.code == sf::Keyboard::S) savePlaylist();
+            if (event.type == sf::Event::KeyPressed && event.key.control && event.key.code == sf::Keyboard::E) chooseExportFolder(event.key.shift);
+            if (event.type == sf::Event::KeyPressed) editHoveredTrack(event.key);
+            if (event.type == sf::Event::KeyPressed && event.key.code == sf::Keyboard::F12) {
+                Tracer::writeChromeTrace("msx_trace.json");
             }
             if (event.type == sf::Event::MouseButtonPressed && !clickProcessed) {
-                handleMouseClick(window.mapPixelToCoords(sf::Mouse::getPosition(window)));
+                handleMouseClick(toView(event.mouseButton.x, event.mouseButton.y));
                 clickProcessed = true;
             }
             if (event.type == sf::Event::MouseButtonReleased) {
                 clickProcessed = false;
+                if (draggingTimeline) {
+                    draggingTimeline = false;
+                    player.seek(sf::microseconds(static_cast<sf::Int64>(dragFraction * state.durationUs)));
+                }
             }
             if (event.type == sf::Event::MouseMoved) {
-                handleMouseHover(window.mapPixelToCoords(sf::Mouse::getPosition(window)));
+                sf::Vector2f mousePos = toView(event.mouseMove.x, event.mouseMove.y);
+                if (draggingTimeline) dragFraction = timelineFraction(mousePos);
+                handleMouseHover(mousePos);
             }
         }
     }
 
+    // Events carry their own coordinates, so a replay doesn't depend on where
+    // the real pointer is.
+    bool pollEvent(sf::Event& event) {
+        if (replay) {
+            if (!replay->pollEvent(event)) return false;
+        } else {
+            if (!window.pollEvent(event)) return false;
+            if (recorder) recorder->addEvent(event);
+        }
+        ++eventsHandled;
+        return true;
+    }
+
+    sf::Vector2f toView(int x, int y) const { return target->mapPixelToCoords(sf::Vector2i(x, y)); }
+
+    // Replays take the recorded answer instead of opening the dialog.
+    template <typename Dialog>
+    bool choosePath(std::string& path, Dialog openDialog) {
+        if (replay) return replay->takeDialogResult(path);
+        const char* picked = openDialog();
+        if (!picked) return false;
+        path = picked;
+        if (recorder) recorder->addDialogResult(path);
+        return true;
+    }
+
+    bool pickFolder(std::string& folderPath) {
+        return choosePath(folderPath, [] { return tinyfd_selectFolderDialog("Select Music Folder", ""); });
+    }
+
+    static constexpr const char* PLAYLIST_PATTERNS[] = {"*.m3u", "*.m3u8", "*.pls", "*.xspf", "*.msxpl"};
+
+    void openPlaylist() {
+        std::string path;
+        if (!choosePath(path, [] {
+                return tinyfd_openFileDialog("Open Playlist", "", 5, PLAYLIST_PATTERNS, "Playlists", 0);
+            })) {
+            return;
+        }
+        importPlaylist(path).detach();
+        scrollOffset = 0.0f;
+    }
+
+    void savePlaylist() {
+        std::string path;
+        if (!choosePath(path, [] {
+                return tinyfd_saveFileDialog("Save Playlist", "playlist.m3u8", 5, PLAYLIST_PATTERNS, "Playlists");
+            })) {
+            return;
+        }
+        PlaylistFormat format;
+        if (!getPlaylistFormat(path, format)) path += ".m3u8";
+        exportPlaylist(path).detach();
+    }
+
+    // Ctrl+E renders the playlist to WAV files, Ctrl+Shift+E to FLAC.
+    void chooseExportFolder(bool flac) {
+        std::string directory;
+        if (!choosePath(directory, [] { return tinyfd_selectFolderDialog("Export Tracks To", ""); })) return;
+        exportTracks(directory, flac ? ExportFormat::Flac : ExportFormat::Wav).detach();
+    }
+
+    // Delete removes the track under the pointer; Alt+Up/Down moves it. N
+    // plays it next and Q adds it to the end of the up-next queue; Shift+Q
+    // clears the queue. The queue keys take no Ctrl or Alt, so shortcuts
+    // like Ctrl+Q never touch the queue. The handle comes from the snapshot
+    // on screen and stays valid however the playlist changed since.
+    void editHoveredTrack(const sf::Event::KeyEvent& key) {
+        bool plain = !key.control && !key.alt;
+        if (plain && key.shift && key.code == sf::Keyboard::Q) {
+            player.clearQueue();
+            return;
+        }
+        if (hoveredTrack < 0 || static_cast<size_t>(hoveredTrack) >= playlist->handles.size()) return;
+        TrackHandle track = playlist->handles[hoveredTrack];
+        if (key.code == sf::Keyboard::Delete) {
+            player.removeTracks({track});
+        } else if (key.alt && key.code == sf::Keyboard::Up && hoveredTrack > 0) {
+            // The highlight follows the moved track, so repeated presses keep moving it.
+            player.moveTrack(track, --hoveredTrack);
+        } else if (key.alt && key.code == sf::Keyboard::Down && static_cast<size_t>(hoveredTrack) + 1 < playlist->handles.size()) {
+            player.moveTrack(track, ++hoveredTrack);
+        } else if (plain && !key.shift && key.code == sf::Keyboard::N) {
+            player.playNext(track);
+        } else if (plain && !key.shift && key.code == sf::Keyboard::Q) {
+            player.addToQueue(track);
+        }
+    }
+
     void handleMouseClick(sf::Vector2f mousePos) {
         if (selectFolderButton.contains(mousePos)) {
-            std::cout << "Select Folder button Clicked\n";
-            const char* folderPath = tinyfd_selectFolderDialog("Select Music Folder", "");
-            if (folderPath) {
+            logDebug("Select Folder button clicked");
+            std::string folderPath;
+            if (pickFolder(folderPath)) {
                 folderPaths.push_back(folderPath);
-                player.loadFromFolder(folderPath);
+                importFolder(folderPath).detach();
                 scrollOffset = 0.0f;
             }
             return;
         } 
         if (playButton.contains(mousePos)) {
-            std::cout << "Play button Clicked\n";
-            if (!player.getPlaylist().empty()) {
-                player.play();
-                adjustScrollToCurrent();
-            }
+            logDebug("Play button clicked");
+            if (!playlist->paths.empty()) scrollTicket = player.play();
             return;
         } 
         if (pauseButton.contains(mousePos)) {
-            std::cout << "Pause button Clicked\n";
+            logDebug("Pause button clicked");
             player.pause();
             return;
         } 
         if (stopButton.contains(mousePos)) {
-            std::cout << "Stop button Clicked\n";
+            logDebug("Stop button clicked");
             player.stop();
             return;
         } 
         if (nextButton.contains(mousePos)) {
-            std::cout << "Next button Clicked\n";
-            player.next();
-            adjustScrollToCurrent();
+            logDebug("Next button clicked");
+            scrollTicket = player.next();
             return;
         } 
         if (prevButton.contains(mousePos)) {
-            std::cout << "Previous button Clicked\n";
-            player.previous();
-            adjustScrollToCurrent();
+            logDebug("Previous button clicked");
+            scrollTicket = player.previous();
             return;
         } 
         if (exitButton.contains(mousePos)) {
-            std::cout << "Close button Clicked\n";
-            window.close();
+            logDebug("Close button clicked");
+            close();
             return;
         }
-
-        float yOffset = PLAYLIST_TOP - scrollOffset;
-        size_t trackIndex = 0;
-        for (const auto& track : player.getPlaylist()) {
-            sf::FloatRect trackBounds(50, yOffset, 700, TRACK_HEIGHT);
-            if (trackBounds.contains(mousePos)) {
-                std::cout << "Track " << trackIndex << " Clicked\n";
-                player.setTrack(trackIndex);
-                adjustScrollToCurrent();
-                break;
+        if (volumeBounds().contains(mousePos)) {
+            state.volume = (mousePos.x - VOLUME_LEFT) / VOLUME_WIDTH * 100.0f;
+            player.setVolume(state.volume);
+            return;
+        }
+        if (normalizeBounds().contains(mousePos)) {
+            state.normalize = !state.normalize;
+            player.setNormalization(state.normalize);
+            return;
+        }
+        if (crossfadeBounds().contains(mousePos)) {
+            // Cycle off -> 2 s -> 5 s -> 10 s.
+            static const float steps[] = {0.0f, 2.0f, 5.0f, 10.0f};
+            size_t step = 0;
+            while (step < 3 && steps[step] < state.crossfade) step++;
+            state.crossfade = steps[(step + 1) % 4];
+            player.setCrossfade(state.crossfade);
+            return;
+        }
+        if (speedBounds().contains(mousePos)) {
+            static const float steps[] = {0.5f, 0.75f, 1.0f, 1.25f, 1.5f, 2.0f};
+            size_t step = 0;
+            while (step < 5 && steps[step] < state.speed - 0.01f) step++;
+            state.speed = steps[(step + 1) % 6];
+            player.setSpeed(state.speed);
+            return;
+        }
+        if (pitchBounds().contains(mousePos)) {
+            // Cycle the key up to +3 semitones, then from -3 back to 0.
+            int semitones = static_cast<int>(std::lround(state.pitch));
+            state.pitch = static_cast<float>(semitones >= 3 ? -3 : semitones + 1);
+            player.setPitch(state.pitch);
+            return;
+        }
+        if (timelineBounds().contains(mousePos)) {
+            if (state.durationUs > 0) {
+                draggingTimeline = true;
+                dragFraction = timelineFraction(mousePos);
             }
-            yOffset += TRACK_HEIGHT;
-            trackIndex++;
+            return;
         }
-    }
 
-    void handleMouseHover(sf::Vector2f mousePos) {
-        float yOffset = PLAYLIST_TOP - scrollOffset;
-        hoveredTrack = -1;
-        size_t trackIndex = 0;
-        for (const auto& track : player.getPlaylist()) {
-            sf::FloatRect trackBounds(50, yOffset, 700, TRACK_HEIGHT);
-            if (trackBounds.contains(mousePos)) {
-                hoveredTrack = trackIndex;
-                break;
-            }
-            yOffset += TRACK_HEIGHT;
-            trackIndex++;
+        int trackIndex = trackAt(mousePos);
+        if (trackIndex >= 0) {
+            logDebug("Track clicked", {{"index", trackIndex}});
+            playTrack(static_cast<size_t>(trackIndex)).detach();
         }
     }
 
+    void handleMouseHover(sf::Vector2f mousePos) { hoveredTrack = trackAt(mousePos); }
+
+    // The playlist row under `mousePos`, or -1; only rows inside the playlist
+    // area count, so the list's length doesn't matter.
+    int trackAt(sf::Vector2f mousePos) const {
+        if (mousePos.x < 50 || mousePos.x >= 750 || mousePos.y < PLAYLIST_TOP || mousePos.y >= PLAYLIST_BOTTOM) return -1;
+        size_t row = static_cast<size_t>((mousePos.y - PLAYLIST_TOP + scrollOffset) / TRACK_HEIGHT);
+        return row < playlist->paths.size() ? static_cast<int>(row) : -1;
+    }
+
     void render() {
-        window.clear(sf::Color(10, 10, 20));
+        TraceScope scope("render");
+        target->clear(sf::Color(10, 10, 20));
         renderPlaylist();
-        selectFolderButton.draw(window);
-        playButton.draw(window);
-        pauseButton.draw(window);
-        stopButton.draw(window);
-        nextButton.draw(window);
-        prevButton.draw(window);
-        exitButton.draw(window);
+        renderTimeline();
+        renderSpectrum();
+        renderVolume();
+        drawCalls += selectFolderButton.draw(*target);
+        drawCalls += playButton.draw(*target);
+        drawCalls += pauseButton.draw(*target);
+        drawCalls += stopButton.draw(*target);
+        drawCalls += nextButton.draw(*target);
+        drawCalls += prevButton.draw(*target);
+        drawCalls += exitButton.draw(*target);
+        drawCalls += hud.draw(*target);
+        if (target != &window) return;
+        TraceScope displayScope("window.display");
         window.display();
     }
 
     void renderPlaylist() {
+        TraceScope scope("renderPlaylist");
         sf::Text trackList;
         trackList.setFont(font);
         trackList.setCharacterSize(16);
-        float yOffset = PLAYLIST_TOP - scrollOffset;
-        size_t trackIndex = 0;
-        for (const auto& track : player.getPlaylist()) {
-            std::string trackName = track.substr(track.find_last_of("/") + 1);
-            if (trackName.length() > 50) trackName = trackName.substr(0, 47) + "...";
-            trackList.setString(std::to_string(trackIndex + 1) + ". " + trackName);
+        sf::Text durationText;
+        durationText.setFont(font);
+        durationText.setCharacterSize(16);
+        // Only rows wholly inside the playlist area are laid out and drawn.
+        for (size_t trackIndex = static_cast<size_t>(scrollOffset / TRACK_HEIGHT); trackIndex < playlist->paths.size(); ++trackIndex) {
+            float yOffset = PLAYLIST_TOP + trackIndex * TRACK_HEIGHT - scrollOffset;
+            if (yOffset + TRACK_HEIGHT > PLAYLIST_BOTTOM) break;
+            if (yOffset < PLAYLIST_TOP) continue;
+            const TrackInfo& info = playlist->info[trackIndex];
+            std::string trackName = trackLabel(playlist->paths[trackIndex], info);
+            if (trackName.length() > 50) {
+                size_t cut = 47;
+                while (cut > 0 && (static_cast<unsigned char>(trackName[cut]) & 0xC0) == 0x80) cut--;
+                trackName = trackName.substr(0, cut) + "...";
+            }
+            std::string label = std::to_string(trackIndex + 1) + ". " + trackName;
+            // Bench snapshots carry no handles.
+            if (trackIndex < playlist->handles.size() && !state.queueHead.isNull() &&
+                playlist->handles[trackIndex] == state.queueHead) {
+                label = std::to_string(trackIndex + 1) + ". > " + trackName;
+                if (state.queueLength > 1) label += " (+" + std::to_string(state.queueLength - 1) + " queued)";
+            }
+            trackList.setString(sf::String::fromUtf8(label.begin(), label.end()));
             float textWidth = trackList.getLocalBounds().width;
             float highlightWidth = std::max(textWidth + 20, 700.0f);
 
-            if (yOffset >= PLAYLIST_TOP && yOffset <= PLAYLIST_BOTTOM) {
-                sf::RectangleShape highlightBox(sf::Vector2f(highlightWidth, TRACK_HEIGHT));
-                highlightBox.setPosition(50, yOffset);
-                if (trackIndex == player.getCurrentTrack() && player.getIsPlaying()) {
-                    highlightBox.setFillColor(sf::Color(0, 255, 0, 150));
-                    trackList.setFillColor(sf::Color::Black);
-                } else if (trackIndex == player.getCurrentTrack() || trackIndex == hoveredTrack) {
-                    highlightBox.setFillColor(sf::Color(0, 255, 255, 150));
-                    trackList.setFillColor(sf::Color::Black);
-                } else {
-                    highlightBox.setFillColor(sf::Color(0, 0, 0, 0));
-                    trackList.setFillColor(sf::Color(0, 255, 255));
-                }
-                window.draw(highlightBox);
-                trackList.setPosition(50, yOffset);
-                window.draw(trackList);
+            sf::RectangleShape highlightBox(sf::Vector2f(highlightWidth, TRACK_HEIGHT));
+            highlightBox.setPosition(50, yOffset);
+            if (trackIndex == state.currentTrack && state.isPlaying) {
+                highlightBox.setFillColor(sf::Color(0, 255, 0, 150));
+                trackList.setFillColor(sf::Color::Black);
+            } else if (trackIndex == state.currentTrack || static_cast<int>(trackIndex) == hoveredTrack) {
+                highlightBox.setFillColor(sf::Color(0, 255, 255, 150));
+                trackList.setFillColor(sf::Color::Black);
+            } else {
+                highlightBox.setFillColor(sf::Color(0, 0, 0, 0));
+                trackList.setFillColor(sf::Color(0, 255, 255));
+            }
+            ++rowsRendered;
+            draw(highlightBox);
+            trackList.setPosition(50, yOffset);
+            draw(trackList);
+            if (info.durationMs > 0) {
+                durationText.setString(formatDuration(info.durationMs));
+                durationText.setFillColor(trackList.getFillColor());
+                durationText.setPosition(740 - durationText.getLocalBounds().width, yOffset);
+                draw(durationText);
             }
-            yOffset += TRACK_HEIGHT;
-            trackIndex++;
+        }
+    }
+
+    void updateSpectrum() {
+        float deltaSeconds = frameClock.restart().asSeconds();
+        const SampleTap& tap = player.getSampleTap();
+        spectrum.update(tap, state.audibleFrame, state.isPlaying, deltaSeconds);
+    }
+
+    void renderSpectrum() {
+        const auto& bands = spectrum.getBands();
+        spectrumVertices.resize(4 * (bands.size() + 2));
+        float bottom = SPECTRUM_TOP + SPECTRUM_HEIGHT;
+        float barWidth = (SPECTRUM_WIDTH - 20.0f) / bands.size();
+        size_t v = 0;
+        auto quad = [&](float left, float width, float height, sf::Color color) {
+            spectrumVertices[v++] = sf::Vertex(sf::Vector2f(left, bottom - height), color);
+            spectrumVertices[v++] = sf::Vertex(sf::Vector2f(left + width, bottom - height), color);
+            spectrumVertices[v++] = sf::Vertex(sf::Vector2f(left + width, bottom), color);
+            spectrumVertices[v++] = sf::Vertex(sf::Vector2f(left, bottom), color);
+        };
+        for (size_t b = 0; b < bands.size(); ++b) {
+            quad(SPECTRUM_LEFT + b * barWidth, barWidth - 1.0f, bands[b] * SPECTRUM_HEIGHT, sf::Color(255, 0, 255, 200));
+        }
+        // Left/right VU meters to the right of the bars.
+        float vuLeft = SPECTRUM_LEFT + SPECTRUM_WIDTH - 16.0f;
+        quad(vuLeft, 6.0f, spectrum.getLevel(0) * SPECTRUM_HEIGHT, sf::Color(0, 255, 0, 200));
+        quad(vuLeft + 8.0f, 6.0f, spectrum.getLevel(1) * SPECTRUM_HEIGHT, sf::Color(0, 255, 0, 200));
+        draw(spectrumVertices);
+    }
+
+    void renderVolume() {
+        sf::RectangleShape bar(sf::Vector2f(VOLUME_WIDTH, VOLUME_HEIGHT));
+        bar.setPosition(VOLUME_LEFT, VOLUME_TOP);
+        bar.setFillColor(sf::Color(0, 255, 255, 40));
+        draw(bar);
+        bar.setSize(sf::Vector2f(VOLUME_WIDTH * state.volume / 100.0f, VOLUME_HEIGHT));
+        bar.setFillColor(sf::Color(0, 255, 255, 180));
+        draw(bar);
+
+        sf::Text label;
+        label.setFont(font);
+        label.setCharacterSize(14);
+        label.setFillColor(sf::Color(0, 255, 255));
+        label.setString("Vol " + std::to_string(static_cast<int>(state.volume + 0.5f)) + "%");
+        label.setPosition(VOLUME_LEFT, VOLUME_TOP + 14);
+        draw(label);
+        // Loudness normalization toggle
+        label.setString("RG");
+        label.setFillColor(state.normalize ? sf::Color(0, 255, 0) : sf::Color(80, 80, 80));
+        label.setPosition(VOLUME_LEFT + 58, VOLUME_TOP + 14);
+        draw(label);
+        // Crossfade length toggle
+        int crossfade = static_cast<int>(state.crossfade + 0.5f);
+        label.setString(crossfade > 0 ? "XF " + std::to_string(crossfade) + "s" : "XF off");
+        label.setFillColor(crossfade > 0 ? sf::Color(0, 255, 0) : sf::Color(80, 80, 80));
+        label.setPosition(CROSSFADE_LEFT, CROSSFADE_TOP);
+        draw(label);
+        // Playback speed and key
+        char text[16];
+        std::snprintf(text, sizeof(text), "%.2fx", state.speed);
+        label.setString(text);
+        label.setFillColor(state.speed != 1.0f ? sf::Color(0, 255, 0) : sf::Color(80, 80, 80));
+        label.setPosition(CROSSFADE_LEFT, SPEED_TOP);
+        draw(label);
+        int semitones = static_cast<int>(std::lround(state.pitch));
+        std::snprintf(text, sizeof(text), "Key %+d", semitones);
+        label.setString(text);
+        label.setFillColor(semitones != 0 ? sf::Color(0, 255, 0) : sf::Color(80, 80, 80));
+        label.setPosition(CROSSFADE_LEFT, PITCH_TOP);
+        draw(label);
+    }
+
+    sf::FloatRect volumeBounds() const {
+        return sf::FloatRect(VOLUME_LEFT, VOLUME_TOP - 4, VOLUME_WIDTH, VOLUME_HEIGHT + 8);
+    }
+
+    sf::FloatRect normalizeBounds() const {
+        return sf::FloatRect(VOLUME_LEFT + 54, VOLUME_TOP + 14, 26, 20);
+    }
+
+    sf::FloatRect crossfadeBounds() const {
+        return sf::FloatRect(CROSSFADE_LEFT - 4, CROSSFADE_TOP - 2, 60, 18);
+    }
+
+    sf::FloatRect speedBounds() const {
+        return sf::FloatRect(CROSSFADE_LEFT - 4, SPEED_TOP - 2, 60, 18);
+    }
+
+    sf::FloatRect pitchBounds() const {
+        return sf::FloatRect(CROSSFADE_LEFT - 4, PITCH_TOP - 2, 60, 18);
+    }
+
+    void renderTimeline() {
+        float duration = state.durationUs / 1e6f;
+        float position = state.positionUs / 1e6f;
+        float fraction = draggingTimeline ? dragFraction : (duration > 0 ? position / duration : 0.0f);
+        fraction = std::max(0.0f, std::min(fraction, 1.0f));
+
+        sf::RectangleShape track(sf::Vector2f(TIMELINE_WIDTH, TIMELINE_HEIGHT));
+        track.setPosition(TIMELINE_LEFT, TIMELINE_TOP);
+        track.setFillColor(sf::Color(0, 255, 255, 40));
+        draw(track);
+
+        std::shared_ptr<const Waveform> waveform;
+        if (state.currentTrack < playlist->paths.size()) waveform = waveforms.get(playlist->paths[state.currentTrack]);
+        if (waveform != shownWaveform) {
+            shownWaveform = waveform;
+            buildWaveformVertices();
+        }
+        if (shownWaveform) draw(waveformVertices);
+
+        sf::RectangleShape progress(sf::Vector2f(TIMELINE_WIDTH * fraction, TIMELINE_HEIGHT));
+        progress.setPosition(TIMELINE_LEFT, TIMELINE_TOP);
+        progress.setFillColor(shownWaveform ? sf::Color(255, 0, 255, 90) : sf::Color(0, 255, 255, 180));
+        draw(progress);
+
+        sf::Text timeText;
+        timeText.setFont(font);
+        timeText.setCharacterSize(14);
+        timeText.setFillColor(sf::Color(0, 255, 255));
+        timeText.setString(formatDuration(static_cast<uint32_t>(fraction * duration * 1000)) + " / " +
+                           formatDuration(static_cast<uint32_t>(duration * 1000)));
+        timeText.setPosition(TIMELINE_LEFT + TIMELINE_WIDTH + 10, TIMELINE_TOP + 6);
+        draw(timeText);
+    }
+
+    void buildWaveformVertices() {
+        waveformVertices.clear();
+        if (!shownWaveform) return;
+        float center = TIMELINE_TOP + TIMELINE_HEIGHT / 2.0f;
+        float scale = TIMELINE_HEIGHT / 2.0f / 32768.0f;
+        float x = TIMELINE_LEFT + 0.5f;
+        for (const auto& column : shownWaveform->columns) {
+            waveformVertices.append(sf::Vertex(sf::Vector2f(x, center - column.max * scale), sf::Color(0, 160, 160)));
+            waveformVertices.append(sf::Vertex(sf::Vector2f(x, center - column.min * scale), sf::Color(0, 160, 160)));
+            waveformVertices.append(sf::Vertex(sf::Vector2f(x, center - column.rms * scale), sf::Color(0, 255, 255)));
+            waveformVertices.append(sf::Vertex(sf::Vector2f(x, center + column.rms * scale), sf::Color(0, 255, 255)));
+            x += 1.0f;
+        }
+    }
+
+    sf::FloatRect timelineBounds() const {
+        // A little taller than the bar so it is easy to grab.
+        return sf::FloatRect(TIMELINE_LEFT, TIMELINE_TOP - 4, TIMELINE_WIDTH, TIMELINE_HEIGHT + 8);
+    }
+
+    float timelineFraction(sf::Vector2f mousePos) const {
+        return std::max(0.0f, std::min((mousePos.x - TIMELINE_LEFT) / TIMELINE_WIDTH, 1.0f));
+    }
+
+    static std::string trackLabel(const std::string& track, const TrackInfo& info) {
+        if (info.title().empty()) return track.substr(track.find_last_of("/") + 1);
+        std::string label;
+        if (!info.artist().empty()) {
+            label.append(info.artist());
+            label += " - ";
+        }
+        label.append(info.title());
+        return label;
+    }
+
+    static std::string formatDuration(uint32_t durationMs) {
+        uint32_t seconds = durationMs / 1000;
+        std::string secs = std::to_string(seconds % 60);
+        return std::to_string(seconds / 60) + ":" + (secs.size() < 2 ? "0" : "") + secs;
+    }
+
+    void updateVisibleRange() {
+        // Rows on screen get their metadata extracted before the rest of the playlist.
+        size_t first = static_cast<size_t>(scrollOffset / TRACK_HEIGHT);
+        size_t last = first + static_cast<size_t>((PLAYLIST_BOTTOM - PLAYLIST_TOP) / TRACK_HEIGHT) + 1;
+        if (first != visibleFirst || last != visibleLast) {
+            visibleFirst = first;
+            visibleLast = last;
+            player.setVisibleRange(first, last);
         }
     }
 
     void adjustScrollToCurrent() {
-        float currentY = PLAYLIST_TOP + player.getCurrentTrack() * TRACK_HEIGHT - scrollOffset;
+        adjustScrollToTrack(state.currentTrack);
+    }
+
+    void adjustScrollToTrack(size_t trackIndex) {
+        if (trackIndex >= playlist->paths.size()) return;
+        float currentY = PLAYLIST_TOP + trackIndex * TRACK_HEIGHT - scrollOffset;
         if (currentY < PLAYLIST_TOP) {
             scrollOffset -= (PLAYLIST_TOP - currentY);
         } else if (currentY + TRACK_HEIGHT > PLAYLIST_BOTTOM) {
@@ -220,7 +806,7 @@ private:
     }
 
     void clampScrollOffset() {
-        float maxScroll = std::max(0.0f, static_cast<float>(player.getPlaylist().size()) * TRACK_HEIGHT - (PLAYLIST_BOTTOM - PLAYLIST_TOP));
+        float maxScroll = std::max(0.0f, static_cast<float>(playlist->paths.size()) * TRACK_HEIGHT - (PLAYLIST_BOTTOM - PLAYLIST_TOP));
         scrollOffset = std::max(0.0f, std::min(scrollOffset, maxScroll));
     }
 };
\ No newline at end of file
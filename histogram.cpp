@@ -0,0 +1,52 @@
+#include "histogram.h"
+#include <algorithm>
+#include <cmath>
+
+// LatencyHistogram implementation
+size_t LatencyHistogram::bucketFor(uint64_t value) {
+    value = std::min(value, MAX_VALUE);
+    if (value < SUB_BUCKETS) return static_cast<size_t>(value);
+    // Keep the top SUB_BITS bits: the leading one picks the half-range,
+    // the rest the linear bucket within it.
+    unsigned shift = 63 - static_cast<unsigned>(__builtin_clzll(value)) - (SUB_BITS - 1);
+    return shift * (SUB_BUCKETS / 2) + static_cast<size_t>(value >> shift);
+}
+
+uint64_t LatencyHistogram::bucketUpperEdge(size_t bucket) {
+    if (bucket < SUB_BUCKETS) return bucket;
+    unsigned shift = static_cast<unsigned>(bucket / (SUB_BUCKETS / 2)) - 1;
+    uint64_t sub = bucket - shift * (SUB_BUCKETS / 2);
+    return ((sub + 1) << shift) - 1;
+}
+
+void LatencyHistogram::record(uint64_t value) {
+    ++counts[bucketFor(value)];
+    ++count;
+}
+
+void LatencyHistogram::remove(uint64_t value) {
+    size_t bucket = bucketFor(value);
+    if (counts[bucket] == 0) return;
+    --counts[bucket];
+    --count;
+}
+
+void LatencyHistogram::reset() {
+    counts.fill(0);
+    count = 0;
+}
+
+uint64_t LatencyHistogram::getCount() const { return count; }
+
+uint64_t LatencyHistogram::getPercentile(double fraction) const {
+    if (count == 0) return 0;
+    uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(std::clamp(fraction, 0.0, 1.0) * count)));
+    uint64_t seen = 0;
+    for (size_t bucket = 0; bucket < BUCKET_COUNT; ++bucket) {
+        seen += counts[bucket];
+        if (seen >= rank) return bucketUpperEdge(bucket);
+    }
+    return MAX_VALUE;
+}
+
+uint64_t LatencyHistogram::getMax() const { return getPercentile(1.0); }
@@ -0,0 +1,39 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+// Log-linear histogram in the style of HdrHistogram: each power of two is
+// split into SUB_BUCKETS/2 linear buckets, so any recorded value is known to
+// within ~3% from 0 to MAX_VALUE with a fixed 3.5 KB of counters. Recording
+// and removing never allocate; removing lets a caller keep a sliding window
+// by taking back the samples that fall out of it.
+class LatencyHistogram {
+public:
+    static constexpr unsigned SUB_BITS = 6;
+    static constexpr uint32_t SUB_BUCKETS = 1u << SUB_BITS;
+    static constexpr uint64_t MAX_VALUE = (uint64_t(1) << 32) - 1; // larger values are clamped
+    static constexpr size_t BUCKET_COUNT = (32 - SUB_BITS + 1) * (SUB_BUCKETS / 2) + SUB_BUCKETS / 2;
+
+    void record(uint64_t value);
+    // `value` must have been recorded and not yet removed.
+    void remove(uint64_t value);
+    void reset();
+
+    uint64_t getCount() const;
+    // Smallest value at or above the given fraction (0..1) of the samples,
+    // as the upper edge of its bucket; 0 when empty.
+    uint64_t getPercentile(double fraction) const;
+    uint64_t getMax() const;
+
+private:
+    static size_t bucketFor(uint64_t value);
+    static uint64_t bucketUpperEdge(size_t bucket);
+
+    std::array<uint32_t, BUCKET_COUNT> counts{};
+    uint64_t count = 0;
+};
+
+#endif // HISTOGRAM_H
@@ -0,0 +1,314 @@
+#include "input_recording.h"
+#include "logger.h"
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+namespace {
+
+constexpr char MAGIC[4] = {'M', 'S', 'X', 'I'};
+constexpr uint8_t VERSION = 1;
+constexpr uint64_t MAX_PATH_LENGTH = 4096;
+
+// Stable on disk, independent of sf::Event::EventType.
+enum class RecordedKind : uint8_t {
+    Closed,
+    Resized,
+    KeyPressed,
+    MouseWheelScrolled,
+    MouseButtonPressed,
+    MouseButtonReleased,
+    MouseMoved,
+    DialogResult
+};
+
+void putVarint(std::string& out, uint64_t value) {
+    while (value >= 0x80) {
+        out += static_cast<char>((value & 0x7F) | 0x80);
+        value >>= 7;
+    }
+    out += static_cast<char>(value);
+}
+
+void putSigned(std::string& out, int64_t value) {
+    putVarint(out, (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63));
+}
+
+class Reader {
+public:
+    Reader(const std::vector<uint8_t>& bytes) : data(bytes) {}
+
+    bool atEnd() const { return position == data.size(); }
+
+    bool byte(uint8_t& value) {
+        if (position >= data.size()) return false;
+        value = data[position++];
+        return true;
+    }
+
+    bool varint(uint64_t& value) {
+        value = 0;
+        for (unsigned shift = 0; shift < 64; shift += 7) {
+            uint8_t next;
+            if (!byte(next)) return false;
+            value |= static_cast<uint64_t>(next & 0x7F) << shift;
+            if (!(next & 0x80)) return true;
+        }
+        return false;
+    }
+
+    bool signedVarint(int& value) {
+        uint64_t raw;
+        if (!varint(raw)) return false;
+        value = static_cast<int>(static_cast<int64_t>(raw >> 1) ^ -static_cast<int64_t>(raw & 1));
+        return true;
+    }
+
+    bool bytes(void* out, size_t size) {
+        if (data.size() - position < size) return false;
+        std::memcpy(out, data.data() + position, size);
+        position += size;
+        return true;
+    }
+
+private:
+    const std::vector<uint8_t>& data;
+    size_t position = 0;
+};
+
+} // namespace
+
+// InputRecorder implementation
+InputRecorder::~InputRecorder() { close(); }
+
+bool InputRecorder::open(const std::string& path) {
+    close();
+    file = std::fopen(path.c_str(), "wb");
+    if (!file) {
+        logError("Failed to open input recording", {{"path", path}});
+        return false;
+    }
+    std::fwrite(MAGIC, 1, sizeof(MAGIC), file);
+    std::fputc(VERSION, file);
+    frames = 0;
+    frameOffset = 0;
+    inFrame = false;
+    logInfo("Recording input", {{"path", path}});
+    return true;
+}
+
+void InputRecorder::beginFrame() {
+    if (!file) return;
+    auto now = std::chrono::steady_clock::now();
+    if (inFrame) {
+        endFrame();
+        frameOffset = std::chrono::duration_cast<std::chrono::microseconds>(now - frameStart).count();
+    }
+    frameStart = now;
+    inFrame = true;
+    frame.clear();
+    frameEvents = 0;
+}
+
+void InputRecorder::addEvent(const sf::Event& event) {
+    if (!inFrame) return;
+    std::string& out = frame;
+    switch (event.type) {
+    case sf::Event::Closed:
+        out += static_cast<char>(RecordedKind::Closed);
+        break;
+    case sf::Event::Resized:
+        out += static_cast<char>(RecordedKind::Resized);
+        putVarint(out, event.size.width);
+        putVarint(out, event.size.height);
+        break;
+    case sf::Event::KeyPressed:
+        out += static_cast<char>(RecordedKind::KeyPressed);
+        putSigned(out, event.key.code);
+        out += static_cast<char>(event.key.alt | event.key.control << 1 | event.key.shift << 2 | event.key.system << 3);
+        break;
+    case sf::Event::MouseWheelScrolled: {
+        out += static_cast<char>(RecordedKind::MouseWheelScrolled);
+        putVarint(out, event.mouseWheelScroll.wheel);
+        char delta[sizeof(float)];
+        std::memcpy(delta, &event.mouseWheelScroll.delta, sizeof(delta));
+        out.append(delta, sizeof(delta));
+        putSigned(out, event.mouseWheelScroll.x);
+        putSigned(out, event.mouseWheelScroll.y);
+        break;
+    }
+    case sf::Event::MouseButtonPressed:
+    case sf::Event::MouseButtonReleased:
+        out += static_cast<char>(event.type == sf::Event::MouseButtonPressed ? RecordedKind::MouseButtonPressed
+                                                                             : RecordedKind::MouseButtonReleased);
+        putVarint(out, event.mouseButton.button);
+        putSigned(out, event.mouseButton.x);
+        putSigned(out, event.mouseButton.y);
+        break;
+    case sf::Event::MouseMoved:
+        out += static_cast<char>(RecordedKind::MouseMoved);
+        putSigned(out, event.mouseMove.x);
+        putSigned(out, event.mouseMove.y);
+        break;
+    default:
+        return; // not acted on, so not needed to reproduce a session
+    }
+    ++frameEvents;
+}
+
+void InputRecorder::addDialogResult(const std::string& path) {
+    if (!inFrame) return;
+    frame += static_cast<char>(RecordedKind::DialogResult);
+    putVarint(frame, path.size());
+    frame += path;
+    ++frameEvents;
+}
+
+void InputRecorder::endFrame() {
+    std::string header;
+    putVarint(header, frameOffset);
+    putVarint(header, frameEvents);
+    std::fwrite(header.data(), 1, header.size(), file);
+    std::fwrite(frame.data(), 1, frame.size(), file);
+    if (++frames % FLUSH_FRAMES == 0) std::fflush(file);
+}
+
+bool InputRecorder::close() {
+    if (!file) return true;
+    if (inFrame) endFrame();
+    inFrame = false;
+    bool ok = std::ferror(file) == 0;
+    ok = std::fclose(file) == 0 && ok;
+    file = nullptr;
+    if (!ok) logError("Failed to write input recording");
+    logInfo("Input recording closed", {{"frames", frames}});
+    return ok;
+}
+
+// InputReplay implementation
+bool InputReplay::open(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        logError("Failed to open input recording", {{"path", path}});
+        return false;
+    }
+    std::vector<uint8_t> bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    items.clear();
+    frames.clear();
+    nextFrameIndex = itemIndex = itemEnd = 0;
+
+    Reader reader(bytes);
+    char magic[sizeof(MAGIC)];
+    uint8_t version = 0;
+    if (!reader.bytes(magic, sizeof(magic)) || std::memcmp(magic, MAGIC, sizeof(MAGIC)) != 0 ||
+        !reader.byte(version) || version != VERSION) {
+        logError("Not an input recording", {{"path", path}});
+        return false;
+    }
+    std::chrono::microseconds start(0);
+    // A recording cut short by a crash ends in a partial frame; keep what came before.
+    while (!reader.atEnd()) {
+        uint64_t sincePrevious, count;
+        if (!reader.varint(sincePrevious) || !reader.varint(count)) break;
+        start += std::chrono::microseconds(sincePrevious);
+        Frame frame{start, items.size(), 0};
+        bool complete = true;
+        for (uint64_t i = 0; i < count && complete; ++i) {
+            Item item{};
+            sf::Event& event = item.event;
+            uint8_t kind;
+            uint64_t value;
+            complete = reader.byte(kind);
+            if (!complete) break;
+            switch (static_cast<RecordedKind>(kind)) {
+            case RecordedKind::Closed:
+                event.type = sf::Event::Closed;
+                break;
+            case RecordedKind::Resized: {
+                uint64_t width, height;
+                event.type = sf::Event::Resized;
+                complete = reader.varint(width) && reader.varint(height);
+                event.size.width = static_cast<unsigned>(width);
+                event.size.height = static_cast<unsigned>(height);
+                break;
+            }
+            case RecordedKind::KeyPressed: {
+                int code = 0;
+                uint8_t modifiers = 0;
+                event.type = sf::Event::KeyPressed;
+                complete = reader.signedVarint(code) && reader.byte(modifiers);
+                event.key.code = static_cast<sf::Keyboard::Key>(code);
+                event.key.alt = modifiers & 1;
+                event.key.control = modifiers & 2;
+                event.key.shift = modifiers & 4;
+                event.key.system = modifiers & 8;
+                break;
+            }
+            case RecordedKind::MouseWheelScrolled:
+                event.type = sf::Event::MouseWheelScrolled;
+                complete = reader.varint(value) &&
+                           reader.bytes(&event.mouseWheelScroll.delta, sizeof(event.mouseWheelScroll.delta)) &&
+                           reader.signedVarint(event.mouseWheelScroll.x) && reader.signedVarint(event.mouseWheelScroll.y);
+                event.mouseWheelScroll.wheel = static_cast<sf::Mouse::Wheel>(value);
+                break;
+            case RecordedKind::MouseButtonPressed:
+            case RecordedKind::MouseButtonReleased:
+                event.type = static_cast<RecordedKind>(kind) == RecordedKind::MouseButtonPressed
+                                 ? sf::Event::MouseButtonPressed
+                                 : sf::Event::MouseButtonReleased;
+                complete = reader.varint(value) && reader.signedVarint(event.mouseButton.x) &&
+                           reader.signedVarint(event.mouseButton.y);
+                event.mouseButton.button = static_cast<sf::Mouse::Button>(value);
+                break;
+            case RecordedKind::MouseMoved:
+                event.type = sf::Event::MouseMoved;
+                complete = reader.signedVarint(event.mouseMove.x) && reader.signedVarint(event.mouseMove.y);
+                break;
+            case RecordedKind::DialogResult:
+                complete = reader.varint(value) && value > 0 && value <= MAX_PATH_LENGTH;
+                if (complete) {
+                    item.dialogPath.resize(value);
+                    complete = reader.bytes(item.dialogPath.data(), value);
+                }
+                break;
+            default:
+                complete = false;
+            }
+            if (complete) items.push_back(std::move(item));
+        }
+        if (!complete) {
+            items.resize(frame.firstItem);
+            logWarn("Input recording is truncated", {{"path", path}, {"frames", frames.size()}});
+            break;
+        }
+        frame.itemCount = items.size() - frame.firstItem;
+        frames.push_back(frame);
+    }
+    logInfo("Input recording loaded", {{"path", path}, {"frames", frames.size()}, {"events", items.size()}});
+    return true;
+}
+
+size_t InputReplay::getFrameCount() const { return frames.size(); }
+
+bool InputReplay::nextFrame(std::chrono::microseconds& start) {
+    if (nextFrameIndex == frames.size()) return false;
+    const Frame& frame = frames[nextFrameIndex++];
+    start = frame.start;
+    itemIndex = frame.firstItem;
+    itemEnd = frame.firstItem + frame.itemCount;
+    return true;
+}
+
+bool InputReplay::pollEvent(sf::Event& event) {
+    // A dialog result nobody asked for (the click landed elsewhere this time) is dropped.
+    while (itemIndex < itemEnd && !items[itemIndex].dialogPath.empty()) ++itemIndex;
+    if (itemIndex == itemEnd) return false;
+    event = items[itemIndex++].event;
+    return true;
+}
+
+bool InputReplay::takeDialogResult(std::string& path) {
+    if (itemIndex == itemEnd || items[itemIndex].dialogPath.empty()) return false;
+    path = items[itemIndex++].dialogPath;
+    return true;
+}
@@ -0,0 +1,88 @@
+#ifndef INPUT_RECORDING_H
+#define INPUT_RECORDING_H
+
+#include <SFML/Window.hpp>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// UI sessions recorded frame by frame, so the scroll and hover storms that
+// stutter on real machines can be replayed against an offscreen UI and the
+// frame times compared between builds. Only the events
+// MusicPlayerUI::handleEvents acts on are kept, plus the path chosen in
+// each folder or playlist dialog, so a replay never opens a dialog.
+//
+// File: "MSXI" and a version byte, then per frame its start time relative to
+// the previous frame in microseconds and an event count, followed by the
+// events as a kind byte and their fields. All integers are varints, so an
+// idle frame takes four bytes.
+class InputRecorder {
+public:
+    static constexpr uint64_t FLUSH_FRAMES = 60; // a crash loses at most about a second
+
+    ~InputRecorder();
+
+    bool open(const std::string& path);
+    // UI thread, at the start of every frame; ends the previous one.
+    void beginFrame();
+    void addEvent(const sf::Event& event);
+    void addDialogResult(const std::string& path);
+    bool close();
+
+private:
+    void endFrame();
+
+    FILE* file = nullptr;
+    std::string frame; // encoded events of the frame in progress
+    uint64_t frameEvents = 0;
+    uint64_t frameOffset = 0; // microseconds after the previous frame started
+    uint64_t frames = 0;
+    bool inFrame = false;
+    std::chrono::steady_clock::time_point frameStart;
+};
+
+// What a replay measured for one frame.
+struct ReplayFrame {
+    uint64_t startMicroseconds = 0; // since the replay started
+    uint64_t workMicroseconds = 0;  // CPU side; offscreen frames are never presented
+    size_t events = 0;
+    size_t drawCalls = 0;
+    size_t rowsRendered = 0;
+};
+
+// Reads a whole recording up front and hands it out a frame at a time.
+class InputReplay {
+public:
+    bool open(const std::string& path);
+    size_t getFrameCount() const;
+
+    // Moves to the next frame; false once the recording is exhausted.
+    // `start` is the frame's offset from the start of the recording.
+    bool nextFrame(std::chrono::microseconds& start);
+    // Events of the current frame, in recorded order.
+    bool pollEvent(sf::Event& event);
+    // The path picked in the dialog opened by the event just polled, if the
+    // dialog wasn't cancelled.
+    bool takeDialogResult(std::string& path);
+
+private:
+    struct Item {
+        sf::Event event;
+        std::string dialogPath; // set for dialog results, which have no event
+    };
+    struct Frame {
+        std::chrono::microseconds start;
+        size_t firstItem;
+        size_t itemCount;
+    };
+
+    std::vector<Item> items;
+    std::vector<Frame> frames;
+    size_t nextFrameIndex = 0;
+    size_t itemIndex = 0;
+    size_t itemEnd = 0;
+};
+
+#endif // INPUT_RECORDING_H
@@ -0,0 +1,303 @@
+#include "logger.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace {
+
+// Records are a RecordHeader followed by fieldCount FieldHeaders, each string
+// field followed by its bytes, padded to 8 bytes. The pointers are string
+// literals, so only their addresses need to travel through the ring.
+struct RecordHeader {
+    uint64_t timeNs;
+    const char* event;
+    uint32_t size;
+    LogLevel level;
+    uint8_t fieldCount;
+};
+
+struct FieldHeader {
+    const char* key;
+    uint64_t value;        // bits of the int, uint, double or bool
+    uint16_t length;       // String: bytes that follow
+    LogField::Type type;
+};
+
+constexpr size_t alignRecord(size_t size) { return (size + 7) & ~size_t(7); }
+
+// Single producer (the owning thread), single consumer (the drain thread).
+struct LogRing {
+    explicit LogRing(unsigned number) : bytes(new unsigned char[Logger::RING_BYTES]), thread(number) {}
+
+    void copyIn(uint64_t position, const void* source, size_t size) {
+        size_t offset = position & (Logger::RING_BYTES - 1);
+        size_t first = std::min(size, Logger::RING_BYTES - offset);
+        std::memcpy(bytes.get() + offset, source, first);
+        std::memcpy(bytes.get(), static_cast<const unsigned char*>(source) + first, size - first);
+    }
+    void copyOut(uint64_t position, void* destination, size_t size) const {
+        size_t offset = position & (Logger::RING_BYTES - 1);
+        size_t first = std::min(size, Logger::RING_BYTES - offset);
+        std::memcpy(destination, bytes.get() + offset, first);
+        std::memcpy(static_cast<unsigned char*>(destination) + first, bytes.get(), size - first);
+    }
+
+    std::unique_ptr<unsigned char[]> bytes;
+    alignas(64) std::atomic<uint64_t> head{0}; // written by the owner
+    alignas(64) std::atomic<uint64_t> tail{0}; // written by the drain thread
+    std::atomic<uint64_t> dropped{0};
+    std::atomic<bool> retired{false};          // owner has exited
+    unsigned thread;
+};
+
+struct FormattedRecord {
+    uint64_t timeNs;
+    std::string line;
+};
+
+const char* levelName(LogLevel level) {
+    switch (level) {
+    case LogLevel::Debug: return "DEBUG";
+    case LogLevel::Info: return "INFO ";
+    case LogLevel::Warn: return "WARN ";
+    case LogLevel::Error: return "ERROR";
+    }
+    return "?    ";
+}
+
+void appendPrefix(std::string& line, uint64_t timeNs, LogLevel level, unsigned thread) {
+    char prefix[48];
+    std::snprintf(prefix, sizeof(prefix), "%10.6f %s [%u] ", timeNs * 1e-9, levelName(level), thread);
+    line += prefix;
+}
+
+void appendQuoted(std::string& line, const char* text, size_t length) {
+    line += '"';
+    for (size_t i = 0; i < length; ++i) {
+        char c = text[i];
+        if (c == '"' || c == '\\') {
+            line += '\\';
+            line += c;
+        } else if (c == '\n') {
+            line += "\\n";
+        } else {
+            line += c;
+        }
+    }
+    line += '"';
+}
+
+std::string formatRecord(const LogRing& ring, uint64_t position, const RecordHeader& header) {
+    std::string line;
+    appendPrefix(line, header.timeNs, header.level, ring.thread);
+    line += header.event;
+    position += sizeof(RecordHeader);
+    char text[Logger::MAX_TEXT];
+    for (uint8_t i = 0; i < header.fieldCount; ++i) {
+        FieldHeader field;
+        ring.copyOut(position, &field, sizeof(field));
+        position += sizeof(field);
+        line += ' ';
+        line += field.key;
+        line += '=';
+        switch (field.type) {
+        case LogField::Type::Int:
+            line += std::to_string(static_cast<int64_t>(field.value));
+            break;
+        case LogField::Type::Uint:
+            line += std::to_string(field.value);
+            break;
+        case LogField::Type::Float: {
+            double value;
+            std::memcpy(&value, &field.value, sizeof(value));
+            char number[32];
+            std::snprintf(number, sizeof(number), "%g", value);
+            line += number;
+            break;
+        }
+        case LogField::Type::Bool:
+            line += field.value ? "true" : "false";
+            break;
+        case LogField::Type::String:
+            ring.copyOut(position, text, field.length);
+            position += field.length;
+            appendQuoted(line, text, field.length);
+            break;
+        }
+    }
+    line += '\n';
+    return line;
+}
+
+class LogDrain {
+public:
+    LogDrain() : start(std::chrono::steady_clock::now()), thread([this] { run(); }) {}
+
+    ~LogDrain() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        thread.join();
+    }
+
+    std::shared_ptr<LogRing> addRing() {
+        std::lock_guard<std::mutex> lock(mutex);
+        rings.push_back(std::make_shared<LogRing>(nextThread++));
+        return rings.back();
+    }
+
+    uint64_t now() const {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    void flush() {
+        std::unique_lock<std::mutex> lock(mutex);
+        uint64_t request = ++requested;
+        wake.notify_all();
+        drainedCondition.wait(lock, [&] { return drained >= request || stopping; });
+    }
+
+private:
+    void run() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            wake.wait_for(lock, std::chrono::milliseconds(Logger::DRAIN_INTERVAL_MS),
+                          [this] { return stopping || requested > drained; });
+            bool last = stopping;
+            uint64_t target = requested;
+            std::vector<std::shared_ptr<LogRing>> snapshot = rings;
+            lock.unlock();
+
+            drainOnce(snapshot);
+
+            lock.lock();
+            // A retired ring was drained after its owner's last write, so it
+            // can go once it's empty.
+            rings.erase(std::remove_if(rings.begin(), rings.end(),
+                                       [](const std::shared_ptr<LogRing>& ring) {
+                                           return ring->retired.load(std::memory_order_acquire) &&
+                                                  ring->tail.load(std::memory_order_relaxed) ==
+                                                      ring->head.load(std::memory_order_acquire);
+                                       }),
+                        rings.end());
+            drained = target;
+            drainedCondition.notify_all();
+            if (last) return;
+        }
+    }
+
+    void drainOnce(const std::vector<std::shared_ptr<LogRing>>& snapshot) {
+        records.clear();
+        for (const auto& ring : snapshot) {
+            uint64_t head = ring->head.load(std::memory_order_acquire);
+            uint64_t position = ring->tail.load(std::memory_order_relaxed);
+            while (position < head) {
+                RecordHeader header;
+                ring->copyOut(position, &header, sizeof(header));
+                records.push_back({header.timeNs, formatRecord(*ring, position, header)});
+                position += header.size;
+            }
+            ring->tail.store(position, std::memory_order_release);
+
+            uint64_t dropped = ring->dropped.exchange(0, std::memory_order_relaxed);
+            if (dropped > 0) {
+                FormattedRecord record{now(), {}};
+                appendPrefix(record.line, record.timeNs, LogLevel::Warn, ring->thread);
+                record.line += "Log records dropped count=" + std::to_string(dropped) + "\n";
+                records.push_back(std::move(record));
+            }
+        }
+        if (records.empty()) return;
+
+        // Each ring is already in order; merge them into one timeline.
+        std::stable_sort(records.begin(), records.end(),
+                         [](const FormattedRecord& a, const FormattedRecord& b) { return a.timeNs < b.timeNs; });
+        output.clear();
+        for (const auto& record : records) output += record.line;
+        std::cout << output << std::flush;
+    }
+
+    const std::chrono::steady_clock::time_point start;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable drainedCondition;
+    std::vector<std::shared_ptr<LogRing>> rings;
+    unsigned nextThread = 0;
+    uint64_t requested = 0;
+    uint64_t drained = 0;
+    bool stopping = false;
+    // Drain thread only; kept to reuse their capacity.
+    std::vector<FormattedRecord> records;
+    std::string output;
+    std::thread thread; // last: starts running in the constructor
+};
+
+LogDrain& logDrain() {
+    static LogDrain drain;
+    return drain;
+}
+
+// Marks the ring retired when its thread exits; the drain thread keeps it
+// alive until the last records are printed.
+struct ThreadRing {
+    std::shared_ptr<LogRing> ring;
+    ~ThreadRing() {
+        if (ring) ring->retired.store(true, std::memory_order_release);
+    }
+};
+
+thread_local ThreadRing threadRing;
+
+} // namespace
+
+// Logger implementation
+void Logger::write(LogLevel level, const char* event, std::initializer_list<LogField> fields) {
+    LogDrain& drain = logDrain();
+    if (!threadRing.ring) threadRing.ring = drain.addRing();
+    LogRing& ring = *threadRing.ring;
+
+    size_t size = sizeof(RecordHeader);
+    for (const auto& field : fields) {
+        size += sizeof(FieldHeader);
+        if (field.type == LogField::Type::String) size += std::min(field.text.size(), MAX_TEXT);
+    }
+    size = alignRecord(size);
+
+    uint64_t head = ring.head.load(std::memory_order_relaxed);
+    if (size > RING_BYTES - (head - ring.tail.load(std::memory_order_acquire))) {
+        ring.dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    RecordHeader header{drain.now(), event, static_cast<uint32_t>(size), level, static_cast<uint8_t>(fields.size())};
+    ring.copyIn(head, &header, sizeof(header));
+    uint64_t position = head + sizeof(header);
+    for (const auto& field : fields) {
+        FieldHeader out{field.key, 0, 0, field.type};
+        if (field.type == LogField::Type::String) {
+            out.length = static_cast<uint16_t>(std::min(field.text.size(), MAX_TEXT));
+        } else {
+            std::memcpy(&out.value, &field.uintValue, sizeof(out.value));
+        }
+        ring.copyIn(position, &out, sizeof(out));
+        position += sizeof(out);
+        if (out.length > 0) {
+            ring.copyIn(position, field.text.data(), out.length);
+            position += out.length;
+        }
+    }
+    ring.head.store(head + size, std::memory_order_release);
+}
+
+void Logger::flush() { logDrain().flush(); }
@@ -0,0 +1,83 @@
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <cstdint>
+#include <initializer_list>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+enum class LogLevel : uint8_t { Debug, Info, Warn, Error };
+
+// Levels below this are compiled out: their calls reduce to nothing, though
+// the arguments are still evaluated, so keep them cheap. -DLOG_MIN_LEVEL=0
+// brings back debug output.
+#ifndef LOG_MIN_LEVEL
+#define LOG_MIN_LEVEL 1
+#endif
+
+// One key=value pair. Keys must be string literals; string values are copied
+// into the record when it is written.
+struct LogField {
+    enum class Type : uint8_t { Int, Uint, Float, Bool, String };
+
+    template <typename T, typename = std::enable_if_t<std::is_arithmetic<T>::value>>
+    LogField(const char* fieldKey, T value) : key(fieldKey) {
+        if constexpr (std::is_same<T, bool>::value) {
+            type = Type::Bool;
+            uintValue = value;
+        } else if constexpr (std::is_floating_point<T>::value) {
+            type = Type::Float;
+            floatValue = value;
+        } else if constexpr (std::is_signed<T>::value) {
+            type = Type::Int;
+            intValue = value;
+        } else {
+            type = Type::Uint;
+            uintValue = value;
+        }
+    }
+    LogField(const char* fieldKey, std::string_view value) : key(fieldKey), type(Type::String), text(value) {}
+    LogField(const char* fieldKey, const std::string& value) : LogField(fieldKey, std::string_view(value)) {}
+    LogField(const char* fieldKey, const char* value) : LogField(fieldKey, std::string_view(value)) {}
+
+    const char* key;
+    Type type;
+    union {
+        int64_t intValue;
+        uint64_t uintValue;
+        double floatValue;
+    };
+    std::string_view text;
+};
+
+// Structured logging that never blocks the caller. Each thread writes binary
+// records into its own lock-free ring; a background thread drains the rings
+// every DRAIN_INTERVAL_MS, orders the records by time and only then formats
+// them as text. A full ring drops the record and counts it rather than wait.
+class Logger {
+public:
+    static constexpr size_t RING_BYTES = 1 << 16;   // per thread, power of two
+    static constexpr size_t MAX_TEXT = 512;         // longer string values are cut
+    static constexpr unsigned DRAIN_INTERVAL_MS = 20;
+
+    // Any thread. `event` must be a string literal.
+    static void write(LogLevel level, const char* event, std::initializer_list<LogField> fields);
+    // Blocks until everything logged before the call has been printed.
+    static void flush();
+};
+
+inline void logDebug(const char* event, std::initializer_list<LogField> fields = {}) {
+    if constexpr (LOG_MIN_LEVEL <= 0) Logger::write(LogLevel::Debug, event, fields);
+}
+inline void logInfo(const char* event, std::initializer_list<LogField> fields = {}) {
+    if constexpr (LOG_MIN_LEVEL <= 1) Logger::write(LogLevel::Info, event, fields);
+}
+inline void logWarn(const char* event, std::initializer_list<LogField> fields = {}) {
+    if constexpr (LOG_MIN_LEVEL <= 2) Logger::write(LogLevel::Warn, event, fields);
+}
+inline void logError(const char* event, std::initializer_list<LogField> fields = {}) {
+    Logger::write(LogLevel::Error, event, fields);
+}
+
+#endif // LOGGER_H
@@ -0,0 +1,287 @@
+#include "loudness.h"
+#include "file_cache.h"
+#include <SFML/Audio.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+constexpr double PI = 3.14159265358979323846;
+constexpr double ABSOLUTE_GATE_LUFS = -70.0;
+constexpr double RELATIVE_GATE_LU = -10.0;
+constexpr size_t DECODE_CHUNK = 1 << 16;
+constexpr char LOUDNESS_MAGIC[4] = {'M', 'S', 'X', 'L'};
+
+double energyToLufs(double energy) { return -0.691 + 10.0 * std::log10(energy); }
+double lufsToEnergy(double lufs) { return std::pow(10.0, (lufs + 0.691) / 10.0); }
+
+} // namespace
+
+LoudnessMeter::LoudnessMeter(unsigned sampleRate, unsigned channelCount)
+    : channelCount(channelCount),
+      state(4 * channelCount, 0.0),
+      weights(channelCount, 1.0),
+      subBlockSum(channelCount, 0.0),
+      subBlockFrames(std::max(1u, sampleRate / 10)),
+      history(2 * FIR_TAPS * channelCount, 0.0f) {
+    // K-weighting coefficients for an arbitrary rate (BS.1770 pre-filter + RLB high-pass).
+    double fs = sampleRate;
+    double f0 = 1681.974450955533, gain = 3.999843853973347, q = 0.7071752369554196;
+    double k = std::tan(PI * f0 / fs);
+    double vh = std::pow(10.0, gain / 20.0);
+    double vb = std::pow(vh, 0.4996667741545416);
+    double a0 = 1.0 + k / q + k * k;
+    shelf = {(vh + vb * k / q + k * k) / a0, 2.0 * (k * k - vh) / a0, (vh - vb * k / q + k * k) / a0,
+             2.0 * (k * k - 1.0) / a0, (1.0 - k / q + k * k) / a0};
+    f0 = 38.13547087602444;
+    q = 0.5003270373238773;
+    k = std::tan(PI * f0 / fs);
+    a0 = 1.0 + k / q + k * k;
+    highpass = {1.0, -2.0, 1.0, 2.0 * (k * k - 1.0) / a0, (1.0 - k / q + k * k) / a0};
+
+    // Surround channels count 1.41x; the LFE of a 5.1 layout does not count.
+    for (unsigned c = 3; c < channelCount; ++c) weights[c] = 1.41;
+    if (channelCount == 6) weights[3] = 0.0;
+
+    // 48-tap Hann windowed sinc interpolator for 4x oversampling, split into phases.
+    const size_t length = FIR_PHASES * FIR_TAPS;
+    double center = (length - 1) / 2.0;
+    for (size_t p = 0; p < FIR_PHASES; ++p) {
+        double sum = 0.0;
+        double taps[FIR_TAPS];
+        for (size_t t = 0; t < FIR_TAPS; ++t) {
+            size_t n = p + FIR_PHASES * (FIR_TAPS - 1 - t);
+            double x = (n - center) / FIR_PHASES;
+            double sinc = std::abs(x) < 1e-9 ? 1.0 : std::sin(PI * x) / (PI * x);
+            double window = 0.5 - 0.5 * std::cos(2.0 * PI * (n + 0.5) / length);
+            taps[t] = sinc * window;
+            sum += taps[t];
+        }
+        for (size_t t = 0; t < FIR_TAPS; ++t) fir[p][t] = static_cast<float>(taps[t] / sum);
+    }
+}
+
+void LoudnessMeter::addFrames(const int16_t* samples, size_t frames) {
+    for (size_t i = 0; i < frames; ++i) {
+        processFrame(samples + i * channelCount);
+        if (++subBlockFill == subBlockFrames) finishSubBlock();
+    }
+}
+
+void LoudnessMeter::processFrame(const int16_t* frame) {
+    const double scale = 1.0 / 32768.0;
+    double* z1 = &state[0];
+    double* z2 = &state[channelCount];
+    double* z3 = &state[2 * channelCount];
+    double* z4 = &state[3 * channelCount];
+    unsigned c = 0;
+#if defined(__SSE2__)
+    const __m128d sb0 = _mm_set1_pd(shelf.b0), sb1 = _mm_set1_pd(shelf.b1), sb2 = _mm_set1_pd(shelf.b2);
+    const __m128d sa1 = _mm_set1_pd(shelf.a1), sa2 = _mm_set1_pd(shelf.a2);
+    const __m128d hb0 = _mm_set1_pd(highpass.b0), hb1 = _mm_set1_pd(highpass.b1), hb2 = _mm_set1_pd(highpass.b2);
+    const __m128d ha1 = _mm_set1_pd(highpass.a1), ha2 = _mm_set1_pd(highpass.a2);
+    for (; c + 2 <= channelCount; c += 2) {
+        // Two channels per register, transposed direct form II for both stages.
+        __m128d x = _mm_mul_pd(_mm_set_pd(frame[c + 1], frame[c]), _mm_set1_pd(scale));
+        __m128d s1 = _mm_loadu_pd(z1 + c), s2 = _mm_loadu_pd(z2 + c);
+        __m128d y = _mm_add_pd(_mm_mul_pd(sb0, x), s1);
+        s1 = _mm_add_pd(_mm_sub_pd(_mm_mul_pd(sb1, x), _mm_mul_pd(sa1, y)), s2);
+        s2 = _mm_sub_pd(_mm_mul_pd(sb2, x), _mm_mul_pd(sa2, y));
+        _mm_storeu_pd(z1 + c, s1);
+        _mm_storeu_pd(z2 + c, s2);
+
+        __m128d s3 = _mm_loadu_pd(z3 + c), s4 = _mm_loadu_pd(z4 + c);
+        __m128d out = _mm_add_pd(_mm_mul_pd(hb0, y), s3);
+        s3 = _mm_add_pd(_mm_sub_pd(_mm_mul_pd(hb1, y), _mm_mul_pd(ha1, out)), s4);
+        s4 = _mm_sub_pd(_mm_mul_pd(hb2, y), _mm_mul_pd(ha2, out));
+        _mm_storeu_pd(z3 + c, s3);
+        _mm_storeu_pd(z4 + c, s4);
+
+        __m128d sum = _mm_add_pd(_mm_loadu_pd(&subBlockSum[c]), _mm_mul_pd(out, out));
+        _mm_storeu_pd(&subBlockSum[c], sum);
+    }
+#endif
+    for (; c < channelCount; ++c) {
+        double x = frame[c] * scale;
+        double y = shelf.b0 * x + z1[c];
+        z1[c] = shelf.b1 * x - shelf.a1 * y + z2[c];
+        z2[c] = shelf.b2 * x - shelf.a2 * y;
+        double out = highpass.b0 * y + z3[c];
+        z3[c] = highpass.b1 * y - highpass.a1 * out + z4[c];
+        z4[c] = highpass.b2 * y - highpass.a2 * out;
+        subBlockSum[c] += out * out;
+    }
+
+    for (unsigned ch = 0; ch < channelCount; ++ch) {
+        peak = std::max(peak, truePeakOf(ch, static_cast<float>(frame[ch] * scale)));
+    }
+    historyPos = (historyPos + 1) % FIR_TAPS;
+}
+
+float LoudnessMeter::truePeakOf(size_t channel, float sample) {
+    float* h = &history[channel * 2 * FIR_TAPS];
+    h[historyPos] = sample;
+    h[historyPos + FIR_TAPS] = sample;
+    const float* window = h + historyPos + 1; // oldest .. newest, always contiguous
+    float best = std::abs(sample);
+    for (size_t p = 0; p < FIR_PHASES; ++p) {
+        float y;
+#if defined(__SSE2__)
+        __m128 acc = _mm_mul_ps(_mm_loadu_ps(fir[p]), _mm_loadu_ps(window));
+        acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(fir[p] + 4), _mm_loadu_ps(window + 4)));
+        acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(fir[p] + 8), _mm_loadu_ps(window + 8)));
+        acc = _mm_add_ps(acc, _mm_movehl_ps(acc, acc));
+        acc = _mm_add_ss(acc, _mm_shuffle_ps(acc, acc, 1));
+        y = _mm_cvtss_f32(acc);
+#else
+        y = 0.0f;
+        for (size_t t = 0; t < FIR_TAPS; ++t) y += fir[p][t] * window[t];
+#endif
+        best = std::max(best, std::abs(y));
+    }
+    return best;
+}
+
+void LoudnessMeter::finishSubBlock() {
+    double energy = 0.0;
+    for (unsigned c = 0; c < channelCount; ++c) {
+        energy += weights[c] * subBlockSum[c] / subBlockFill;
+        subBlockSum[c] = 0.0;
+    }
+    subBlockFill = 0;
+    // A 400 ms gating block is four 100 ms sub-blocks, advancing one sub-block at a time.
+    recentSubBlocks.push_back(energy);
+    if (recentSubBlocks.size() > 4) recentSubBlocks.erase(recentSubBlocks.begin());
+    if (recentSubBlocks.size() == 4) {
+        blockEnergies.push_back((recentSubBlocks[0] + recentSubBlocks[1] + recentSubBlocks[2] + recentSubBlocks[3]) / 4.0);
+    }
+}
+
+float LoudnessMeter::getIntegratedLoudness() const {
+    double absoluteGate = lufsToEnergy(ABSOLUTE_GATE_LUFS);
+    double sum = 0.0;
+    size_t count = 0;
+    for (double e : blockEnergies) {
+        if (e > absoluteGate) { sum += e; ++count; }
+    }
+    if (count == 0) return static_cast<float>(ABSOLUTE_GATE_LUFS);
+
+    double relativeGate = lufsToEnergy(energyToLufs(sum / count) + RELATIVE_GATE_LU);
+    double gate = std::max(absoluteGate, relativeGate);
+    sum = 0.0;
+    count = 0;
+    for (double e : blockEnergies) {
+        if (e > gate) { sum += e; ++count; }
+    }
+    return count == 0 ? static_cast<float>(ABSOLUTE_GATE_LUFS) : static_cast<float>(energyToLufs(sum / count));
+}
+
+float LoudnessMeter::getTruePeak() const {
+    return 20.0f * std::log10(std::max(peak, 1e-6f));
+}
+
+bool analyzeLoudness(const std::string& filepath, LoudnessInfo& info) {
+    sf::InputSoundFile file;
+    if (!file.openFromFile(filepath) || file.getChannelCount() == 0) return false;
+    unsigned channels = file.getChannelCount();
+    LoudnessMeter meter(file.getSampleRate(), channels);
+    std::vector<sf::Int16> buffer(DECODE_CHUNK - DECODE_CHUNK % channels);
+    while (uint64_t read = file.read(buffer.data(), buffer.size())) {
+        meter.addFrames(buffer.data(), static_cast<size_t>(read / channels));
+    }
+    info.integratedLufs = meter.getIntegratedLoudness();
+    info.truePeakDb = meter.getTruePeak();
+    return true;
+}
+
+bool loadLoudness(const std::string& filepath, LoudnessInfo& info) {
+    FileIdentity expected, stored;
+    if (!getFileIdentity(filepath, expected)) return false;
+    std::string cachePath = getCachePath(expected, "loudness", ".lufs");
+    if (cachePath.empty()) return false;
+    std::ifstream in(cachePath, std::ios::binary);
+    char magic[4];
+    in.read(magic, sizeof(magic));
+    in.read(reinterpret_cast<char*>(&stored), sizeof(stored));
+    in.read(reinterpret_cast<char*>(&info), sizeof(info));
+    return in && std::memcmp(magic, LOUDNESS_MAGIC, 4) == 0 && stored == expected;
+}
+
+bool saveLoudness(const std::string& filepath, const LoudnessInfo& info) {
+    FileIdentity identity;
+    if (!getFileIdentity(filepath, identity)) return false;
+    std::string cachePath = getCachePath(identity, "loudness", ".lufs");
+    if (cachePath.empty()) return false;
+    std::string tmpPath = getTemporaryPath(cachePath);
+    bool ok;
+    {
+        std::ofstream out(tmpPath, std::ios::binary | std::ios::trunc);
+        out.write(LOUDNESS_MAGIC, sizeof(LOUDNESS_MAGIC));
+        out.write(reinterpret_cast<const char*>(&identity), sizeof(identity));
+        out.write(reinterpret_cast<const char*>(&info), sizeof(info));
+        out.close();
+        ok = static_cast<bool>(out);
+    }
+    if (ok && std::rename(tmpPath.c_str(), cachePath.c_str()) == 0) return true;
+    std::remove(tmpPath.c_str());
+    return false;
+}
+
+// LoudnessScanner implementation
+LoudnessScanner::LoudnessScanner() : pool(std::max(1u, std::thread::hardware_concurrency()), WorkerPool::Priority::Low) {}
+
+void LoudnessScanner::enqueue(size_t trackId, const std::string& filepath) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        pending.emplace_back(trackId, filepath);
+    }
+    pool.submit([this] { scanNext(); });
+}
+
+void LoudnessScanner::analyzeFirst(size_t trackId, const std::string& filepath) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (scanning.count(trackId)) return;
+        // Linear, but only when a track starts playing; a second entry would
+        // have another worker scan the same file at the same time.
+        auto queued = std::find_if(pending.begin(), pending.end(),
+                                   [trackId](const std::pair<size_t, std::string>& job) { return job.first == trackId; });
+        if (queued != pending.end()) pending.erase(queued);
+        pending.emplace_front(trackId, filepath);
+    }
+    pool.submit([this] { scanNext(); });
+}
+
+size_t LoudnessScanner::collect(std::vector<std::pair<size_t, LoudnessInfo>>& results) {
+    std::lock_guard<std::mutex> lock(mutex);
+    results.swap(finished);
+    finished.clear();
+    return results.size();
+}
+
+void LoudnessScanner::scanNext() {
+    std::pair<size_t, std::string> job;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (pending.empty()) return;
+        job = std::move(pending.front());
+        pending.pop_front();
+        scanning.insert(job.first);
+    }
+    LoudnessInfo info;
+    bool ok = loadLoudness(job.second, info);
+    if (!ok && analyzeLoudness(job.second, info)) {
+        saveLoudness(job.second, info);
+        ok = true;
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    scanning.erase(job.first);
+    if (ok) finished.emplace_back(job.first, info);
+}
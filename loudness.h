@@ -0,0 +1,80 @@
+#ifndef LOUDNESS_H
+#define LOUDNESS_H
+
+#include "worker_pool.h"
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+struct LoudnessInfo {
+    float integratedLufs = 0.0f;
+    float truePeakDb = 0.0f;
+};
+
+// EBU R128 / ITU-R BS.1770-4 meter: K-weighting, gated integrated loudness
+// over 400 ms blocks with 75% overlap, and 4x oversampled true peak.
+// Channels are filtered in pairs with SSE2 double lanes.
+class LoudnessMeter {
+public:
+    LoudnessMeter(unsigned sampleRate, unsigned channelCount);
+
+    void addFrames(const int16_t* samples, size_t frames);
+    float getIntegratedLoudness() const; // LUFS, -70 for silence
+    float getTruePeak() const;           // dBTP
+
+private:
+    struct Biquad {
+        double b0, b1, b2, a1, a2;
+    };
+    static constexpr size_t FIR_PHASES = 4;
+    static constexpr size_t FIR_TAPS = 12; // per phase
+
+    void processFrame(const int16_t* frame);
+    void finishSubBlock();
+    float truePeakOf(size_t channel, float sample);
+
+    unsigned channelCount;
+    Biquad shelf, highpass;
+    std::vector<double> state;      // 4 values per channel per biquad
+    std::vector<double> weights;
+    std::vector<double> subBlockSum;
+    size_t subBlockFrames;
+    size_t subBlockFill = 0;
+    std::vector<double> recentSubBlocks; // last 4 per-subblock weighted energies
+    std::vector<double> blockEnergies;
+    float fir[FIR_PHASES][FIR_TAPS];
+    std::vector<float> history;     // 2 * FIR_TAPS per channel, mirrored so reads are contiguous
+    size_t historyPos = 0;
+    float peak = 0.0f;
+};
+
+bool analyzeLoudness(const std::string& filepath, LoudnessInfo& info);
+bool loadLoudness(const std::string& filepath, LoudnessInfo& info);
+bool saveLoudness(const std::string& filepath, const LoudnessInfo& info);
+
+// Scans tracks on a low-priority pool, cache first. analyzeFirst() jumps the queue.
+class LoudnessScanner {
+public:
+    LoudnessScanner();
+
+    // `trackId` is whatever the caller matches results with.
+    void enqueue(size_t trackId, const std::string& filepath);
+    // Moves the track to the front of the queue; nothing if it's being scanned.
+    void analyzeFirst(size_t trackId, const std::string& filepath);
+    size_t collect(std::vector<std::pair<size_t, LoudnessInfo>>& results);
+
+private:
+    void scanNext();
+
+    std::mutex mutex;
+    std::deque<std::pair<size_t, std::string>> pending;
+    std::unordered_set<size_t> scanning;
+    std::vector<std::pair<size_t, LoudnessInfo>> finished;
+    WorkerPool pool;
+};
+
+#endif // LOUDNESS_H
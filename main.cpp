@@ -1,7 +1,211 @@
 #include "front_end.cpp"
+#include "control_server.h"
+#include "histogram.h"
+#include "input_recording.h"
+#include "metrics.h"
+#include "playlist_file.h"
+#include "session_store.h"
+#include <charconv>
+#include <csignal>
+#include <cstring>
+#include <fstream>
+#include <iostream>
 
-int main() {
+// msx_player_gui --export <dir> [--flac] [--threads N] [--no-normalize] [--metrics file] (playlist | file...)
+static int runExport(int argc, char** argv) {
+    std::string directory;
+    ExportFormat format = ExportFormat::Wav;
+    bool normalize = true;
+    size_t threads = 0;
+    bool valid = true;
+    std::vector<std::string> tracks;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--export") == 0 && i + 1 < argc) {
+            directory = argv[++i];
+        } else if (std::strcmp(argv[i], "--flac") == 0) {
+            format = ExportFormat::Flac;
+        } else if (std::strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            const char* count = argv[++i];
+            const char* end = count + std::strlen(count);
+            auto parsed = std::from_chars(count, end, threads);
+            valid = valid && parsed.ec == std::errc() && parsed.ptr == end;
+        } else if (std::strcmp(argv[i], "--no-normalize") == 0) {
+            normalize = false;
+        } else if (std::strcmp(argv[i], "--metrics") == 0 && i + 1 < argc) {
+            ++i; // handled in main()
+        } else {
+            PlaylistFormat format;
+            if (getPlaylistFormat(argv[i], format)) {
+                if (!readPlaylist(argv[i], tracks)) return 1;
+            } else {
+                tracks.push_back(argv[i]);
+            }
+        }
+    }
+    if (!valid || directory.empty() || tracks.empty()) {
+        std::cout << "usage: msx_player_gui --export <dir> [--flac] [--threads N] [--no-normalize] [--metrics file] (playlist | file...)\n";
+        return 1;
+    }
+
+    ExportSettings settings;
+    settings.outputDirectory = directory;
+    settings.format = format;
+    settings.sampleRate = MusicPlayer::OUTPUT_RATE;
+    settings.normalize = normalize;
+    settings.targetLufs = MusicPlayer::NORMALIZATION_TARGET_LUFS;
+    settings.ceilingDbtp = MusicPlayer::NORMALIZATION_CEILING_DBTP;
+    settings.threadCount = threads;
+    BatchExporter exporter(settings);
+    std::vector<ExportResult> results;
+    size_t written = exporter.run(tracks, results);
+    Logger::flush(); // per-track lines first
+    std::cout << written << " of " << tracks.size() << " tracks exported to " << directory << "\n";
+    return written == tracks.size() ? 0 : 1;
+}
+
+static ControlServer* daemonServer = nullptr;
+
+static void stopDaemon(int) {
+    if (daemonServer) daemonServer->stop();
+}
+
+// msx_player_gui --daemon <socket> [--null] [--no-normalize] [--metrics file] [playlist | file...]
+// Plays without a window, controlled through the socket (control_protocol.h).
+static int runDaemon(int argc, char** argv) {
+    std::string socketPath;
+    bool nullOutput = false;
+    bool normalize = true;
+    std::vector<std::string> tracks;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--daemon") == 0 && i + 1 < argc) {
+            socketPath = argv[++i];
+        } else if (std::strcmp(argv[i], "--null") == 0) {
+            nullOutput = true;
+        } else if (std::strcmp(argv[i], "--no-normalize") == 0) {
+            normalize = false;
+        } else if (std::strcmp(argv[i], "--metrics") == 0 && i + 1 < argc) {
+            ++i; // handled in main()
+        } else {
+            PlaylistFormat format;
+            if (getPlaylistFormat(argv[i], format)) {
+                if (!readPlaylist(argv[i], tracks)) return 1;
+            } else {
+                tracks.push_back(argv[i]);
+            }
+        }
+    }
+    if (socketPath.empty()) {
+        std::cout << "usage: msx_player_gui --daemon <socket> [--null] [--no-normalize] [--metrics file] [playlist | file...]\n";
+        return 1;
+    }
+
+    std::unique_ptr<AudioSink> sink;
+    if (nullOutput) sink = std::make_unique<NullSink>();
+    PlayerController player(std::move(sink));
+    player.setNormalization(normalize);
+    for (size_t i = 0; i < tracks.size(); ++i) {
+        uint64_t ticket = player.addToPlaylist(tracks[i]);
+        // Let the control thread catch up before the command queue fills.
+        if ((i + 1) % (PlayerController::QUEUE_SIZE / 2) == 0) player.wait(ticket, ControlServer::APPLY_TIMEOUT);
+    }
+
+    ControlServer server(player, socketPath);
+    if (!server.open()) return 1;
+    daemonServer = &server;
+    std::signal(SIGINT, stopDaemon);
+    std::signal(SIGTERM, stopDaemon);
+    std::signal(SIGPIPE, SIG_IGN);
+    server.run();
+    daemonServer = nullptr;
+    player.wait(player.stop(), ControlServer::APPLY_TIMEOUT);
+    return 0;
+}
+
+// msx_player_gui --replay-input <file> [--fast] [--frames out.csv] [--metrics file]
+// Replays a session recorded with --record-input against an offscreen UI
+// with no audio output, and reports how long each frame took.
+static int runReplay(int argc, char** argv) {
+    std::string inputPath;
+    std::string framesPath;
+    bool paced = true;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--replay-input") == 0 && i + 1 < argc) {
+            inputPath = argv[++i];
+        } else if (std::strcmp(argv[i], "--fast") == 0) {
+            paced = false;
+        } else if (std::strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+            framesPath = argv[++i];
+        } else if (std::strcmp(argv[i], "--metrics") == 0 && i + 1 < argc) {
+            ++i; // handled in main()
+        } else {
+            inputPath.clear();
+            break;
+        }
+    }
+    if (inputPath.empty()) {
+        std::cout << "usage: msx_player_gui --replay-input <file> [--fast] [--frames out.csv] [--metrics file]\n";
+        return 1;
+    }
+
+    InputReplay input;
+    if (!input.open(inputPath)) return 1;
+    sf::RenderTexture texture;
+    if (!texture.create(800, 600)) {
+        logError("Failed to create offscreen render target");
+        return 1;
+    }
+    MusicPlayerUI app(texture, std::make_unique<NullSink>());
+    std::vector<ReplayFrame> frames = app.replayInput(input, paced);
+
+    if (!framesPath.empty()) {
+        std::ofstream out(framesPath);
+        out << "frame,start_us,work_us,events,draw_calls,rows\n";
+        for (size_t i = 0; i < frames.size(); ++i) {
+            const ReplayFrame& frame = frames[i];
+            out << i << ',' << frame.startMicroseconds << ',' << frame.workMicroseconds << ',' << frame.events << ','
+                << frame.drawCalls << ',' << frame.rowsRendered << '\n';
+        }
+        if (!out) logError("Failed to write frame times", {{"path", framesPath}});
+    }
+
+    LatencyHistogram workTimes;
+    size_t slowFrames = 0;
+    for (const ReplayFrame& frame : frames) {
+        workTimes.record(frame.workMicroseconds);
+        if (frame.workMicroseconds > 16667) ++slowFrames;
+    }
+    Logger::flush();
+    std::cout << frames.size() << " of " << input.getFrameCount() << " frames replayed"
+              << (paced ? "" : " unpaced") << "; work p50 " << workTimes.getPercentile(0.5) << " us, p90 "
+              << workTimes.getPercentile(0.9) << " us, p99 " << workTimes.getPercentile(0.99) << " us, max "
+              << workTimes.getMax() << " us; " << slowFrames << " over 16.7 ms\n";
+    return 0;
+}
+
+// --metrics <file> in any mode: Prometheus text, rewritten every 10 seconds.
+int main(int argc, char** argv) {
+    std::unique_ptr<MetricsFileWriter> metricsWriter;
+    for (int i = 1; i + 1 < argc; ++i) {
+        if (std::strcmp(argv[i], "--metrics") == 0) metricsWriter = std::make_unique<MetricsFileWriter>(argv[i + 1]);
+    }
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--export") == 0) return runExport(argc, argv);
+        if (std::strcmp(argv[i], "--daemon") == 0) return runDaemon(argc, argv);
+        if (std::strcmp(argv[i], "--replay-input") == 0) return runReplay(argc, argv);
+    }
+    // --record-input <file>: the session's input, for --replay-input.
+    InputRecorder recorder;
+    // --no-session: start empty and don't save the session either.
+    SessionStore session(SessionStore::defaultDirectory());
     MusicPlayerUI app;
+    bool resume = true;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--no-session") == 0) resume = false;
+        if (std::strcmp(argv[i], "--record-input") == 0 && i + 1 < argc && recorder.open(argv[i + 1])) {
+            app.setInputRecorder(&recorder);
+        }
+    }
+    if (resume) app.resumeSession(session);
     app.run();
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,68 @@
+#include "mapped_file.h"
+#include "logger.h"
+#include <utility>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// MappedFile implementation
+MappedFile::~MappedFile() { close(); }
+
+MappedFile::MappedFile(MappedFile&& other) noexcept
+    : address(std::exchange(other.address, nullptr)),
+      length(std::exchange(other.length, 0)),
+      opened(std::exchange(other.opened, false)) {}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept {
+    if (this != &other) {
+        close();
+        address = std::exchange(other.address, nullptr);
+        length = std::exchange(other.length, 0);
+        opened = std::exchange(other.opened, false);
+    }
+    return *this;
+}
+
+bool MappedFile::open(const std::string& path, Access access) {
+    close();
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        logError("Failed to open file", {{"path", path}});
+        return false;
+    }
+    struct stat info;
+    if (::fstat(fd, &info) != 0 || !S_ISREG(info.st_mode)) {
+        ::close(fd);
+        logError("Not a regular file", {{"path", path}});
+        return false;
+    }
+    length = static_cast<size_t>(info.st_size);
+    if (length > 0) {
+        address = ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (address == MAP_FAILED) {
+            address = nullptr;
+            length = 0;
+            ::close(fd);
+            logError("Failed to map file", {{"path", path}});
+            return false;
+        }
+        ::madvise(address, length, access == Access::Sequential ? MADV_SEQUENTIAL : MADV_RANDOM);
+    }
+    // The mapping keeps the file alive on its own.
+    ::close(fd);
+    opened = true;
+    return true;
+}
+
+void MappedFile::close() {
+    if (address) ::munmap(address, length);
+    address = nullptr;
+    length = 0;
+    opened = false;
+}
+
+bool MappedFile::isOpen() const { return opened; }
+const char* MappedFile::data() const { return static_cast<const char*>(address); }
+size_t MappedFile::size() const { return length; }
+std::string_view MappedFile::view() const { return std::string_view(data(), length); }
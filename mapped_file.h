@@ -0,0 +1,40 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+// Read-only memory map of a whole file. Parsers work on the mapping directly
+// instead of copying the file into a buffer first; the kernel pages it in
+// as it's read. An empty file opens as an empty view.
+class MappedFile {
+public:
+    enum class Access {
+        Sequential, // read ahead aggressively, e.g. a parser going front to back
+        Random      // no read-ahead, e.g. records looked up by index
+    };
+
+    MappedFile() = default;
+    ~MappedFile();
+
+    MappedFile(MappedFile&& other) noexcept;
+    MappedFile& operator=(MappedFile&& other) noexcept;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool open(const std::string& path, Access access = Access::Sequential);
+    void close();
+
+    bool isOpen() const;
+    const char* data() const;
+    size_t size() const;
+    std::string_view view() const;
+
+private:
+    void* address = nullptr;
+    size_t length = 0;
+    bool opened = false;
+};
+
+#endif // MAPPED_FILE_H
@@ -0,0 +1,198 @@
+#include "metrics.h"
+#include "logger.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#ifdef __linux__
+#include <unistd.h>
+#endif
+
+namespace {
+
+struct MetricRegistry {
+    std::mutex mutex;
+    std::vector<const Metric*> metrics;
+};
+
+MetricRegistry& metricRegistry() {
+    static MetricRegistry registry;
+    return registry;
+}
+
+void appendNumber(std::string& out, double value) {
+    char number[32];
+    std::snprintf(number, sizeof(number), "%.9g", value);
+    out += number;
+}
+
+MetricGauge residentMemory("msx_resident_memory_bytes", "Resident set size");
+
+} // namespace
+
+// Metric implementation
+Metric::Metric(const char* metricName, const char* metricHelp) : name(metricName), help(metricHelp) {
+    MetricRegistry& registry = metricRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    registry.metrics.push_back(this);
+}
+
+Metric::~Metric() {
+    MetricRegistry& registry = metricRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    registry.metrics.erase(std::remove(registry.metrics.begin(), registry.metrics.end(), this), registry.metrics.end());
+}
+
+const char* Metric::getName() const { return name; }
+
+void Metric::renderHeader(std::string& out, const char* type) const {
+    out += "# HELP ";
+    out += name;
+    out += ' ';
+    out += help;
+    out += "\n# TYPE ";
+    out += name;
+    out += ' ';
+    out += type;
+    out += '\n';
+}
+
+// MetricCounter implementation
+void MetricCounter::add(uint64_t amount) { value.fetch_add(amount, std::memory_order_relaxed); }
+uint64_t MetricCounter::get() const { return value.load(std::memory_order_relaxed); }
+
+void MetricCounter::render(std::string& out) const {
+    renderHeader(out, "counter");
+    out += name;
+    out += ' ';
+    out += std::to_string(get());
+    out += '\n';
+}
+
+// MetricGauge implementation
+void MetricGauge::set(double newValue) { value.store(newValue, std::memory_order_relaxed); }
+double MetricGauge::get() const { return value.load(std::memory_order_relaxed); }
+
+void MetricGauge::render(std::string& out) const {
+    renderHeader(out, "gauge");
+    out += name;
+    out += ' ';
+    appendNumber(out, get());
+    out += '\n';
+}
+
+// MetricHistogram implementation
+MetricHistogram::MetricHistogram(const char* name, const char* help, std::initializer_list<double> upperBoundsSeconds)
+    : Metric(name, help) {
+    for (double bound : upperBoundsSeconds) {
+        if (boundCount == MAX_BUCKETS) break;
+        bounds[boundCount++] = bound;
+    }
+}
+
+void MetricHistogram::observe(std::chrono::nanoseconds duration) {
+    double seconds = duration.count() * 1e-9;
+    size_t bucket = std::lower_bound(bounds.begin(), bounds.begin() + boundCount, seconds) - bounds.begin();
+    counts[bucket].fetch_add(1, std::memory_order_relaxed);
+    sumNanoseconds.fetch_add(static_cast<uint64_t>(std::max<int64_t>(duration.count(), 0)), std::memory_order_relaxed);
+}
+
+void MetricHistogram::render(std::string& out) const {
+    renderHeader(out, "histogram");
+    // Buckets and sum are read separately, so a scrape racing an update can
+    // be one observation apart; Prometheus tolerates that.
+    uint64_t cumulative = 0;
+    for (size_t i = 0; i <= boundCount; ++i) {
+        cumulative += counts[i].load(std::memory_order_relaxed);
+        out += name;
+        out += "_bucket{le=\"";
+        if (i < boundCount) {
+            appendNumber(out, bounds[i]);
+        } else {
+            out += "+Inf";
+        }
+        out += "\"} ";
+        out += std::to_string(cumulative);
+        out += '\n';
+    }
+    out += name;
+    out += "_sum ";
+    appendNumber(out, sumNanoseconds.load(std::memory_order_relaxed) * 1e-9);
+    out += '\n';
+    out += name;
+    out += "_count ";
+    out += std::to_string(cumulative);
+    out += '\n';
+}
+
+// Metrics implementation
+std::string Metrics::render() {
+    residentMemory.set(static_cast<double>(readResidentBytes()));
+    MetricRegistry& registry = metricRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    std::vector<const Metric*> sorted = registry.metrics;
+    std::sort(sorted.begin(), sorted.end(),
+              [](const Metric* a, const Metric* b) { return std::strcmp(a->getName(), b->getName()) < 0; });
+    std::string out;
+    for (const Metric* metric : sorted) metric->render(out);
+    return out;
+}
+
+uint64_t Metrics::readResidentBytes() {
+#ifdef __linux__
+    // statm: total and resident size, in pages.
+    FILE* statm = std::fopen("/proc/self/statm", "r");
+    if (!statm) return 0;
+    unsigned long long pages = 0, resident = 0;
+    int fields = std::fscanf(statm, "%llu %llu", &pages, &resident);
+    std::fclose(statm);
+    if (fields != 2) return 0;
+    return resident * static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+#else
+    return 0;
+#endif
+}
+
+// MetricsFileWriter implementation
+MetricsFileWriter::MetricsFileWriter(std::string filePath) : path(std::move(filePath)), thread([this] { run(); }) {}
+
+MetricsFileWriter::~MetricsFileWriter() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    thread.join();
+}
+
+bool MetricsFileWriter::writeNow() {
+    std::string text = Metrics::render();
+    std::string temporary = path + ".tmp";
+    FILE* file = std::fopen(temporary.c_str(), "w");
+    if (!file) {
+        logError("Failed to write metrics", {{"path", temporary}});
+        return false;
+    }
+    bool ok = std::fwrite(text.data(), 1, text.size(), file) == text.size();
+    ok = std::fclose(file) == 0 && ok;
+    if (ok && std::rename(temporary.c_str(), path.c_str()) != 0) {
+        logError("Failed to replace metrics file", {{"path", path}});
+        ok = false;
+    }
+    if (!ok) std::remove(temporary.c_str());
+    return ok;
+}
+
+void MetricsFileWriter::run() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (!stopping) {
+        lock.unlock();
+        writeNow();
+        lock.lock();
+        wake.wait_for(lock, INTERVAL, [this] { return stopping; });
+    }
+    // One last write so the file reflects the final counts.
+    lock.unlock();
+    writeNow();
+}
@@ -0,0 +1,114 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <initializer_list>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// Process-wide counters, gauges and duration histograms in Prometheus text
+// format. Each metric is a static object next to the code it measures and
+// registers itself on construction; updating one is a relaxed atomic add, so
+// the audio and render threads never wait on a scrape.
+//
+//     namespace { MetricCounter tracksPlayed("msx_tracks_played_total", "Tracks started"); }
+//     tracksPlayed.add();
+class Metric {
+public:
+    Metric(const char* name, const char* help);
+    virtual ~Metric();
+
+    Metric(const Metric&) = delete;
+    Metric& operator=(const Metric&) = delete;
+
+    const char* getName() const;
+    // Appends the # HELP / # TYPE lines and samples.
+    virtual void render(std::string& out) const = 0;
+
+protected:
+    void renderHeader(std::string& out, const char* type) const;
+
+    const char* name;
+    const char* help;
+};
+
+class MetricCounter : public Metric {
+public:
+    using Metric::Metric;
+    void add(uint64_t amount = 1);
+    uint64_t get() const;
+    void render(std::string& out) const override;
+
+private:
+    std::atomic<uint64_t> value{0};
+};
+
+class MetricGauge : public Metric {
+public:
+    using Metric::Metric;
+    void set(double value);
+    double get() const;
+    void render(std::string& out) const override;
+
+private:
+    std::atomic<double> value{0.0};
+};
+
+// Durations into fixed buckets, given in seconds. Counts are kept per bucket
+// and accumulated when rendered, as Prometheus expects cumulative buckets.
+class MetricHistogram : public Metric {
+public:
+    static constexpr size_t MAX_BUCKETS = 16;
+
+    MetricHistogram(const char* name, const char* help, std::initializer_list<double> upperBoundsSeconds);
+    void observe(std::chrono::nanoseconds duration);
+    void render(std::string& out) const override;
+
+private:
+    std::array<double, MAX_BUCKETS> bounds{};
+    size_t boundCount = 0;
+    std::array<std::atomic<uint64_t>, MAX_BUCKETS + 1> counts{}; // last: above every bound
+    std::atomic<uint64_t> sumNanoseconds{0};
+};
+
+class Metrics {
+public:
+    // Every registered metric, sorted by name. Takes the registry lock, which
+    // only registration and other renders contend for.
+    static std::string render();
+    // Resident set size, or 0 where it can't be read.
+    static uint64_t readResidentBytes();
+};
+
+// Rewrites a Prometheus text file every INTERVAL for the node_exporter
+// textfile collector (or anything else that reads files). Each write goes to
+// a temporary file that is renamed over the target, so readers never see a
+// partial file.
+class MetricsFileWriter {
+public:
+    static constexpr auto INTERVAL = std::chrono::seconds(10);
+
+    explicit MetricsFileWriter(std::string path);
+    ~MetricsFileWriter();
+
+    MetricsFileWriter(const MetricsFileWriter&) = delete;
+    MetricsFileWriter& operator=(const MetricsFileWriter&) = delete;
+
+    bool writeNow();
+
+private:
+    void run();
+
+    std::string path;
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool stopping = false;
+    std::thread thread;
+};
+
+#endif // METRICS_H
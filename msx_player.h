@@ -1,33 +1,156 @@
 #ifndef MUSIC_PLAYER_H
 #define MUSIC_PLAYER_H
 
+#include "audio_engine.h"
+#include "audio_sink.h"
+#include "batch_export.h"
+#include "loudness.h"
+#include "seek_index.h"
+#include "track_metadata.h"
+#include "track_table.h"
 #include <SFML/Audio.hpp>
 #include <SFML/Graphics.hpp>
+#include <deque>
 #include <filesystem>
+#include <memory>
+#include <mutex>
 #include <vector>
 #include <string>
 
 namespace fs = std::filesystem;
 
 class MusicPlayer {
+public:
+    // ReplayGain 2.0 reference level; gain is limited to keep true peaks under -1 dBTP.
+    static constexpr float NORMALIZATION_TARGET_LUFS = -18.0f;
+    static constexpr float NORMALIZATION_CEILING_DBTP = -1.0f;
+    // Every track is resampled to this rate, so the device is configured once.
+    static constexpr unsigned OUTPUT_RATE = 48000;
+
 private:
-    sf::Music music;
-    std::vector<std::string> playlist;
-    size_t currentTrack;
+    PlaybackEngine engine;
+    std::unique_ptr<AudioSink> sink;
+    PreampStage* preamp;
+    EqualizerStage* equalizer;
+    LimiterStage* limiter;
+    TrackTable tracks;
+    TrackHandle currentTrack;
+    // Where playlist order continues from: the current track, unless that
+    // came from the up-next queue.
+    TrackHandle playlistTrack;
+    // Set when playlistTrack is removed: what to continue with instead.
+    TrackHandle followingTrack;
+    std::deque<TrackHandle> upNext; // played before playlist order resumes
+    TrackHandle queuedTrack; // handed to the engine by prepareNext()
     bool isPlaying;
+    uint64_t audibleTrack;
+    size_t visibleFirst = 0;
+    size_t visibleLast = 0;
+    sf::Time currentDuration;
+    sf::Time nextDuration;
+    sf::Time resumeOffset; // where play() starts the current track, once
+    float volume;
+    bool normalize;
+    ResamplerQuality resamplerQuality;
+    MetadataExtractor metadataExtractor;
+    LoudnessScanner loudnessScanner;
+    std::mutex seekIndexMutex;
+    std::string seekIndexPath;
+    std::shared_ptr<const SeekIndex> seekIndex;
+    WorkerPool indexPool;
+
+    std::unique_ptr<TrackDecoder> openTrack(TrackHandle track);
+    bool startTrack(bool crossfade, std::unique_ptr<TrackDecoder> decoder = nullptr);
+    void selectTrack(TrackHandle track);
+    TrackHandle getNextTrack() const;
+    void consumeNext(TrackHandle track);
+    void prepareNext();
+    void refreshNext();
+    void afterEdit();
+    void updateVisibleTracks();
+    float trackGain(TrackHandle track) const;
+    void updateGain();
+    void requestSeekIndex(const std::string& filepath);
+    void publishSeekIndex(const std::string& filepath, std::shared_ptr<const SeekIndex> index);
 
 public:
-    MusicPlayer();
+    // Plays to the audio device unless another sink is given.
+    explicit MusicPlayer(std::unique_ptr<AudioSink> output = nullptr);
+    // Stops playback and switches output, e.g. to a NullSink for headless runs.
+    void setSink(std::unique_ptr<AudioSink> output);
+    const AudioSink& getSink() const;
     void addToPlaylist(const std::string& filepath);
+    // With metadata already known, e.g. from a binary playlist: tags aren't
+    // read again if `known` is loaded, nor loudness rescanned if it has it.
+    void addToPlaylist(const std::string& filepath, const TrackInfo& known);
     void loadFromFolder(const std::string& folderPath);
+    // Stale handles are skipped. Removing the current track lets it play on;
+    // next() then continues with what followed it.
+    size_t removeTracks(const std::vector<TrackHandle>& handles);
+    bool moveTrack(TrackHandle track, size_t toIndex);
+    // The up-next queue: next() and the end of a track take from it before
+    // continuing in playlist order from where it left off. Entries are
+    // handles, so the queue is unaffected by moves; removed tracks drop out.
+    // While playing, the head is kept opened in the engine like any next track.
+    bool playNext(TrackHandle track);
+    bool addToQueue(TrackHandle track);
+    void clearQueue();
+    const std::deque<TrackHandle>& getQueue() const;
     bool play();
+    // Selects a track to continue from `offset`, e.g. from a saved session;
+    // starts it now if `playing`, otherwise on the next play().
+    void resumeAt(size_t trackIndex, sf::Time offset, bool playing);
     void pause();
     void stop();
     void next();
     void previous();
-    void setTrack(size_t trackIndex);
-    const std::vector<std::string>& getPlaylist() const;
+    // A decoder already opened for the track, e.g. on an I/O thread, is used
+    // instead of opening the file here.
+    void setTrack(size_t trackIndex, std::unique_ptr<TrackDecoder> opened = nullptr);
+    bool seek(sf::Time offset);
+    sf::Time getPlayingOffset() const;
+    sf::Time getDuration() const;
+    void setVolume(float percent);
+    float getVolume() const;
+    void setNormalization(bool enabled);
+    bool getNormalization() const;
+    // 0 disables crossfading; track changes are then gapless cuts.
+    void setCrossfade(float seconds, CrossfadeCurve curve = CrossfadeCurve::EqualPower);
+    float getCrossfade() const;
+    // 0.5x-2x without changing pitch.
+    void setSpeed(float speed);
+    float getSpeed() const;
+    // Semitones, -12 to +12, without changing speed.
+    void setPitch(float semitones);
+    float getPitch() const;
+    void setResamplerQuality(ResamplerQuality quality);
+    ResamplerQuality getResamplerQuality() const;
+    // Post-mix DSP; stage setters are lock-free and safe to call while playing.
+    PreampStage& getPreamp();
+    EqualizerStage& getEqualizer();
+    LimiterStage& getLimiter();
+    void getDspCosts(std::vector<DspStageCost>& costs) const;
+    // What a BatchExporter needs to render tracks with the current
+    // normalization, DSP and speed/pitch settings.
+    ExportSettings getExportSettings(const std::string& directory, ExportFormat format) const;
+    // Follows automatic track changes; call once per frame.
+    void update();
+    // Tracks whose tags or loudness arrived are appended to `refreshed`.
+    size_t pollMetadata(std::vector<TrackHandle>& refreshed);
+    void setVisibleRange(size_t first, size_t last);
+    const TrackTable& getPlaylist() const;
+    // Any thread; what openTrack() uses, for opening ahead of setTrack().
+    static std::unique_ptr<TrackDecoder> openDecoder(const std::string& filepath, ResamplerQuality quality);
+    const TrackInfo& getTrackInfo(size_t trackIndex) const;
+    const SampleTap& getSampleTap() const;
+    AudioSink::Stats getSinkStats() const;
+    uint64_t getAudibleFrame() const;
+    // TrackTable::NOT_FOUND once the current track has been removed.
     size_t getCurrentTrack() const;
+    TrackHandle getCurrentHandle() const;
+    // The track at the audible frame: lags getCurrentHandle() after a change
+    // until the sink has played out what was queued before it.
+    TrackHandle getAudibleHandle() const;
     bool getIsPlaying() const;
 };
 
@@ -40,7 +163,8 @@ private:
 public:
     Button(const std::string& label, float x, float y, float width, float height, const sf::Color& color, sf::Font& font, 
            unsigned int textSize = 20, float originOffsetX = 0.0f, float originOffsetY = 0.0f);
-    void draw(sf::RenderWindow& window);
+    // Returns the number of draw calls made.
+    size_t draw(sf::RenderTarget& target);
     bool contains(sf::Vector2f point);
     void setClicked(bool clicked);
     bool getClicked() const;
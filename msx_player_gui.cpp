@@ -1,103 +1,569 @@
 #include "msx_player.h"
-#include <iostream>
+#include "file_cache.h"
+#include "logger.h"
+#include "metrics.h"
+#include "playlist_file.h"
 #include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <unordered_set>
 
-MusicPlayer::MusicPlayer() : currentTrack(0), isPlaying(false) {}
+namespace {
 
-void MusicPlayer::addToPlaylist(const std::string& filepath) {
-    if (std::find(playlist.begin(), playlist.end(), filepath) == playlist.end()) {
-        playlist.push_back(filepath);
+MetricCounter tracksPlayedMetric("msx_tracks_played_total", "Tracks started, by request or by advancing");
+MetricCounter openFailuresMetric("msx_track_open_failures_total", "Tracks that could not be opened");
+MetricHistogram openLatencyMetric("msx_track_open_seconds", "Time to open a track's decoder",
+                                  {0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5});
+
+// ISO octave centres; the outer bands are shelves.
+std::vector<EqBand> defaultEqBands() {
+    const float centres[] = {31.0f, 62.0f, 125.0f, 250.0f, 500.0f, 1000.0f, 2000.0f, 4000.0f, 8000.0f, 16000.0f};
+    std::vector<EqBand> bands;
+    for (float centre : centres) {
+        EqBand band;
+        band.frequency = centre;
+        band.q = 1.41f;
+        bands.push_back(band);
     }
+    bands.front().type = EqBand::Type::LowShelf;
+    bands.back().type = EqBand::Type::HighShelf;
+    return bands;
+}
+
+} // namespace
+
+MusicPlayer::MusicPlayer(std::unique_ptr<AudioSink> output)
+    : sink(output ? std::move(output) : std::make_unique<DeviceSink>()), isPlaying(false), audibleTrack(0), volume(100.0f), normalize(true),
+      resamplerQuality(ResamplerQuality::Best),
+      indexPool(1, WorkerPool::Priority::Low) {
+    DspChain& dsp = engine.getDsp();
+    preamp = dsp.insert(0, std::make_unique<PreampStage>());
+    equalizer = dsp.insert(1, std::make_unique<EqualizerStage>(defaultEqBands()));
+    limiter = dsp.insert(2, std::make_unique<LimiterStage>());
+    sink->open(engine, OUTPUT_RATE);
+}
+
+void MusicPlayer::setSink(std::unique_ptr<AudioSink> output) {
+    if (!output) return;
+    stop();
+    sink = std::move(output);
+    sink->open(engine, OUTPUT_RATE);
+    logInfo("Output", {{"sink", sink->getName()}});
+}
+
+const AudioSink& MusicPlayer::getSink() const { return *sink; }
+
+void MusicPlayer::addToPlaylist(const std::string& filepath) { addToPlaylist(filepath, TrackInfo{}); }
+
+void MusicPlayer::addToPlaylist(const std::string& filepath, const TrackInfo& known) {
+    TrackHandle track = tracks.add(filepath, known);
+    if (track.isNull()) return;
+    if (currentTrack.isNull()) selectTrack(track);
+    if (!known.loaded) metadataExtractor.enqueue(track.value(), filepath);
+    if (!known.hasLoudness) loudnessScanner.enqueue(track.value(), filepath);
+    // Appended right behind the playing track: queue it so it follows gaplessly.
+    if (isPlaying && queuedTrack.isNull() && getNextTrack() == track) prepareNext();
+    if (tracks.size() <= visibleLast) updateVisibleTracks();
 }
 
 void MusicPlayer::loadFromFolder(const std::string& folderPath) {
-    std::vector<std::string> supportedExtensions = {".mp3", ".wav", ".ogg", ".flac"};
-    try {
-        for (const auto& entry : fs::directory_iterator(folderPath)) {
-            std::string path = entry.path().string();
-            std::string ext = entry.path().extension().string();
-            std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
-            if (std::find(supportedExtensions.begin(), supportedExtensions.end(), ext) 
-                != supportedExtensions.end()) {
-                addToPlaylist(path);
-            }
+    std::vector<std::string> found;
+    if (!scanFolder(folderPath, found)) return;
+    for (const auto& path : found) addToPlaylist(path);
+    selectTrack(tracks.at(0));
+    logInfo("Loaded folder", {{"tracks", tracks.size()}, {"path", folderPath}});
+    play();
+}
+
+size_t MusicPlayer::removeTracks(const std::vector<TrackHandle>& handles) {
+    if (tracks.contains(playlistTrack) || tracks.contains(followingTrack)) {
+        // Find what playlist order leads on to once these are gone.
+        std::unordered_set<uint64_t> removing;
+        for (TrackHandle handle : handles) removing.insert(handle.value());
+        // A handle from an older snapshot can name a track that's already
+        // gone, and indexOf() has no position for it.
+        bool positionListed = tracks.contains(playlistTrack);
+        bool positionRemoved = positionListed && removing.count(playlistTrack.value()) > 0;
+        bool followingRemoved = !positionListed && tracks.contains(followingTrack) && removing.count(followingTrack.value()) > 0;
+        if (positionRemoved || followingRemoved) {
+            size_t index = positionRemoved ? tracks.indexOf(playlistTrack) + 1 : tracks.indexOf(followingTrack);
+            while (index < tracks.size() && removing.count(tracks.at(index).value())) ++index;
+            followingTrack = tracks.at(index);
         }
-        currentTrack = 0;
-        std::cout << "Loaded " << playlist.size() << " unique audio files from " << folderPath << "\n";
-        play();
-    } catch (const std::exception& e) {
-        std::cout << "Error loading folder: " << e.what() << "\n";
     }
+    size_t removed = tracks.remove(handles);
+    if (removed > 0) {
+        upNext.erase(std::remove_if(upNext.begin(), upNext.end(), [this](TrackHandle track) { return !tracks.contains(track); }),
+                     upNext.end());
+        logInfo("Removed tracks", {{"count", removed}, {"tracks", tracks.size()}});
+        afterEdit();
+    }
+    return removed;
+}
+
+bool MusicPlayer::moveTrack(TrackHandle track, size_t toIndex) {
+    if (!tracks.move(track, toIndex)) return false;
+    afterEdit();
+    return true;
+}
+
+bool MusicPlayer::playNext(TrackHandle track) {
+    if (!tracks.contains(track)) return false;
+    upNext.push_front(track);
+    refreshNext();
+    return true;
+}
+
+bool MusicPlayer::addToQueue(TrackHandle track) {
+    if (!tracks.contains(track)) return false;
+    upNext.push_back(track);
+    refreshNext();
+    return true;
+}
+
+void MusicPlayer::clearQueue() {
+    upNext.clear();
+    refreshNext();
+}
+
+const std::deque<TrackHandle>& MusicPlayer::getQueue() const { return upNext; }
+
+// The engine holds the next track already opened; replace it if an edit or
+// the queue changed which track follows.
+void MusicPlayer::refreshNext() {
+    if (sink->getStatus() != AudioSink::Status::Stopped && getNextTrack() != queuedTrack) prepareNext();
+}
+
+void MusicPlayer::afterEdit() {
+    refreshNext();
+    updateVisibleTracks();
 }
 
 bool MusicPlayer::play() {
-    if (playlist.empty() || currentTrack >= playlist.size()) {
-        std::cout << "Cannot play: Invalid track " << currentTrack << "\n";
-        return false;
+    if (sink->getStatus() == AudioSink::Status::Paused) {
+        sink->play();
+        isPlaying = true;
+        logInfo("Resumed track", {{"index", getCurrentTrack()}});
+        return true;
     }
-    if (music.getStatus() == sf::Music::Stopped) {
-        if (!music.openFromFile(playlist[currentTrack])) {
-            std::cout << "Failed to open file: " << playlist[currentTrack] << "\n";
+    if (sink->getStatus() == AudioSink::Status::Stopped) {
+        if (!tracks.contains(currentTrack)) {
+            TrackHandle next = getNextTrack();
+            if (next.isNull()) {
+                selectTrack(tracks.at(0));
+            } else {
+                consumeNext(next);
+            }
+        }
+        if (!tracks.contains(currentTrack)) {
+            logWarn("Cannot play: playlist is empty");
             return false;
         }
-        music.play();
-        isPlaying = true;
-    } else if (music.getStatus() == sf::Music::Paused) {
-        music.play();
-        isPlaying = true;
+        sf::Time offset = resumeOffset;
+        if (!startTrack(false)) return false;
+        if (offset > sf::Time::Zero) seek(offset);
+    }
+    return true;
+}
+
+void MusicPlayer::resumeAt(size_t trackIndex, sf::Time offset, bool playing) {
+    if (trackIndex >= tracks.size()) return;
+    stop();
+    selectTrack(tracks.at(trackIndex));
+    resumeOffset = offset;
+    if (playing) play();
+}
+
+std::unique_ptr<TrackDecoder> MusicPlayer::openDecoder(const std::string& filepath, ResamplerQuality quality) {
+    auto start = std::chrono::steady_clock::now();
+    auto decoder = std::make_unique<TrackDecoder>();
+    if (!decoder->open(filepath, OUTPUT_RATE, quality)) {
+        openFailuresMetric.add();
+        logError("Failed to open file", {{"path", filepath}});
+        return nullptr;
     }
-    std::cout << "Playing track " << currentTrack << ": " << playlist[currentTrack] << "\n";
+    openLatencyMetric.observe(std::chrono::steady_clock::now() - start);
+    return decoder;
+}
+
+std::unique_ptr<TrackDecoder> MusicPlayer::openTrack(TrackHandle track) {
+    return openDecoder(tracks.getPath(track), resamplerQuality);
+}
+
+bool MusicPlayer::startTrack(bool crossfade, std::unique_ptr<TrackDecoder> decoder) {
+    resumeOffset = sf::Time::Zero;
+    if (!decoder) decoder = openTrack(currentTrack);
+    if (!decoder) return false;
+    crossfade = crossfade && engine.getCrossfadeSeconds() > 0.0f && sink->getStatus() == AudioSink::Status::Playing;
+    currentDuration = decoder->getDuration();
+    engine.play(std::move(decoder), currentTrack.value(), trackGain(currentTrack), crossfade);
+    // A cut should be heard now, not after the buffers already queued.
+    if (!crossfade) sink->flush();
+    sink->play();
+    isPlaying = true;
+
+    const std::string& path = tracks.getPath(currentTrack);
+    if (!tracks.getInfo(currentTrack).hasLoudness) loudnessScanner.analyzeFirst(currentTrack.value(), path);
+    requestSeekIndex(path);
+    prepareNext();
+    tracksPlayedMetric.add();
+    logInfo("Playing track", {{"index", getCurrentTrack()}, {"path", path}});
     return true;
 }
 
+// A track picked directly; playlist order continues from it.
+void MusicPlayer::selectTrack(TrackHandle track) {
+    currentTrack = track;
+    playlistTrack = track;
+    followingTrack = TrackHandle{};
+}
+
+TrackHandle MusicPlayer::getNextTrack() const {
+    // Removed tracks are taken out of the queue as they're removed.
+    if (!upNext.empty()) return upNext.front();
+    size_t index = tracks.indexOf(playlistTrack);
+    if (index != TrackTable::NOT_FOUND) return tracks.at(index + 1);
+    return tracks.contains(followingTrack) ? followingTrack : TrackHandle{};
+}
+
+// Makes `track`, which getNextTrack() returned, the current one.
+void MusicPlayer::consumeNext(TrackHandle track) {
+    if (!upNext.empty() && upNext.front() == track) {
+        upNext.pop_front();
+        currentTrack = track;
+    } else {
+        selectTrack(track);
+    }
+}
+
+void MusicPlayer::prepareNext() {
+    queuedTrack = getNextTrack();
+    std::unique_ptr<TrackDecoder> decoder = queuedTrack.isNull() ? nullptr : openTrack(queuedTrack);
+    if (!decoder) {
+        queuedTrack = TrackHandle{};
+        engine.clearNext();
+        return;
+    }
+    nextDuration = decoder->getDuration();
+    engine.setNext(std::move(decoder), queuedTrack.value(), trackGain(queuedTrack));
+}
+
 void MusicPlayer::pause() {
-    if (isPlaying && music.getStatus() == sf::Music::Playing) {
-        music.pause();
+    if (isPlaying && sink->getStatus() == AudioSink::Status::Playing) {
+        sink->pause();
         isPlaying = false;
-        std::cout << "Paused track " << currentTrack << "\n";
-    } else if (!isPlaying && music.getStatus() == sf::Music::Paused) {
-        music.play();
+        logInfo("Paused track", {{"index", getCurrentTrack()}});
+    } else if (!isPlaying && sink->getStatus() == AudioSink::Status::Paused) {
+        sink->play();
         isPlaying = true;
-        std::cout << "Resumed track " << currentTrack << "\n";
+        logInfo("Resumed track", {{"index", getCurrentTrack()}});
     }
 }
 
 void MusicPlayer::stop() {
-    music.stop();
+    sink->stop();
     isPlaying = false;
-    std::cout << "Stopped playback\n";
+    logInfo("Stopped playback");
 }
 
 void MusicPlayer::next() {
-    if (currentTrack + 1 < playlist.size()) {
-        stop();
-        currentTrack++;
-        play();
+    TrackHandle following = getNextTrack();
+    if (!following.isNull()) {
+        consumeNext(following);
+        startTrack(true);
     } else {
-        std::cout << "No next track available\n";
+        logInfo("No next track available");
     }
 }
 
 void MusicPlayer::previous() {
-    if (currentTrack > 0) {
-        stop();
-        currentTrack--;
-        play();
+    // In playlist order, whatever the queue did in between.
+    size_t index = tracks.indexOf(playlistTrack);
+    // A removed track's predecessor is the one before whatever replaced it.
+    if (index == TrackTable::NOT_FOUND) index = tracks.indexOf(followingTrack);
+    if (index != TrackTable::NOT_FOUND && index > 0) {
+        setTrack(index - 1);
     } else {
-        std::cout << "No previous track available\n";
+        logInfo("No previous track available");
     }
 }
 
-void MusicPlayer::setTrack(size_t trackIndex) {
-    if (trackIndex < playlist.size()) {
-        stop();
-        currentTrack = trackIndex;
-        play();
+void MusicPlayer::setTrack(size_t trackIndex, std::unique_ptr<TrackDecoder> opened) {
+    if (trackIndex < tracks.size()) {
+        selectTrack(tracks.at(trackIndex));
+        startTrack(true, std::move(opened));
     }
 }
 
-const std::vector<std::string>& MusicPlayer::getPlaylist() const { return playlist; }
-size_t MusicPlayer::getCurrentTrack() const { return currentTrack; }
+bool MusicPlayer::seek(sf::Time offset) {
+    if (sink->getStatus() == AudioSink::Status::Stopped) {
+        logWarn("Cannot seek: nothing is playing");
+        return false;
+    }
+    offset = std::max(sf::Time::Zero, std::min(offset, currentDuration));
+
+    std::shared_ptr<const SeekIndex> index;
+    {
+        // Requested whenever a track starts, so it's the current track's even
+        // if that has since been removed from the playlist.
+        std::lock_guard<std::mutex> lock(seekIndexMutex);
+        index = seekIndex;
+    }
+    // Round up to the next frame boundary, so the decoder starts on a whole
+    // frame instead of decoding one and discarding its head. The file readers
+    // seek with their own tables (libFLAC's SEEKTABLE, minimp3's frame index,
+    // vorbisfile's bisection); the index only picks where to land, and never
+    // earlier than asked.
+    if (index && index->isFrameAccurate() && index->getSampleRate() > 0) {
+        uint64_t rate = index->getSampleRate();
+        uint64_t sample = static_cast<uint64_t>(offset.asMicroseconds()) * rate / 1000000;
+        sf::Time snapped = sf::microseconds(static_cast<sf::Int64>((index->getFrameBoundary(sample) * 1000000 + rate - 1) / rate));
+        offset = std::max(offset, std::min(snapped, currentDuration));
+    }
+    engine.seek(static_cast<uint64_t>(offset.asMicroseconds()) * sink->getSampleRate() / 1000000);
+    sink->flush();
+    logInfo("Seek", {{"seconds", offset.asSeconds()}, {"index", getCurrentTrack()}});
+    return true;
+}
+
+sf::Time MusicPlayer::getPlayingOffset() const {
+    PlaybackSegment segment;
+    uint64_t frame = sink->getAudibleFrame();
+    if (sink->getStatus() == AudioSink::Status::Stopped || !engine.findSegment(frame, segment) ||
+        segment.trackId != currentTrack.value()) {
+        return sf::Time::Zero;
+    }
+    sf::Int64 elapsed = static_cast<sf::Int64>((frame - segment.streamFrame) * 1000000 / sink->getSampleRate() * segment.speed);
+    return std::min(sf::microseconds(segment.trackStartUs + elapsed), currentDuration);
+}
+
+sf::Time MusicPlayer::getDuration() const {
+    if (sink->getStatus() != AudioSink::Status::Stopped) return currentDuration;
+    if (tracks.contains(currentTrack)) return sf::milliseconds(static_cast<sf::Int32>(tracks.getInfo(currentTrack).durationMs));
+    return sf::Time::Zero;
+}
+
+void MusicPlayer::update() {
+    engine.collectGarbage();
+    if (!isPlaying) return;
+    if (sink->getStatus() == AudioSink::Status::Stopped) {
+        // The engine ran dry: the playlist ended or the next track failed to open.
+        // A fast sink can get through queued tracks between two updates, so
+        // continue from the last one it rendered.
+        PlaybackSegment last;
+        TrackHandle rendered;
+        if (engine.findSegment(UINT64_MAX, last)) rendered = TrackHandle::fromValue(last.trackId);
+        if (rendered != currentTrack && tracks.contains(rendered)) {
+            if (rendered == queuedTrack) {
+                consumeNext(rendered);
+            } else {
+                selectTrack(rendered);
+            }
+        }
+        TrackHandle following = getNextTrack();
+        if (!following.isNull()) {
+            consumeNext(following);
+            startTrack(false);
+        } else {
+            isPlaying = false;
+            logInfo("Reached end of playlist");
+        }
+        return;
+    }
+    PlaybackSegment segment;
+    if (!engine.findSegment(sink->getAudibleFrame(), segment) || segment.trackId == audibleTrack) return;
+    audibleTrack = segment.trackId;
+    TrackHandle audible = TrackHandle::fromValue(audibleTrack);
+    if (audible != currentTrack && tracks.contains(audible)) {
+        // The engine moved on to the queued track by itself.
+        if (audible == queuedTrack) {
+            consumeNext(audible);
+        } else {
+            selectTrack(audible);
+        }
+        currentDuration = nextDuration;
+        const std::string& path = tracks.getPath(currentTrack);
+        if (!tracks.getInfo(currentTrack).hasLoudness) loudnessScanner.analyzeFirst(currentTrack.value(), path);
+        requestSeekIndex(path);
+        prepareNext();
+        tracksPlayedMetric.add();
+        logInfo("Playing track", {{"index", getCurrentTrack()}, {"path", path}});
+    }
+}
+
+void MusicPlayer::requestSeekIndex(const std::string& filepath) {
+    {
+        std::lock_guard<std::mutex> lock(seekIndexMutex);
+        if (seekIndexPath == filepath) return;
+        seekIndexPath = filepath;
+        seekIndex.reset();
+    }
+    indexPool.submit([this, filepath] {
+        FileIdentity identity;
+        std::string cachePath = getFileIdentity(filepath, identity) ? getCachePath(identity, "seek", ".idx") : "";
+        auto cached = std::make_shared<SeekIndex>();
+        if (cached->load(cachePath, filepath)) {
+            publishSeekIndex(filepath, cached);
+            return;
+        }
+        // The container's own table is usable immediately; MP3s then get a
+        // frame-accurate index from a header scan, which is kept on disk.
+        auto container = std::make_shared<SeekIndex>();
+        if (container->buildFromContainer(filepath)) publishSeekIndex(filepath, container);
+        if (container->getSource() == SeekIndex::Source::FlacSeekTable) {
+            container->save(cachePath, filepath);
+            return;
+        }
+        auto scanned = std::make_shared<SeekIndex>();
+        if (scanned->buildByScanning(filepath)) {
+            scanned->save(cachePath, filepath);
+            publishSeekIndex(filepath, scanned);
+        }
+    });
+}
+
+void MusicPlayer::publishSeekIndex(const std::string& filepath, std::shared_ptr<const SeekIndex> index) {
+    std::lock_guard<std::mutex> lock(seekIndexMutex);
+    if (seekIndexPath == filepath) seekIndex = std::move(index);
+}
+
+void MusicPlayer::setVolume(float percent) {
+    volume = std::max(0.0f, std::min(percent, 100.0f));
+    updateGain();
+}
+
+float MusicPlayer::getVolume() const { return volume; }
+
+void MusicPlayer::setNormalization(bool enabled) {
+    normalize = enabled;
+    updateGain();
+    logInfo("Loudness normalization", {{"enabled", enabled}});
+}
+
+bool MusicPlayer::getNormalization() const { return normalize; }
+
+void MusicPlayer::setCrossfade(float seconds, CrossfadeCurve curve) {
+    engine.setCrossfade(seconds, curve);
+    logInfo("Crossfade", {{"seconds", engine.getCrossfadeSeconds()}});
+}
+
+float MusicPlayer::getCrossfade() const { return engine.getCrossfadeSeconds(); }
+
+void MusicPlayer::setSpeed(float speed) {
+    engine.setSpeed(speed);
+    logInfo("Speed", {{"ratio", engine.getSpeed()}});
+}
+
+float MusicPlayer::getSpeed() const { return engine.getSpeed(); }
+
+void MusicPlayer::setPitch(float semitones) {
+    engine.setPitch(std::pow(2.0f, std::clamp(semitones, -12.0f, 12.0f) / 12.0f));
+    logInfo("Pitch", {{"semitones", getPitch()}});
+}
+
+float MusicPlayer::getPitch() const { return 12.0f * std::log2(engine.getPitch()); }
+
+void MusicPlayer::setResamplerQuality(ResamplerQuality quality) {
+    // Applies to tracks opened from now on; re-queue the next one with it.
+    resamplerQuality = quality;
+    if (sink->getStatus() != AudioSink::Status::Stopped) prepareNext();
+}
+
+ResamplerQuality MusicPlayer::getResamplerQuality() const { return resamplerQuality; }
+
+PreampStage& MusicPlayer::getPreamp() { return *preamp; }
+EqualizerStage& MusicPlayer::getEqualizer() { return *equalizer; }
+LimiterStage& MusicPlayer::getLimiter() { return *limiter; }
+void MusicPlayer::getDspCosts(std::vector<DspStageCost>& costs) const { engine.getDsp().getCosts(costs); }
+
+ExportSettings MusicPlayer::getExportSettings(const std::string& directory, ExportFormat format) const {
+    ExportSettings settings;
+    settings.outputDirectory = directory;
+    settings.format = format;
+    settings.sampleRate = OUTPUT_RATE;
+    settings.quality = resamplerQuality;
+    settings.normalize = normalize;
+    settings.targetLufs = NORMALIZATION_TARGET_LUFS;
+    settings.ceilingDbtp = NORMALIZATION_CEILING_DBTP;
+    settings.preampDb = preamp->isEnabled() ? preamp->getGainDb() : 0.0f;
+    if (equalizer->isEnabled()) {
+        for (size_t i = 0; i < equalizer->getBandCount(); ++i) settings.eqBands.push_back(equalizer->getBand(i));
+    }
+    settings.limiter = limiter->isEnabled();
+    settings.speed = engine.getSpeed();
+    settings.pitch = engine.getPitch();
+    return settings;
+}
+
+float MusicPlayer::trackGain(TrackHandle track) const {
+    if (!normalize || !tracks.contains(track) || !tracks.getInfo(track).hasLoudness) return 1.0f;
+    const TrackInfo& info = tracks.getInfo(track);
+    float gainDb = std::min(NORMALIZATION_TARGET_LUFS - info.loudnessLufs, NORMALIZATION_CEILING_DBTP - info.truePeakDb);
+    return std::pow(10.0f, gainDb / 20.0f);
+}
+
+void MusicPlayer::updateGain() {
+    engine.setMasterGain(volume / 100.0f);
+    if (!currentTrack.isNull()) engine.setTrackGain(currentTrack.value(), trackGain(currentTrack));
+    if (!queuedTrack.isNull()) engine.setTrackGain(queuedTrack.value(), trackGain(queuedTrack));
+}
+
+size_t MusicPlayer::pollMetadata(std::vector<TrackHandle>& refreshed) {
+    std::vector<std::pair<size_t, TrackInfo>> results;
+    metadataExtractor.collect(results);
+    for (auto& result : results) {
+        TrackHandle track = TrackHandle::fromValue(result.first);
+        if (!tracks.contains(track)) continue; // removed meanwhile
+        TrackInfo& info = tracks.getInfo(track);
+        // Loudness may already have arrived from the scanner; keep it.
+        result.second.hasLoudness = info.hasLoudness;
+        result.second.loudnessLufs = info.loudnessLufs;
+        result.second.truePeakDb = info.truePeakDb;
+        info = std::move(result.second);
+        refreshed.push_back(track);
+    }
+
+    std::vector<std::pair<size_t, LoudnessInfo>> loudness;
+    loudnessScanner.collect(loudness);
+    for (const auto& result : loudness) {
+        TrackHandle track = TrackHandle::fromValue(result.first);
+        if (!tracks.contains(track)) continue;
+        TrackInfo& info = tracks.getInfo(track);
+        info.hasLoudness = true;
+        info.loudnessLufs = result.second.integratedLufs;
+        info.truePeakDb = result.second.truePeakDb;
+        refreshed.push_back(track);
+        if (track == currentTrack || track == queuedTrack) engine.setTrackGain(track.value(), trackGain(track));
+    }
+    return results.size() + loudness.size();
+}
+
+void MusicPlayer::setVisibleRange(size_t first, size_t last) {
+    visibleFirst = first;
+    visibleLast = last;
+    updateVisibleTracks();
+}
+
+// Rows keep their positions across edits but not their tracks, so the
+// extractor is told again after every edit.
+void MusicPlayer::updateVisibleTracks() {
+    std::vector<size_t> visible;
+    for (size_t i = visibleFirst; i < visibleLast && i < tracks.size(); ++i) visible.push_back(tracks.at(i).value());
+    metadataExtractor.setVisibleTracks(std::move(visible));
+}
+
+const TrackTable& MusicPlayer::getPlaylist() const { return tracks; }
+const TrackInfo& MusicPlayer::getTrackInfo(size_t trackIndex) const { return tracks.getInfo(tracks.at(trackIndex)); }
+const SampleTap& MusicPlayer::getSampleTap() const { return sink->getTap(); }
+AudioSink::Stats MusicPlayer::getSinkStats() const { return sink->getStats(); }
+uint64_t MusicPlayer::getAudibleFrame() const { return sink->getAudibleFrame(); }
+size_t MusicPlayer::getCurrentTrack() const { return tracks.indexOf(currentTrack); }
+TrackHandle MusicPlayer::getCurrentHandle() const { return currentTrack; }
+TrackHandle MusicPlayer::getAudibleHandle() const {
+    PlaybackSegment segment;
+    if (!engine.findSegment(sink->getAudibleFrame(), segment)) return TrackHandle();
+    return TrackHandle::fromValue(segment.trackId);
+}
 bool MusicPlayer::getIsPlaying() const { return isPlaying; }
 
 // Button class implementation
@@ -118,9 +584,10 @@ Button::Button(const std::string& label, float x, float y, float width, float he
     text.setPosition(x + width / 2.0f, y + height / 2.0f);
 }
 
-void Button::draw(sf::RenderWindow& window) {
-    window.draw(shape);
-    window.draw(text);
+size_t Button::draw(sf::RenderTarget& target) {
+    target.draw(shape);
+    target.draw(text);
+    return 2;
 }
 
 bool Button::contains(sf::Vector2f point) {
@@ -0,0 +1,70 @@
+#include "perf_hud.h"
+#include "metrics.h"
+#include <algorithm>
+#include <cstdio>
+
+// PerfHud implementation
+PerfHud::PerfHud(const sf::Font& font) : lastRefresh(std::chrono::steady_clock::now()) {
+    background.setPosition(50, 64);
+    background.setSize(sf::Vector2f(330, 84));
+    background.setFillColor(sf::Color(0, 0, 0, 200));
+    background.setOutlineColor(sf::Color(0, 255, 255, 120));
+    background.setOutlineThickness(1);
+    text.setFont(font);
+    text.setCharacterSize(13);
+    text.setFillColor(sf::Color(0, 255, 255));
+    text.setPosition(58, 68);
+}
+
+void PerfHud::toggle() {
+    visible = !visible;
+    if (visible) refreshText();
+}
+
+bool PerfHud::isVisible() const { return visible; }
+
+void PerfHud::addFrame(const FrameSample& sample) {
+    uint32_t micros = static_cast<uint32_t>(std::min<uint64_t>(sample.frameMicroseconds, LatencyHistogram::MAX_VALUE));
+    if (recentCount == WINDOW) {
+        frameTimes.remove(recent[recentNext]);
+    } else {
+        ++recentCount;
+    }
+    recent[recentNext] = micros;
+    recentNext = (recentNext + 1) % WINDOW;
+    frameTimes.record(micros);
+    last = sample;
+}
+
+size_t PerfHud::draw(sf::RenderTarget& target) {
+    if (!visible) return 0;
+    if (std::chrono::steady_clock::now() - lastRefresh >= REFRESH_INTERVAL) refreshText();
+    target.draw(background);
+    target.draw(text);
+    return 2;
+}
+
+void PerfHud::refreshText() {
+    auto now = std::chrono::steady_clock::now();
+    double elapsedNs = std::chrono::duration<double, std::nano>(now - lastRefresh).count();
+    double decodePercent = elapsedNs > 0 ? 100.0 * (last.audio.renderNanoseconds - lastRenderNanoseconds) / elapsedNs : 0.0;
+    lastRefresh = now;
+    lastRenderNanoseconds = last.audio.renderNanoseconds;
+
+    double bufferMs = 0.0;
+    if (last.playing && last.sampleRate > 0 && last.audio.renderedFrame > last.audibleFrame) {
+        bufferMs = 1000.0 * (last.audio.renderedFrame - last.audibleFrame) / last.sampleRate;
+    }
+    uint64_t rss = Metrics::readResidentBytes();
+
+    char lines[256];
+    std::snprintf(lines, sizeof(lines),
+                  "frame  p50 %.1f  p99 %.1f  max %.1f ms  (%zu)\n"
+                  "draws  %zu   rows %zu\n"
+                  "audio  buffer %.0f ms  underruns %llu  decode %.1f%%\n"
+                  "rss    %.1f MB",
+                  frameTimes.getPercentile(0.5) / 1000.0, frameTimes.getPercentile(0.99) / 1000.0,
+                  frameTimes.getMax() / 1000.0, recentCount, last.drawCalls, last.rowsRendered, bufferMs,
+                  static_cast<unsigned long long>(last.audio.underruns), decodePercent, rss / (1024.0 * 1024.0));
+    text.setString(lines);
+}
@@ -0,0 +1,59 @@
+#ifndef PERF_HUD_H
+#define PERF_HUD_H
+
+#include "audio_sink.h"
+#include "histogram.h"
+#include <SFML/Graphics.hpp>
+#include <array>
+#include <chrono>
+#include <cstdint>
+
+// What the UI measured for one frame.
+struct FrameSample {
+    uint64_t frameMicroseconds = 0; // since the previous frame started
+    size_t drawCalls = 0;
+    size_t rowsRendered = 0;        // playlist rows actually drawn
+    size_t events = 0;              // input events handled
+    AudioSink::Stats audio;
+    uint64_t audibleFrame = 0;
+    unsigned sampleRate = 0;
+    bool playing = false;
+};
+
+// Overlay with frame-time percentiles, draw counts and audio buffer health,
+// for diagnosing stutter on slow machines without attaching a profiler.
+// Frame times are kept in a histogram over the last WINDOW frames, updated
+// in place; only the text is rebuilt, REFRESH_INTERVAL apart.
+class PerfHud {
+public:
+    static constexpr size_t WINDOW = 600; // frames, ~10 s at 60 fps
+    static constexpr auto REFRESH_INTERVAL = std::chrono::milliseconds(250);
+
+    explicit PerfHud(const sf::Font& font);
+
+    void toggle();
+    bool isVisible() const;
+    // Every frame, shown or not, so the window is full when it opens.
+    void addFrame(const FrameSample& sample);
+    // Returns the number of draw calls made.
+    size_t draw(sf::RenderTarget& target);
+
+private:
+    void refreshText();
+
+    bool visible = false;
+    LatencyHistogram frameTimes;
+    std::array<uint32_t, WINDOW> recent{};
+    size_t recentNext = 0;
+    size_t recentCount = 0;
+    FrameSample last;
+
+    // Decode load is the render time the sink accumulated between refreshes.
+    std::chrono::steady_clock::time_point lastRefresh;
+    uint64_t lastRenderNanoseconds = 0;
+
+    sf::RectangleShape background;
+    sf::Text text;
+};
+
+#endif // PERF_HUD_H
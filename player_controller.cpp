@@ -0,0 +1,469 @@
+#include "player_controller.h"
+#include "logger.h"
+#include "metrics.h"
+#include "playlist_file.h"
+#include "trace.h"
+#include <cstring>
+
+namespace {
+
+MetricCounter commandsAppliedMetric("msx_player_commands_total", "Player commands applied");
+MetricCounter commandsDroppedMetric("msx_player_commands_dropped_total", "Player commands dropped on a full queue");
+
+PlayerCommand makeCommand(PlayerCommand::Type type, float value = 0.0f, size_t first = 0, size_t last = 0) {
+    PlayerCommand command;
+    command.type = type;
+    command.value = value;
+    command.first = first;
+    command.last = last;
+    return command;
+}
+
+PlayerCommand makeCommand(PlayerCommand::Type type, const std::string& path) {
+    PlayerCommand command;
+    command.type = type;
+    command.path = path;
+    return command;
+}
+
+} // namespace
+
+template <typename T>
+PlayerController::MpscQueue<T>::MpscQueue() {
+    for (size_t i = 0; i < QUEUE_SIZE; ++i) cells[i].sequence.store(i, std::memory_order_relaxed);
+}
+
+// Bounded queue after Vyukov: each cell's sequence says whether it is free
+// for the producer claiming that position or holds an item for the consumer.
+template <typename T>
+uint64_t PlayerController::MpscQueue<T>::push(T&& item) {
+    size_t position = tail.load(std::memory_order_relaxed);
+    for (;;) {
+        Cell& cell = cells[position & (QUEUE_SIZE - 1)];
+        size_t sequence = cell.sequence.load(std::memory_order_acquire);
+        std::ptrdiff_t lag = static_cast<std::ptrdiff_t>(sequence - position);
+        if (lag == 0) {
+            if (tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                cell.item = std::move(item);
+                cell.sequence.store(position + 1, std::memory_order_release);
+                return position + 1;
+            }
+        } else if (lag < 0) {
+            return 0;
+        } else {
+            position = tail.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+template <typename T>
+bool PlayerController::MpscQueue<T>::pop(T& item) {
+    Cell& cell = cells[head & (QUEUE_SIZE - 1)];
+    if (cell.sequence.load(std::memory_order_acquire) != head + 1) return false;
+    item = std::move(cell.item);
+    cell.sequence.store(head + QUEUE_SIZE, std::memory_order_release);
+    ++head;
+    return true;
+}
+
+template <typename T>
+bool PlayerController::MpscQueue<T>::empty() const {
+    return cells[head & (QUEUE_SIZE - 1)].sequence.load(std::memory_order_acquire) != head + 1;
+}
+
+template <typename T>
+void PlayerController::SeqLock<T>::store(const T& value) {
+    uint64_t buffer[WORDS] = {};
+    std::memcpy(buffer, &value, sizeof(T));
+    sequence.fetch_add(1, std::memory_order_acq_rel);
+    for (size_t i = 0; i < WORDS; ++i) words[i].store(buffer[i], std::memory_order_relaxed);
+    sequence.fetch_add(1, std::memory_order_release);
+}
+
+template <typename T>
+T PlayerController::SeqLock<T>::load() const {
+    uint64_t buffer[WORDS];
+    for (;;) {
+        uint32_t before = sequence.load(std::memory_order_acquire);
+        if (before & 1) continue;
+        for (size_t i = 0; i < WORDS; ++i) buffer[i] = words[i].load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (sequence.load(std::memory_order_relaxed) == before) break;
+    }
+    T value;
+    std::memcpy(&value, buffer, sizeof(T));
+    return value;
+}
+
+PlayerController::PlayerController(std::unique_ptr<AudioSink> output)
+    : player(std::move(output)), ioPool(2), exportPool(1, WorkerPool::Priority::Low) {
+    publishPlaylist();
+    publishState();
+    thread = std::thread(&PlayerController::run, this);
+}
+
+PlayerController::~PlayerController() {
+    {
+        std::lock_guard<std::mutex> lock(exportMutex);
+        exportsClosed = true;
+        if (runningExport) runningExport->cancel();
+    }
+    running.store(false);
+    {
+        std::lock_guard<std::mutex> lock(wakeMutex);
+        wake.notify_one();
+    }
+    thread.join();
+}
+
+uint64_t PlayerController::post(PlayerCommand command) {
+    uint64_t ticket = commands.push(std::move(command));
+    if (ticket == 0) {
+        commandsDroppedMetric.add();
+        logWarn("Player command queue full, dropping command");
+        return 0;
+    }
+    // Pairs with the fence in run(): either it sees the command or we see it sleeping.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (sleeping.load(std::memory_order_relaxed)) {
+        std::lock_guard<std::mutex> lock(wakeMutex);
+        wake.notify_one();
+    }
+    return ticket;
+}
+
+uint64_t PlayerController::play() { return post(makeCommand(PlayerCommand::Type::Play)); }
+uint64_t PlayerController::pause() { return post(makeCommand(PlayerCommand::Type::Pause)); }
+uint64_t PlayerController::stop() { return post(makeCommand(PlayerCommand::Type::Stop)); }
+uint64_t PlayerController::next() { return post(makeCommand(PlayerCommand::Type::Next)); }
+uint64_t PlayerController::previous() { return post(makeCommand(PlayerCommand::Type::Previous)); }
+uint64_t PlayerController::setTrack(size_t trackIndex) { return post(makeCommand(PlayerCommand::Type::SetTrack, 0.0f, trackIndex)); }
+uint64_t PlayerController::seek(sf::Time offset) { return post(makeCommand(PlayerCommand::Type::Seek, offset.asSeconds())); }
+uint64_t PlayerController::setVolume(float percent) { return post(makeCommand(PlayerCommand::Type::SetVolume, percent)); }
+uint64_t PlayerController::setNormalization(bool enabled) { return post(makeCommand(PlayerCommand::Type::SetNormalization, enabled ? 1.0f : 0.0f)); }
+uint64_t PlayerController::setCrossfade(float seconds) { return post(makeCommand(PlayerCommand::Type::SetCrossfade, seconds)); }
+uint64_t PlayerController::setSpeed(float speed) { return post(makeCommand(PlayerCommand::Type::SetSpeed, speed)); }
+uint64_t PlayerController::setPitch(float semitones) { return post(makeCommand(PlayerCommand::Type::SetPitch, semitones)); }
+uint64_t PlayerController::addToPlaylist(const std::string& filepath) { return post(makeCommand(PlayerCommand::Type::Enqueue, filepath)); }
+uint64_t PlayerController::addTracks(std::vector<std::string> filepaths, std::vector<TrackInfo> info) {
+    PlayerCommand command = makeCommand(PlayerCommand::Type::EnqueueMany);
+    command.paths = std::move(filepaths);
+    command.info = std::move(info);
+    return post(std::move(command));
+}
+uint64_t PlayerController::resumeAt(size_t trackIndex, sf::Time offset, bool playing) {
+    return post(makeCommand(PlayerCommand::Type::Resume, offset.asSeconds(), trackIndex, playing ? 1 : 0));
+}
+uint64_t PlayerController::removeTracks(std::vector<TrackHandle> handles) {
+    PlayerCommand command = makeCommand(PlayerCommand::Type::Remove);
+    command.handles = std::move(handles);
+    return post(std::move(command));
+}
+uint64_t PlayerController::moveTrack(TrackHandle track, size_t toIndex) {
+    return post(makeCommand(PlayerCommand::Type::Move, 0.0f, track.value(), toIndex));
+}
+uint64_t PlayerController::playNext(TrackHandle track) { return post(makeCommand(PlayerCommand::Type::PlayNext, 0.0f, track.value())); }
+uint64_t PlayerController::addToQueue(TrackHandle track) { return post(makeCommand(PlayerCommand::Type::AddToQueue, 0.0f, track.value())); }
+uint64_t PlayerController::clearQueue() { return post(makeCommand(PlayerCommand::Type::ClearQueue)); }
+uint64_t PlayerController::loadFromFolder(const std::string& folderPath) { return post(makeCommand(PlayerCommand::Type::LoadFolder, folderPath)); }
+uint64_t PlayerController::setVisibleRange(size_t first, size_t last) { return post(makeCommand(PlayerCommand::Type::SetVisibleRange, 0.0f, first, last)); }
+
+bool PlayerController::wait(uint64_t ticket, std::chrono::milliseconds timeout) const {
+    if (ticket == 0) return false;
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    for (int spin = 0;; ++spin) {
+        if (getState().commandsApplied >= ticket) return true;
+        if (std::chrono::steady_clock::now() >= deadline) return false;
+        // Most commands are applied within microseconds; back off for the slow ones.
+        if (spin < 64) {
+            std::this_thread::yield();
+        } else {
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+        }
+    }
+}
+
+PlayerController::AppliedAwaitable::AppliedAwaitable(PlayerController& owner, uint64_t commandTicket)
+    : controller(owner), ticket(commandTicket) {}
+
+bool PlayerController::AppliedAwaitable::await_ready() const {
+    return ticket == 0 || controller.getState().commandsApplied >= ticket;
+}
+
+void PlayerController::AppliedAwaitable::await_suspend(std::coroutine_handle<> handle) {
+    // Checked once per drain; commands are usually applied before the next frame.
+    struct Poll {
+        PlayerController* controller;
+        uint64_t ticket;
+        std::coroutine_handle<> handle;
+        void operator()() const {
+            if (controller->getState().commandsApplied >= ticket) {
+                handle.resume();
+            } else {
+                controller->executor.post(*this);
+            }
+        }
+    };
+    controller.executor.post(Poll{&controller, ticket, handle});
+}
+
+bool PlayerController::AppliedAwaitable::await_resume() const { return ticket != 0; }
+
+PlayerController::AppliedAwaitable PlayerController::applied(uint64_t ticket) { return AppliedAwaitable(*this, ticket); }
+
+Task<bool> PlayerController::openAsync(size_t trackIndex) {
+    std::shared_ptr<const PlaylistSnapshot> current = getPlaylist();
+    if (trackIndex >= current->paths.size()) co_return false;
+    std::string path = current->paths[trackIndex];
+    TrackHandle track = current->handles[trackIndex];
+    ResamplerQuality quality = getState().resamplerQuality;
+    // Awaitables are named locals throughout: GCC 12 mis-copies temporaries
+    // with non-trivial members (here the captured string) inside co_await.
+    auto opening = runOnPool(ioPool, executor, [path, quality] { return MusicPlayer::openDecoder(path, quality); });
+    std::unique_ptr<TrackDecoder> decoder = co_await opening;
+    if (!decoder) co_return false;
+
+    PlayerCommand command = makeCommand(PlayerCommand::Type::SetTrack, 0.0f, trackIndex, track.value());
+    command.path = path;
+    command.decoder = std::move(decoder);
+    if (!co_await applied(post(std::move(command)))) co_return false;
+    PlayerState now = getState();
+    co_return now.currentHandle == track && now.isPlaying;
+}
+
+Task<size_t> PlayerController::importAsync(std::string folderPath) {
+    auto scanning = runOnPool(ioPool, executor, [folderPath] {
+        std::vector<std::string> tracks;
+        scanFolder(folderPath, tracks);
+        return tracks;
+    });
+    std::vector<std::string> found = co_await scanning;
+    if (found.empty()) co_return 0;
+
+    size_t before = getState().trackCount;
+    PlayerCommand command = makeCommand(PlayerCommand::Type::EnqueueMany);
+    command.paths = std::move(found);
+    if (!co_await applied(post(std::move(command)))) co_return 0;
+    size_t after = getState().trackCount;
+    logInfo("Imported folder", {{"tracks", after - before}, {"path", folderPath}});
+    co_return after - before;
+}
+
+Task<size_t> PlayerController::importPlaylistAsync(std::string path) {
+    auto reading = runOnPool(ioPool, executor, [path] {
+        PlayerCommand command = makeCommand(PlayerCommand::Type::EnqueueMany);
+        PlaylistFormat format;
+        if (getPlaylistFormat(path, format) && readPlaylist(path, command.paths, &command.info) &&
+            format != PlaylistFormat::Binary) {
+            removeMissingTracks(command.paths, &command.info);
+        }
+        return command;
+    });
+    PlayerCommand command = co_await reading;
+    if (command.paths.empty()) co_return 0;
+
+    size_t before = getState().trackCount;
+    if (!co_await applied(post(std::move(command)))) co_return 0;
+    size_t after = getState().trackCount;
+    logInfo("Imported playlist", {{"tracks", after - before}, {"path", path}});
+    co_return after - before;
+}
+
+Task<bool> PlayerController::exportPlaylistAsync(std::string path) {
+    std::shared_ptr<const PlaylistSnapshot> current = getPlaylist();
+    auto writing = runOnPool(ioPool, executor, [path, current] { return writePlaylist(path, current->paths.toVector(), current->info.toVector()); });
+    co_return co_await writing;
+}
+
+Task<size_t> PlayerController::exportTracksAsync(std::string directory, ExportFormat format) {
+    // The settings live on the control thread; the render doesn't.
+    PlayerCommand command = makeCommand(PlayerCommand::Type::ReadExportSettings, directory);
+    command.exportSettings = std::make_shared<ExportSettings>();
+    command.exportSettings->format = format;
+    std::shared_ptr<ExportSettings> settings = command.exportSettings;
+    if (!co_await applied(post(std::move(command)))) co_return 0;
+    std::shared_ptr<const PlaylistSnapshot> current = getPlaylist();
+    auto rendering = runOnPool(exportPool, executor, [this, settings, current] {
+        BatchExporter exporter(*settings);
+        {
+            std::lock_guard<std::mutex> lock(exportMutex);
+            if (exportsClosed) return size_t(0);
+            runningExport = &exporter;
+        }
+        std::vector<ExportResult> results;
+        size_t written = exporter.run(current->paths.toVector(), results);
+        std::lock_guard<std::mutex> lock(exportMutex);
+        runningExport = nullptr;
+        return written;
+    });
+    size_t written = co_await rendering;
+    logInfo("Exported tracks", {{"written", written}, {"tracks", current->paths.size()}, {"path", directory}});
+    co_return written;
+}
+
+Task<bool> PlayerController::seekAsync(sf::Time offset) {
+    co_return co_await applied(seek(offset));
+}
+
+Executor& PlayerController::getExecutor() { return executor; }
+
+PlayerState PlayerController::getState() const { return state.load(); }
+
+std::shared_ptr<const PlaylistSnapshot> PlayerController::getPlaylist() const { return std::atomic_load(&playlist); }
+
+const SampleTap& PlayerController::getSampleTap() const { return player.getSampleTap(); }
+AudioSink::Stats PlayerController::getSinkStats() const { return player.getSinkStats(); }
+
+void PlayerController::run() {
+    Tracer::setThreadName("player");
+    auto lastMetadata = std::chrono::steady_clock::now();
+    bool metadataPending = false;
+    while (running.load()) {
+        {
+            TraceScope scope("controlTick");
+            bool playlistChanged = false;
+            PlayerCommand command;
+            while (commands.pop(command)) {
+                playlistChanged |= apply(command);
+                ++appliedCount;
+                commandsAppliedMetric.add();
+            }
+            player.update();
+            if (player.pollMetadata(refreshedTracks) > 0) metadataPending = true;
+            auto now = std::chrono::steady_clock::now();
+            if (playlistChanged || (metadataPending && now - lastMetadata >= METADATA_INTERVAL)) {
+                publishPlaylist();
+                metadataPending = false;
+                lastMetadata = now;
+            }
+            publishState();
+        }
+
+        std::unique_lock<std::mutex> lock(wakeMutex);
+        sleeping.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (commands.empty() && running.load()) wake.wait_for(lock, UPDATE_INTERVAL);
+        sleeping.store(false, std::memory_order_relaxed);
+    }
+}
+
+bool PlayerController::apply(PlayerCommand& command) {
+    size_t trackCount = player.getPlaylist().size();
+    uint64_t edits = player.getPlaylist().getEditCount();
+    switch (command.type) {
+    case PlayerCommand::Type::Play: player.play(); break;
+    case PlayerCommand::Type::Pause: player.pause(); break;
+    case PlayerCommand::Type::Stop: player.stop(); break;
+    case PlayerCommand::Type::Next: player.next(); break;
+    case PlayerCommand::Type::Previous: player.previous(); break;
+    case PlayerCommand::Type::SetTrack:
+        // The track may have moved while its decoder was being opened off-thread.
+        if (command.decoder) {
+            command.first = player.getPlaylist().indexOf(TrackHandle::fromValue(command.last));
+            if (command.first == TrackTable::NOT_FOUND) {
+                command.decoder.reset();
+                break;
+            }
+        }
+        player.setTrack(command.first, std::move(command.decoder));
+        break;
+    case PlayerCommand::Type::Seek: player.seek(sf::seconds(command.value)); break;
+    case PlayerCommand::Type::SetVolume: player.setVolume(command.value); break;
+    case PlayerCommand::Type::SetNormalization: player.setNormalization(command.value != 0.0f); break;
+    case PlayerCommand::Type::SetCrossfade: player.setCrossfade(command.value); break;
+    case PlayerCommand::Type::SetSpeed: player.setSpeed(command.value); break;
+    case PlayerCommand::Type::SetPitch: player.setPitch(command.value); break;
+    case PlayerCommand::Type::Enqueue: player.addToPlaylist(command.path); break;
+    case PlayerCommand::Type::EnqueueMany:
+        for (size_t i = 0; i < command.paths.size(); ++i) {
+            if (i < command.info.size()) {
+                player.addToPlaylist(command.paths[i], command.info[i]);
+            } else {
+                player.addToPlaylist(command.paths[i]);
+            }
+        }
+        break;
+    case PlayerCommand::Type::LoadFolder: player.loadFromFolder(command.path); break;
+    case PlayerCommand::Type::SetVisibleRange: player.setVisibleRange(command.first, command.last); break;
+    case PlayerCommand::Type::Resume: player.resumeAt(command.first, sf::seconds(command.value), command.last != 0); break;
+    case PlayerCommand::Type::Remove: player.removeTracks(command.handles); break;
+    case PlayerCommand::Type::Move: player.moveTrack(TrackHandle::fromValue(command.first), command.last); break;
+    case PlayerCommand::Type::PlayNext: player.playNext(TrackHandle::fromValue(command.first)); break;
+    case PlayerCommand::Type::AddToQueue: player.addToQueue(TrackHandle::fromValue(command.first)); break;
+    case PlayerCommand::Type::ClearQueue: player.clearQueue(); break;
+    case PlayerCommand::Type::ReadExportSettings:
+        *command.exportSettings = player.getExportSettings(command.path, command.exportSettings->format);
+        break;
+    }
+    return player.getPlaylist().size() != trackCount || player.getPlaylist().getEditCount() != edits;
+}
+
+void PlayerController::publishState() {
+    PlayerState current;
+    current.status = player.getSink().getStatus();
+    current.isPlaying = player.getIsPlaying();
+    current.normalize = player.getNormalization();
+    current.currentTrack = player.getCurrentTrack();
+    current.currentHandle = player.getCurrentHandle();
+    current.audibleHandle = player.getAudibleHandle();
+    const std::deque<TrackHandle>& queue = player.getQueue();
+    if (!queue.empty()) current.queueHead = queue.front();
+    current.queueLength = queue.size();
+    current.trackCount = player.getPlaylist().size();
+    current.positionUs = player.getPlayingOffset().asMicroseconds();
+    current.durationUs = player.getDuration().asMicroseconds();
+    current.audibleFrame = player.getAudibleFrame();
+    current.volume = player.getVolume();
+    current.crossfade = player.getCrossfade();
+    current.speed = player.getSpeed();
+    current.pitch = player.getPitch();
+    current.resamplerQuality = player.getResamplerQuality();
+    current.playlistVersion = playlistVersion;
+    current.commandsApplied = appliedCount;
+    state.store(current);
+}
+
+void PlayerController::publishPlaylist() {
+    using Paths = SharedRows<std::string>;
+    using Info = SharedRows<TrackInfo>;
+    const TrackTable& tracks = player.getPlaylist();
+    // Only this thread stores `playlist`, so reading it needs no atomic load.
+    const PlaylistSnapshot* previous = playlist.get();
+    auto snapshot = std::make_shared<PlaylistSnapshot>();
+    snapshot->version = ++playlistVersion;
+    snapshot->edits = tracks.getEditCount();
+    snapshot->handles = tracks.getOrder();
+    const std::vector<TrackHandle>& handles = snapshot->handles;
+    size_t chunks = (handles.size() + Paths::CHUNK_ROWS - 1) / Paths::CHUNK_ROWS;
+    std::vector<bool> refreshed(chunks, false);
+    for (TrackHandle track : refreshedTracks) {
+        size_t index = tracks.indexOf(track);
+        if (index != TrackTable::NOT_FOUND) refreshed[index / Paths::CHUNK_ROWS] = true;
+    }
+    refreshedTracks.clear();
+    // Without edits since the previous snapshot, it's a prefix of this one.
+    bool appended = previous && previous->edits == snapshot->edits;
+    for (size_t chunk = 0; chunk < chunks; ++chunk) {
+        size_t first = chunk * Paths::CHUNK_ROWS;
+        size_t last = std::min(handles.size(), first + Paths::CHUNK_ROWS);
+        bool shared = previous && std::min(previous->handles.size(), first + Paths::CHUNK_ROWS) == last &&
+                      (appended || std::equal(handles.begin() + first, handles.begin() + last, previous->handles.begin() + first));
+        if (shared) {
+            snapshot->paths.append(previous->paths.getChunk(chunk));
+        } else {
+            auto paths = std::make_shared<Paths::Chunk>();
+            paths->reserve(last - first);
+            for (size_t i = first; i < last; ++i) paths->push_back(tracks.getPath(handles[i]));
+            snapshot->paths.append(std::move(paths));
+        }
+        if (shared && !refreshed[chunk]) {
+            snapshot->info.append(previous->info.getChunk(chunk));
+        } else {
+            auto info = std::make_shared<Info::Chunk>();
+            info->reserve(last - first);
+            for (size_t i = first; i < last; ++i) info->push_back(tracks.getInfo(handles[i]));
+            snapshot->info.append(std::move(info));
+        }
+    }
+    std::atomic_store(&playlist, std::shared_ptr<const PlaylistSnapshot>(std::move(snapshot)));
+}
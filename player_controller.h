@@ -0,0 +1,262 @@
+#ifndef PLAYER_CONTROLLER_H
+#define PLAYER_CONTROLLER_H
+
+#include "async_task.h"
+#include "msx_player.h"
+#include "worker_pool.h"
+#include <algorithm>
+#include <array>
+#include <iterator>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+struct PlayerCommand {
+    enum class Type : uint8_t {
+        Play, Pause, Stop, Next, Previous, SetTrack, Seek, SetVolume, SetNormalization,
+        SetCrossfade, SetSpeed, SetPitch, Enqueue, EnqueueMany, LoadFolder, SetVisibleRange, Resume,
+        Remove, Move, PlayNext, AddToQueue, ClearQueue, ReadExportSettings
+    };
+    Type type = Type::Play;
+    float value = 0.0f;     // seconds, percent, speed, semitones or 0/1
+    size_t first = 0;       // track index, or first visible row; Move, PlayNext, AddToQueue: track handle
+    size_t last = 0;        // last visible row; Resume: 1 to start playing; Move: new index;
+                            // SetTrack with a decoder: track handle
+    std::string path;       // Enqueue, LoadFolder; SetTrack with a decoder
+    std::vector<std::string> paths;        // EnqueueMany
+    std::vector<TrackInfo> info;           // EnqueueMany: known metadata, parallel to paths or empty
+    std::vector<TrackHandle> handles;      // Remove
+    std::unique_ptr<TrackDecoder> decoder; // SetTrack: already opened off-thread
+    std::shared_ptr<ExportSettings> exportSettings; // ReadExportSettings: filled in, directory and format given
+};
+
+// Scalar player state, republished by the control thread after every batch
+// of commands and every update.
+struct PlayerState {
+    AudioSink::Status status = AudioSink::Status::Stopped;
+    bool isPlaying = false;
+    bool normalize = false;
+    size_t currentTrack = 0;       // TrackTable::NOT_FOUND once removed
+    TrackHandle currentHandle;
+    TrackHandle audibleHandle;     // lags currentHandle until a change is heard
+    TrackHandle queueHead;         // plays after the current track; null with an empty queue
+    size_t queueLength = 0;
+    size_t trackCount = 0;
+    int64_t positionUs = 0;
+    int64_t durationUs = 0;
+    uint64_t audibleFrame = 0;
+    float volume = 0.0f;
+    float crossfade = 0.0f;
+    float speed = 1.0f;
+    float pitch = 0.0f;            // semitones
+    ResamplerQuality resamplerQuality = ResamplerQuality::Best;
+    uint64_t playlistVersion = 0;  // matches PlaylistSnapshot::version
+    uint64_t commandsApplied = 0;  // compare with a ticket from post()
+};
+
+// Read-only rows in fixed-size chunks that snapshots share, so publishing a
+// playlist copies only the chunks that changed.
+template <typename T>
+class SharedRows {
+public:
+    static constexpr size_t CHUNK_ROWS = 4096;
+    using Chunk = std::vector<T>;
+
+    SharedRows() = default;
+    explicit SharedRows(std::vector<T> rows) {
+        for (size_t first = 0; first < rows.size(); first += CHUNK_ROWS) {
+            size_t last = std::min(rows.size(), first + CHUNK_ROWS);
+            append(std::make_shared<const Chunk>(std::make_move_iterator(rows.begin() + first),
+                                                 std::make_move_iterator(rows.begin() + last)));
+        }
+    }
+
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    const T& operator[](size_t index) const { return (*chunks[index / CHUNK_ROWS])[index % CHUNK_ROWS]; }
+    std::vector<T> toVector() const {
+        std::vector<T> rows;
+        rows.reserve(count);
+        for (const auto& chunk : chunks) rows.insert(rows.end(), chunk->begin(), chunk->end());
+        return rows;
+    }
+
+    size_t getChunkCount() const { return chunks.size(); }
+    const std::shared_ptr<const Chunk>& getChunk(size_t index) const { return chunks[index]; }
+    // Every chunk but the last must hold CHUNK_ROWS rows.
+    void append(std::shared_ptr<const Chunk> chunk) {
+        count += chunk->size();
+        chunks.push_back(std::move(chunk));
+    }
+
+private:
+    std::vector<std::shared_ptr<const Chunk>> chunks;
+    size_t count = 0;
+};
+
+// Playlist paths and metadata. A new snapshot is published whenever they
+// change, sharing the chunks whose tracks and metadata didn't.
+struct PlaylistSnapshot {
+    uint64_t version = 0;
+    uint64_t edits = 0; // TrackTable::getEditCount(): unchanged means only appends since
+    SharedRows<std::string> paths;
+    SharedRows<TrackInfo> info;
+    std::vector<TrackHandle> handles; // stay valid for commands after the playlist changes
+};
+
+// Runs a MusicPlayer on its own control thread. Any thread may post commands;
+// they go through a bounded lock-free MPSC queue and are applied in order.
+// Readers never lock: scalar state comes from a seqlock and the playlist from
+// an atomically swapped shared_ptr, which stays valid for as long as it's held.
+class PlayerController {
+public:
+    static constexpr size_t QUEUE_SIZE = 1024; // power of two
+    static constexpr auto UPDATE_INTERVAL = std::chrono::milliseconds(5);
+    // Metadata trickles in per track; copying the playlist for each would be
+    // quadratic, so metadata-only changes are published at most this often.
+    static constexpr auto METADATA_INTERVAL = std::chrono::milliseconds(100);
+
+    explicit PlayerController(std::unique_ptr<AudioSink> output = nullptr);
+    ~PlayerController();
+
+    PlayerController(const PlayerController&) = delete;
+    PlayerController& operator=(const PlayerController&) = delete;
+
+    // Any thread. Returns a ticket that getState().commandsApplied reaches
+    // once the command has run, or 0 if the queue was full.
+    uint64_t post(PlayerCommand command);
+    uint64_t play();
+    uint64_t pause();
+    uint64_t stop();
+    uint64_t next();
+    uint64_t previous();
+    uint64_t setTrack(size_t trackIndex);
+    uint64_t seek(sf::Time offset);
+    uint64_t setVolume(float percent);
+    uint64_t setNormalization(bool enabled);
+    uint64_t setCrossfade(float seconds);
+    uint64_t setSpeed(float speed);
+    uint64_t setPitch(float semitones);
+    uint64_t addToPlaylist(const std::string& filepath);
+    // One command however many paths, so large playlists don't fill the queue.
+    // Tracks whose `info` is already loaded aren't scanned again.
+    uint64_t addTracks(std::vector<std::string> filepaths, std::vector<TrackInfo> info = {});
+    uint64_t resumeAt(size_t trackIndex, sf::Time offset, bool playing);
+    uint64_t removeTracks(std::vector<TrackHandle> handles);
+    uint64_t moveTrack(TrackHandle track, size_t toIndex);
+    uint64_t playNext(TrackHandle track);
+    uint64_t addToQueue(TrackHandle track);
+    uint64_t clearQueue();
+    uint64_t loadFromFolder(const std::string& folderPath);
+    uint64_t setVisibleRange(size_t first, size_t last);
+    // Blocks until the ticket's command has run; false on timeout.
+    bool wait(uint64_t ticket, std::chrono::milliseconds timeout) const;
+
+    // co_await applied(ticket): resumes on the executor once the command has
+    // run. Yields false for a rejected ticket.
+    class AppliedAwaitable {
+    public:
+        AppliedAwaitable(PlayerController& controller, uint64_t ticket);
+        bool await_ready() const;
+        void await_suspend(std::coroutine_handle<> handle);
+        bool await_resume() const;
+
+    private:
+        PlayerController& controller;
+        uint64_t ticket;
+    };
+    AppliedAwaitable applied(uint64_t ticket);
+
+    // Awaitable versions of the blocking operations. File opening and folder
+    // scans run on a small I/O pool; everything after a co_await resumes on
+    // getExecutor(), which the owner must drain regularly (the UI: per frame).
+    // True once the track is playing.
+    Task<bool> openAsync(size_t trackIndex);
+    // Resolves to the number of tracks added.
+    Task<size_t> importAsync(std::string folderPath);
+    // An M3U, PLS, XSPF or binary playlist. Entries of text playlists whose
+    // files are missing are skipped; binary playlists are trusted, like the
+    // session, and bring their metadata along. Resolves to the number of
+    // tracks added.
+    Task<size_t> importPlaylistAsync(std::string path);
+    // Writes the playlist as it is now, in the format the extension names.
+    Task<bool> exportPlaylistAsync(std::string path);
+    // Renders every track with the current playback settings to numbered
+    // files in `directory`, on a thread of its own while playback goes on.
+    // Resolves to the number of files written; shutting down cancels it.
+    Task<size_t> exportTracksAsync(std::string directory, ExportFormat format);
+    Task<bool> seekAsync(sf::Time offset);
+    Executor& getExecutor();
+
+    // Any thread, lock-free.
+    PlayerState getState() const;
+    // Swapped only when the playlist changes; callers holding one can skip
+    // this until getState().playlistVersion moves past its version.
+    std::shared_ptr<const PlaylistSnapshot> getPlaylist() const;
+    // The sink's tap is written by the audio thread and safe to read anywhere.
+    const SampleTap& getSampleTap() const;
+    AudioSink::Stats getSinkStats() const;
+
+private:
+    template <typename T>
+    struct MpscQueue {
+        struct Cell {
+            std::atomic<size_t> sequence;
+            T item;
+        };
+        std::array<Cell, QUEUE_SIZE> cells;
+        std::atomic<size_t> tail{0};
+        size_t head = 0; // consumer only
+        MpscQueue();
+        // Returns the item's position in the stream plus one, or 0 when full.
+        uint64_t push(T&& item);
+        bool pop(T& item);
+        bool empty() const;
+    };
+
+    // Readers copy the words out and retry if the sequence moved; the words
+    // are atomics so a torn read is never undefined behaviour, just discarded.
+    template <typename T>
+    struct SeqLock {
+        static_assert(std::is_trivially_copyable<T>::value, "SeqLock needs a trivially copyable type");
+        static constexpr size_t WORDS = (sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+        std::array<std::atomic<uint64_t>, WORDS> words{};
+        std::atomic<uint32_t> sequence{0};
+        void store(const T& value);
+        T load() const;
+    };
+
+    void run();
+    // Returns true if the playlist changed.
+    bool apply(PlayerCommand& command);
+    void publishState();
+    void publishPlaylist();
+
+    MusicPlayer player;
+    MpscQueue<PlayerCommand> commands;
+    uint64_t appliedCount = 0;
+    uint64_t playlistVersion = 0;
+    std::vector<TrackHandle> refreshedTracks; // metadata changed since publishPlaylist()
+    SeqLock<PlayerState> state;
+    std::shared_ptr<const PlaylistSnapshot> playlist;
+    Executor executor;
+    WorkerPool ioPool; // after executor: its jobs post to it until joined
+    std::mutex exportMutex;
+    BatchExporter* runningExport = nullptr;
+    bool exportsClosed = false;
+    WorkerPool exportPool; // last: joined first, after the destructor cancels the export
+
+    std::mutex wakeMutex;
+    std::condition_variable wake;
+    std::atomic<bool> sleeping{false};
+    std::atomic<bool> running{true};
+    std::thread thread;
+};
+
+#endif // PLAYER_CONTROLLER_H
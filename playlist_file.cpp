@@ -0,0 +1,467 @@
+#include "playlist_file.h"
+#include "binary_playlist.h"
+#include "logger.h"
+#include "mapped_file.h"
+#include "metrics.h"
+#include "trace.h"
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <thread>
+#include <sys/stat.h>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+MetricHistogram scanDurationMetric("msx_folder_scan_seconds", "Time to list a folder's audio files",
+                                   {0.001, 0.01, 0.05, 0.1, 0.5, 1, 5, 30});
+
+// stat() mostly waits on the disk or the network, so this is about
+// overlapping requests rather than cores.
+constexpr size_t VALIDATE_THREADS = 8;
+constexpr size_t VALIDATE_MIN_PER_THREAD = 256;
+
+std::string_view trim(std::string_view text) {
+    while (!text.empty() && (text.front() == ' ' || text.front() == '\t')) text.remove_prefix(1);
+    while (!text.empty() && (text.back() == ' ' || text.back() == '\t' || text.back() == '\r')) text.remove_suffix(1);
+    return text;
+}
+
+bool startsWithNoCase(std::string_view text, std::string_view prefix) {
+    if (text.size() < prefix.size()) return false;
+    for (size_t i = 0; i < prefix.size(); ++i) {
+        if (std::tolower(static_cast<unsigned char>(text[i])) != prefix[i]) return false;
+    }
+    return true;
+}
+
+int hexValue(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+void appendUtf8(std::string& out, uint32_t codepoint) {
+    if (codepoint < 0x80) {
+        out += static_cast<char>(codepoint);
+    } else if (codepoint < 0x800) {
+        out += static_cast<char>(0xC0 | (codepoint >> 6));
+        out += static_cast<char>(0x80 | (codepoint & 0x3F));
+    } else if (codepoint < 0x10000) {
+        out += static_cast<char>(0xE0 | (codepoint >> 12));
+        out += static_cast<char>(0x80 | ((codepoint >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (codepoint & 0x3F));
+    } else if (codepoint < 0x110000) {
+        out += static_cast<char>(0xF0 | (codepoint >> 18));
+        out += static_cast<char>(0x80 | ((codepoint >> 12) & 0x3F));
+        out += static_cast<char>(0x80 | ((codepoint >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (codepoint & 0x3F));
+    }
+}
+
+std::string percentDecode(std::string_view text) {
+    std::string out;
+    out.reserve(text.size());
+    for (size_t i = 0; i < text.size(); ++i) {
+        if (text[i] == '%' && i + 2 < text.size() && hexValue(text[i + 1]) >= 0 && hexValue(text[i + 2]) >= 0) {
+            out += static_cast<char>(hexValue(text[i + 1]) * 16 + hexValue(text[i + 2]));
+            i += 2;
+        } else {
+            out += text[i];
+        }
+    }
+    return out;
+}
+
+// Text content of an XML element: the five named entities and numeric references.
+std::string xmlDecode(std::string_view text) {
+    std::string out;
+    out.reserve(text.size());
+    for (size_t i = 0; i < text.size(); ++i) {
+        if (text[i] != '&') {
+            out += text[i];
+            continue;
+        }
+        size_t end = text.find(';', i);
+        if (end == std::string_view::npos || end - i > 10) {
+            out += text[i];
+            continue;
+        }
+        std::string_view entity = text.substr(i + 1, end - i - 1);
+        if (entity == "amp") out += '&';
+        else if (entity == "lt") out += '<';
+        else if (entity == "gt") out += '>';
+        else if (entity == "quot") out += '"';
+        else if (entity == "apos") out += '\'';
+        else if (entity.size() > 1 && entity[0] == '#') {
+            bool hex = entity[1] == 'x' || entity[1] == 'X';
+            appendUtf8(out, static_cast<uint32_t>(std::strtoul(std::string(entity.substr(hex ? 2 : 1)).c_str(), nullptr, hex ? 16 : 10)));
+        } else {
+            out.append(text.substr(i, end - i + 1));
+        }
+        i = end;
+    }
+    return out;
+}
+
+void appendXmlEscaped(std::string& out, std::string_view text) {
+    for (char c : text) {
+        switch (c) {
+        case '&': out += "&amp;"; break;
+        case '<': out += "&lt;"; break;
+        case '>': out += "&gt;"; break;
+        case '"': out += "&quot;"; break;
+        default: out += c;
+        }
+    }
+}
+
+void appendPercentEncoded(std::string& out, std::string_view path) {
+    static const char digits[] = "0123456789ABCDEF";
+    for (unsigned char c : path) {
+        if (std::isalnum(c) || c == '/' || c == '-' || c == '_' || c == '.' || c == '~') {
+            out += static_cast<char>(c);
+        } else {
+            out += '%';
+            out += digits[c >> 4];
+            out += digits[c & 15];
+        }
+    }
+}
+
+// Resolves entries against the playlist's folder with plain string joins;
+// only entries with "." or ".." segments, or doubled slashes, go through
+// std::filesystem to be normalized.
+class PathResolver {
+public:
+    explicit PathResolver(const std::string& playlistPath) {
+        base = fs::absolute(fs::path(playlistPath)).parent_path().lexically_normal().string();
+        if (base.empty() || base.back() != '/') base += '/';
+    }
+
+    // `uri`: the entry is a URI reference (XSPF), so it is percent-decoded
+    // even without a file:// scheme.
+    bool resolve(std::string_view entry, bool uri, std::string& out) const {
+        entry = trim(entry);
+        if (entry.empty()) return false;
+        std::string decoded;
+        if (startsWithNoCase(entry, "file://")) {
+            entry.remove_prefix(7);
+            if (startsWithNoCase(entry, "localhost/")) entry.remove_prefix(9);
+            decoded = percentDecode(entry);
+        } else if (entry.find("://") != std::string_view::npos) {
+            return false; // a stream or web URL
+        } else {
+            decoded = uri ? percentDecode(entry) : std::string(entry);
+        }
+#ifndef _WIN32
+        // Playlists written on Windows.
+        std::replace(decoded.begin(), decoded.end(), '\\', '/');
+#endif
+        if (decoded.empty()) return false;
+        out = decoded[0] == '/' ? std::move(decoded) : base + decoded;
+        if (needsNormalizing(out)) out = fs::path(out).lexically_normal().string();
+        return true;
+    }
+
+    // The path as a playlist in this folder would refer to it.
+    std::string_view relative(std::string_view path) const {
+        if (path.size() > base.size() && path.compare(0, base.size(), base) == 0) return path.substr(base.size());
+        return path;
+    }
+
+private:
+    static bool needsNormalizing(const std::string& path) {
+        return path.find("//") != std::string::npos || path.find("/./") != std::string::npos ||
+               path.find("/../") != std::string::npos ||
+               (path.size() >= 2 && path.compare(path.size() - 2, 2, "/.") == 0) ||
+               (path.size() >= 3 && path.compare(path.size() - 3, 3, "/..") == 0);
+    }
+
+    std::string base; // ends with '/'
+};
+
+// Calls fn for each line, without its line break.
+template <typename F>
+void forEachLine(std::string_view text, F fn) {
+    if (text.size() >= 3 && text.compare(0, 3, "\xEF\xBB\xBF") == 0) text.remove_prefix(3);
+    size_t position = 0;
+    while (position < text.size()) {
+        const void* found = std::memchr(text.data() + position, '\n', text.size() - position);
+        size_t end = found ? static_cast<const char*>(found) - text.data() : text.size();
+        std::string_view line = text.substr(position, end - position);
+        if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+        fn(line);
+        position = end + 1;
+    }
+}
+
+void parseM3u(std::string_view text, const PathResolver& resolver, std::vector<std::string>& tracks) {
+    std::string path;
+    forEachLine(text, [&](std::string_view line) {
+        if (line.empty() || line[0] == '#') return;
+        if (resolver.resolve(line, false, path)) tracks.push_back(std::move(path));
+    });
+}
+
+// FileN=path lines, ordered by N rather than by where they appear.
+void parsePls(std::string_view text, const PathResolver& resolver, std::vector<std::string>& tracks) {
+    std::vector<std::pair<unsigned long, std::string>> entries;
+    std::string path;
+    forEachLine(text, [&](std::string_view line) {
+        line = trim(line);
+        if (!startsWithNoCase(line, "file")) return;
+        size_t equals = line.find('=');
+        if (equals == std::string_view::npos || equals == 4) return;
+        std::string_view number = line.substr(4, equals - 4);
+        if (!std::all_of(number.begin(), number.end(), [](char c) { return c >= '0' && c <= '9'; })) return;
+        if (resolver.resolve(line.substr(equals + 1), false, path)) {
+            entries.emplace_back(std::strtoul(std::string(number).c_str(), nullptr, 10), std::move(path));
+        }
+    });
+    std::stable_sort(entries.begin(), entries.end(),
+                     [](const auto& a, const auto& b) { return a.first < b.first; });
+    for (auto& entry : entries) tracks.push_back(std::move(entry.second));
+}
+
+// Only <location> elements inside <trackList> are tracks; the playlist
+// itself may have one too. Not a general XML parser: CDATA sections and
+// comments around locations aren't handled.
+void parseXspf(std::string_view text, const PathResolver& resolver, std::vector<std::string>& tracks) {
+    static constexpr std::string_view OPEN = "<location>";
+    static constexpr std::string_view CLOSE = "</location>";
+    size_t position = text.find("<trackList");
+    std::string path;
+    while (position != std::string_view::npos) {
+        size_t open = text.find(OPEN, position);
+        if (open == std::string_view::npos) break;
+        size_t start = open + OPEN.size();
+        size_t end = text.find(CLOSE, start);
+        if (end == std::string_view::npos) break;
+        if (resolver.resolve(xmlDecode(text.substr(start, end - start)), true, path)) tracks.push_back(std::move(path));
+        position = end + CLOSE.size();
+    }
+}
+
+std::string titleOf(const std::vector<TrackInfo>& info, size_t index) {
+    if (index >= info.size() || info[index].title().empty()) return {};
+    std::string title;
+    if (!info[index].artist().empty()) {
+        title = info[index].artist();
+        title += " - ";
+    }
+    title += info[index].title();
+    // One line per entry in both M3U and PLS.
+    std::replace(title.begin(), title.end(), '\n', ' ');
+    std::replace(title.begin(), title.end(), '\r', ' ');
+    return title;
+}
+
+// Seconds, or -1 when unknown as both M3U and PLS expect.
+long lengthOf(const std::vector<TrackInfo>& info, size_t index) {
+    if (index >= info.size() || info[index].durationMs == 0) return -1;
+    return static_cast<long>((info[index].durationMs + 500) / 1000);
+}
+
+} // namespace
+
+bool getPlaylistFormat(const std::string& path, PlaylistFormat& format) {
+    std::string ext = fs::path(path).extension().string();
+    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+    if (ext == ".m3u" || ext == ".m3u8") {
+        format = PlaylistFormat::M3u;
+    } else if (ext == ".pls") {
+        format = PlaylistFormat::Pls;
+    } else if (ext == ".xspf") {
+        format = PlaylistFormat::Xspf;
+    } else if (ext == ".msxpl") {
+        format = PlaylistFormat::Binary;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool readPlaylist(const std::string& path, std::vector<std::string>& tracks, std::vector<TrackInfo>* info) {
+    TraceScope scope("readPlaylist");
+    PlaylistFormat format;
+    if (!getPlaylistFormat(path, format)) {
+        logError("Unsupported playlist format", {{"path", path}});
+        return false;
+    }
+    size_t before = tracks.size();
+    if (format == PlaylistFormat::Binary) {
+        BinaryPlaylist playlist;
+        if (!playlist.open(path)) return false;
+        tracks.reserve(before + playlist.size());
+        if (info) info->resize(before);
+        for (size_t i = 0; i < playlist.size(); ++i) {
+            std::string track = playlist.getPath(i);
+            if (track.empty()) continue;
+            tracks.push_back(std::move(track));
+            if (!info) continue;
+            info->emplace_back();
+            playlist.getInfo(i, info->back());
+        }
+        return true;
+    }
+    MappedFile file;
+    if (!file.open(path)) return false;
+    PathResolver resolver(path);
+    switch (format) {
+    case PlaylistFormat::M3u: parseM3u(file.view(), resolver, tracks); break;
+    case PlaylistFormat::Pls: parsePls(file.view(), resolver, tracks); break;
+    case PlaylistFormat::Xspf: parseXspf(file.view(), resolver, tracks); break;
+    case PlaylistFormat::Binary: break;
+    }
+    if (info) info->resize(tracks.size());
+    logInfo("Read playlist", {{"path", path}, {"tracks", tracks.size() - before}});
+    return true;
+}
+
+size_t removeMissingTracks(std::vector<std::string>& tracks, std::vector<TrackInfo>* info) {
+    TraceScope scope("removeMissingTracks");
+    std::vector<char> present(tracks.size(), 0);
+    std::atomic<size_t> next{0};
+    auto check = [&] {
+        // Claims chunks rather than single paths to keep the counter cold.
+        constexpr size_t CHUNK = 64;
+        for (size_t first; (first = next.fetch_add(CHUNK)) < tracks.size();) {
+            size_t last = std::min(first + CHUNK, tracks.size());
+            for (size_t i = first; i < last; ++i) {
+                struct stat info;
+                present[i] = ::stat(tracks[i].c_str(), &info) == 0 && S_ISREG(info.st_mode);
+            }
+        }
+    };
+    size_t threadCount = std::min(VALIDATE_THREADS, tracks.size() / VALIDATE_MIN_PER_THREAD);
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < threadCount; ++i) threads.emplace_back(check);
+    check();
+    for (auto& thread : threads) thread.join();
+
+    size_t kept = 0;
+    for (size_t i = 0; i < tracks.size(); ++i) {
+        if (present[i]) {
+            if (kept != i) {
+                tracks[kept] = std::move(tracks[i]);
+                if (info && i < info->size()) (*info)[kept] = std::move((*info)[i]);
+            }
+            ++kept;
+        }
+    }
+    size_t dropped = tracks.size() - kept;
+    tracks.resize(kept);
+    if (info && info->size() > kept) info->resize(kept);
+    if (dropped > 0) logWarn("Skipped missing playlist entries", {{"count", dropped}});
+    return dropped;
+}
+
+bool writePlaylist(const std::string& path, const std::vector<std::string>& tracks, const std::vector<TrackInfo>& info) {
+    TraceScope scope("writePlaylist");
+    PlaylistFormat format;
+    if (!getPlaylistFormat(path, format)) {
+        logError("Unsupported playlist format", {{"path", path}});
+        return false;
+    }
+    if (format == PlaylistFormat::Binary) return writeBinaryPlaylist(path, tracks, info);
+    PathResolver resolver(path);
+    std::string out;
+    out.reserve(tracks.size() * 96);
+    switch (format) {
+    case PlaylistFormat::M3u:
+        out += "#EXTM3U\n";
+        for (size_t i = 0; i < tracks.size(); ++i) {
+            std::string title = titleOf(info, i);
+            if (!title.empty()) out += "#EXTINF:" + std::to_string(lengthOf(info, i)) + "," + title + "\n";
+            out += resolver.relative(tracks[i]);
+            out += '\n';
+        }
+        break;
+    case PlaylistFormat::Pls:
+        out += "[playlist]\n";
+        for (size_t i = 0; i < tracks.size(); ++i) {
+            std::string number = std::to_string(i + 1);
+            out += "File" + number + "=";
+            out += resolver.relative(tracks[i]);
+            out += '\n';
+            std::string title = titleOf(info, i);
+            if (!title.empty()) out += "Title" + number + "=" + title + "\n";
+            out += "Length" + number + "=" + std::to_string(lengthOf(info, i)) + "\n";
+        }
+        out += "NumberOfEntries=" + std::to_string(tracks.size()) + "\nVersion=2\n";
+        break;
+    case PlaylistFormat::Xspf:
+        out += "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<playlist version=\"1\" xmlns=\"http://xspf.org/ns/0/\">\n"
+               "  <trackList>\n";
+        for (size_t i = 0; i < tracks.size(); ++i) {
+            out += "    <track>\n      <location>";
+            std::string_view location = resolver.relative(tracks[i]);
+            if (!location.empty() && location[0] == '/') out += "file://";
+            appendPercentEncoded(out, location);
+            out += "</location>\n";
+            if (i < info.size() && !info[i].title().empty()) {
+                out += "      <title>";
+                appendXmlEscaped(out, info[i].title());
+                out += "</title>\n";
+            }
+            if (i < info.size() && !info[i].artist().empty()) {
+                out += "      <creator>";
+                appendXmlEscaped(out, info[i].artist());
+                out += "</creator>\n";
+            }
+            if (i < info.size() && info[i].durationMs > 0) {
+                out += "      <duration>" + std::to_string(info[i].durationMs) + "</duration>\n";
+            }
+            out += "    </track>\n";
+        }
+        out += "  </trackList>\n</playlist>\n";
+        break;
+    case PlaylistFormat::Binary:
+        break;
+    }
+
+    std::string temporary = path + ".tmp";
+    FILE* file = std::fopen(temporary.c_str(), "wb");
+    if (!file) {
+        logError("Failed to write playlist", {{"path", temporary}});
+        return false;
+    }
+    bool ok = std::fwrite(out.data(), 1, out.size(), file) == out.size();
+    ok = std::fclose(file) == 0 && ok;
+    if (ok && std::rename(temporary.c_str(), path.c_str()) != 0) ok = false;
+    if (!ok) {
+        std::remove(temporary.c_str());
+        logError("Failed to write playlist", {{"path", path}});
+        return false;
+    }
+    logInfo("Wrote playlist", {{"path", path}, {"tracks", tracks.size()}});
+    return true;
+}
+
+bool scanFolder(const std::string& folderPath, std::vector<std::string>& tracks) {
+    TraceScope scope("scanFolder");
+    auto start = std::chrono::steady_clock::now();
+    static const char* const supportedExtensions[] = {".mp3", ".wav", ".ogg", ".flac"};
+    std::error_code error;
+    fs::directory_iterator entries(folderPath, error);
+    if (error) {
+        logError("Error loading folder", {{"path", folderPath}, {"error", error.message()}});
+        return false;
+    }
+    for (const auto& entry : entries) {
+        std::string ext = entry.path().extension().string();
+        std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+        if (std::find(std::begin(supportedExtensions), std::end(supportedExtensions), ext) != std::end(supportedExtensions)) {
+            tracks.push_back(entry.path().string());
+        }
+    }
+    scanDurationMetric.observe(std::chrono::steady_clock::now() - start);
+    return true;
+}
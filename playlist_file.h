@@ -0,0 +1,42 @@
+#ifndef PLAYLIST_FILE_H
+#define PLAYLIST_FILE_H
+
+#include "track_metadata.h"
+#include <string>
+#include <vector>
+
+enum class PlaylistFormat {
+    M3u, // .m3u and .m3u8, read and written as UTF-8
+    Pls,
+    Xspf,
+    Binary // .msxpl, see binary_playlist.h
+};
+
+// From the extension; false if it isn't a playlist format.
+bool getPlaylistFormat(const std::string& path, PlaylistFormat& format);
+
+// Reads an M3U/M3U8, PLS, XSPF or binary playlist into absolute, normalized
+// paths in playlist order. The file is mapped and parsed in place; relative
+// entries are resolved against the playlist's folder and URLs other than
+// file:// are skipped. If `info` is given it gets one entry per track, filled
+// only for binary playlists saved with metadata. Returns false if the file
+// can't be read.
+bool readPlaylist(const std::string& path, std::vector<std::string>& tracks, std::vector<TrackInfo>* info = nullptr);
+
+// Drops tracks whose files don't exist, checking many at once since
+// playlists often point at network shares. `info`, if given, runs parallel
+// to `tracks` and is compacted with it. Returns the number dropped.
+size_t removeMissingTracks(std::vector<std::string>& tracks, std::vector<TrackInfo>* info = nullptr);
+
+// Writes `tracks` in the format the extension names, with titles and
+// durations from `info` where they're known. Text formats write tracks inside
+// the playlist's folder relative to it, so the folder can be moved as a
+// whole; binary playlists keep absolute paths and all of `info`. The file is
+// replaced atomically.
+bool writePlaylist(const std::string& path, const std::vector<std::string>& tracks, const std::vector<TrackInfo>& info);
+
+// Appends the supported audio files directly inside a folder, in directory
+// order. Returns false if the folder can't be listed.
+bool scanFolder(const std::string& folderPath, std::vector<std::string>& tracks);
+
+#endif // PLAYLIST_FILE_H
@@ -0,0 +1,215 @@
+#include "resampler.h"
+#include "logger.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <numeric>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+constexpr double PI = 3.14159265358979323846;
+
+struct Preset {
+    size_t taps;
+    double beta;    // Kaiser window shape
+    double rolloff; // passband edge as a fraction of the lower Nyquist
+};
+
+Preset presetFor(ResamplerQuality quality) {
+    switch (quality) {
+    case ResamplerQuality::Fast: return {16, 6.0, 0.85};
+    case ResamplerQuality::Balanced: return {32, 8.5, 0.91};
+    default: return {64, 11.0, 0.95};
+    }
+}
+
+double besselI0(double x) {
+    double sum = 1.0, term = 1.0;
+    for (int k = 1; k < 40; ++k) {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+        if (term < sum * 1e-12) break;
+    }
+    return sum;
+}
+
+// Dot product of one coefficient row with both planar channels.
+void dotStereo(const float* h, const float* l, const float* r, size_t taps, float& outLeft, float& outRight) {
+    size_t k = 0;
+#if defined(__AVX2__)
+    __m256 accL = _mm256_setzero_ps(), accR = _mm256_setzero_ps();
+    for (; k + 8 <= taps; k += 8) {
+        __m256 c = _mm256_loadu_ps(h + k);
+#if defined(__FMA__)
+        accL = _mm256_fmadd_ps(c, _mm256_loadu_ps(l + k), accL);
+        accR = _mm256_fmadd_ps(c, _mm256_loadu_ps(r + k), accR);
+#else
+        accL = _mm256_add_ps(accL, _mm256_mul_ps(c, _mm256_loadu_ps(l + k)));
+        accR = _mm256_add_ps(accR, _mm256_mul_ps(c, _mm256_loadu_ps(r + k)));
+#endif
+    }
+    // Horizontal sums of both accumulators at once.
+    __m256 sums = _mm256_hadd_ps(accL, accR);
+    __m128 folded = _mm_add_ps(_mm256_castps256_ps128(sums), _mm256_extractf128_ps(sums, 1));
+    float lanes[4];
+    _mm_storeu_ps(lanes, folded);
+    float sumL = lanes[0] + lanes[1], sumR = lanes[2] + lanes[3];
+#elif defined(__ARM_NEON)
+    float32x4_t accL = vdupq_n_f32(0.0f), accR = vdupq_n_f32(0.0f);
+    for (; k + 4 <= taps; k += 4) {
+        float32x4_t c = vld1q_f32(h + k);
+        accL = vmlaq_f32(accL, c, vld1q_f32(l + k));
+        accR = vmlaq_f32(accR, c, vld1q_f32(r + k));
+    }
+    float32x2_t halfL = vadd_f32(vget_low_f32(accL), vget_high_f32(accL));
+    float32x2_t halfR = vadd_f32(vget_low_f32(accR), vget_high_f32(accR));
+    float sumL = vget_lane_f32(vpadd_f32(halfL, halfL), 0), sumR = vget_lane_f32(vpadd_f32(halfR, halfR), 0);
+#elif defined(__SSE2__)
+    __m128 accL = _mm_setzero_ps(), accR = _mm_setzero_ps();
+    for (; k + 4 <= taps; k += 4) {
+        __m128 c = _mm_loadu_ps(h + k);
+        accL = _mm_add_ps(accL, _mm_mul_ps(c, _mm_loadu_ps(l + k)));
+        accR = _mm_add_ps(accR, _mm_mul_ps(c, _mm_loadu_ps(r + k)));
+    }
+    float lanesL[4], lanesR[4];
+    _mm_storeu_ps(lanesL, accL);
+    _mm_storeu_ps(lanesR, accR);
+    float sumL = (lanesL[0] + lanesL[1]) + (lanesL[2] + lanesL[3]);
+    float sumR = (lanesR[0] + lanesR[1]) + (lanesR[2] + lanesR[3]);
+#else
+    float sumL = 0.0f, sumR = 0.0f;
+#endif
+    for (; k < taps; ++k) {
+        sumL += h[k] * l[k];
+        sumR += h[k] * r[k];
+    }
+    outLeft = sumL;
+    outRight = sumR;
+}
+
+} // namespace
+
+Resampler::Resampler(unsigned inRate, unsigned outRate, ResamplerQuality quality)
+    : inputRate(std::max(1u, inRate)), outputRate(std::max(1u, outRate)) {
+    uint32_t divisor = std::gcd(inputRate, outputRate);
+    upFactor = outputRate / divisor;
+    downFactor = inputRate / divisor;
+    if (upFactor > MAX_PHASES) {
+        // Odd rate pairs: keep the phase table bounded at the cost of a
+        // tiny (<0.05%) speed error.
+        downFactor = static_cast<uint32_t>(std::lround(static_cast<double>(downFactor) * MAX_PHASES / upFactor));
+        upFactor = MAX_PHASES;
+        logInfo("Resampler: approximating rate pair", {{"input", inputRate}, {"output", outputRate},
+                                                     {"up", upFactor}, {"down", downFactor}});
+    }
+
+    Preset preset = presetFor(quality);
+    double ratio = static_cast<double>(upFactor) / downFactor;
+    // Downsampling narrows the passband relative to the input, so the filter
+    // needs proportionally more taps for the same transition quality.
+    taps = preset.taps;
+    if (ratio < 1.0) taps = static_cast<size_t>(std::ceil(preset.taps / ratio));
+    taps = std::min(MAX_TAPS, (taps + 7) / 8 * 8);
+    double cutoff = std::min(1.0, ratio) * preset.rolloff;
+
+    coefficients.resize(static_cast<size_t>(upFactor) * taps);
+    double half = taps / 2.0;
+    double center = half - 1.0;
+    double norm = besselI0(preset.beta);
+    for (uint32_t p = 0; p < upFactor; ++p) {
+        float* row = &coefficients[static_cast<size_t>(p) * taps];
+        double sum = 0.0;
+        for (size_t k = 0; k < taps; ++k) {
+            double x = (static_cast<double>(k) - center) - static_cast<double>(p) / upFactor;
+            double sinc = std::abs(x) < 1e-12 ? 1.0 : std::sin(PI * cutoff * x) / (PI * cutoff * x);
+            double w = x / half;
+            double window = std::abs(w) >= 1.0 ? 0.0 : besselI0(preset.beta * std::sqrt(1.0 - w * w)) / norm;
+            double value = cutoff * sinc * window;
+            row[k] = static_cast<float>(value);
+            sum += value;
+        }
+        // Unity DC gain on every phase, so no phase-dependent ripple.
+        for (size_t k = 0; k < taps; ++k) row[k] = static_cast<float>(row[k] / sum);
+    }
+
+    left.resize(taps + CHUNK);
+    right.resize(taps + CHUNK);
+    reset();
+}
+
+void Resampler::reset() {
+    // taps/2 - 1 frames of silence put the first output on input frame 0.
+    fill = taps / 2 - 1;
+    std::fill(left.begin(), left.begin() + fill, 0.0f);
+    std::fill(right.begin(), right.begin() + fill, 0.0f);
+    index = 0;
+    phase = 0;
+    drainRemaining = taps / 2;
+}
+
+size_t Resampler::produce(float* output, size_t outputFrames) {
+    size_t produced = 0;
+    while (produced < outputFrames && index + taps <= fill) {
+        const float* row = &coefficients[static_cast<size_t>(phase) * taps];
+        dotStereo(row, &left[index], &right[index], taps, output[2 * produced], output[2 * produced + 1]);
+        produced++;
+        phase += downFactor;
+        index += phase / upFactor;
+        phase %= upFactor;
+    }
+    // Keep only the history the next window still needs.
+    size_t keep = index < fill ? fill - index : 0;
+    if (index > 0) {
+        std::memmove(left.data(), left.data() + std::min(index, fill), keep * sizeof(float));
+        std::memmove(right.data(), right.data() + std::min(index, fill), keep * sizeof(float));
+        index = index > fill ? index - fill : 0;
+        fill = keep;
+    }
+    return produced;
+}
+
+size_t Resampler::process(const float* input, size_t inputFrames, size_t& consumed, float* output, size_t outputFrames) {
+    consumed = 0;
+    size_t produced = 0;
+    while (produced < outputFrames) {
+        size_t space = left.size() - fill;
+        size_t take = std::min(space, inputFrames - consumed);
+        for (size_t i = 0; i < take; ++i) {
+            left[fill + i] = input[2 * (consumed + i)];
+            right[fill + i] = input[2 * (consumed + i) + 1];
+        }
+        fill += take;
+        consumed += take;
+        size_t made = produce(output + 2 * produced, outputFrames - produced);
+        produced += made;
+        if (made == 0 && (take == 0 || consumed == inputFrames)) break;
+    }
+    return produced;
+}
+
+size_t Resampler::drain(float* output, size_t outputFrames) {
+    size_t produced = 0;
+    while (produced < outputFrames) {
+        size_t pad = std::min(drainRemaining, left.size() - fill);
+        std::fill(left.begin() + fill, left.begin() + fill + pad, 0.0f);
+        std::fill(right.begin() + fill, right.begin() + fill + pad, 0.0f);
+        fill += pad;
+        drainRemaining -= pad;
+        size_t made = produce(output + 2 * produced, outputFrames - produced);
+        produced += made;
+        if (made == 0) break;
+    }
+    return produced;
+}
+
+unsigned Resampler::getInputRate() const { return inputRate; }
+unsigned Resampler::getOutputRate() const { return outputRate; }
+size_t Resampler::getTapCount() const { return taps; }
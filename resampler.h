@@ -0,0 +1,53 @@
+#ifndef RESAMPLER_H
+#define RESAMPLER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+enum class ResamplerQuality : uint8_t {
+    Fast,     // 16 taps per phase
+    Balanced, // 32 taps per phase
+    Best      // 64 taps per phase
+};
+
+// Rational polyphase resampler for interleaved stereo float, using a
+// Kaiser-windowed sinc. Each output frame is one dot product per channel
+// against the phase's coefficient row (AVX2/FMA, NEON or SSE).
+// Output frame n lines up with input time n * inputRate / outputRate.
+class Resampler {
+public:
+    static constexpr size_t MAX_PHASES = 1024;
+    static constexpr size_t MAX_TAPS = 256;
+
+    Resampler(unsigned inputRate, unsigned outputRate, ResamplerQuality quality);
+
+    // Consumes up to `inputFrames` and writes up to `outputFrames`; returns
+    // the frames written and sets `consumed`.
+    size_t process(const float* input, size_t inputFrames, size_t& consumed, float* output, size_t outputFrames);
+    // Pushes silence through so the last input frames come out; call once at end of input.
+    size_t drain(float* output, size_t outputFrames);
+    // Drops history, e.g. after a seek.
+    void reset();
+
+    unsigned getInputRate() const;
+    unsigned getOutputRate() const;
+    size_t getTapCount() const;
+
+private:
+    static constexpr size_t CHUNK = 4096; // input frames buffered per call
+
+    size_t produce(float* output, size_t outputFrames);
+
+    unsigned inputRate, outputRate;
+    uint32_t upFactor, downFactor; // L and M of L/M
+    size_t taps;
+    std::vector<float> coefficients; // phase-major, `taps` per phase
+    std::vector<float> left, right;  // planar history
+    size_t fill = 0;                 // frames in history
+    size_t index = 0;                // window start of the next output
+    uint32_t phase = 0;
+    size_t drainRemaining = 0;
+};
+
+#endif // RESAMPLER_H
@@ -0,0 +1,56 @@
+#include "sample_tap.h"
+
+namespace {
+
+constexpr uint64_t MASK = SampleTap::CAPACITY - 1;
+
+uint32_t packFrame(int16_t left, int16_t right) {
+    return uint32_t(uint16_t(left)) | (uint32_t(uint16_t(right)) << 16);
+}
+
+} // namespace
+
+SampleTap::SampleTap() : ring(new std::atomic<uint32_t>[CAPACITY]) {
+    for (size_t i = 0; i < CAPACITY; ++i) ring[i].store(0, std::memory_order_relaxed);
+}
+
+void SampleTap::reset(unsigned rate, unsigned channels, uint64_t startFrame) {
+    generation.fetch_add(1, std::memory_order_release);
+    sampleRate.store(rate, std::memory_order_relaxed);
+    channelCount.store(channels, std::memory_order_relaxed);
+    writeFrame.store(startFrame, std::memory_order_release);
+}
+
+void SampleTap::push(const int16_t* samples, size_t sampleCount) {
+    unsigned channels = channelCount.load(std::memory_order_relaxed);
+    if (channels == 0) return;
+    uint64_t frame = writeFrame.load(std::memory_order_relaxed);
+    size_t frames = sampleCount / channels;
+    for (size_t i = 0; i < frames; ++i) {
+        const int16_t* s = samples + i * channels;
+        ring[(frame + i) & MASK].store(packFrame(s[0], channels > 1 ? s[1] : s[0]), std::memory_order_relaxed);
+    }
+    writeFrame.store(frame + frames, std::memory_order_release);
+}
+
+bool SampleTap::read(uint64_t endFrame, float* left, float* right, size_t frames) const {
+    if (frames > CAPACITY / 2 || endFrame < frames) return false;
+    uint32_t gen = generation.load(std::memory_order_acquire);
+    uint64_t written = writeFrame.load(std::memory_order_acquire);
+    uint64_t start = endFrame - frames;
+    if (endFrame > written || start + CAPACITY < written) return false;
+
+    const float scale = 1.0f / 32768.0f;
+    for (size_t i = 0; i < frames; ++i) {
+        uint32_t packed = ring[(start + i) & MASK].load(std::memory_order_relaxed);
+        left[i] = int16_t(packed & 0xFFFF) * scale;
+        right[i] = int16_t(packed >> 16) * scale;
+    }
+
+    // If the writer lapped us or the stream was reset mid-copy, the copy is torn.
+    std::atomic_thread_fence(std::memory_order_acquire);
+    uint64_t after = writeFrame.load(std::memory_order_relaxed);
+    return generation.load(std::memory_order_relaxed) == gen && start + CAPACITY >= after;
+}
+
+unsigned SampleTap::getSampleRate() const { return sampleRate.load(std::memory_order_relaxed); }
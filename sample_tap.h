@@ -0,0 +1,35 @@
+#ifndef SAMPLE_TAP_H
+#define SAMPLE_TAP_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+// Copy of the most recent audio handed to the device, indexed by absolute
+// frame position in the output stream. One writer (the audio thread) never
+// blocks or allocates; readers validate their copy instead of taking a lock.
+class SampleTap {
+public:
+    static constexpr size_t CAPACITY = 1 << 19; // frames, covers SFML's ~3 s of queued buffers
+
+    SampleTap();
+
+    // Only while the stream is stopped (open/seek).
+    void reset(unsigned sampleRate, unsigned channelCount, uint64_t startFrame);
+    void push(const int16_t* samples, size_t sampleCount);
+
+    // Copies `frames` stereo frames ending at `endFrame` into left/right as
+    // floats in [-1, 1]. Returns false if that range is not (or no longer) available.
+    bool read(uint64_t endFrame, float* left, float* right, size_t frames) const;
+    unsigned getSampleRate() const;
+
+private:
+    // Each slot packs one stereo frame, so a frame is always read whole.
+    std::unique_ptr<std::atomic<uint32_t>[]> ring;
+    std::atomic<uint64_t> writeFrame{0};
+    std::atomic<uint32_t> generation{0};
+    std::atomic<unsigned> sampleRate{0};
+    std::atomic<unsigned> channelCount{0};
+};
+
+#endif // SAMPLE_TAP_H
@@ -0,0 +1,316 @@
+#include "seek_index.h"
+#include "file_cache.h"
+#include "track_metadata.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+namespace {
+
+constexpr char INDEX_MAGIC[4] = {'M', 'S', 'X', 'K'};
+constexpr uint32_t INDEX_VERSION = 1;
+constexpr size_t SCAN_CHUNK = 1 << 20;
+
+uint32_t readBE32(const uint8_t* p) { return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | p[3]; }
+uint64_t readBE64(const uint8_t* p) { return (uint64_t(readBE32(p)) << 32) | readBE32(p + 4); }
+uint16_t readBE16(const uint8_t* p) { return uint16_t((p[0] << 8) | p[1]); }
+uint32_t readBE24(const uint8_t* p) { return (uint32_t(p[0]) << 16) | (uint32_t(p[1]) << 8) | p[2]; }
+
+bool readAt(std::ifstream& file, uint64_t offset, void* dst, size_t count) {
+    file.clear();
+    file.seekg(static_cast<std::streamoff>(offset));
+    file.read(static_cast<char*>(dst), static_cast<std::streamsize>(count));
+    return static_cast<size_t>(file.gcount()) == count;
+}
+
+uint64_t fileSize(std::ifstream& file) {
+    file.clear();
+    file.seekg(0, std::ios::end);
+    return static_cast<uint64_t>(file.tellg());
+}
+
+uint64_t skipId3v2(std::ifstream& file) {
+    uint8_t header[10];
+    return readAt(file, 0, header, sizeof(header)) ? getId3v2TagSize(header) : 0;
+}
+
+size_t xingOffset(const Mp3FrameHeader& header) {
+    return 4 + (header.mpeg1 ? (header.channels == 1 ? 17 : 32) : (header.channels == 1 ? 9 : 17));
+}
+
+} // namespace
+
+bool SeekIndex::buildFromContainer(const std::string& filepath) {
+    std::ifstream file(filepath, std::ios::binary);
+    if (!file) return false;
+    points.clear();
+    source = Source::None;
+    uint64_t size = fileSize(file);
+    uint64_t start = skipId3v2(file);
+
+    uint8_t magic[4];
+    if (!readAt(file, start, magic, sizeof(magic))) return false;
+
+    if (std::memcmp(magic, "fLaC", 4) == 0) {
+        std::vector<SeekPoint> table;
+        uint64_t pos = start + 4;
+        bool last = false;
+        while (!last) {
+            uint8_t header[4];
+            if (!readAt(file, pos, header, sizeof(header))) return false;
+            last = header[0] & 0x80;
+            uint8_t type = header[0] & 0x7F;
+            uint32_t length = readBE24(header + 1);
+            pos += 4;
+            if (type == 0 && length >= 18) {
+                uint8_t si[18];
+                if (!readAt(file, pos, si, sizeof(si))) return false;
+                uint16_t minBlock = readBE16(si);
+                uint16_t maxBlock = readBE16(si + 2);
+                frameSamples = minBlock == maxBlock ? minBlock : 0;
+                sampleRate = (uint32_t(si[10]) << 12) | (uint32_t(si[11]) << 4) | (si[12] >> 4);
+                sampleCount = (uint64_t(si[13] & 0x0F) << 32) | readBE32(si + 14);
+            } else if (type == 3) {
+                std::vector<uint8_t> raw(length);
+                if (!readAt(file, pos, raw.data(), raw.size())) return false;
+                for (size_t i = 0; i + 18 <= raw.size(); i += 18) {
+                    uint64_t sample = readBE64(&raw[i]);
+                    if (sample == ~uint64_t(0)) continue; // placeholder
+                    table.push_back({sample, readBE64(&raw[i + 8])});
+                }
+            } else if (type == 127) {
+                return false;
+            }
+            pos += length;
+        }
+        // Seek table offsets are relative to the first frame, which follows the last metadata block.
+        for (auto& point : table) point.byteOffset += pos;
+        points.push_back({0, pos});
+        points.insert(points.end(), table.begin(), table.end());
+        if (points.size() < 2 || sampleRate == 0) return false;
+        source = Source::FlacSeekTable;
+        finalize();
+        return true;
+    }
+
+    std::vector<uint8_t> buf(static_cast<size_t>(std::min<uint64_t>(64 * 1024, size > start ? size - start : 0)));
+    if (buf.size() < 4 || !readAt(file, start, buf.data(), buf.size())) return false;
+    Mp3FrameHeader header;
+    size_t first = findMp3FrameSync(buf.data(), buf.size(), header);
+    if (first == buf.size()) return false;
+    const uint8_t* frame = &buf[first];
+    size_t available = buf.size() - first;
+    uint64_t audioStart = start + first;
+    sampleRate = header.sampleRate;
+    frameSamples = header.samplesPerFrame;
+
+    size_t xing = xingOffset(header);
+    if (xing + 120 <= available &&
+        (std::memcmp(frame + xing, "Xing", 4) == 0 || std::memcmp(frame + xing, "Info", 4) == 0)) {
+        const uint8_t* p = frame + xing + 4;
+        uint32_t flags = readBE32(p);
+        p += 4;
+        uint32_t frames = 0;
+        uint64_t bytes = size - audioStart;
+        if (flags & 0x1) { frames = readBE32(p); p += 4; }
+        if (flags & 0x2) { bytes = readBE32(p); p += 4; }
+        if (!(flags & 0x4) || frames == 0) return false;
+        // TOC entry i is the byte position (in 1/256ths of the stream) at i percent of the duration.
+        sampleCount = uint64_t(frames) * frameSamples;
+        uint64_t firstAudio = audioStart + header.frameLength;
+        for (int i = 0; i < 100; ++i) {
+            points.push_back({sampleCount * i / 100, firstAudio + bytes * p[i] / 256});
+        }
+        source = Source::XingToc;
+        finalize();
+        return true;
+    }
+
+    if (36 + 26 <= available && std::memcmp(frame + 36, "VBRI", 4) == 0) {
+        const uint8_t* p = frame + 36;
+        uint32_t frames = readBE32(p + 14);
+        uint16_t entries = readBE16(p + 18);
+        uint16_t scale = readBE16(p + 20);
+        uint16_t entrySize = readBE16(p + 22);
+        uint16_t framesPerEntry = readBE16(p + 24);
+        if (entrySize < 1 || entrySize > 4 || 26 + size_t(entries) * entrySize > available - 36) return false;
+        sampleCount = uint64_t(frames) * frameSamples;
+        uint64_t offset = audioStart + header.frameLength;
+        const uint8_t* toc = p + 26;
+        points.push_back({0, offset});
+        for (uint16_t i = 0; i + 1 < entries; ++i) {
+            uint32_t value = 0;
+            for (uint16_t b = 0; b < entrySize; ++b) value = (value << 8) | toc[i * entrySize + b];
+            offset += uint64_t(value) * scale;
+            points.push_back({uint64_t(i + 1) * framesPerEntry * frameSamples, offset});
+        }
+        source = Source::VbriToc;
+        finalize();
+        return true;
+    }
+    return false;
+}
+
+bool SeekIndex::buildByScanning(const std::string& filepath, uint32_t framesPerPoint) {
+    std::ifstream file(filepath, std::ios::binary);
+    if (!file) return false;
+    uint64_t size = fileSize(file);
+    uint64_t pos = skipId3v2(file);
+
+    std::vector<uint8_t> buf(SCAN_CHUNK);
+    uint64_t bufStart = 0;
+    size_t bufLen = 0;
+    auto fill = [&](uint64_t at) {
+        bufStart = at;
+        bufLen = static_cast<size_t>(std::min<uint64_t>(buf.size(), size > at ? size - at : 0));
+        return bufLen >= 4 && readAt(file, at, buf.data(), bufLen);
+    };
+
+    if (!fill(pos)) return false;
+    // Only MP3 streams are scanned; PCM data in other containers can look like frame syncs.
+    if (std::memcmp(buf.data(), "fLaC", 4) == 0 || std::memcmp(buf.data(), "OggS", 4) == 0 ||
+        std::memcmp(buf.data(), "RIFF", 4) == 0) {
+        return false;
+    }
+    Mp3FrameHeader header;
+    size_t first = findMp3FrameSync(buf.data(), bufLen, header);
+    if (first == bufLen) return false;
+    pos = bufStart + first;
+    sampleRate = header.sampleRate;
+    frameSamples = header.samplesPerFrame;
+
+    // A Xing/Info frame carries no audio, decoders skip it.
+    size_t xing = xingOffset(header);
+    if (first + xing + 4 <= bufLen &&
+        (std::memcmp(&buf[first + xing], "Xing", 4) == 0 || std::memcmp(&buf[first + xing], "Info", 4) == 0 ||
+         (first + 40 <= bufLen && std::memcmp(&buf[first + 36], "VBRI", 4) == 0))) {
+        pos += header.frameLength;
+    }
+
+    std::vector<SeekPoint> scanned;
+    uint64_t sample = 0;
+    uint64_t frameIndex = 0;
+    while (pos + 4 <= size) {
+        if (pos < bufStart || pos + 4 > bufStart + bufLen) {
+            if (!fill(pos)) break;
+        }
+        const uint8_t* p = &buf[pos - bufStart];
+        if (!parseMp3FrameHeader(p, header) || header.sampleRate != sampleRate) {
+            // Lost sync (junk or a trailing tag): look for the next frame in this chunk.
+            size_t offset = static_cast<size_t>(pos - bufStart) + 1;
+            size_t next = findMp3FrameSync(&buf[offset], bufLen - offset, header);
+            if (next == bufLen - offset) {
+                if (bufStart + bufLen >= size) break;
+                pos = bufStart + bufLen - 3;
+                continue;
+            }
+            pos = bufStart + offset + next;
+            continue;
+        }
+        if (frameIndex % framesPerPoint == 0) scanned.push_back({sample, pos});
+        sample += header.samplesPerFrame;
+        pos += header.frameLength;
+        ++frameIndex;
+    }
+    if (scanned.empty()) return false;
+
+    points.swap(scanned);
+    sampleCount = sample;
+    source = Source::FrameScan;
+    finalize();
+    return true;
+}
+
+bool SeekIndex::load(const std::string& cachePath, const std::string& filepath) {
+    FileIdentity expected, stored;
+    if (cachePath.empty() || !getFileIdentity(filepath, expected)) return false;
+    std::ifstream in(cachePath, std::ios::binary);
+    char magic[4];
+    uint32_t version = 0;
+    uint64_t count = 0;
+    in.read(magic, sizeof(magic));
+    in.read(reinterpret_cast<char*>(&version), sizeof(version));
+    in.read(reinterpret_cast<char*>(&stored), sizeof(stored));
+    if (!in || std::memcmp(magic, INDEX_MAGIC, 4) != 0 || version != INDEX_VERSION || stored != expected) return false;
+
+    in.read(reinterpret_cast<char*>(&source), sizeof(source));
+    in.read(reinterpret_cast<char*>(&sampleRate), sizeof(sampleRate));
+    in.read(reinterpret_cast<char*>(&frameSamples), sizeof(frameSamples));
+    in.read(reinterpret_cast<char*>(&sampleCount), sizeof(sampleCount));
+    in.read(reinterpret_cast<char*>(&count), sizeof(count));
+    if (!in || count == 0 || count > (expected.size / 4 + 1)) return false;
+    points.resize(static_cast<size_t>(count));
+    in.read(reinterpret_cast<char*>(points.data()), static_cast<std::streamsize>(count * sizeof(SeekPoint)));
+    if (!in) {
+        points.clear();
+        return false;
+    }
+    finalize();
+    return true;
+}
+
+bool SeekIndex::save(const std::string& cachePath, const std::string& filepath) const {
+    FileIdentity identity;
+    if (cachePath.empty() || points.empty() || !getFileIdentity(filepath, identity)) return false;
+    // Write to a temporary name first so a crash never leaves a truncated index behind.
+    std::string tmpPath = getTemporaryPath(cachePath);
+    bool ok;
+    {
+        std::ofstream out(tmpPath, std::ios::binary | std::ios::trunc);
+        uint64_t count = points.size();
+        out.write(INDEX_MAGIC, sizeof(INDEX_MAGIC));
+        out.write(reinterpret_cast<const char*>(&INDEX_VERSION), sizeof(INDEX_VERSION));
+        out.write(reinterpret_cast<const char*>(&identity), sizeof(identity));
+        out.write(reinterpret_cast<const char*>(&source), sizeof(source));
+        out.write(reinterpret_cast<const char*>(&sampleRate), sizeof(sampleRate));
+        out.write(reinterpret_cast<const char*>(&frameSamples), sizeof(frameSamples));
+        out.write(reinterpret_cast<const char*>(&sampleCount), sizeof(sampleCount));
+        out.write(reinterpret_cast<const char*>(&count), sizeof(count));
+        out.write(reinterpret_cast<const char*>(points.data()), static_cast<std::streamsize>(count * sizeof(SeekPoint)));
+        out.close();
+        ok = static_cast<bool>(out);
+    }
+    if (ok && std::rename(tmpPath.c_str(), cachePath.c_str()) == 0) return true;
+    std::remove(tmpPath.c_str());
+    return false;
+}
+
+SeekPoint SeekIndex::lookup(uint64_t sample) const {
+    if (points.empty()) return {0, 0};
+    size_t bucket = static_cast<size_t>(std::min<uint64_t>(sample / bucketSize, buckets.size() - 1));
+    size_t i = buckets[bucket];
+    // Points are spread evenly enough that this walks at most a couple of entries.
+    while (i + 1 < points.size() && points[i + 1].sample <= sample) ++i;
+    return points[i];
+}
+
+uint64_t SeekIndex::getFrameBoundary(uint64_t sample) const {
+    if (sampleCount > 0) sample = std::min(sample, sampleCount);
+    if (!isFrameAccurate()) return sample;
+    SeekPoint point = lookup(sample);
+    uint64_t boundary = point.sample + (sample - point.sample + frameSamples - 1) / frameSamples * frameSamples;
+    return sampleCount > 0 ? std::min(boundary, sampleCount) : boundary;
+}
+
+bool SeekIndex::isEmpty() const { return points.empty(); }
+bool SeekIndex::isFrameAccurate() const {
+    // Variable-blocksize FLAC only has the seek table's own points.
+    return frameSamples > 0 && source != Source::None && source != Source::XingToc;
+}
+SeekIndex::Source SeekIndex::getSource() const { return source; }
+uint32_t SeekIndex::getSampleRate() const { return sampleRate; }
+uint64_t SeekIndex::getSampleCount() const { return sampleCount; }
+
+void SeekIndex::finalize() {
+    std::sort(points.begin(), points.end(), [](const SeekPoint& a, const SeekPoint& b) { return a.sample < b.sample; });
+    uint64_t span = std::max<uint64_t>(sampleCount, points.back().sample + 1);
+    bucketSize = std::max<uint64_t>(1, span / points.size());
+    buckets.resize(static_cast<size_t>(span / bucketSize + 1));
+    size_t i = 0;
+    for (size_t b = 0; b < buckets.size(); ++b) {
+        uint64_t start = b * bucketSize;
+        while (i + 1 < points.size() && points[i + 1].sample <= start) ++i;
+        buckets[b] = static_cast<uint32_t>(i);
+    }
+}
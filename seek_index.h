@@ -0,0 +1,53 @@
+#ifndef SEEK_INDEX_H
+#define SEEK_INDEX_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct SeekPoint {
+    uint64_t sample;      // first sample (per channel) of the frame
+    uint64_t byteOffset;  // absolute file offset of the frame header
+};
+
+// Sparse time -> frame map for one file. Points are bucketed on a uniform
+// grid, so lookup() costs the same at the end of a three hour set as at the start.
+class SeekIndex {
+public:
+    enum class Source : uint8_t { None, FlacSeekTable, XingToc, VbriToc, FrameScan };
+
+    // Reads the container's own table (FLAC SEEKTABLE, Xing or VBRI TOC). Cheap.
+    bool buildFromContainer(const std::string& filepath);
+    // Walks every MP3 frame header and keeps every Nth one. Reads the whole
+    // file but decodes nothing; meant for a background thread.
+    bool buildByScanning(const std::string& filepath, uint32_t framesPerPoint = 8);
+
+    bool load(const std::string& cachePath, const std::string& filepath);
+    bool save(const std::string& cachePath, const std::string& filepath) const;
+
+    // Last indexed point at or before `sample`.
+    SeekPoint lookup(uint64_t sample) const;
+    // First frame boundary at or after `sample`, clamped to the end of the
+    // stream. Only meaningful when isFrameAccurate().
+    uint64_t getFrameBoundary(uint64_t sample) const;
+
+    bool isEmpty() const;
+    // Frames have a fixed length and the points sit on frame starts.
+    bool isFrameAccurate() const;
+    Source getSource() const;
+    uint32_t getSampleRate() const;
+    uint64_t getSampleCount() const;
+
+private:
+    void finalize();
+
+    std::vector<SeekPoint> points;
+    std::vector<uint32_t> buckets;  // buckets[i] = last point at or before i * bucketSize
+    uint64_t bucketSize = 1;
+    uint64_t sampleCount = 0;
+    uint32_t sampleRate = 0;
+    uint32_t frameSamples = 0;      // 0 when frames are not a fixed number of samples
+    Source source = Source::None;
+};
+
+#endif // SEEK_INDEX_H
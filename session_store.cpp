@@ -0,0 +1,620 @@
+#include "session_store.h"
+#include "file_cache.h"
+#include "logger.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <algorithm>
+#include <fstream>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+constexpr char SNAPSHOT_MAGIC[4] = {'M', 'S', 'X', 'S'};
+constexpr char JOURNAL_MAGIC[4] = {'M', 'S', 'X', 'J'};
+constexpr uint32_t FORMAT_VERSION = 2;
+constexpr size_t JOURNAL_HEADER_BYTES = 16;
+// Track info flags, as in the .msxpl records.
+constexpr uint8_t INFO_LOADED = 1;
+constexpr uint8_t INFO_LOUDNESS = 2;
+
+// Journal record: payload length (u32), type (u8), payload, and a hash of
+// type and payload (u64). Integers are in host byte order; the files never
+// leave the machine. Remove holds ascending track indices, Move a from and
+// to index, both as they were before the record.
+enum class RecordType : uint8_t { State = 1, Tracks = 2, Remove = 3, Move = 4 };
+
+template <typename T>
+void put(std::string& out, T value) {
+    char bytes[sizeof(T)];
+    std::memcpy(bytes, &value, sizeof(T));
+    out.append(bytes, sizeof(T));
+}
+
+void putString(std::string& out, const std::string& text) {
+    put<uint32_t>(out, static_cast<uint32_t>(text.size()));
+    out += text;
+}
+
+void putInfo(std::string& out, const TrackInfo& info) {
+    put<uint8_t>(out, (info.loaded ? INFO_LOADED : 0) | (info.hasLoudness ? INFO_LOUDNESS : 0));
+    if (info.loaded) {
+        putString(out, info.text);
+        put(out, info.artistPos);
+        put(out, info.albumPos);
+        put(out, info.trackNumber);
+        put(out, info.channels);
+        put(out, info.durationMs);
+        put(out, info.sampleRate);
+    }
+    if (info.hasLoudness) {
+        put(out, info.loudnessLufs);
+        put(out, info.truePeakDb);
+    }
+}
+
+// Tracks [first, paths.size()) with their info, from vectors or a snapshot's SharedRows.
+template <typename Paths, typename Info>
+void putTracks(std::string& out, const Paths& paths, const Info& info, size_t first) {
+    put<uint64_t>(out, paths.size() - first);
+    for (size_t i = first; i < paths.size(); ++i) {
+        putString(out, paths[i]);
+        putInfo(out, i < info.size() ? info[i] : TrackInfo{});
+    }
+}
+
+void putState(std::string& out, const SessionState& state) {
+    put(out, state.currentTrack);
+    put(out, state.positionUs);
+    put<uint8_t>(out, state.playing);
+    put<uint8_t>(out, state.normalize);
+    put(out, state.volume);
+    put(out, state.crossfade);
+    put(out, state.speed);
+    put(out, state.pitch);
+    put(out, state.scrollOffset);
+}
+
+class Reader {
+public:
+    Reader(const std::string& bytes, size_t start = 0, size_t end = std::string::npos)
+        : data(bytes.data()), size(std::min(end, bytes.size())), position(start) {}
+
+    size_t getPosition() const { return position; }
+    size_t remaining() const { return size - position; }
+
+    template <typename T>
+    bool get(T& value) {
+        if (remaining() < sizeof(T)) return false;
+        std::memcpy(&value, data + position, sizeof(T));
+        position += sizeof(T);
+        return true;
+    }
+
+    bool getString(std::string& text) {
+        uint32_t length;
+        if (!get(length) || remaining() < length) return false;
+        text.assign(data + position, length);
+        position += length;
+        return true;
+    }
+
+    bool getState(SessionState& state) {
+        uint8_t playing, normalize;
+        if (!get(state.currentTrack) || !get(state.positionUs) || !get(playing) || !get(normalize) ||
+            !get(state.volume) || !get(state.crossfade) || !get(state.speed) || !get(state.pitch) ||
+            !get(state.scrollOffset)) {
+            return false;
+        }
+        state.playing = playing != 0;
+        state.normalize = normalize != 0;
+        return true;
+    }
+
+    bool getMagic(const char (&magic)[4]) {
+        if (remaining() < sizeof(magic) || std::memcmp(data + position, magic, sizeof(magic)) != 0) return false;
+        position += sizeof(magic);
+        return true;
+    }
+
+    bool getInfo(TrackInfo& info) {
+        uint8_t flags;
+        info = TrackInfo{};
+        if (!get(flags)) return false;
+        if ((flags & INFO_LOADED) &&
+            (!getString(info.text) || !get(info.artistPos) || !get(info.albumPos) || !get(info.trackNumber) ||
+             !get(info.channels) || !get(info.durationMs) || !get(info.sampleRate) ||
+             info.artistPos > info.text.size() || info.albumPos > info.text.size())) {
+            return false;
+        }
+        if ((flags & INFO_LOUDNESS) && (!get(info.loudnessLufs) || !get(info.truePeakDb))) return false;
+        info.loaded = (flags & INFO_LOADED) != 0;
+        info.hasLoudness = (flags & INFO_LOUDNESS) != 0;
+        return true;
+    }
+
+    // Each track reserves its length prefix and flags, so a corrupt count
+    // can't make the reserve below huge.
+    bool getTracks(std::vector<std::string>& paths, std::vector<TrackInfo>& info) {
+        uint64_t count;
+        if (!get(count) || count > remaining() / (sizeof(uint32_t) + 1)) return false;
+        paths.reserve(paths.size() + count);
+        info.reserve(info.size() + count);
+        std::string path;
+        TrackInfo known;
+        for (uint64_t i = 0; i < count; ++i) {
+            if (!getString(path) || !getInfo(known)) return false;
+            paths.push_back(std::move(path));
+            info.push_back(std::move(known));
+        }
+        return true;
+    }
+
+    // Applies a Remove record, whose indices must be ascending and in range;
+    // the tracks are only touched once the whole record checks out.
+    bool getRemoval(std::vector<std::string>& paths, std::vector<TrackInfo>& info) {
+        uint64_t count;
+        if (!get(count) || count > remaining() / sizeof(uint64_t)) return false;
+        std::vector<uint64_t> removed(count);
+        for (uint64_t i = 0; i < count; ++i) {
+            if (!get(removed[i]) || removed[i] >= paths.size() || (i > 0 && removed[i] <= removed[i - 1])) return false;
+        }
+        size_t kept = removed.empty() ? paths.size() : removed[0];
+        for (size_t i = kept, next = 0; i < paths.size(); ++i) {
+            if (next < removed.size() && removed[next] == i) {
+                ++next;
+                continue;
+            }
+            paths[kept] = std::move(paths[i]);
+            info[kept] = std::move(info[i]);
+            ++kept;
+        }
+        paths.resize(kept);
+        info.resize(kept);
+        return true;
+    }
+
+    bool getMove(std::vector<std::string>& paths, std::vector<TrackInfo>& info) {
+        uint64_t from, to;
+        if (!get(from) || !get(to) || from >= paths.size() || to >= paths.size()) return false;
+        if (from < to) {
+            std::rotate(paths.begin() + from, paths.begin() + from + 1, paths.begin() + to + 1);
+            std::rotate(info.begin() + from, info.begin() + from + 1, info.begin() + to + 1);
+        } else {
+            std::rotate(paths.begin() + to, paths.begin() + from, paths.begin() + from + 1);
+            std::rotate(info.begin() + to, info.begin() + from, info.begin() + from + 1);
+        }
+        return true;
+    }
+
+private:
+    const char* data;
+    size_t size;
+    size_t position;
+};
+
+void appendRecord(std::string& out, RecordType type, const std::string& payload) {
+    put<uint32_t>(out, static_cast<uint32_t>(payload.size()));
+    size_t start = out.size();
+    put(out, static_cast<uint8_t>(type));
+    out += payload;
+    put(out, hashBytes(out.data() + start, out.size() - start));
+}
+
+template <typename Paths, typename Info>
+std::string encodeSnapshot(uint64_t generation, const SessionState& state, const Paths& paths, const Info& info) {
+    std::string out;
+    size_t bytes = 64;
+    for (size_t i = 0; i < paths.size(); ++i) {
+        bytes += paths[i].size() + 40;
+        if (i < info.size()) bytes += info[i].text.size();
+    }
+    out.reserve(bytes);
+    out.append(SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    put(out, FORMAT_VERSION);
+    put(out, generation);
+    putState(out, state);
+    putTracks(out, paths, info, 0);
+    put(out, hashBytes(out.data(), out.size()));
+    return out;
+}
+
+bool decodeSnapshot(const std::string& contents, uint64_t& generation, SessionState& state,
+                    std::vector<std::string>& paths, std::vector<TrackInfo>& info) {
+    if (contents.size() < sizeof(uint64_t)) return false;
+    size_t body = contents.size() - sizeof(uint64_t);
+    uint64_t stored;
+    std::memcpy(&stored, contents.data() + body, sizeof(stored));
+    if (stored != hashBytes(contents.data(), body)) return false;
+    Reader reader(contents, 0, body);
+    uint32_t version;
+    return reader.getMagic(SNAPSHOT_MAGIC) && reader.get(version) && version == FORMAT_VERSION &&
+           reader.get(generation) && reader.getState(state) && reader.getTracks(paths, info);
+}
+
+std::string journalHeader(uint64_t generation) {
+    std::string out(JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC));
+    put(out, FORMAT_VERSION);
+    put(out, generation);
+    return out;
+}
+
+bool readFile(const std::string& path, std::string& contents) {
+    std::ifstream in(path, std::ios::binary | std::ios::ate);
+    if (!in) return false;
+    contents.resize(static_cast<size_t>(in.tellg()));
+    in.seekg(0);
+    return static_cast<bool>(in.read(contents.data(), contents.size()));
+}
+
+bool writeAll(int fd, const std::string& data) {
+    size_t written = 0;
+    while (written < data.size()) {
+        ssize_t result = ::write(fd, data.data() + written, data.size() - written);
+        if (result < 0) return false;
+        written += static_cast<size_t>(result);
+    }
+    return true;
+}
+
+bool syncData(int fd) {
+#ifdef __APPLE__
+    return ::fsync(fd) == 0;
+#else
+    return ::fdatasync(fd) == 0;
+#endif
+}
+
+// Makes a rename durable.
+void syncDirectory(const std::string& directory) {
+    int fd = ::open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) return;
+    ::fsync(fd);
+    ::close(fd);
+}
+
+// Written and synced under a temporary name, then renamed over `path`.
+bool replaceFile(const std::string& path, const std::string& contents, const std::string& directory) {
+    std::string temporary = path + ".tmp";
+    int fd = ::open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) return false;
+    bool ok = writeAll(fd, contents) && syncData(fd);
+    ok = ::close(fd) == 0 && ok;
+    if (ok) ok = std::rename(temporary.c_str(), path.c_str()) == 0;
+    if (!ok) {
+        std::remove(temporary.c_str());
+        return false;
+    }
+    syncDirectory(directory);
+    return true;
+}
+
+double millisecondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+} // namespace
+
+// SessionStore implementation
+std::string SessionStore::defaultDirectory() {
+    fs::path root;
+    if (const char* xdg = std::getenv("XDG_STATE_HOME"); xdg && *xdg) {
+        root = xdg;
+    } else if (const char* home = std::getenv("HOME"); home && *home) {
+        root = fs::path(home) / ".local" / "state";
+    } else {
+        return {};
+    }
+    return (root / "msx_player").string();
+}
+
+SessionStore::SessionStore(std::string sessionDirectory)
+    : directory(std::move(sessionDirectory)),
+      snapshotPath((fs::path(directory) / "session.snapshot").string()),
+      journalPath((fs::path(directory) / "session.journal").string()) {}
+
+SessionStore::~SessionStore() {
+    if (thread.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_one();
+        thread.join();
+    }
+    if (journal >= 0) ::close(journal);
+}
+
+bool SessionStore::open(SessionState& state, std::vector<std::string>& paths, std::vector<TrackInfo>& info) {
+    if (directory.empty() || thread.joinable()) return false;
+    std::error_code error;
+    fs::create_directories(directory, error);
+    if (error) {
+        logError("Failed to create session directory", {{"path", directory}, {"error", error.message()}});
+        return false;
+    }
+    auto start = std::chrono::steady_clock::now();
+    bool restored = load(state, paths, info);
+    logInfo("Session loaded", {{"tracks", paths.size()}, {"restored", restored}, {"ms", millisecondsSince(start)}});
+    if (!startJournal()) return restored;
+    observed = state;
+    observedTracks = paths.size();
+    positionObserved = std::chrono::steady_clock::now();
+    thread = std::thread(&SessionStore::run, this);
+    return restored;
+}
+
+bool SessionStore::load(SessionState& state, std::vector<std::string>& paths, std::vector<TrackInfo>& info) {
+    bool restored = false;
+    std::string contents;
+    if (readFile(snapshotPath, contents)) {
+        if (decodeSnapshot(contents, generation, savedState, savedPaths, savedInfo)) {
+            restored = true;
+        } else {
+            generation = 0;
+            savedState = SessionState();
+            savedPaths.clear();
+            savedInfo.clear();
+            logWarn("Ignoring damaged session snapshot", {{"path", snapshotPath}});
+        }
+    }
+
+    // A journal from an older generation was folded into the snapshot just
+    // before a crash; startJournal() replaces it.
+    journalBytes = 0;
+    if (!readFile(journalPath, contents)) contents.clear();
+    Reader header(contents);
+    uint32_t version;
+    uint64_t journalGeneration;
+    if (header.getMagic(JOURNAL_MAGIC) && header.get(version) && version == FORMAT_VERSION &&
+        header.get(journalGeneration) && journalGeneration == generation) {
+        Reader reader(contents, JOURNAL_HEADER_BYTES);
+        size_t valid = reader.getPosition();
+        size_t records = 0;
+        for (;;) {
+            uint32_t length;
+            uint8_t type;
+            uint64_t stored;
+            size_t start = reader.getPosition() + sizeof(length);
+            if (!reader.get(length) || reader.remaining() < length + sizeof(type) + sizeof(stored)) break;
+            Reader record(contents, start + sizeof(type), start + sizeof(type) + length);
+            Reader trailer(contents, start + sizeof(type) + length);
+            if (!reader.get(type) || !trailer.get(stored) ||
+                stored != hashBytes(contents.data() + start, sizeof(type) + length)) {
+                break;
+            }
+            bool ok = false;
+            switch (static_cast<RecordType>(type)) {
+            case RecordType::State: ok = record.getState(savedState); break;
+            case RecordType::Tracks: ok = record.getTracks(savedPaths, savedInfo); break;
+            case RecordType::Remove: ok = record.getRemoval(savedPaths, savedInfo); break;
+            case RecordType::Move: ok = record.getMove(savedPaths, savedInfo); break;
+            }
+            if (!ok) break;
+            reader = trailer;
+            valid = reader.getPosition();
+            ++records;
+        }
+        if (valid < contents.size()) {
+            logWarn("Dropping torn session journal tail", {{"path", journalPath}, {"bytes", contents.size() - valid}});
+            if (::truncate(journalPath.c_str(), static_cast<off_t>(valid)) != 0) valid = 0;
+        }
+        journalBytes = valid;
+        restored = restored || records > 0;
+    }
+    state = savedState;
+    paths = savedPaths;
+    info = savedInfo;
+    restoredTracks = savedPaths.size();
+    return restored;
+}
+
+// Continues the journal load() accepted, or starts a fresh one for the
+// current generation.
+bool SessionStore::startJournal() {
+    if (journal >= 0) ::close(journal);
+    journal = -1;
+    if (journalBytes == 0) {
+        std::string header = journalHeader(generation);
+        if (!replaceFile(journalPath, header, directory)) {
+            logError("Failed to create session journal", {{"path", journalPath}});
+            return false;
+        }
+        journalBytes = header.size();
+    }
+    journal = ::open(journalPath.c_str(), O_WRONLY | O_APPEND | O_CLOEXEC);
+    if (journal < 0) {
+        logError("Failed to open session journal", {{"path", journalPath}});
+        return false;
+    }
+    return true;
+}
+
+void SessionStore::observe(const SessionState& state, const std::shared_ptr<const PlaylistSnapshot>& playlist) {
+    if (!thread.joinable()) return;
+    auto now = std::chrono::steady_clock::now();
+    bool changed = state.currentTrack != observed.currentTrack || state.playing != observed.playing ||
+                   state.normalize != observed.normalize || state.volume != observed.volume ||
+                   state.crossfade != observed.crossfade || state.speed != observed.speed ||
+                   state.pitch != observed.pitch || state.scrollOffset != observed.scrollOffset;
+    // While playing the position moves every frame; a seek while paused doesn't wait.
+    changed = changed || (state.positionUs != observed.positionUs &&
+                          (!state.playing || now - positionObserved >= POSITION_INTERVAL));
+    bool edited = playlist->edits != observedEdits || playlist->paths.size() != observedTracks;
+    // New metadata alone isn't worth a write; it goes into the next snapshot.
+    bool refreshed = playlist->version != observedVersion;
+    if (!changed && !refreshed) return;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (refreshed) pendingPlaylist = playlist;
+        playlistPending = playlistPending || edited;
+        if (changed) {
+            pendingState = state;
+            statePending = true;
+        }
+    }
+    if (changed || edited) wake.notify_one();
+    observedVersion = playlist->version;
+    observedEdits = playlist->edits;
+    observedTracks = playlist->paths.size();
+    if (changed) {
+        observed = state;
+        positionObserved = now;
+    }
+}
+
+void SessionStore::run() {
+    std::unique_lock<std::mutex> lock(mutex);
+    for (;;) {
+        wake.wait(lock, [this] { return stopping || statePending || playlistPending; });
+        // Let a burst (a scroll, an import) settle into one write and one sync.
+        wake.wait_for(lock, BATCH_INTERVAL, [this] { return stopping; });
+        if (pendingPlaylist) latest = std::move(pendingPlaylist);
+        pendingPlaylist.reset();
+        bool playlistChanged = playlistPending && latest;
+        playlistPending = false;
+        SessionState state = pendingState;
+        bool changed = statePending;
+        statePending = false;
+        bool last = stopping;
+        lock.unlock();
+        if (latest && !savedPaths.empty()) {
+            // The player holds the restored tracks now.
+            savedPaths = {};
+            savedInfo = {};
+        }
+        if (changed || playlistChanged) writeBatch(playlistChanged, changed ? &state : nullptr);
+        if (last) {
+            // Next launch reads one file instead of replaying the journal,
+            // with whatever metadata was scanned meanwhile.
+            if (journalBytes > JOURNAL_HEADER_BYTES || (latest && latest->version != snapshotVersion)) compact();
+            return;
+        }
+        lock.lock();
+    }
+}
+
+void SessionStore::writeBatch(bool playlistChanged, const SessionState* changed) {
+    std::string batch;
+    if (changed) savedState = *changed;
+    if (playlistChanged && !journalPlaylist(*latest, batch)) {
+        compact();
+        return;
+    }
+    if (changed) {
+        std::string payload;
+        putState(payload, *changed);
+        appendRecord(batch, RecordType::State, payload);
+    }
+    if (playlistChanged) journaled = latest;
+    // On failure the changes still reach the next snapshot.
+    if (journal >= 0 && writeAll(journal, batch) && syncData(journal)) {
+        journalBytes += batch.size();
+    } else {
+        logError("Failed to write session journal", {{"path", journalPath}});
+    }
+    if (journalBytes > COMPACT_BYTES) compact();
+}
+
+// Appends to `batch` the records that turn what's saved into `playlist`:
+// removals, then at most one move, then new tracks. False if the difference
+// takes more than that, and the playlist needs a new snapshot instead.
+bool SessionStore::journalPlaylist(const PlaylistSnapshot& playlist, std::string& batch) const {
+    std::string payload;
+    if (!journaled) {
+        // Right after open(), the player was sent the restored tracks first.
+        if (playlist.edits != 0 || playlist.paths.size() < restoredTracks) return false;
+        putTracks(payload, playlist.paths, playlist.info, restoredTracks);
+        appendRecord(batch, RecordType::Tracks, payload);
+        return true;
+    }
+    const PlaylistSnapshot& before = *journaled;
+    if (playlist.edits == before.edits) {
+        if (playlist.paths.size() < before.paths.size()) return false;
+        putTracks(payload, playlist.paths, playlist.info, before.paths.size());
+        appendRecord(batch, RecordType::Tracks, payload);
+        return true;
+    }
+    if (playlist.handles.size() != playlist.paths.size() || before.handles.size() != before.paths.size()) return false;
+
+    // Which saved tracks are still listed: handles are unique and slots dense,
+    // so one array indexed by slot answers it without hashing.
+    uint32_t slots = 0;
+    for (TrackHandle handle : before.handles) slots = std::max(slots, handle.slot + 1);
+    for (TrackHandle handle : playlist.handles) slots = std::max(slots, handle.slot + 1);
+    std::vector<uint32_t> listed(slots, 0);
+    for (TrackHandle handle : playlist.handles) listed[handle.slot] = handle.generation;
+    std::vector<TrackHandle> kept;
+    kept.reserve(before.handles.size());
+    payload.clear();
+    uint64_t removed = 0;
+    put<uint64_t>(payload, 0); // count, filled in below
+    for (size_t i = 0; i < before.handles.size(); ++i) {
+        TrackHandle handle = before.handles[i];
+        if (listed[handle.slot] == handle.generation) {
+            kept.push_back(handle);
+        } else {
+            put<uint64_t>(payload, i);
+            ++removed;
+        }
+    }
+    if (kept.size() > playlist.handles.size()) return false;
+    if (removed > 0) {
+        std::memcpy(payload.data(), &removed, sizeof(removed));
+        appendRecord(batch, RecordType::Remove, payload);
+    }
+
+    // What's left must be the start of the playlist, give or take one track
+    // moved from one end of the differing range to the other.
+    const std::vector<TrackHandle>& now = playlist.handles;
+    size_t first = 0;
+    while (first < kept.size() && kept[first] == now[first]) ++first;
+    size_t last = kept.size();
+    while (last > first && kept[last - 1] == now[last - 1]) --last;
+    if (first < last) {
+        uint64_t from, to;
+        if (now[first] == kept[last - 1] && std::equal(kept.begin() + first, kept.begin() + last - 1, now.begin() + first + 1)) {
+            from = last - 1;
+            to = first;
+        } else if (now[last - 1] == kept[first] && std::equal(kept.begin() + first + 1, kept.begin() + last, now.begin() + first)) {
+            from = first;
+            to = last - 1;
+        } else {
+            return false;
+        }
+        payload.clear();
+        put(payload, from);
+        put(payload, to);
+        appendRecord(batch, RecordType::Move, payload);
+    }
+    if (now.size() > kept.size()) {
+        payload.clear();
+        putTracks(payload, playlist.paths, playlist.info, kept.size());
+        appendRecord(batch, RecordType::Tracks, payload);
+    }
+    return true;
+}
+
+bool SessionStore::compact() {
+    auto start = std::chrono::steady_clock::now();
+    size_t tracks = latest ? latest->paths.size() : savedPaths.size();
+    std::string contents = latest ? encodeSnapshot(generation + 1, savedState, latest->paths, latest->info)
+                                  : encodeSnapshot(generation + 1, savedState, savedPaths, savedInfo);
+    if (!replaceFile(snapshotPath, contents, directory)) {
+        logError("Failed to write session snapshot", {{"path", snapshotPath}});
+        return false;
+    }
+    ++generation;
+    journalBytes = 0;
+    if (latest) {
+        journaled = latest;
+        snapshotVersion = latest->version;
+    }
+    bool ok = startJournal();
+    logInfo("Session snapshot written", {{"tracks", tracks}, {"ms", millisecondsSince(start)}});
+    return ok;
+}
@@ -0,0 +1,104 @@
+#ifndef SESSION_STORE_H
+#define SESSION_STORE_H
+
+#include "player_controller.h"
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Everything besides the playlist that a restart should bring back.
+struct SessionState {
+    uint64_t currentTrack = 0;
+    int64_t positionUs = 0;
+    bool playing = false;
+    bool normalize = true;
+    float volume = 100.0f;
+    float crossfade = 0.0f;
+    float speed = 1.0f;
+    float pitch = 0.0f;
+    float scrollOffset = 0.0f;
+};
+
+// Keeps the session in a directory as a snapshot plus an append-only journal
+// of what changed since. A writer thread batches changes, appends them with
+// one fdatasync per batch and folds the journal into a new snapshot once it
+// grows past COMPACT_BYTES and on shutdown, so a crash loses at most the
+// last batch and a clean exit restarts from a single file. Journal records
+// carry a checksum; a torn tail is cut off when the session is next opened.
+// Tracks are stored with their metadata and loudness, so a restored
+// playlist is not rescanned.
+class SessionStore {
+public:
+    static constexpr auto BATCH_INTERVAL = std::chrono::milliseconds(200);
+    // The position is journaled this often while it just advances.
+    static constexpr auto POSITION_INTERVAL = std::chrono::seconds(5);
+    static constexpr uint64_t COMPACT_BYTES = 4 << 20;
+
+    // $XDG_STATE_HOME/msx_player, or ~/.local/state/msx_player; empty if
+    // neither can be determined.
+    static std::string defaultDirectory();
+
+    explicit SessionStore(std::string directory);
+    ~SessionStore();
+
+    SessionStore(const SessionStore&) = delete;
+    SessionStore& operator=(const SessionStore&) = delete;
+
+    // Reads the saved session, if any, and starts journaling. Returns false
+    // when there was nothing to restore (or nowhere to keep a session).
+    // `info` is parallel to `paths`.
+    bool open(SessionState& state, std::vector<std::string>& paths, std::vector<TrackInfo>& info);
+
+    // UI thread, every frame; only takes the lock when something changed.
+    // Appends, removals and a single move between two observations are
+    // journaled; anything else goes into a new snapshot.
+    void observe(const SessionState& state, const std::shared_ptr<const PlaylistSnapshot>& playlist);
+
+private:
+    bool load(SessionState& state, std::vector<std::string>& paths, std::vector<TrackInfo>& info);
+    bool startJournal();
+    void run();
+    void writeBatch(bool playlistChanged, const SessionState* changed);
+    bool journalPlaylist(const PlaylistSnapshot& playlist, std::string& batch) const;
+    bool compact();
+
+    std::string directory;
+    std::string snapshotPath;
+    std::string journalPath;
+
+    // Writer thread only, after open().
+    int journal = -1;
+    uint64_t generation = 0; // of the snapshot the journal extends
+    uint64_t journalBytes = 0;
+    SessionState savedState;
+    // What load() restored, until the first playlist is observed.
+    std::vector<std::string> savedPaths;
+    std::vector<TrackInfo> savedInfo;
+    size_t restoredTracks = 0;
+    std::shared_ptr<const PlaylistSnapshot> latest;    // newest observed, metadata included
+    std::shared_ptr<const PlaylistSnapshot> journaled; // what snapshot and journal hold now
+    uint64_t snapshotVersion = 0;                      // of the playlist in the snapshot
+
+    // UI thread only.
+    SessionState observed;
+    size_t observedTracks = 0;
+    uint64_t observedEdits = 0;
+    uint64_t observedVersion = 0;
+    std::chrono::steady_clock::time_point positionObserved;
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::shared_ptr<const PlaylistSnapshot> pendingPlaylist;
+    bool playlistPending = false; // tracks added, removed or moved; not just new metadata
+    SessionState pendingState;
+    bool statePending = false;
+    bool stopping = false;
+    std::thread thread;
+};
+
+#endif // SESSION_STORE_H
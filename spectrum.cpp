@@ -0,0 +1,206 @@
+#include "spectrum.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+constexpr double PI = 3.14159265358979323846;
+constexpr float MIN_FREQUENCY = 40.0f;
+constexpr float MAX_FREQUENCY = 16000.0f;
+constexpr float FLOOR_DB = -70.0f;
+constexpr float BAR_FALL_PER_SECOND = 1.5f;
+
+float toUnit(float db, float floorDb) {
+    return std::max(0.0f, std::min(1.0f, (db - floorDb) / -floorDb));
+}
+
+} // namespace
+
+RealFft::RealFft(size_t size) : n(size), half(size / 2) {
+    size_t bits = 0;
+    while ((size_t(1) << bits) < half) ++bits;
+
+    bitReverse.resize(half);
+    for (size_t i = 0; i < half; ++i) {
+        uint32_t r = 0;
+        for (size_t b = 0; b < bits; ++b) r |= ((i >> b) & 1u) << (bits - 1 - b);
+        bitReverse[i] = r;
+    }
+
+    window.resize(n);
+    for (size_t i = 0; i < n; ++i) window[i] = static_cast<float>(0.5 - 0.5 * std::cos(2.0 * PI * i / (n - 1)));
+
+    twiddleRe.resize(half);
+    twiddleIm.resize(half);
+    for (size_t m = 2; m <= half; m <<= 1) {
+        for (size_t k = 0; k < m / 2; ++k) {
+            twiddleRe[m / 2 + k] = static_cast<float>(std::cos(-2.0 * PI * k / m));
+            twiddleIm[m / 2 + k] = static_cast<float>(std::sin(-2.0 * PI * k / m));
+        }
+    }
+
+    splitRe.resize(half);
+    splitIm.resize(half);
+    for (size_t k = 0; k < half; ++k) {
+        splitRe[k] = static_cast<float>(std::cos(-2.0 * PI * k / n));
+        splitIm[k] = static_cast<float>(std::sin(-2.0 * PI * k / n));
+    }
+    re.resize(half);
+    im.resize(half);
+}
+
+size_t RealFft::size() const { return n; }
+
+void RealFft::magnitudes(const float* input, float* output) {
+    // Even samples become the real part, odd samples the imaginary part.
+    for (size_t i = 0; i < half; ++i) {
+        uint32_t j = bitReverse[i];
+        re[j] = input[2 * i] * window[2 * i];
+        im[j] = input[2 * i + 1] * window[2 * i + 1];
+    }
+    transform();
+
+    // Untangle the half-size transform into bins 0..n/2-1 of the real one.
+    for (size_t k = 0; k < half; ++k) {
+        size_t c = (half - k) & (half - 1);
+        float zr = re[k], zi = im[k];
+        float cr = re[c], ci = -im[c];
+        float er = 0.5f * (zr + cr), ei = 0.5f * (zi + ci);
+        float dr = 0.5f * (zr - cr), di = 0.5f * (zi - ci);
+        float orr = di, oi = -dr; // -j * d
+        float xr = er + splitRe[k] * orr - splitIm[k] * oi;
+        float xi = ei + splitRe[k] * oi + splitIm[k] * orr;
+        output[k] = std::sqrt(xr * xr + xi * xi);
+    }
+}
+
+void RealFft::transform() {
+    // Radix-4 pass: the first two radix-2 stages fused, all twiddles are 1 or -j.
+    for (size_t i = 0; i + 4 <= half; i += 4) {
+        float a0r = re[i] + re[i + 1], a0i = im[i] + im[i + 1];
+        float a1r = re[i] - re[i + 1], a1i = im[i] - im[i + 1];
+        float a2r = re[i + 2] + re[i + 3], a2i = im[i + 2] + im[i + 3];
+        float a3r = re[i + 2] - re[i + 3], a3i = im[i + 2] - im[i + 3];
+        re[i] = a0r + a2r;      im[i] = a0i + a2i;
+        re[i + 2] = a0r - a2r;  im[i + 2] = a0i - a2i;
+        re[i + 1] = a1r + a3i;  im[i + 1] = a1i - a3r;
+        re[i + 3] = a1r - a3i;  im[i + 3] = a1i + a3r;
+    }
+
+    for (size_t m = 8; m <= half; m <<= 1) {
+        size_t h = m / 2;
+        const float* wr = &twiddleRe[h];
+        const float* wi = &twiddleIm[h];
+        for (size_t j = 0; j < half; j += m) {
+            float* ar = &re[j];
+            float* ai = &im[j];
+            float* br = &re[j + h];
+            float* bi = &im[j + h];
+            size_t k = 0;
+#if defined(__SSE2__)
+            for (; k + 4 <= h; k += 4) {
+                __m128 vwr = _mm_loadu_ps(wr + k), vwi = _mm_loadu_ps(wi + k);
+                __m128 vbr = _mm_loadu_ps(br + k), vbi = _mm_loadu_ps(bi + k);
+                __m128 vtr = _mm_sub_ps(_mm_mul_ps(vbr, vwr), _mm_mul_ps(vbi, vwi));
+                __m128 vti = _mm_add_ps(_mm_mul_ps(vbr, vwi), _mm_mul_ps(vbi, vwr));
+                __m128 var = _mm_loadu_ps(ar + k), vai = _mm_loadu_ps(ai + k);
+                _mm_storeu_ps(br + k, _mm_sub_ps(var, vtr));
+                _mm_storeu_ps(bi + k, _mm_sub_ps(vai, vti));
+                _mm_storeu_ps(ar + k, _mm_add_ps(var, vtr));
+                _mm_storeu_ps(ai + k, _mm_add_ps(vai, vti));
+            }
+#endif
+            for (; k < h; ++k) {
+                float tr = br[k] * wr[k] - bi[k] * wi[k];
+                float ti = br[k] * wi[k] + bi[k] * wr[k];
+                br[k] = ar[k] - tr;
+                bi[k] = ai[k] - ti;
+                ar[k] += tr;
+                ai[k] += ti;
+            }
+        }
+    }
+}
+
+// SpectrumAnalyzer implementation
+SpectrumAnalyzer::SpectrumAnalyzer() {
+    for (size_t size : {1024, 2048, 4096}) ffts.emplace_back(size);
+    active = 1;
+    size_t largest = ffts.back().size();
+    left.resize(largest);
+    right.resize(largest);
+    mono.resize(largest);
+    bins.resize(largest / 2);
+}
+
+void SpectrumAnalyzer::update(const SampleTap& tap, uint64_t endFrame, bool playing, float deltaSeconds) {
+    auto start = std::chrono::steady_clock::now();
+    RealFft& fft = ffts[active];
+    size_t n = fft.size();
+    unsigned sampleRate = tap.getSampleRate();
+
+    if (!playing || sampleRate == 0 || !tap.read(endFrame, left.data(), right.data(), n)) {
+        decay(deltaSeconds);
+        return;
+    }
+
+    float sumL = 0.0f, sumR = 0.0f;
+    for (size_t i = 0; i < n; ++i) {
+        mono[i] = 0.5f * (left[i] + right[i]);
+        sumL += left[i] * left[i];
+        sumR += right[i] * right[i];
+    }
+    levels[0] = toUnit(10.0f * std::log10(sumL / n + 1e-12f), -60.0f);
+    levels[1] = toUnit(10.0f * std::log10(sumR / n + 1e-12f), -60.0f);
+
+    fft.magnitudes(mono.data(), bins.data());
+
+    // A full scale sine reads n/4 through a Hann window.
+    float reference = 4.0f / n;
+    float binHz = static_cast<float>(sampleRate) / n;
+    float top = std::min(MAX_FREQUENCY, sampleRate / 2.0f);
+    float ratio = std::pow(top / MIN_FREQUENCY, 1.0f / BAND_COUNT);
+    float fall = BAR_FALL_PER_SECOND * deltaSeconds;
+    float lower = MIN_FREQUENCY;
+    for (size_t b = 0; b < BAND_COUNT; ++b) {
+        float upper = lower * ratio;
+        size_t first = std::min(bins.size() - 1, static_cast<size_t>(lower / binHz));
+        size_t last = std::min(bins.size(), std::max(first + 1, static_cast<size_t>(upper / binHz)));
+        float peak = *std::max_element(bins.begin() + first, bins.begin() + last);
+        float value = toUnit(20.0f * std::log10(peak * reference + 1e-9f), FLOOR_DB);
+        bands[b] = std::max(value, bands[b] - fall);
+        lower = upper;
+    }
+
+    double cost = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    averageCostMs = averageCostMs * 0.9 + cost * 0.1;
+    if (averageCostMs > FRAME_BUDGET_MS && active > 0) {
+        --active;
+        averageCostMs = 0.0;
+        framesUnderBudget = 0;
+    } else if (averageCostMs < FRAME_BUDGET_MS / 4 && active + 1 < ffts.size()) {
+        // Only grow back after a sustained stretch of headroom (~2 s at 60 fps).
+        if (++framesUnderBudget > 120) {
+            ++active;
+            framesUnderBudget = 0;
+        }
+    } else {
+        framesUnderBudget = 0;
+    }
+}
+
+const std::array<float, SpectrumAnalyzer::BAND_COUNT>& SpectrumAnalyzer::getBands() const { return bands; }
+float SpectrumAnalyzer::getLevel(size_t channel) const { return levels[channel]; }
+double SpectrumAnalyzer::getAverageCostMs() const { return averageCostMs; }
+size_t SpectrumAnalyzer::getFftSize() const { return ffts[active].size(); }
+
+void SpectrumAnalyzer::decay(float deltaSeconds) {
+    float fall = BAR_FALL_PER_SECOND * deltaSeconds;
+    for (auto& band : bands) band = std::max(0.0f, band - fall);
+    for (auto& level : levels) level = std::max(0.0f, level - fall);
+}
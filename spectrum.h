@@ -0,0 +1,61 @@
+#ifndef SPECTRUM_H
+#define SPECTRUM_H
+
+#include "sample_tap.h"
+#include <array>
+#include <cstdint>
+#include <vector>
+
+// Real-input FFT of a fixed power-of-two size. The half-size complex transform
+// runs a radix-4 first pass and SIMD radix-2 passes on split real/imag arrays;
+// twiddles, bit reversal and the window are computed once up front.
+class RealFft {
+public:
+    explicit RealFft(size_t size);
+
+    // Windows `input` (size() samples) and writes size()/2 bin magnitudes.
+    void magnitudes(const float* input, float* output);
+    size_t size() const;
+
+private:
+    void transform();
+
+    size_t n;
+    size_t half;
+    std::vector<uint32_t> bitReverse;
+    std::vector<float> window;
+    std::vector<float> twiddleRe, twiddleIm;   // per stage, stage of length m at offset m/2
+    std::vector<float> splitRe, splitIm;       // e^{-2 pi i k / n}
+    std::vector<float> re, im;
+};
+
+// Log-spaced spectrum bars plus stereo VU levels for the render loop. Work is
+// timed every frame and the FFT size drops when it exceeds the frame budget.
+class SpectrumAnalyzer {
+public:
+    static constexpr size_t BAND_COUNT = 48;
+    static constexpr double FRAME_BUDGET_MS = 1.0;
+
+    SpectrumAnalyzer();
+
+    // `endFrame` is the frame currently coming out of the speakers.
+    void update(const SampleTap& tap, uint64_t endFrame, bool playing, float deltaSeconds);
+
+    const std::array<float, BAND_COUNT>& getBands() const;  // 0..1
+    float getLevel(size_t channel) const;                    // 0..1
+    double getAverageCostMs() const;
+    size_t getFftSize() const;
+
+private:
+    void decay(float deltaSeconds);
+
+    std::vector<RealFft> ffts;  // smallest first
+    size_t active;
+    std::vector<float> left, right, mono, bins;
+    std::array<float, BAND_COUNT> bands{};
+    std::array<float, 2> levels{};
+    double averageCostMs = 0.0;
+    unsigned framesUnderBudget = 0;
+};
+
+#endif // SPECTRUM_H
@@ -0,0 +1,263 @@
+#include "time_stretch.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+constexpr double PI = 3.14159265358979323846;
+
+float dotProduct(const float* a, const float* b, size_t count) {
+    size_t i = 0;
+#if defined(__AVX2__)
+    __m256 acc0 = _mm256_setzero_ps(), acc1 = _mm256_setzero_ps();
+    for (size_t end = count & ~size_t(15); i < end; i += 16) {
+#if defined(__FMA__)
+        acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), acc0);
+        acc1 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8), acc1);
+#else
+        acc0 = _mm256_add_ps(acc0, _mm256_mul_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)));
+        acc1 = _mm256_add_ps(acc1, _mm256_mul_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8)));
+#endif
+    }
+    __m256 acc = _mm256_add_ps(acc0, acc1);
+    __m128 folded = _mm_add_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1));
+    float lanes[4];
+    _mm_storeu_ps(lanes, folded);
+    float sum = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+#elif defined(__ARM_NEON)
+    float32x4_t acc = vdupq_n_f32(0.0f);
+    for (size_t end = count & ~size_t(3); i < end; i += 4) acc = vmlaq_f32(acc, vld1q_f32(a + i), vld1q_f32(b + i));
+    float32x2_t half = vadd_f32(vget_low_f32(acc), vget_high_f32(acc));
+    float sum = vget_lane_f32(vpadd_f32(half, half), 0);
+#elif defined(__SSE2__)
+    __m128 acc0 = _mm_setzero_ps(), acc1 = _mm_setzero_ps();
+    for (size_t end = count & ~size_t(7); i < end; i += 8) {
+        acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+        acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+    }
+    float lanes[4];
+    _mm_storeu_ps(lanes, _mm_add_ps(acc0, acc1));
+    float sum = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+#else
+    float sum = 0.0f;
+#endif
+    for (; i < count; ++i) sum += a[i] * b[i];
+    return sum;
+}
+
+// accumulator[i] += window[i] * samples[i]
+void addWindowed(const float* window, const float* samples, float* accumulator, size_t count) {
+    size_t i = 0;
+#if defined(__AVX2__)
+    for (size_t end = count & ~size_t(7); i < end; i += 8) {
+        __m256 w = _mm256_loadu_ps(window + i);
+        __m256 acc = _mm256_loadu_ps(accumulator + i);
+#if defined(__FMA__)
+        acc = _mm256_fmadd_ps(w, _mm256_loadu_ps(samples + i), acc);
+#else
+        acc = _mm256_add_ps(acc, _mm256_mul_ps(w, _mm256_loadu_ps(samples + i)));
+#endif
+        _mm256_storeu_ps(accumulator + i, acc);
+    }
+#elif defined(__ARM_NEON)
+    for (size_t end = count & ~size_t(3); i < end; i += 4)
+        vst1q_f32(accumulator + i, vmlaq_f32(vld1q_f32(accumulator + i), vld1q_f32(window + i), vld1q_f32(samples + i)));
+#elif defined(__SSE2__)
+    for (size_t end = count & ~size_t(3); i < end; i += 4) {
+        __m128 product = _mm_mul_ps(_mm_loadu_ps(window + i), _mm_loadu_ps(samples + i));
+        _mm_storeu_ps(accumulator + i, _mm_add_ps(_mm_loadu_ps(accumulator + i), product));
+    }
+#endif
+    for (; i < count; ++i) accumulator[i] += window[i] * samples[i];
+}
+
+// Catmull-Rom through p1..p2 at fraction t.
+float cubic(float p0, float p1, float p2, float p3, float t) {
+    return p1 + 0.5f * t * (p2 - p0 + t * (2.0f * p0 - 5.0f * p1 + 4.0f * p2 - p3 + t * (3.0f * (p1 - p2) + p3 - p0)));
+}
+
+} // namespace
+
+TimeStretcher::TimeStretcher()
+    : window(2 * WINDOW), input(2 * CAPACITY), mono(CAPACITY), accumulator(2 * WINDOW), stretched(2 * 4 * HOP) {
+    // Periodic Hann: windows HOP apart sum to exactly one.
+    for (size_t i = 0; i < WINDOW; ++i) {
+        float w = static_cast<float>(0.5 - 0.5 * std::cos(2.0 * PI * i / WINDOW));
+        window[2 * i] = w;
+        window[2 * i + 1] = w;
+    }
+    reset();
+}
+
+void TimeStretcher::setRatios(double newSpeed, double newPitch) {
+    pitch = std::clamp(newPitch, MIN_PITCH, MAX_PITCH);
+    // Stretch `pitch` times longer than the speed asks for; the pitch stage
+    // reads it back that much faster.
+    tempo = std::clamp(newSpeed, MIN_SPEED, MAX_SPEED) / pitch;
+}
+
+void TimeStretcher::reset() {
+    // SEARCH frames of silence so the first window can be searched around.
+    std::fill(input.begin(), input.begin() + 2 * SEARCH, 0.0f);
+    std::fill(mono.begin(), mono.begin() + SEARCH, 0.0f);
+    inputFill = SEARCH;
+    bufferStart = -static_cast<int64_t>(SEARCH);
+    readPosition = static_cast<double>(SEARCH);
+    continuation = 0;
+    hasPrevious = false;
+    std::fill(accumulator.begin(), accumulator.end(), 0.0f);
+    // One frame of history in front of the interpolator.
+    stretched[0] = stretched[1] = 0.0f;
+    stretchedFill = 1;
+    stretchedPosition = 1.0;
+    ending = false;
+    endFrame = 0;
+    tailPadded = false;
+}
+
+void TimeStretcher::append(const float* frames, size_t count) {
+    std::memcpy(&input[2 * inputFill], frames, count * 2 * sizeof(float));
+    for (size_t i = 0; i < count; ++i) mono[inputFill + i] = 0.5f * (frames[2 * i] + frames[2 * i + 1]);
+    inputFill += count;
+}
+
+void TimeStretcher::compact() {
+    size_t keepFrom = static_cast<size_t>(readPosition) - SEARCH;
+    if (hasPrevious) keepFrom = std::min(keepFrom, continuation);
+    keepFrom = std::min(keepFrom, inputFill);
+    if (keepFrom == 0) return;
+    size_t keep = inputFill - keepFrom;
+    std::memmove(input.data(), input.data() + 2 * keepFrom, keep * 2 * sizeof(float));
+    std::memmove(mono.data(), mono.data() + keepFrom, keep * sizeof(float));
+    inputFill = keep;
+    bufferStart += static_cast<int64_t>(keepFrom);
+    readPosition -= static_cast<double>(keepFrom);
+    continuation -= keepFrom;
+    endFrame -= std::min(endFrame, keepFrom);
+}
+
+bool TimeStretcher::produceHop() {
+    size_t base = static_cast<size_t>(readPosition);
+    if (base + SEARCH + WINDOW > inputFill) return false;
+
+    // The interpolator leaves at most a few frames behind; drop them.
+    if (stretchedFill + HOP > stretched.size() / 2) {
+        size_t drop = static_cast<size_t>(stretchedPosition) - 1;
+        std::memmove(stretched.data(), stretched.data() + 2 * drop, (stretchedFill - drop) * 2 * sizeof(float));
+        stretchedFill -= drop;
+        stretchedPosition -= static_cast<double>(drop);
+    }
+
+    size_t start = base;
+    if (hasPrevious) {
+        // Best match for where the previous window would have continued.
+        // Scores are normalized by candidate energy so loud passages don't
+        // win by default; the ideal position wins ties.
+        const float* target = &mono[continuation];
+        size_t first = base - SEARCH;
+        double energy = dotProduct(&mono[first], &mono[first], OVERLAP);
+        double baseEnergy = dotProduct(&mono[base], &mono[base], OVERLAP);
+        double bestScore = dotProduct(target, &mono[base], OVERLAP) / std::sqrt(baseEnergy + 1e-9);
+        for (size_t c = first; c <= base + SEARCH; ++c) {
+            if (c != base) {
+                double score = dotProduct(target, &mono[c], OVERLAP) / std::sqrt(std::max(0.0, energy) + 1e-9);
+                if (score > bestScore) {
+                    bestScore = score;
+                    start = c;
+                }
+            }
+            energy += static_cast<double>(mono[c + OVERLAP]) * mono[c + OVERLAP] - static_cast<double>(mono[c]) * mono[c];
+        }
+    } else {
+        // First window after a reset: pre-load the complement of its rising
+        // half so the first hop comes out unwindowed instead of fading in.
+        for (size_t i = 0; i < 2 * OVERLAP; ++i) accumulator[i] = (1.0f - window[i]) * input[2 * start + i];
+    }
+
+    addWindowed(window.data(), &input[2 * start], accumulator.data(), 2 * WINDOW);
+    std::memcpy(&stretched[2 * stretchedFill], accumulator.data(), 2 * HOP * sizeof(float));
+    stretchedFill += HOP;
+    std::memmove(accumulator.data(), accumulator.data() + 2 * HOP, 2 * OVERLAP * sizeof(float));
+    std::fill(accumulator.begin() + 2 * OVERLAP, accumulator.end(), 0.0f);
+
+    continuation = start + HOP;
+    hasPrevious = true;
+    readPosition += HOP * tempo;
+    return true;
+}
+
+size_t TimeStretcher::emitPitched(float* output, size_t outputFrames) {
+    size_t produced = 0;
+    while (produced < outputFrames) {
+        size_t i = static_cast<size_t>(stretchedPosition);
+        if (i + 2 >= stretchedFill) break;
+        float t = static_cast<float>(stretchedPosition - i);
+        const float* p = &stretched[2 * (i - 1)];
+        output[2 * produced] = cubic(p[0], p[2], p[4], p[6], t);
+        output[2 * produced + 1] = cubic(p[1], p[3], p[5], p[7], t);
+        produced++;
+        stretchedPosition += pitch;
+    }
+    return produced;
+}
+
+size_t TimeStretcher::process(const float* in, size_t inputFrames, size_t& consumed, float* output, size_t outputFrames) {
+    consumed = 0;
+    size_t produced = 0;
+    while (produced < outputFrames) {
+        produced += emitPitched(output + 2 * produced, outputFrames - produced);
+        if (produced == outputFrames || produceHop()) continue;
+        if (consumed == inputFrames) break;
+        if (inputFill > CAPACITY / 2) compact();
+        size_t take = std::min(CAPACITY - inputFill, inputFrames - consumed);
+        if (take == 0) break;
+        append(in + 2 * consumed, take);
+        consumed += take;
+    }
+    return produced;
+}
+
+size_t TimeStretcher::drain(float* output, size_t outputFrames) {
+    if (!ending) {
+        ending = true;
+        endFrame = inputFill;
+    }
+    size_t produced = 0;
+    while (produced < outputFrames) {
+        produced += emitPitched(output + 2 * produced, outputFrames - produced);
+        if (produced == outputFrames) break;
+        if (readPosition >= static_cast<double>(endFrame)) {
+            // Every input frame has been windowed; two frames of silence let
+            // the interpolator reach the last of them.
+            if (tailPadded || stretchedFill + 2 > stretched.size() / 2) break;
+            std::fill(stretched.begin() + 2 * stretchedFill, stretched.begin() + 2 * (stretchedFill + 2), 0.0f);
+            stretchedFill += 2;
+            tailPadded = true;
+            continue;
+        }
+        if (produceHop()) continue;
+        compact();
+        size_t needed = static_cast<size_t>(readPosition) + SEARCH + WINDOW;
+        size_t pad = std::min(CAPACITY, needed) - inputFill;
+        std::fill(input.begin() + 2 * inputFill, input.begin() + 2 * (inputFill + pad), 0.0f);
+        std::fill(mono.begin() + inputFill, mono.begin() + inputFill + pad, 0.0f);
+        inputFill += pad;
+    }
+    return produced;
+}
+
+double TimeStretcher::getSourcePosition() const {
+    // The end of the stretched queue lines up with readPosition; each queued
+    // frame stands for `tempo` input frames.
+    double queued = static_cast<double>(stretchedFill) - stretchedPosition;
+    return std::max(0.0, static_cast<double>(bufferStart) + readPosition - queued * tempo);
+}
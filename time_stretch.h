@@ -0,0 +1,68 @@
+#ifndef TIME_STRETCH_H
+#define TIME_STRETCH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Streaming tempo and pitch change for interleaved stereo float.
+//
+// Tempo uses WSOLA: 1024-frame Hann windows are overlap-added every 512
+// output frames, each taken from within +/-256 frames of its ideal source
+// position at the offset whose start best matches (normalized
+// cross-correlation, SIMD) the natural continuation of the previous window.
+// Pitch is then shifted by stretching `pitch` times longer and reading the
+// result back `pitch` times faster through a cubic interpolator, so the
+// two are independent. All buffers are sized in the constructor.
+class TimeStretcher {
+public:
+    static constexpr size_t WINDOW = 1024;
+    static constexpr size_t HOP = WINDOW / 2;
+    static constexpr size_t OVERLAP = WINDOW - HOP;
+    static constexpr size_t SEARCH = 256;
+    static constexpr size_t CAPACITY = 16384; // input frames held
+
+    static constexpr double MIN_SPEED = 0.5, MAX_SPEED = 2.0;
+    static constexpr double MIN_PITCH = 0.5, MAX_PITCH = 2.0; // +/- one octave
+
+    TimeStretcher();
+
+    // Safe between calls; takes effect at the next window.
+    void setRatios(double speed, double pitch);
+    size_t process(const float* input, size_t inputFrames, size_t& consumed, float* output, size_t outputFrames);
+    // Flushes what is left once the input has ended; returns 0 when done.
+    size_t drain(float* output, size_t outputFrames);
+    void reset();
+
+    // Input frames (since reset) that the next output frame corresponds to.
+    double getSourcePosition() const;
+
+private:
+    bool produceHop();
+    size_t emitPitched(float* output, size_t outputFrames);
+    void compact();
+    void append(const float* frames, size_t count);
+
+    double tempo = 1.0;
+    double pitch = 1.0;
+
+    std::vector<float> window;   // Hann, duplicated per channel
+    std::vector<float> input;    // interleaved stereo
+    std::vector<float> mono;     // (L+R)/2 for the correlation search
+    size_t inputFill = 0;
+    int64_t bufferStart = 0;     // source frame of input[0]; negative while primed with silence
+    double readPosition = 0.0;   // ideal source position of the next window, in buffer frames
+    size_t continuation = 0;     // where the previous window would have gone on
+    bool hasPrevious = false;
+    std::vector<float> accumulator;
+
+    std::vector<float> stretched; // WSOLA output waiting for the pitch stage
+    size_t stretchedFill = 0;
+    double stretchedPosition = 1.0;
+
+    bool ending = false;
+    size_t endFrame = 0;          // buffer frame where the input ended
+    bool tailPadded = false;
+};
+
+#endif // TIME_STRETCH_H
@@ -0,0 +1,180 @@
+// Load test for the daemon's control socket: fires one kind of request and
+// reports throughput and round-trip latency percentiles. Commands are timed
+// until the player has applied them, which is when the daemon replies.
+// g++ -std=c++17 -O2 -I. tools/control_load.cpp -o control_load
+// ./control_load <socket> [--count 100000] [--rate 5000] [--depth 1] [--op query] [--arg 0]
+//   --rate   requests per second, 0 for as fast as possible
+//   --depth  requests kept in flight; 1 measures pure round trips
+//   --op     query, ping, play, pause, next, previous, seek, track or volume
+//            (--ping is short for --op ping)
+//   --arg    the request's argument: milliseconds, track index or percent
+#include "control_protocol.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+bool writeAll(int fd, const uint8_t* data, size_t size) {
+    while (size > 0) {
+        ssize_t n = ::send(fd, data, size, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        data += n;
+        size -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+bool readAll(int fd, uint8_t* data, size_t size) {
+    while (size > 0) {
+        ssize_t n = ::recv(fd, data, size, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        data += n;
+        size -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+struct OpName {
+    const char* name;
+    ControlOp op;
+};
+
+constexpr OpName OP_NAMES[] = {
+    {"query", ControlOp::Query}, {"ping", ControlOp::Ping},     {"play", ControlOp::Play},
+    {"pause", ControlOp::Pause}, {"next", ControlOp::Next},     {"previous", ControlOp::Previous},
+    {"seek", ControlOp::Seek},   {"track", ControlOp::SetTrack}, {"volume", ControlOp::SetVolume},
+};
+
+bool parseOp(const char* name, ControlOp& op) {
+    for (const auto& entry : OP_NAMES) {
+        if (std::strcmp(entry.name, name) == 0) {
+            op = entry.op;
+            return true;
+        }
+    }
+    return false;
+}
+
+double percentile(const std::vector<double>& sorted, double p) {
+    if (sorted.empty()) return 0.0;
+    size_t index = static_cast<size_t>(p * (sorted.size() - 1) + 0.5);
+    return sorted[std::min(index, sorted.size() - 1)];
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        std::printf("usage: control_load <socket> [--count N] [--rate R] [--depth D] [--op OP] [--arg A] [--ping]\n");
+        return 1;
+    }
+    std::string socketPath = argv[1];
+    size_t count = 100000;
+    double rate = 0.0;
+    size_t depth = 1;
+    ControlOp op = ControlOp::Query;
+    int64_t argument = 0;
+    for (int i = 2; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--count") == 0 && i + 1 < argc) {
+            count = std::stoul(argv[++i]);
+        } else if (std::strcmp(argv[i], "--rate") == 0 && i + 1 < argc) {
+            rate = std::stod(argv[++i]);
+        } else if (std::strcmp(argv[i], "--depth") == 0 && i + 1 < argc) {
+            depth = std::max<size_t>(1, std::stoul(argv[++i]));
+        } else if (std::strcmp(argv[i], "--ping") == 0) {
+            op = ControlOp::Ping;
+        } else if (std::strcmp(argv[i], "--op") == 0 && i + 1 < argc) {
+            if (!parseOp(argv[++i], op)) {
+                std::printf("unknown op %s\n", argv[i]);
+                return 1;
+            }
+        } else if (std::strcmp(argv[i], "--arg") == 0 && i + 1 < argc) {
+            argument = std::stoll(argv[++i]);
+        }
+    }
+
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (socketPath.size() >= sizeof(address.sun_path)) {
+        std::printf("socket path too long\n");
+        return 1;
+    }
+    std::memcpy(address.sun_path, socketPath.c_str(), socketPath.size() + 1);
+    int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || ::connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+        std::printf("cannot connect to %s: %s\n", socketPath.c_str(), std::strerror(errno));
+        return 1;
+    }
+
+    std::vector<Clock::time_point> sentAt(count);
+    std::vector<double> latencies;
+    latencies.reserve(count);
+    size_t sent = 0, received = 0, failed = 0;
+    ControlState last;
+    uint8_t header[CONTROL_HEADER_SIZE];
+    uint8_t payload[CONTROL_MAX_PAYLOAD];
+    auto interval = rate > 0.0 ? std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / rate))
+                               : Clock::duration::zero();
+    auto start = Clock::now();
+    auto nextSend = start;
+
+    while (received < count) {
+        while (sent < count && sent - received < depth && Clock::now() >= nextSend) {
+            ControlHeader request;
+            request.opcode = op;
+            request.sequence = static_cast<uint32_t>(sent);
+            request.argument = argument;
+            encodeHeader(request, header);
+            sentAt[sent] = Clock::now();
+            if (!writeAll(fd, header, sizeof(header))) {
+                std::printf("send failed after %zu requests\n", sent);
+                return 1;
+            }
+            ++sent;
+            nextSend += interval;
+        }
+        if (sent == received) {
+            std::this_thread::sleep_until(nextSend);
+            continue;
+        }
+        ControlHeader reply;
+        if (!readAll(fd, header, sizeof(header)) || !decodeHeader(header, reply) || !readAll(fd, payload, reply.length)) {
+            std::printf("connection lost after %zu replies\n", received);
+            return 1;
+        }
+        auto now = Clock::now();
+        if (reply.sequence >= sent) {
+            std::printf("unexpected reply sequence %u\n", reply.sequence);
+            return 1;
+        }
+        latencies.push_back(std::chrono::duration<double, std::micro>(now - sentAt[reply.sequence]).count());
+        if (reply.status != ControlStatus::Ok) ++failed;
+        if (reply.opcode == ControlOp::Query && reply.length >= CONTROL_STATE_SIZE) decodeState(payload, last);
+        ++received;
+    }
+    double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+    ::close(fd);
+
+    std::sort(latencies.begin(), latencies.end());
+    std::printf("%zu requests in %.3f s: %.0f/s, %zu failed\n", count, elapsed, count / elapsed, failed);
+    std::printf("round trip us: p50 %.1f  p90 %.1f  p99 %.1f  p99.9 %.1f  max %.1f\n", percentile(latencies, 0.5),
+                percentile(latencies, 0.9), percentile(latencies, 0.99), percentile(latencies, 0.999), latencies.back());
+    if (op == ControlOp::Query) {
+        std::printf("last state: track %u/%u, %lld/%lld ms\n", last.track, last.trackCount,
+                    static_cast<long long>(last.positionMs), static_cast<long long>(last.durationMs));
+    }
+    return 0;
+}
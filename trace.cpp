@@ -0,0 +1,157 @@
+#include "trace.h"
+#include "logger.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#ifdef ENABLE_TRACING
+
+namespace {
+
+// Slots are atomics so a dump racing the owner is never undefined
+// behaviour; the dump rereads the count afterwards and discards any slot
+// that may have been overwritten while it was copying.
+struct TraceSlot {
+    std::atomic<const char*> name{nullptr};
+    std::atomic<uint64_t> start{0};
+    std::atomic<uint64_t> end{0};
+};
+
+struct TraceEvent {
+    const char* name;
+    uint64_t start;
+    uint64_t end;
+};
+
+struct TraceBuffer {
+    explicit TraceBuffer(unsigned number) : slots(new TraceSlot[Tracer::EVENTS_PER_THREAD]), thread(number) {}
+
+    std::unique_ptr<TraceSlot[]> slots;
+    std::atomic<uint64_t> count{0};
+    std::atomic<const char*> threadName{nullptr};
+    unsigned thread;
+};
+
+uint64_t steadyNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+struct TraceRegistry {
+    // Paired with a second reading at dump time to turn ticks into nanoseconds.
+    const uint64_t startTicks = Tracer::now();
+    const uint64_t startNs = steadyNs();
+    std::mutex mutex;
+    std::vector<std::shared_ptr<TraceBuffer>> buffers;
+    unsigned nextThread = 1;
+};
+
+TraceRegistry& traceRegistry() {
+    static TraceRegistry registry;
+    return registry;
+}
+
+// Kept after the thread exits so its last events still show up in a dump.
+thread_local TraceBuffer* threadBuffer = nullptr;
+
+TraceBuffer& localBuffer() {
+    if (!threadBuffer) {
+        TraceRegistry& registry = traceRegistry();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        registry.buffers.push_back(std::make_shared<TraceBuffer>(registry.nextThread++));
+        threadBuffer = registry.buffers.back().get();
+    }
+    return *threadBuffer;
+}
+
+void copyEvents(const TraceBuffer& buffer, std::vector<TraceEvent>& events) {
+    uint64_t count = buffer.count.load(std::memory_order_acquire);
+    uint64_t first = count > Tracer::EVENTS_PER_THREAD ? count - Tracer::EVENTS_PER_THREAD : 0;
+    size_t begin = events.size();
+    for (uint64_t i = first; i < count; ++i) {
+        const TraceSlot& slot = buffer.slots[i & (Tracer::EVENTS_PER_THREAD - 1)];
+        events.push_back({slot.name.load(std::memory_order_relaxed), slot.start.load(std::memory_order_relaxed),
+                          slot.end.load(std::memory_order_relaxed)});
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    // The owner may have started on event `now` already, overwriting now - N.
+    uint64_t now = buffer.count.load(std::memory_order_relaxed);
+    uint64_t valid = now + 1 > Tracer::EVENTS_PER_THREAD ? now + 1 - Tracer::EVENTS_PER_THREAD : 0;
+    if (valid > first) events.erase(events.begin() + begin, events.begin() + begin + std::min(valid - first, count - first));
+}
+
+} // namespace
+
+// Tracer implementation
+void Tracer::record(const char* name, uint64_t start, uint64_t end) {
+    TraceBuffer& buffer = localBuffer();
+    uint64_t index = buffer.count.load(std::memory_order_relaxed);
+    TraceSlot& slot = buffer.slots[index & (EVENTS_PER_THREAD - 1)];
+    slot.name.store(name, std::memory_order_relaxed);
+    slot.start.store(start, std::memory_order_relaxed);
+    slot.end.store(end, std::memory_order_relaxed);
+    buffer.count.store(index + 1, std::memory_order_release);
+}
+
+void Tracer::setThreadName(const char* name) { localBuffer().threadName.store(name, std::memory_order_relaxed); }
+
+bool Tracer::writeChromeTrace(const std::string& path) {
+    TraceRegistry& registry = traceRegistry();
+    std::vector<std::shared_ptr<TraceBuffer>> buffers;
+    {
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        buffers = registry.buffers;
+    }
+    uint64_t ticks = Tracer::now() - registry.startTicks;
+    double nsPerTick = ticks > 0 ? static_cast<double>(steadyNs() - registry.startNs) / ticks : 1.0;
+
+    FILE* file = std::fopen(path.c_str(), "w");
+    if (!file) {
+        logError("Failed to open trace file", {{"path", path}});
+        return false;
+    }
+    // Complete ("X") events in microseconds; three decimals keep the nanoseconds.
+    std::fputs("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n", file);
+    bool firstLine = true;
+    size_t written = 0;
+    std::vector<TraceEvent> events;
+    for (const auto& buffer : buffers) {
+        const char* threadName = buffer->threadName.load(std::memory_order_relaxed);
+        if (threadName) {
+            std::fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+                         firstLine ? "" : ",\n", buffer->thread, threadName);
+            firstLine = false;
+        }
+        events.clear();
+        copyEvents(*buffer, events);
+        for (const auto& event : events) {
+            // Relative to the first event, so the doubles keep nanosecond precision.
+            double start = static_cast<double>(static_cast<int64_t>(event.start - registry.startTicks)) * nsPerTick;
+            double duration = static_cast<double>(event.end - event.start) * nsPerTick;
+            std::fprintf(file, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+                         firstLine ? "" : ",\n", event.name, buffer->thread, start * 1e-3, duration * 1e-3);
+            firstLine = false;
+        }
+        written += events.size();
+    }
+    std::fputs("\n]}\n", file);
+    bool ok = std::fclose(file) == 0;
+    if (ok) logInfo("Trace written", {{"path", path}, {"events", written}});
+    return ok;
+}
+
+#else
+
+void Tracer::record(const char*, uint64_t, uint64_t) {}
+void Tracer::setThreadName(const char*) {}
+
+bool Tracer::writeChromeTrace(const std::string&) {
+    logWarn("Tracing is not compiled in; rebuild with -DENABLE_TRACING");
+    return false;
+}
+
+#endif
@@ -0,0 +1,66 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// Scoped timing of the frame loop and playback path, viewable in
+// chrome://tracing or ui.perfetto.dev. Build with -DENABLE_TRACING to record;
+// otherwise TraceScope is empty and every scope compiles away.
+//
+//     void render() {
+//         TraceScope scope("render");
+//         ...
+class Tracer {
+public:
+    // Per thread; older events are overwritten, so a dump shows the most
+    // recent stretch of each thread.
+    static constexpr size_t EVENTS_PER_THREAD = 1 << 14;
+
+    // Raw timestamp: the TSC on x86, which costs a fraction of a clock call
+    // and runs at a constant rate on anything recent; steady_clock
+    // nanoseconds elsewhere. Dumps convert to nanoseconds.
+    static uint64_t now() {
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+    }
+    // `name` must be a string literal. Lock-free; the calling thread's buffer
+    // is allocated on its first event.
+    static void record(const char* name, uint64_t start, uint64_t end);
+    // Labels the calling thread in dumps.
+    static void setThreadName(const char* name);
+    // Any thread, while others keep recording. False if tracing is compiled
+    // out or the file can't be written.
+    static bool writeChromeTrace(const std::string& path);
+};
+
+#ifdef ENABLE_TRACING
+class TraceScope {
+public:
+    explicit TraceScope(const char* scopeName) : name(scopeName), start(Tracer::now()) {}
+    ~TraceScope() { Tracer::record(name, start, Tracer::now()); }
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+private:
+    const char* name;
+    uint64_t start;
+};
+#else
+class TraceScope {
+public:
+    explicit TraceScope(const char*) {}
+};
+#endif
+
+#endif // TRACE_H
@@ -0,0 +1,585 @@
+#include "track_metadata.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+
+namespace {
+
+constexpr size_t MAX_TAG_BYTES = 1 << 20;      // never pull more than this for a tag block
+constexpr size_t MAX_COMMENT_BYTES = 256 * 1024;
+
+uint32_t readBE32(const uint8_t* p) { return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | p[3]; }
+uint32_t readBE24(const uint8_t* p) { return (uint32_t(p[0]) << 16) | (uint32_t(p[1]) << 8) | p[2]; }
+uint32_t readLE32(const uint8_t* p) { return uint32_t(p[0]) | (uint32_t(p[1]) << 8) | (uint32_t(p[2]) << 16) | (uint32_t(p[3]) << 24); }
+uint16_t readLE16(const uint8_t* p) { return uint16_t(p[0] | (p[1] << 8)); }
+uint32_t readSyncsafe(const uint8_t* p) { return (uint32_t(p[0] & 0x7f) << 21) | (uint32_t(p[1] & 0x7f) << 14) | (uint32_t(p[2] & 0x7f) << 7) | (p[3] & 0x7f); }
+
+class FileReader {
+public:
+    explicit FileReader(const std::string& path) : file(path, std::ios::binary) {
+        if (file) {
+            file.seekg(0, std::ios::end);
+            size = static_cast<uint64_t>(file.tellg());
+            file.seekg(0);
+        }
+    }
+    bool isOpen() const { return static_cast<bool>(file); }
+    uint64_t getSize() const { return size; }
+
+    bool readAt(uint64_t offset, void* dst, size_t count) {
+        if (offset + count > size) return false;
+        file.clear();
+        file.seekg(static_cast<std::streamoff>(offset));
+        file.read(static_cast<char*>(dst), static_cast<std::streamsize>(count));
+        return static_cast<size_t>(file.gcount()) == count;
+    }
+
+    bool readAt(uint64_t offset, std::vector<uint8_t>& dst, size_t count) {
+        dst.resize(count);
+        return readAt(offset, dst.data(), count);
+    }
+
+private:
+    std::ifstream file;
+    uint64_t size = 0;
+};
+
+struct Tags {
+    std::string title, artist, album;
+    uint16_t trackNumber = 0;
+    uint32_t lengthMs = 0;
+};
+
+void appendUtf8(std::string& out, uint32_t cp) {
+    if (cp < 0x80) {
+        out += static_cast<char>(cp);
+    } else if (cp < 0x800) {
+        out += static_cast<char>(0xC0 | (cp >> 6));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    } else if (cp < 0x10000) {
+        out += static_cast<char>(0xE0 | (cp >> 12));
+        out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    } else {
+        out += static_cast<char>(0xF0 | (cp >> 18));
+        out += static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+        out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    }
+}
+
+std::string latin1ToUtf8(const uint8_t* p, size_t n) {
+    std::string out;
+    out.reserve(n);
+    for (size_t i = 0; i < n && p[i]; ++i) appendUtf8(out, p[i]);
+    return out;
+}
+
+std::string utf16ToUtf8(const uint8_t* p, size_t n, bool bigEndian) {
+    std::string out;
+    if (n >= 2) {
+        if (p[0] == 0xFF && p[1] == 0xFE) { bigEndian = false; p += 2; n -= 2; }
+        else if (p[0] == 0xFE && p[1] == 0xFF) { bigEndian = true; p += 2; n -= 2; }
+    }
+    for (size_t i = 0; i + 1 < n; i += 2) {
+        uint32_t unit = bigEndian ? (p[i] << 8) | p[i + 1] : p[i] | (p[i + 1] << 8);
+        if (unit == 0) break;
+        if (unit >= 0xD800 && unit < 0xDC00 && i + 3 < n) {
+            uint32_t low = bigEndian ? (p[i + 2] << 8) | p[i + 3] : p[i + 2] | (p[i + 3] << 8);
+            if (low >= 0xDC00 && low < 0xE000) {
+                appendUtf8(out, 0x10000 + ((unit - 0xD800) << 10) + (low - 0xDC00));
+                i += 2;
+                continue;
+            }
+        }
+        appendUtf8(out, unit);
+    }
+    return out;
+}
+
+void trim(std::string& s) {
+    while (!s.empty() && (s.back() == ' ' || s.back() == '\0')) s.pop_back();
+    size_t start = s.find_first_not_of(' ');
+    if (start == std::string::npos) s.clear();
+    else if (start > 0) s.erase(0, start);
+}
+
+uint16_t parseTrackNumber(const std::string& s) {
+    // "3", "03" and "3/12" all mean track 3
+    uint32_t n = 0;
+    for (char c : s) {
+        if (c < '0' || c > '9') break;
+        n = n * 10 + static_cast<uint32_t>(c - '0');
+        if (n > 0xFFFF) return 0;
+    }
+    return static_cast<uint16_t>(n);
+}
+
+// ---- ID3v2 ------------------------------------------------------------------
+
+std::string decodeId3Text(const uint8_t* p, size_t n) {
+    if (n == 0) return {};
+    std::string s;
+    switch (p[0]) {
+        case 0: s = latin1ToUtf8(p + 1, n - 1); break;
+        case 1: s = utf16ToUtf8(p + 1, n - 1, false); break;
+        case 2: s = utf16ToUtf8(p + 1, n - 1, true); break;
+        case 3: s.assign(reinterpret_cast<const char*>(p + 1), strnlen(reinterpret_cast<const char*>(p + 1), n - 1)); break;
+        default: break;
+    }
+    trim(s);
+    return s;
+}
+
+void removeUnsynchronisation(std::vector<uint8_t>& data) {
+    size_t out = 0;
+    for (size_t i = 0; i < data.size(); ++i) {
+        data[out++] = data[i];
+        if (data[i] == 0xFF && i + 1 < data.size() && data[i + 1] == 0x00) ++i;
+    }
+    data.resize(out);
+}
+
+void applyId3Frame(const char* id, const uint8_t* p, size_t n, Tags& tags) {
+    auto is = [id](const char* a, const char* b) { return std::strcmp(id, a) == 0 || std::strcmp(id, b) == 0; };
+    if (is("TIT2", "TT2")) tags.title = decodeId3Text(p, n);
+    else if (is("TPE1", "TP1")) tags.artist = decodeId3Text(p, n);
+    else if (is("TALB", "TAL")) tags.album = decodeId3Text(p, n);
+    else if (is("TRCK", "TRK")) tags.trackNumber = parseTrackNumber(decodeId3Text(p, n));
+    else if (is("TLEN", "TLE")) tags.lengthMs = std::strtoul(decodeId3Text(p, n).c_str(), nullptr, 10);
+}
+
+// Returns the number of bytes taken by the tag (0 if there is none).
+uint64_t readId3v2(FileReader& file, uint64_t offset, Tags& tags) {
+    uint8_t header[10];
+    if (!file.readAt(offset, header, sizeof(header))) return 0;
+    uint64_t total = getId3v2TagSize(header);
+    if (total == 0) return 0;
+    uint8_t version = header[3];
+    uint8_t flags = header[5];
+    uint32_t size = readSyncsafe(header + 6);
+    if (version < 2 || version > 4) return total;
+
+    std::vector<uint8_t> tag;
+    if (!file.readAt(offset + 10, tag, std::min<size_t>(size, MAX_TAG_BYTES))) return total;
+    if ((flags & 0x80) && version < 4) removeUnsynchronisation(tag);
+
+    size_t pos = 0;
+    if ((flags & 0x40) && version >= 3 && tag.size() >= 4) {
+        pos = version == 3 ? readBE32(tag.data()) + 4 : readSyncsafe(tag.data());
+    }
+
+    size_t idLen = version == 2 ? 3 : 4;
+    size_t headerLen = version == 2 ? 6 : 10;
+    while (pos + headerLen <= tag.size() && tag[pos] != 0) {
+        char id[5] = {};
+        std::memcpy(id, &tag[pos], idLen);
+        size_t frameSize;
+        uint8_t formatFlags = 0;
+        if (version == 2) frameSize = readBE24(&tag[pos + 3]);
+        else if (version == 3) frameSize = readBE32(&tag[pos + 4]);
+        else frameSize = readSyncsafe(&tag[pos + 4]);
+        if (version >= 3) formatFlags = tag[pos + 9];
+        pos += headerLen;
+        if (frameSize > tag.size() - pos) break;
+
+        if (id[0] == 'T') {
+            const uint8_t* body = &tag[pos];
+            size_t bodySize = frameSize;
+            bool skip = false;
+            std::vector<uint8_t> unsynced;
+            if (version == 3) {
+                skip = formatFlags & 0xC0; // compressed or encrypted
+                if (formatFlags & 0x20) { body += 1; bodySize -= std::min<size_t>(bodySize, 1); }
+            } else if (version == 4) {
+                skip = formatFlags & 0x0C;
+                if (formatFlags & 0x40) { body += 1; bodySize -= std::min<size_t>(bodySize, 1); }
+                if (formatFlags & 0x01) { body += 4; bodySize -= std::min<size_t>(bodySize, 4); }
+                if ((formatFlags & 0x02) || (flags & 0x80)) {
+                    unsynced.assign(body, body + bodySize);
+                    removeUnsynchronisation(unsynced);
+                    body = unsynced.data();
+                    bodySize = unsynced.size();
+                }
+            }
+            if (!skip) applyId3Frame(id, body, bodySize, tags);
+        }
+        pos += frameSize;
+    }
+    return total;
+}
+
+void readId3v1(FileReader& file, Tags& tags) {
+    if (file.getSize() < 128) return;
+    uint8_t tag[128];
+    if (!file.readAt(file.getSize() - 128, tag, sizeof(tag)) || std::memcmp(tag, "TAG", 3) != 0) return;
+    auto field = [&tag](size_t offset, size_t len) {
+        std::string s = latin1ToUtf8(tag + offset, len);
+        trim(s);
+        return s;
+    };
+    if (tags.title.empty()) tags.title = field(3, 30);
+    if (tags.artist.empty()) tags.artist = field(33, 30);
+    if (tags.album.empty()) tags.album = field(63, 30);
+    if (tags.trackNumber == 0 && tag[125] == 0) tags.trackNumber = tag[126];
+}
+
+// ---- Vorbis comments (FLAC and Ogg Vorbis) ------------------------------------
+
+bool equalsIgnoreCase(std::string_view a, std::string_view b) {
+    if (a.size() != b.size()) return false;
+    for (size_t i = 0; i < a.size(); ++i) {
+        if (std::toupper(static_cast<unsigned char>(a[i])) != b[i]) return false;
+    }
+    return true;
+}
+
+void parseVorbisComments(const uint8_t* p, size_t n, Tags& tags) {
+    if (n < 8) return;
+    size_t pos = 4 + readLE32(p);
+    if (pos + 4 > n) return;
+    uint32_t count = readLE32(p + pos);
+    pos += 4;
+    for (uint32_t i = 0; i < count && pos + 4 <= n; ++i) {
+        uint32_t len = readLE32(p + pos);
+        pos += 4;
+        if (len > n - pos) break;
+        std::string_view comment(reinterpret_cast<const char*>(p + pos), len);
+        pos += len;
+        size_t eq = comment.find('=');
+        if (eq == std::string_view::npos) continue;
+        std::string_view key = comment.substr(0, eq);
+        std::string value(comment.substr(eq + 1));
+        if (equalsIgnoreCase(key, "TITLE") && tags.title.empty()) tags.title = value;
+        else if (equalsIgnoreCase(key, "ARTIST") && tags.artist.empty()) tags.artist = value;
+        else if (equalsIgnoreCase(key, "ALBUM") && tags.album.empty()) tags.album = value;
+        else if (equalsIgnoreCase(key, "TRACKNUMBER") && tags.trackNumber == 0) tags.trackNumber = parseTrackNumber(value);
+    }
+}
+
+// ---- Formats ----------------------------------------------------------------
+
+void applyTags(const Tags& tags, TrackInfo& info) {
+    info.setText(tags.title, tags.artist, tags.album);
+    info.trackNumber = tags.trackNumber;
+    if (info.durationMs == 0) info.durationMs = tags.lengthMs;
+}
+
+bool readMp3(FileReader& file, uint64_t audioStart, Tags& tags, TrackInfo& info) {
+    // Skip padding after the tag and look for two consecutive valid frames.
+    std::vector<uint8_t> buf;
+    size_t window = static_cast<size_t>(std::min<uint64_t>(64 * 1024, file.getSize() - std::min(file.getSize(), audioStart)));
+    if (window < 4 || !file.readAt(audioStart, buf, window)) return false;
+
+    Mp3FrameHeader header;
+    size_t frameStart = findMp3FrameSync(buf.data(), buf.size(), header);
+    if (frameStart == buf.size()) return false;
+
+    readId3v1(file, tags);
+    info.sampleRate = header.sampleRate;
+    info.channels = header.channels;
+
+    // A Xing/Info or VBRI header in the first frame gives the exact frame count.
+    const uint8_t* frame = &buf[frameStart];
+    size_t available = buf.size() - frameStart;
+    size_t sideInfo = header.mpeg1 ? (header.channels == 1 ? 17 : 32) : (header.channels == 1 ? 9 : 17);
+    uint32_t frames = 0;
+    if (4 + sideInfo + 12 <= available &&
+        (std::memcmp(frame + 4 + sideInfo, "Xing", 4) == 0 || std::memcmp(frame + 4 + sideInfo, "Info", 4) == 0)) {
+        const uint8_t* xing = frame + 4 + sideInfo;
+        if (readBE32(xing + 4) & 0x1) frames = readBE32(xing + 8);
+    } else if (4 + 32 + 18 <= available && std::memcmp(frame + 36, "VBRI", 4) == 0) {
+        frames = readBE32(frame + 36 + 14);
+    }
+
+    if (frames > 0) {
+        info.durationMs = static_cast<uint32_t>(uint64_t(frames) * header.samplesPerFrame * 1000 / header.sampleRate);
+    } else if (header.bitrate > 0) {
+        uint64_t end = file.getSize();
+        uint8_t tagId[3];
+        if (end >= 128 && file.readAt(end - 128, tagId, 3) && std::memcmp(tagId, "TAG", 3) == 0) end -= 128;
+        uint64_t audioBytes = end - (audioStart + frameStart);
+        info.durationMs = static_cast<uint32_t>(audioBytes * 8000 / header.bitrate);
+    }
+    return true;
+}
+
+bool readFlac(FileReader& file, uint64_t offset, Tags& tags, TrackInfo& info) {
+    uint64_t pos = offset + 4;
+    bool last = false;
+    bool haveStreamInfo = false;
+    while (!last) {
+        uint8_t blockHeader[4];
+        if (!file.readAt(pos, blockHeader, sizeof(blockHeader))) break;
+        last = blockHeader[0] & 0x80;
+        uint8_t type = blockHeader[0] & 0x7F;
+        uint32_t length = readBE24(blockHeader + 1);
+        pos += 4;
+        if (type == 0 && length >= 18) {
+            uint8_t si[18];
+            if (!file.readAt(pos, si, sizeof(si))) return false;
+            info.sampleRate = (uint32_t(si[10]) << 12) | (uint32_t(si[11]) << 4) | (si[12] >> 4);
+            info.channels = static_cast<uint8_t>(((si[12] >> 1) & 0x07) + 1);
+            uint64_t totalSamples = (uint64_t(si[13] & 0x0F) << 32) | readBE32(si + 14);
+            if (info.sampleRate > 0) info.durationMs = static_cast<uint32_t>(totalSamples * 1000 / info.sampleRate);
+            haveStreamInfo = true;
+        } else if (type == 4 && length <= MAX_TAG_BYTES) {
+            std::vector<uint8_t> comments;
+            if (file.readAt(pos, comments, length)) parseVorbisComments(comments.data(), comments.size(), tags);
+        } else if (type == 127) {
+            break;
+        }
+        pos += length;
+    }
+    return haveStreamInfo;
+}
+
+// Reassembles one logical packet of the first Ogg stream starting at the page at `pos`.
+bool readOggPacket(FileReader& file, uint64_t& pos, size_t& segmentIndex, std::vector<uint8_t>& packet, size_t limit) {
+    packet.clear();
+    while (true) {
+        uint8_t page[27];
+        if (!file.readAt(pos, page, sizeof(page)) || std::memcmp(page, "OggS", 4) != 0) return false;
+        uint8_t segments = page[26];
+        uint8_t lacing[255];
+        if (!file.readAt(pos + 27, lacing, segments)) return false;
+        uint64_t data = pos + 27 + segments;
+        for (size_t i = 0; i < segmentIndex; ++i) data += lacing[i];
+        for (; segmentIndex < segments; ++segmentIndex) {
+            uint8_t len = lacing[segmentIndex];
+            if (packet.size() < limit) {
+                size_t keep = std::min<size_t>(len, limit - packet.size());
+                size_t old = packet.size();
+                packet.resize(old + keep);
+                if (keep && !file.readAt(data, packet.data() + old, keep)) return false;
+            }
+            data += len;
+            if (len < 255) {
+                ++segmentIndex;
+                return true;
+            }
+        }
+        pos = data;
+        segmentIndex = 0;
+    }
+}
+
+bool readOgg(FileReader& file, uint64_t offset, Tags& tags, TrackInfo& info) {
+    uint64_t pos = offset;
+    size_t segment = 0;
+    std::vector<uint8_t> packet;
+    if (!readOggPacket(file, pos, segment, packet, 64) || packet.size() < 16 ||
+        std::memcmp(packet.data(), "\x01vorbis", 7) != 0) {
+        return false;
+    }
+    info.channels = packet[11];
+    info.sampleRate = readLE32(&packet[12]);
+    uint8_t serial[4];
+    file.readAt(offset + 14, serial, sizeof(serial));
+
+    if (readOggPacket(file, pos, segment, packet, MAX_COMMENT_BYTES) && packet.size() > 7 &&
+        std::memcmp(packet.data(), "\x03vorbis", 7) == 0) {
+        parseVorbisComments(packet.data() + 7, packet.size() - 7, tags);
+    }
+
+    // Duration is the granule position of the last page of the stream.
+    size_t tailSize = static_cast<size_t>(std::min<uint64_t>(file.getSize(), 64 * 1024));
+    std::vector<uint8_t> tail;
+    if (info.sampleRate > 0 && file.readAt(file.getSize() - tailSize, tail, tailSize)) {
+        for (size_t i = tail.size() >= 27 ? tail.size() - 27 : 0; i-- > 0;) {
+            if (std::memcmp(&tail[i], "OggS", 4) == 0 && std::memcmp(&tail[i + 14], serial, 4) == 0) {
+                uint64_t granule = uint64_t(readLE32(&tail[i + 6])) | (uint64_t(readLE32(&tail[i + 10])) << 32);
+                if (granule != ~uint64_t(0)) info.durationMs = static_cast<uint32_t>(granule * 1000 / info.sampleRate);
+                break;
+            }
+        }
+    }
+    return true;
+}
+
+bool readWav(FileReader& file, Tags& tags, TrackInfo& info) {
+    uint64_t pos = 12;
+    uint32_t byteRate = 0;
+    uint64_t dataSize = 0;
+    uint8_t chunk[8];
+    while (file.readAt(pos, chunk, sizeof(chunk))) {
+        uint32_t size = readLE32(chunk + 4);
+        uint64_t body = pos + 8;
+        if (std::memcmp(chunk, "fmt ", 4) == 0 && size >= 16) {
+            uint8_t fmt[16];
+            if (!file.readAt(body, fmt, sizeof(fmt))) return false;
+            info.channels = static_cast<uint8_t>(readLE16(fmt + 2));
+            info.sampleRate = readLE32(fmt + 4);
+            byteRate = readLE32(fmt + 8);
+        } else if (std::memcmp(chunk, "data", 4) == 0) {
+            dataSize = std::min<uint64_t>(size, file.getSize() - body);
+        } else if (std::memcmp(chunk, "LIST", 4) == 0 && size >= 4 && size <= MAX_TAG_BYTES) {
+            std::vector<uint8_t> list;
+            if (file.readAt(body, list, size) && std::memcmp(list.data(), "INFO", 4) == 0) {
+                size_t p = 4;
+                while (p + 8 <= list.size()) {
+                    uint32_t len = readLE32(&list[p + 4]);
+                    if (len > list.size() - p - 8) break;
+                    std::string value = latin1ToUtf8(&list[p + 8], len);
+                    trim(value);
+                    if (std::memcmp(&list[p], "INAM", 4) == 0) tags.title = value;
+                    else if (std::memcmp(&list[p], "IART", 4) == 0) tags.artist = value;
+                    else if (std::memcmp(&list[p], "IPRD", 4) == 0) tags.album = value;
+                    else if (std::memcmp(&list[p], "ITRK", 4) == 0 || std::memcmp(&list[p], "IPRT", 4) == 0) tags.trackNumber = parseTrackNumber(value);
+                    p += 8 + len + (len & 1);
+                }
+            }
+        }
+        pos = body + size + (size & 1);
+    }
+    if (byteRate > 0) info.durationMs = static_cast<uint32_t>(dataSize * 1000 / byteRate);
+    return info.sampleRate > 0;
+}
+
+} // namespace
+
+void TrackInfo::setText(std::string_view title, std::string_view artist, std::string_view album) {
+    // Offsets are 16 bit, so each field is capped well below that.
+    title = title.substr(0, 1024);
+    artist = artist.substr(0, 1024);
+    album = album.substr(0, 1024);
+    text.clear();
+    text.reserve(title.size() + artist.size() + album.size());
+    text.append(title);
+    artistPos = static_cast<uint16_t>(text.size());
+    text.append(artist);
+    albumPos = static_cast<uint16_t>(text.size());
+    text.append(album);
+}
+
+std::string_view TrackInfo::title() const { return std::string_view(text).substr(0, artistPos); }
+std::string_view TrackInfo::artist() const { return std::string_view(text).substr(artistPos, albumPos - artistPos); }
+std::string_view TrackInfo::album() const { return std::string_view(text).substr(albumPos); }
+
+bool parseMp3FrameHeader(const uint8_t* p, Mp3FrameHeader& header) {
+    static const uint16_t bitrates[2][3][15] = {
+        { // MPEG-1: layer I, II, III
+            {0, 32, 64, 96, 128, 160, 192, 224, 256, 288, 320, 352, 384, 416, 448},
+            {0, 32, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384},
+            {0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320}
+        },
+        { // MPEG-2 and 2.5
+            {0, 32, 48, 56, 64, 80, 96, 112, 128, 144, 160, 176, 192, 224, 256},
+            {0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160},
+            {0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160}
+        }
+    };
+    static const uint32_t sampleRates[3] = {44100, 48000, 32000};
+
+    if (p[0] != 0xFF || (p[1] & 0xE0) != 0xE0) return false;
+    uint8_t version = (p[1] >> 3) & 0x03;   // 0: 2.5, 2: 2, 3: 1
+    uint8_t layer = (p[1] >> 1) & 0x03;     // 1: III, 2: II, 3: I
+    uint8_t bitrateIndex = p[2] >> 4;
+    uint8_t rateIndex = (p[2] >> 2) & 0x03;
+    if (version == 1 || layer == 0 || bitrateIndex == 0 || bitrateIndex == 15 || rateIndex == 3) return false;
+
+    header.mpeg1 = version == 3;
+    int layerIndex = 3 - layer;
+    header.bitrate = bitrates[header.mpeg1 ? 0 : 1][layerIndex][bitrateIndex] * 1000u;
+    header.sampleRate = sampleRates[rateIndex] >> (version == 3 ? 0 : version == 2 ? 1 : 2);
+    header.channels = ((p[3] >> 6) == 3) ? 1 : 2;
+    uint32_t padding = (p[2] >> 1) & 0x01;
+    if (layer == 3) {
+        header.samplesPerFrame = 384;
+        header.frameLength = (12 * header.bitrate / header.sampleRate + padding) * 4;
+    } else {
+        header.samplesPerFrame = (layer == 1 && !header.mpeg1) ? 576 : 1152;
+        header.frameLength = header.samplesPerFrame / 8 * header.bitrate / header.sampleRate + padding;
+    }
+    return header.frameLength >= 4;
+}
+
+size_t findMp3FrameSync(const uint8_t* data, size_t size, Mp3FrameHeader& header) {
+    for (size_t i = 0; i + 4 <= size; ++i) {
+        if (data[i] != 0xFF || !parseMp3FrameHeader(&data[i], header)) continue;
+        Mp3FrameHeader following;
+        size_t next = i + header.frameLength;
+        if (next + 4 > size || parseMp3FrameHeader(&data[next], following)) return i;
+    }
+    return size;
+}
+
+uint64_t getId3v2TagSize(const uint8_t* header) {
+    if (std::memcmp(header, "ID3", 3) != 0) return 0;
+    return 10 + uint64_t(readSyncsafe(header + 6)) + ((header[5] & 0x10) ? 10 : 0);
+}
+
+bool readTrackInfo(const std::string& filepath, TrackInfo& info) {
+    FileReader file(filepath);
+    if (!file.isOpen()) return false;
+
+    Tags tags;
+    uint64_t offset = readId3v2(file, 0, tags);
+    uint8_t magic[12] = {};
+    file.readAt(offset, magic, sizeof(magic));
+
+    bool ok;
+    if (std::memcmp(magic, "fLaC", 4) == 0) ok = readFlac(file, offset, tags, info);
+    else if (std::memcmp(magic, "OggS", 4) == 0) ok = readOgg(file, offset, tags, info);
+    else if (std::memcmp(magic, "RIFF", 4) == 0 && std::memcmp(magic + 8, "WAVE", 4) == 0) ok = readWav(file, tags, info);
+    else ok = readMp3(file, offset, tags, info);
+
+    if (ok) applyTags(tags, info);
+    info.loaded = true;
+    return ok;
+}
+
+// MetadataExtractor implementation
+MetadataExtractor::MetadataExtractor() : pool(WorkerPool::defaultThreadCount(), WorkerPool::Priority::Low) {}
+
+void MetadataExtractor::enqueue(size_t trackId, const std::string& filepath) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        pending[trackId] = filepath;
+    }
+    // Each job extracts whichever pending track is most urgent at the time it runs.
+    pool.submit([this] { extractNext(); });
+}
+
+void MetadataExtractor::setVisibleTracks(std::vector<size_t> trackIds) {
+    std::lock_guard<std::mutex> lock(mutex);
+    visible = std::move(trackIds);
+}
+
+size_t MetadataExtractor::collect(std::vector<std::pair<size_t, TrackInfo>>& results) {
+    std::lock_guard<std::mutex> lock(mutex);
+    results.swap(finished);
+    finished.clear();
+    return results.size();
+}
+
+size_t MetadataExtractor::getPendingCount() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return pending.size();
+}
+
+void MetadataExtractor::extractNext() {
+    size_t trackId;
+    std::string filepath;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (pending.empty()) return;
+        auto it = pending.end();
+        for (size_t id : visible) {
+            it = pending.find(id);
+            if (it != pending.end()) break;
+        }
+        if (it == pending.end()) it = pending.begin();
+        trackId = it->first;
+        filepath = std::move(it->second);
+        pending.erase(it);
+    }
+
+    TrackInfo info;
+    readTrackInfo(filepath, info);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    finished.emplace_back(trackId, std::move(info));
+}
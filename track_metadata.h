@@ -0,0 +1,79 @@
+#ifndef TRACK_METADATA_H
+#define TRACK_METADATA_H
+
+#include "worker_pool.h"
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Per-track record filled from the tag blocks of a file. Title, artist and
+// album share one allocation so a large playlist stays cheap to keep in memory.
+struct TrackInfo {
+    std::string text;
+    uint16_t artistPos = 0;
+    uint16_t albumPos = 0;
+    uint16_t trackNumber = 0;
+    uint8_t channels = 0;
+    bool loaded = false;
+    bool hasLoudness = false;
+    uint32_t durationMs = 0;
+    uint32_t sampleRate = 0;
+    float loudnessLufs = 0.0f;
+    float truePeakDb = 0.0f;
+
+    void setText(std::string_view title, std::string_view artist, std::string_view album);
+    std::string_view title() const;
+    std::string_view artist() const;
+    std::string_view album() const;
+};
+
+struct Mp3FrameHeader {
+    uint32_t bitrate = 0;        // bits per second
+    uint32_t sampleRate = 0;
+    uint32_t frameLength = 0;    // bytes including the header
+    uint32_t samplesPerFrame = 0;
+    uint8_t channels = 0;
+    bool mpeg1 = false;
+};
+
+bool parseMp3FrameHeader(const uint8_t* data, Mp3FrameHeader& header);
+
+// Offset of the first frame header in `data` that is followed by another valid
+// header (or the end of the buffer). Returns `size` if there is none.
+size_t findMp3FrameSync(const uint8_t* data, size_t size, Mp3FrameHeader& header);
+
+// Total size of an ID3v2 tag given its 10 byte header, 0 if it is not one.
+uint64_t getId3v2TagSize(const uint8_t* header);
+
+// Reads only the tag/header blocks of an mp3, flac, ogg or wav file.
+// Returns false if the format is not recognised or the file cannot be read.
+bool readTrackInfo(const std::string& filepath, TrackInfo& info);
+
+// Extracts TrackInfo records on a bounded background pool. Visible tracks are
+// picked first; results are handed back through collect(). Tracks are named
+// by whatever id the caller matches results with.
+class MetadataExtractor {
+public:
+    MetadataExtractor();
+
+    void enqueue(size_t trackId, const std::string& filepath);
+    // Replaces the set picked first; a screenful, so a few dozen at most.
+    void setVisibleTracks(std::vector<size_t> trackIds);
+    size_t collect(std::vector<std::pair<size_t, TrackInfo>>& results);
+    size_t getPendingCount();
+
+private:
+    void extractNext();
+
+    std::mutex mutex;
+    std::map<size_t, std::string> pending;
+    std::vector<std::pair<size_t, TrackInfo>> finished;
+    std::vector<size_t> visible;
+    WorkerPool pool; // declared last so workers are joined before the queues go away
+};
+
+#endif // TRACK_METADATA_H
@@ -0,0 +1,107 @@
+#include "track_table.h"
+#include <algorithm>
+
+// TrackTable implementation
+size_t TrackTable::size() const { return order.size(); }
+bool TrackTable::empty() const { return order.empty(); }
+
+TrackHandle TrackTable::add(const std::string& path, const TrackInfo& info) {
+    auto inserted = byPath.emplace(path, TrackHandle{});
+    if (!inserted.second) return TrackHandle{};
+    uint32_t slot = freeSlot;
+    if (slot == NO_SLOT) {
+        slot = static_cast<uint32_t>(slots.size());
+        slots.emplace_back();
+    } else {
+        freeSlot = slots[slot].position;
+    }
+    Slot& entry = slots[slot];
+    entry.path = &inserted.first->first;
+    entry.info = info;
+    entry.position = static_cast<uint32_t>(order.size());
+    TrackHandle handle{slot, entry.generation};
+    inserted.first->second = handle;
+    order.push_back(handle);
+    return handle;
+}
+
+bool TrackTable::remove(TrackHandle handle) {
+    size_t index = indexOf(handle);
+    if (index == NOT_FOUND) return false;
+    release(handle);
+    order.erase(order.begin() + index);
+    renumber(index, order.size());
+    ++edits;
+    return true;
+}
+
+size_t TrackTable::remove(const std::vector<TrackHandle>& handles) {
+    if (handles.size() == 1) return remove(handles[0]) ? 1 : 0;
+    size_t removed = 0;
+    size_t first = order.size();
+    for (TrackHandle handle : handles) {
+        size_t index = indexOf(handle);
+        if (index == NOT_FOUND) continue;
+        first = std::min(first, index);
+        release(handle);
+        ++removed;
+    }
+    if (removed == 0) return 0;
+    // Released slots no longer match their handles; drop those in one pass.
+    order.erase(std::remove_if(order.begin() + first, order.end(), [this](TrackHandle handle) { return !contains(handle); }),
+                order.end());
+    renumber(first, order.size());
+    ++edits;
+    return removed;
+}
+
+bool TrackTable::move(TrackHandle handle, size_t toIndex) {
+    size_t index = indexOf(handle);
+    if (index == NOT_FOUND) return false;
+    toIndex = std::min(toIndex, order.size() - 1);
+    if (toIndex == index) return true;
+    if (toIndex < index) {
+        std::rotate(order.begin() + toIndex, order.begin() + index, order.begin() + index + 1);
+        renumber(toIndex, index + 1);
+    } else {
+        std::rotate(order.begin() + index, order.begin() + index + 1, order.begin() + toIndex + 1);
+        renumber(index, toIndex + 1);
+    }
+    ++edits;
+    return true;
+}
+
+bool TrackTable::contains(TrackHandle handle) const {
+    return handle.slot < slots.size() && slots[handle.slot].generation == handle.generation && slots[handle.slot].path;
+}
+
+TrackHandle TrackTable::at(size_t index) const { return index < order.size() ? order[index] : TrackHandle{}; }
+
+size_t TrackTable::indexOf(TrackHandle handle) const { return contains(handle) ? slots[handle.slot].position : NOT_FOUND; }
+
+TrackHandle TrackTable::find(const std::string& path) const {
+    auto found = byPath.find(path);
+    return found == byPath.end() ? TrackHandle{} : found->second;
+}
+
+const std::string& TrackTable::getPath(TrackHandle handle) const { return *slots[handle.slot].path; }
+const TrackInfo& TrackTable::getInfo(TrackHandle handle) const { return slots[handle.slot].info; }
+TrackInfo& TrackTable::getInfo(TrackHandle handle) { return slots[handle.slot].info; }
+const std::vector<TrackHandle>& TrackTable::getOrder() const { return order; }
+uint64_t TrackTable::getEditCount() const { return edits; }
+
+void TrackTable::release(TrackHandle handle) {
+    Slot& entry = slots[handle.slot];
+    // By iterator: the key is what entry.path points at.
+    byPath.erase(byPath.find(*entry.path));
+    entry.path = nullptr;
+    entry.info = TrackInfo{};
+    // Generation 0 is the null handle's; skip it when wrapping around.
+    if (++entry.generation == 0) entry.generation = 1;
+    entry.position = freeSlot;
+    freeSlot = handle.slot;
+}
+
+void TrackTable::renumber(size_t first, size_t last) {
+    for (size_t i = first; i < last; ++i) slots[order[i].slot].position = static_cast<uint32_t>(i);
+}
@@ -0,0 +1,85 @@
+#ifndef TRACK_TABLE_H
+#define TRACK_TABLE_H
+
+#include "track_metadata.h"
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Names one playlist entry for as long as it stays in the playlist,
+// whatever is removed or moved around it. Slots are reused after a removal
+// with a new generation, so a handle to a removed track never matches
+// whatever takes its slot. The default handle names nothing.
+struct TrackHandle {
+    uint32_t slot = 0;
+    uint32_t generation = 0;
+
+    bool isNull() const { return generation == 0; }
+    // Slot in the low half, so it fits anywhere a track index used to.
+    uint64_t value() const { return static_cast<uint64_t>(generation) << 32 | slot; }
+    static TrackHandle fromValue(uint64_t value) {
+        return TrackHandle{static_cast<uint32_t>(value), static_cast<uint32_t>(value >> 32)};
+    }
+    bool operator==(const TrackHandle& other) const { return slot == other.slot && generation == other.generation; }
+    bool operator!=(const TrackHandle& other) const { return !(*this == other); }
+};
+
+// The playlist: tracks in play order, each with its metadata, addressed
+// either by position or by handle. Handles resolve through a slot map, so
+// lookups, validity checks and finding a track's position are O(1). Order is
+// a dense array of handles, so a row on screen is still a plain index; a
+// removal or move shifts the handles between the old and new position, and
+// removing many tracks at once compacts the order in a single pass.
+class TrackTable {
+public:
+    static constexpr size_t NOT_FOUND = SIZE_MAX;
+
+    size_t size() const;
+    bool empty() const;
+
+    // Appends a track; returns a null handle if its path is already listed.
+    TrackHandle add(const std::string& path, const TrackInfo& info);
+    // False, or true and the track is gone from the playlist.
+    bool remove(TrackHandle handle);
+    // Returns the number of tracks removed; stale handles are skipped.
+    size_t remove(const std::vector<TrackHandle>& handles);
+    // Moves the track so it ends up at `toIndex` (clamped to the end).
+    bool move(TrackHandle handle, size_t toIndex);
+
+    bool contains(TrackHandle handle) const;
+    TrackHandle at(size_t index) const;
+    // NOT_FOUND for a removed or null handle.
+    size_t indexOf(TrackHandle handle) const;
+    TrackHandle find(const std::string& path) const;
+    // Only for handles the table contains.
+    const std::string& getPath(TrackHandle handle) const;
+    const TrackInfo& getInfo(TrackHandle handle) const;
+    TrackInfo& getInfo(TrackHandle handle);
+    const std::vector<TrackHandle>& getOrder() const;
+
+    // Counts removals and moves, not appends: while it's unchanged, an
+    // earlier copy of the playlist is still a prefix of this one.
+    uint64_t getEditCount() const;
+
+private:
+    static constexpr uint32_t NO_SLOT = UINT32_MAX;
+
+    struct Slot {
+        const std::string* path = nullptr; // key in byPath; null while free
+        TrackInfo info;
+        uint32_t generation = 1;
+        uint32_t position = 0; // in order, or the next free slot while free
+    };
+
+    void release(TrackHandle handle);
+    void renumber(size_t first, size_t last);
+
+    std::vector<Slot> slots;
+    std::vector<TrackHandle> order;
+    std::unordered_map<std::string, TrackHandle> byPath; // duplicate checks without a linear search
+    uint32_t freeSlot = NO_SLOT;
+    uint64_t edits = 0;
+};
+
+#endif // TRACK_TABLE_H
@@ -0,0 +1,256 @@
+#include "waveform.h"
+#include "file_cache.h"
+#include "logger.h"
+#include <SFML/Audio.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+constexpr char WAVEFORM_MAGIC[4] = {'M', 'S', 'X', 'W'};
+constexpr uint32_t WAVEFORM_VERSION = 1;
+constexpr size_t DECODE_CHUNK = 1 << 16;
+
+#if defined(__SSE2__)
+// madd of two int16 squares is at most 2^31, which fits an unsigned 32-bit lane.
+inline __m128i widenSquares(__m128i squares32) {
+    __m128i zero = _mm_setzero_si128();
+    return _mm_add_epi64(_mm_unpacklo_epi32(squares32, zero), _mm_unpackhi_epi32(squares32, zero));
+}
+
+int16_t horizontalMin(__m128i v) {
+    v = _mm_min_epi16(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+    v = _mm_min_epi16(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1)));
+    v = _mm_min_epi16(v, _mm_shufflelo_epi16(v, _MM_SHUFFLE(2, 3, 0, 1)));
+    return static_cast<int16_t>(_mm_cvtsi128_si32(v));
+}
+
+int16_t horizontalMax(__m128i v) {
+    v = _mm_max_epi16(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+    v = _mm_max_epi16(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1)));
+    v = _mm_max_epi16(v, _mm_shufflelo_epi16(v, _MM_SHUFFLE(2, 3, 0, 1)));
+    return static_cast<int16_t>(_mm_cvtsi128_si32(v));
+}
+#endif
+
+} // namespace
+
+void reducePeaks(const int16_t* samples, size_t count, int16_t& min, int16_t& max, uint64_t& sumSquares) {
+    size_t i = 0;
+    int16_t lo = min;
+    int16_t hi = max;
+    uint64_t sum = 0;
+#if defined(__AVX2__)
+    if (count >= 16) {
+        __m256i vmin = _mm256_set1_epi16(lo);
+        __m256i vmax = _mm256_set1_epi16(hi);
+        __m256i vsum = _mm256_setzero_si256();
+        __m256i zero = _mm256_setzero_si256();
+        for (; i + 16 <= count; i += 16) {
+            __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(samples + i));
+            vmin = _mm256_min_epi16(vmin, v);
+            vmax = _mm256_max_epi16(vmax, v);
+            __m256i sq = _mm256_madd_epi16(v, v);
+            vsum = _mm256_add_epi64(vsum, _mm256_add_epi64(_mm256_unpacklo_epi32(sq, zero), _mm256_unpackhi_epi32(sq, zero)));
+        }
+        __m128i min128 = _mm_min_epi16(_mm256_castsi256_si128(vmin), _mm256_extracti128_si256(vmin, 1));
+        __m128i max128 = _mm_max_epi16(_mm256_castsi256_si128(vmax), _mm256_extracti128_si256(vmax, 1));
+        __m128i sum128 = _mm_add_epi64(_mm256_castsi256_si128(vsum), _mm256_extracti128_si256(vsum, 1));
+        lo = horizontalMin(min128);
+        hi = horizontalMax(max128);
+        uint64_t lanes[2];
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), sum128);
+        sum += lanes[0] + lanes[1];
+    }
+#elif defined(__SSE2__)
+    if (count >= 8) {
+        __m128i vmin = _mm_set1_epi16(lo);
+        __m128i vmax = _mm_set1_epi16(hi);
+        __m128i vsum = _mm_setzero_si128();
+        for (; i + 8 <= count; i += 8) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(samples + i));
+            vmin = _mm_min_epi16(vmin, v);
+            vmax = _mm_max_epi16(vmax, v);
+            vsum = _mm_add_epi64(vsum, widenSquares(_mm_madd_epi16(v, v)));
+        }
+        lo = horizontalMin(vmin);
+        hi = horizontalMax(vmax);
+        uint64_t lanes[2];
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), vsum);
+        sum += lanes[0] + lanes[1];
+    }
+#endif
+    for (; i < count; ++i) {
+        int16_t s = samples[i];
+        lo = std::min(lo, s);
+        hi = std::max(hi, s);
+        sum += static_cast<uint64_t>(int32_t(s) * int32_t(s));
+    }
+    min = lo;
+    max = hi;
+    sumSquares += sum;
+}
+
+bool computeWaveform(const std::string& filepath, size_t columnCount, Waveform& waveform) {
+    sf::InputSoundFile file;
+    if (columnCount == 0 || !file.openFromFile(filepath)) return false;
+    unsigned channels = file.getChannelCount();
+    uint64_t totalSamples = file.getSampleCount();
+    if (channels == 0 || totalSamples == 0) return false;
+
+    waveform.columns.assign(columnCount, WaveformColumn{0, 0, 0});
+    std::vector<sf::Int16> buffer(DECODE_CHUNK - DECODE_CHUNK % channels);
+
+    // Column c covers interleaved samples [c * total / columns, (c + 1) * total / columns).
+    size_t column = 0;
+    uint64_t position = 0;
+    uint64_t columnEnd = totalSamples / columnCount;
+    uint64_t columnStart = 0;
+    int16_t lo = INT16_MAX, hi = INT16_MIN;
+    uint64_t sumSquares = 0;
+    auto closeColumn = [&]() {
+        uint64_t n = std::max<uint64_t>(1, columnEnd - columnStart);
+        waveform.columns[column] = {lo <= hi ? lo : int16_t(0), lo <= hi ? hi : int16_t(0),
+                                    static_cast<uint16_t>(std::sqrt(static_cast<double>(sumSquares) / n))};
+        lo = INT16_MAX;
+        hi = INT16_MIN;
+        sumSquares = 0;
+        ++column;
+        columnStart = columnEnd;
+        columnEnd = column + 1 >= columnCount ? totalSamples : totalSamples * (column + 1) / columnCount;
+    };
+
+    while (column < columnCount) {
+        uint64_t read = file.read(buffer.data(), buffer.size());
+        if (read == 0) break;
+        uint64_t offset = 0;
+        while (offset < read && column < columnCount) {
+            uint64_t take = std::min<uint64_t>(read - offset, columnEnd - position);
+            reducePeaks(buffer.data() + offset, static_cast<size_t>(take), lo, hi, sumSquares);
+            offset += take;
+            position += take;
+            if (position >= columnEnd) closeColumn();
+        }
+    }
+    while (column < columnCount) closeColumn();
+    return true;
+}
+
+bool loadWaveform(const std::string& cachePath, const std::string& filepath, size_t columnCount, Waveform& waveform) {
+    FileIdentity expected, stored;
+    if (cachePath.empty() || !getFileIdentity(filepath, expected)) return false;
+    std::ifstream in(cachePath, std::ios::binary);
+    char magic[4];
+    uint32_t version = 0;
+    uint64_t count = 0;
+    in.read(magic, sizeof(magic));
+    in.read(reinterpret_cast<char*>(&version), sizeof(version));
+    in.read(reinterpret_cast<char*>(&stored), sizeof(stored));
+    in.read(reinterpret_cast<char*>(&count), sizeof(count));
+    if (!in || std::memcmp(magic, WAVEFORM_MAGIC, 4) != 0 || version != WAVEFORM_VERSION || stored != expected ||
+        count != columnCount) {
+        return false;
+    }
+    waveform.columns.resize(columnCount);
+    in.read(reinterpret_cast<char*>(waveform.columns.data()), static_cast<std::streamsize>(columnCount * sizeof(WaveformColumn)));
+    return static_cast<bool>(in);
+}
+
+bool saveWaveform(const std::string& cachePath, const std::string& filepath, const Waveform& waveform) {
+    FileIdentity identity;
+    if (cachePath.empty() || !getFileIdentity(filepath, identity)) return false;
+    // The playing track's pool and the batch pool can save the same file at once.
+    std::string tmpPath = getTemporaryPath(cachePath);
+    bool ok;
+    {
+        std::ofstream out(tmpPath, std::ios::binary | std::ios::trunc);
+        uint64_t count = waveform.columns.size();
+        out.write(WAVEFORM_MAGIC, sizeof(WAVEFORM_MAGIC));
+        out.write(reinterpret_cast<const char*>(&WAVEFORM_VERSION), sizeof(WAVEFORM_VERSION));
+        out.write(reinterpret_cast<const char*>(&identity), sizeof(identity));
+        out.write(reinterpret_cast<const char*>(&count), sizeof(count));
+        out.write(reinterpret_cast<const char*>(waveform.columns.data()), static_cast<std::streamsize>(count * sizeof(WaveformColumn)));
+        out.close();
+        ok = static_cast<bool>(out);
+    }
+    if (ok && std::rename(tmpPath.c_str(), cachePath.c_str()) == 0) return true;
+    std::remove(tmpPath.c_str());
+    return false;
+}
+
+// WaveformGenerator implementation
+WaveformGenerator::WaveformGenerator(size_t columnCount)
+    : columnCount(columnCount),
+      currentPool(1, WorkerPool::Priority::Low),
+      batchPool(std::max(1u, std::thread::hardware_concurrency()), WorkerPool::Priority::Idle) {}
+
+std::shared_ptr<const Waveform> WaveformGenerator::get(const std::string& filepath) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (filepath == currentPath) return current;
+    currentPath = filepath;
+    current.reset();
+    currentPool.submit([this, filepath] {
+        {
+            // Skipped past while queued: don't decode ahead of the track now playing.
+            std::lock_guard<std::mutex> lock(mutex);
+            if (currentPath != filepath) return;
+        }
+        auto waveform = std::make_shared<Waveform>();
+        bool computed;
+        if (!loadOrCompute(filepath, *waveform, computed)) return;
+        std::lock_guard<std::mutex> lock(mutex);
+        if (currentPath == filepath) current = std::move(waveform);
+    });
+    return nullptr;
+}
+
+void WaveformGenerator::precompute(const std::vector<std::string>& filepaths) {
+    if (filepaths.empty()) return;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (batchRemaining.load() == 0) {
+            batchSize = 0;
+            batchComputed = 0;
+            batchStart = std::chrono::steady_clock::now();
+        }
+        batchSize += filepaths.size();
+        batchRemaining += filepaths.size();
+    }
+    for (const auto& filepath : filepaths) {
+        batchPool.submit([this, filepath] {
+            Waveform waveform;
+            bool computed = false;
+            loadOrCompute(filepath, waveform, computed);
+            finishBatchItem(computed);
+        });
+    }
+}
+
+bool WaveformGenerator::loadOrCompute(const std::string& filepath, Waveform& waveform, bool& computed) {
+    computed = false;
+    FileIdentity identity;
+    std::string cachePath = getFileIdentity(filepath, identity) ? getCachePath(identity, "waveform", ".wfm") : "";
+    if (loadWaveform(cachePath, filepath, columnCount, waveform)) return true;
+    if (!computeWaveform(filepath, columnCount, waveform)) return false;
+    saveWaveform(cachePath, filepath, waveform);
+    computed = true;
+    return true;
+}
+
+void WaveformGenerator::finishBatchItem(bool computed) {
+    if (computed) ++batchComputed;
+    if (--batchRemaining != 0) return;
+    std::lock_guard<std::mutex> lock(mutex);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - batchStart).count();
+    logInfo("Waveform batch", {{"analyzed", batchComputed.load()}, {"cached", batchSize - batchComputed.load()},
+                               {"tracksPerSecond", batchSize / std::max(seconds, 1e-6)}});
+}
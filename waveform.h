@@ -0,0 +1,60 @@
+#ifndef WAVEFORM_H
+#define WAVEFORM_H
+
+#include "worker_pool.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+struct WaveformColumn {
+    int16_t min;
+    int16_t max;
+    uint16_t rms;
+};
+
+// Peak/RMS overview of a whole track, one column per horizontal pixel of the seek bar.
+struct Waveform {
+    std::vector<WaveformColumn> columns;
+};
+
+// Min/max and sum of squares over interleaved 16-bit samples (SSE2/AVX2 when available).
+void reducePeaks(const int16_t* samples, size_t count, int16_t& min, int16_t& max, uint64_t& sumSquares);
+
+bool computeWaveform(const std::string& filepath, size_t columnCount, Waveform& waveform);
+bool loadWaveform(const std::string& cachePath, const std::string& filepath, size_t columnCount, Waveform& waveform);
+bool saveWaveform(const std::string& cachePath, const std::string& filepath, const Waveform& waveform);
+
+// Produces waveforms off the UI thread. The current track is served from a
+// dedicated worker; whole libraries can be analyzed ahead of time at idle
+// priority, in which case results only go to the on-disk cache.
+class WaveformGenerator {
+public:
+    explicit WaveformGenerator(size_t columnCount);
+
+    // Never blocks. Returns nullptr until the waveform for `filepath` is ready.
+    std::shared_ptr<const Waveform> get(const std::string& filepath);
+    void precompute(const std::vector<std::string>& filepaths);
+
+private:
+    bool loadOrCompute(const std::string& filepath, Waveform& waveform, bool& computed);
+    void finishBatchItem(bool computed);
+
+    size_t columnCount;
+    std::mutex mutex;
+    std::string currentPath;
+    std::shared_ptr<const Waveform> current;
+
+    std::atomic<size_t> batchRemaining{0};
+    std::atomic<size_t> batchComputed{0};
+    size_t batchSize = 0;
+    std::chrono::steady_clock::time_point batchStart;
+
+    WorkerPool currentPool;
+    WorkerPool batchPool;
+};
+
+#endif // WAVEFORM_H
@@ -0,0 +1,92 @@
+#include "worker_pool.h"
+#include <algorithm>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+void applyThreadPriority(WorkerPool::Priority priority) {
+#ifdef __linux__
+    // On Linux nice values are per thread, so this only affects the worker.
+    if (priority == WorkerPool::Priority::Low) {
+        setpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)), 10);
+    } else if (priority == WorkerPool::Priority::Idle) {
+        sched_param param{};
+        param.sched_priority = 0;
+        if (pthread_setschedparam(pthread_self(), SCHED_IDLE, &param) != 0) {
+            setpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)), 19);
+        }
+    }
+#else
+    (void)priority;
+#endif
+}
+
+} // namespace
+
+WorkerPool::WorkerPool(size_t threadCount, Priority priority) : priority(priority) {
+    if (threadCount == 0) threadCount = defaultThreadCount();
+    workers.reserve(threadCount);
+    for (size_t i = 0; i < threadCount; ++i) {
+        workers.emplace_back([this] { workerLoop(); });
+    }
+}
+
+WorkerPool::~WorkerPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+        jobs.clear();
+    }
+    jobAvailable.notify_all();
+    for (auto& worker : workers) worker.join();
+}
+
+void WorkerPool::submit(Job job) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (stopping) return;
+        jobs.push_back(std::move(job));
+    }
+    jobAvailable.notify_one();
+}
+
+void WorkerPool::waitIdle() {
+    std::unique_lock<std::mutex> lock(mutex);
+    idle.wait(lock, [this] { return jobs.empty() && activeJobs == 0; });
+}
+
+size_t WorkerPool::getThreadCount() const { return workers.size(); }
+
+size_t WorkerPool::defaultThreadCount() {
+    // Background work is mostly disk bound, more threads than this only thrash the drive.
+    size_t hw = std::thread::hardware_concurrency();
+    return std::max<size_t>(1, std::min<size_t>(hw == 0 ? 2 : hw, 4));
+}
+
+void WorkerPool::workerLoop() {
+    applyThreadPriority(priority);
+    while (true) {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            jobAvailable.wait(lock, [this] { return stopping || !jobs.empty(); });
+            if (stopping) return;
+            job = std::move(jobs.front());
+            jobs.pop_front();
+            ++activeJobs;
+        }
+        job();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            --activeJobs;
+            if (jobs.empty() && activeJobs == 0) idle.notify_all();
+        }
+    }
+}
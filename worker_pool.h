@@ -0,0 +1,48 @@
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed-size pool of background threads consuming a FIFO of jobs. Jobs still
+// queued when the pool is destroyed are dropped, running ones are joined.
+class WorkerPool {
+public:
+    using Job = std::function<void()>;
+
+    enum class Priority {
+        Normal,
+        Low,    // niced, for background library work
+        Idle    // only runs when nothing else wants the CPU
+    };
+
+    explicit WorkerPool(size_t threadCount = 0, Priority priority = Priority::Normal);
+    ~WorkerPool();
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    void submit(Job job);
+    void waitIdle();
+    size_t getThreadCount() const;
+
+    static size_t defaultThreadCount();
+
+private:
+    void workerLoop();
+
+    std::vector<std::thread> workers;
+    std::deque<Job> jobs;
+    std::mutex mutex;
+    std::condition_variable jobAvailable;
+    std::condition_variable idle;
+    size_t activeJobs = 0;
+    bool stopping = false;
+    Priority priority;
+};
+
+#endif // WORKER_POOL_H